@@ -0,0 +1,152 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-07					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#ifndef __FrANNINDEX_H_INCLUDED
+#define __FrANNINDEX_H_INCLUDED
+
+#include "framepac/array.h"
+#include "framepac/vecsim.h"
+
+namespace Fr {
+
+// forward declarations
+class CFile ;
+
+/************************************************************************/
+/************************************************************************/
+
+enum class ANNIndexType
+   {
+   none,
+   hnsw,			// hierarchical navigable small-world graph (dense vectors)
+   simhash,			// random-hyperplane LSH (sparse vectors, real-valued measures)
+   minhash			// min-wise hashing LSH (sparse vectors, binary measures)
+   } ;
+
+struct ANNResult
+   {
+      size_t id ;		// position of the vector within the index
+      double sim ;		// exact similarity to the query under the index's measure
+   } ;
+
+//----------------------------------------------------------------------------
+
+class ANNIndexHeader
+   {
+   public:
+      uint64_t    m_type ;		// ANNIndexType
+      uint64_t    m_size ;		// number of indexed vectors
+      uint64_t    m_params[4] ;		// type-specific parameters
+      uint64_t    m_pad[2] { 0 } ;	// padding for future extensions
+   } ;
+
+//----------------------------------------------------------------------------
+// an approximate nearest-neighbor index over a collection of vectors; the index stores only pointers
+//   to the vectors, which remain owned by the caller and must outlive the index.  Insertions must be
+//   made by a single thread at a time, while any number of threads may query the index concurrently
+//   provided that no insertion is in progress.
+
+template <typename IdxT, typename ValT>
+class ANNIndex
+   {
+   public:
+      typedef Vector<IdxT,ValT> vec_type ;
+
+   public:
+      static ANNIndex* create(ANNIndexType type, VectorMeasure<IdxT,ValT>* measure) ;
+      // select the type of index best suited to the vectors and similarity measure
+      static ANNIndex* create(VectorMeasure<IdxT,ValT>* measure, VectorSimilarityMeasure simtype, bool sparse) ;
+      // restore an index written by save(); 'vectors' must contain the same vectors in the same order
+      //   as when the index was saved
+      static ANNIndex* load(CFile& fp, const char* filename, const Array* vectors,
+	 VectorMeasure<IdxT,ValT>* measure) ;
+      static ANNIndex* load(const char* filename, const Array* vectors, VectorMeasure<IdxT,ValT>* measure) ;
+      virtual ~ANNIndex() = default ;
+      void free() { delete this ; }
+
+      virtual ANNIndexType indexType() const = 0 ;
+      virtual const char* indexName() const = 0 ;
+      size_t size() const { return m_size ; }
+      const vec_type* vector(size_t id) const { return m_vectors[id] ; }
+      VectorMeasure<IdxT,ValT>* measure() const { return m_measure ; }
+
+      // adjust the speed/accuracy tradeoff for queries; 0 restores the default
+      void searchEffort(size_t effort) { m_effort = effort ; }
+      size_t searchEffort() const { return m_effort ; }
+
+      // add all of the vectors in the array, skipping null entries (which are not assigned a position);
+      //   returns false if any element is not a vector
+      bool build(const Array* vectors) ;
+      // add one vector, returning its position within the index
+      size_t insert(const vec_type* vector) ;
+
+      // find (approximately) the k most similar indexed vectors, sorted by decreasing similarity;
+      //   returns the number of results, which may be fewer than k
+      size_t query(const vec_type* vector, size_t k, ANNResult* results) const ;
+      // find (approximately) the most similar indexed vector, or nullptr if no candidate was found
+      const vec_type* nearest(const vec_type* vector, double* sim = nullptr) const ;
+
+      bool save(CFile& fp) const ;
+      bool save(const char* filename) const ;
+
+   protected:
+      ANNIndex(VectorMeasure<IdxT,ValT>* measure) : m_measure(measure) {}
+
+      double similarity(const vec_type* v1, const vec_type* v2) const { return m_measure->similarity(v1,v2) ; }
+      double similarity(const vec_type* v, size_t id) const { return m_measure->similarity(v,m_vectors[id]) ; }
+      double similarity(size_t id1, size_t id2) const
+	 { return m_measure->similarity(m_vectors[id1],m_vectors[id2]) ; }
+
+      bool reserve(size_t capacity) ;
+
+      // the per-type portion of the index
+      virtual bool grow(size_t old_capacity, size_t new_capacity) = 0 ;
+      virtual void prepare(size_t /*expected_size*/) {}
+      virtual void link(size_t id) = 0 ;
+      virtual size_t search(const vec_type* vector, size_t k, size_t effort, ANNResult* results) const = 0 ;
+      virtual void getParameters(uint64_t* params) const = 0 ;
+      virtual bool setParameters(const uint64_t* params) = 0 ;
+      virtual bool saveStructure(CFile& fp) const = 0 ;
+      virtual bool loadStructure(CFile& fp) = 0 ;
+
+   protected:
+      VectorMeasure<IdxT,ValT>* m_measure ;
+      NewPtr<const vec_type*>   m_vectors ;
+      size_t                    m_size { 0 } ;
+      size_t                    m_capacity { 0 } ;
+      size_t                    m_effort { 0 } ;
+
+      // magic values for serializing
+      static constexpr auto signature = "\x7F" "ANNIndex" ;
+      static constexpr unsigned file_format = 1 ;
+      static constexpr unsigned min_file_format = 1 ;
+   } ;
+
+// predefined instantiations for the standard vector types are provided in separate modules in the library
+extern template class ANNIndex<uint32_t, uint32_t> ;
+extern template class ANNIndex<uint32_t, float> ;
+extern template class ANNIndex<uint32_t, double> ;
+
+} // end of namespace Fr
+
+#endif /* !__FrANNINDEX_H_INCLUDED */
+
+// end of file annindex.h //
@@ -887,46 +887,150 @@ typedef Atomic<size_t> atom_size_t ;
 namespace Fr
 {
 
-class HazardPointer
-   {
-   public:
-      HazardPointer() : m_pointer(nullptr) {}
-      HazardPointer(const HazardPointer &) = delete ;
-      ~HazardPointer() = default ;
-      void operator= (const HazardPointer&) = delete ;
-
-      void *pointer() const { return  m_pointer ; }
-
-      void setHazard(void *hp) { m_pointer = hp ; }
-      void clearHazard() { m_pointer = nullptr ; }
-   private:
-      void *m_pointer ;
-
-   } ;
+// Hazard pointers (M. Michael, "Hazard Pointers: Safe Memory Reclamation for Lock-Free Objects",
+//   2004).  Before dereferencing a shared object, a thread publishes a pointer to it in its own
+//   HazardPointerList; an object which has been unlinked from its data structure is "retired" and
+//   only reclaimed once no thread's list contains it.  The lists are allocated on a thread's first
+//   use and recycled (but never freed) when the thread exits, so scanning them is always safe.
 
-//----------------------------------------------------------------------------
+class HazardRetired ;
 
 class HazardPointerList
    {
    public:
-      HazardPointerList() {}
+      typedef void reclaim_fn(void* object) ;
+      static constexpr size_t NUM_POINTERS = 7 ;
+      // a thread's retired objects are scanned once there are this many per registered thread
+      static constexpr size_t RETIRE_FACTOR = 2 * NUM_POINTERS ;
+
+   public:
+      HazardPointerList() { for (auto& ptr : m_pointers) ptr.store_relax(nullptr) ; }
       HazardPointerList(const HazardPointerList&) = delete ;
       ~HazardPointerList() {}
 
       HazardPointerList& operator= (const HazardPointerList&) = delete ;
 
+      // returns false if all of the list's slots are in use
       bool registerPointer(void *) ;
-      bool unregisterPointer(void *) ;
+      bool unregisterPointer(void* object)
+	 {
+	    for (auto& ptr : m_pointers)
+	       {
+	       if (ptr.load_relax() == object)
+		  {
+		  ptr.store(nullptr) ;
+		  return true ;
+		  }
+	       }
+	    return false ;
+	 }
 
       bool hasHazard(void *object) const ;
 
+      // the calling thread's list
+      static HazardPointerList* threadList()
+	 { HazardPointerList* list = s_thread_list ; return list ? list : acquire() ; }
+      // publish a hazard pointer to the object currently stored in 'src'; the pointer is re-read
+      //   after publishing and the process repeated until it is unchanged, since an object which was
+      //   unlinked before our hazard pointer became visible may already have been reclaimed
+      template <typename T>
+      static T* protect(const Atomic<T*>& src, Atomic<void*>*& slot)
+	 {
+	    HazardPointerList* list = threadList() ;
+	    T* ptr = src.load() ;
+	    slot = nullptr ;
+	    while (ptr)
+	       {
+	       slot = list->publish(ptr) ;
+	       T* current = src.load() ;
+	       if (current == ptr)
+		  break ;
+	       slot->store(nullptr) ;
+	       slot = nullptr ;
+	       ptr = current ;
+	       }
+	    return ptr ;
+	 }
+      template <typename T>
+      static T* protect(const Atomic<T*>& src) { Atomic<void*>* slot ; return protect(src,slot) ; }
+      static void release(void* object) { if (object) threadList()->unregisterPointer(object) ; }
+      // release the hazard pointer in a slot returned by protect(), avoiding the search for it
+      static void releaseSlot(Atomic<void*>* slot) { if (slot) slot->store(nullptr) ; }
+      // does any thread hold a hazard pointer to the object?
+      static bool isHazardous(const void* object) ;
+      // hand an unlinked object to the calling thread's retirement list; 'fn' is invoked on the
+      //   object once no thread holds a hazard pointer to it
+      static void retire(void* object, reclaim_fn* fn) ;
+      // reclaim as many of the calling thread's retired objects as possible, returning the number
+      //   which are still hazardous
+      static size_t reclaimRetired() ;
+      static size_t pendingRetirements() { return threadList()->m_numretired ; }
+      static size_t registeredThreads() { return s_numlists.load() ; }
+      // release the calling thread's list for reuse; invoked by Fr::ThreadCleanup()
+      static void threadCleanup() ;
+
    protected: // data
-      HazardPointerList *m_next { nullptr } ;
-      void *m_pointers[7] { nullptr } ;
+      HazardPointerList* m_next { nullptr } ;
+      Atomic<void*>      m_pointers[NUM_POINTERS] ;
+      HazardRetired*     m_retired { nullptr } ;
+      size_t             m_numretired { 0 } ;
+      Atomic<bool>       m_active { false } ;
+
+      static Atomic<HazardPointerList*> s_lists ;
+      static Atomic<size_t>             s_numlists ;
+      static thread_local HazardPointerList* s_thread_list ;
+      static bool                       s_asymmetric_fences ;
 
    protected: // methods
+      Atomic<void*>* publish(void* object)
+	 {
+	    // hazard pointers are rarely nested, so the first slot is almost always free
+	    Atomic<void*>* slot = &m_pointers[0] ;
+	    if (slot->load_relax() != nullptr)
+	       slot = freeSlot() ;
+	    // the store must be visible to other threads before we re-read the pointer being
+	    //   protected.  If the reclaiming side can force a barrier on every running thread
+	    //   (see heavyFence()), a compiler barrier suffices here; otherwise we need a full fence.
+	    slot->store_relax(object) ;
+	    if (s_asymmetric_fences)
+	       std::atomic_signal_fence(std::memory_order_seq_cst) ;
+	    else
+	       std::atomic_thread_fence(std::memory_order_seq_cst) ;
+	    return slot ;
+	 }
+      [[gnu::cold]] Atomic<void*>* freeSlot() ;
+      // the reclaiming side of publish()'s fence, which orders the unlinking of an object before the
+      //   scan of the hazard pointers in every thread
+      static void heavyFence() ;
+      static bool enableAsymmetricFences() ;
+      static HazardPointerList* acquire() ;
    } ;
 
+//----------------------------------------------------------------------------
+
+// RAII guard holding a hazard pointer for the lifetime of a scope
+
+template <typename T>
+class HazardPointer
+   {
+   public:
+      HazardPointer() : m_pointer(nullptr), m_slot(nullptr) {}
+      explicit HazardPointer(const Atomic<T*>& src) : m_pointer(HazardPointerList::protect(src,m_slot)) {}
+      HazardPointer(const HazardPointer &) = delete ;
+      ~HazardPointer() { clearHazard() ; }
+      void operator= (const HazardPointer&) = delete ;
+
+      T* pointer() const { return  m_pointer ; }
+      T* operator-> () const { return m_pointer ; }
+
+      T* setHazard(const Atomic<T*>& src)
+	 { clearHazard() ; m_pointer = HazardPointerList::protect(src,m_slot) ; return m_pointer ; }
+      void clearHazard()
+	 { HazardPointerList::releaseSlot(m_slot) ; m_pointer = nullptr ; m_slot = nullptr ; }
+   private:
+      T*             m_pointer ;
+      Atomic<void*>* m_slot ;
+   } ;
 
 } // end namespace Fr
 
@@ -0,0 +1,117 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.15, last edit 2019-08-28					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#ifndef _Fr_BINARYVEC_H_INCLUDED
+#define _Fr_BINARYVEC_H_INCLUDED
+
+#include <cstdlib>
+#include "framepac/array.h"
+#include "framepac/vector.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Declarations for template class BinaryVectors			*/
+/************************************************************************/
+
+// A bit-packed copy of a set of vectors for the measures which only care whether each element is
+//   nonzero (the binary_* VectorSimilarityMeasures).  Every vector becomes a row of dimensions() bits,
+//   padded to a multiple of 64 bytes, along with the number of bits set in the row, so that the full
+//   2x2 contingency table of two rows follows from a single AND and popcount over the row words:
+//   both = |x AND y|, x_only = |x| - both, y_only = |y| - both, and neither = dims - |x OR y|.
+//   Unlike the merge of sparse index lists in VectorMeasure::contingencyTable(), 'neither' thus
+//   counts every dimension which is zero in both vectors rather than just explicitly-stored zeros;
+//   the two agree for dense vectors with dimensions() elements.
+//
+// The rows take dims/8 bytes regardless of how many elements are nonzero, so this representation
+//   pays off for dense vectors or sparse vectors over vocabularies of up to several thousand terms,
+//   not for a handful of terms out of millions.  As with VectorCollection, the source Array must
+//   outlive the bit-packed copy.
+
+template <typename IdxT, typename ValT>
+class BinaryVectors
+   {
+   public:
+      typedef Vector<IdxT,ValT> vec_type ;
+      static constexpr size_t ROW_ALIGN = 64 ;
+
+   public:
+      BinaryVectors() {}
+      BinaryVectors(const Array* vectors, size_t dims = 0) { load(vectors,dims) ; }
+      BinaryVectors(const BinaryVectors&) = delete ;
+      ~BinaryVectors() { clear() ; }
+      BinaryVectors& operator= (const BinaryVectors&) = delete ;
+
+      // pack the given vectors into rows of 'dims' bits (default: one more than the highest index
+      //   used by any vector); elements at or beyond 'dims' are ignored, and entries of the array
+      //   which are not vectors become absent rows
+      bool load(const Array* vectors, size_t dims = 0) ;
+      void clear() ;
+
+      size_t size() const { return m_size ; }
+      size_t dimensions() const { return m_dims ; }
+      size_t rowWords() const { return m_stride ; }
+      const Array* source() const { return m_source ; }
+      const vec_type* vector(size_t N) const
+	 { return m_source ? static_cast<const vec_type*>(m_source->getNth(N)) : nullptr ; }
+      bool present(size_t N) const { return m_counts[N] != ABSENT ; }
+      const uint64_t* row(size_t N) const { return m_bits + N * m_stride ; }
+      // number of nonzero elements of the Nth vector within the first dimensions() elements
+      size_t bitsSet(size_t N) const { return m_counts[N] ; }
+      size_t memoryUsage() const { return m_size * (m_stride * sizeof(uint64_t) + sizeof(size_t)) ; }
+
+      // set bit i of 'bits' (which must hold (dims+63)/64 zeroed words) for each nonzero element i < dims
+      //   of the vector, and return the number of bits set
+      static size_t encode(const vec_type* vector, uint64_t* bits, size_t dims) ;
+
+      explicit operator bool () const { return m_bits != nullptr ; }
+
+   protected:
+      static constexpr size_t ABSENT = ~(size_t)0 ;
+
+   protected:
+      const Array* m_source { nullptr } ;
+      uint64_t*    m_bits { nullptr } ;
+      size_t*      m_counts { nullptr } ;	// bits set in each row, or ABSENT for non-vectors
+      size_t       m_size { 0 } ;
+      size_t       m_dims { 0 } ;
+      size_t       m_stride { 0 } ;		// 64-bit words per row including padding
+   } ;
+
+// keep linker happy on debug builds:
+template <typename IdxT, typename ValT>
+constexpr size_t BinaryVectors<IdxT,ValT>::ROW_ALIGN ;
+template <typename IdxT, typename ValT>
+constexpr size_t BinaryVectors<IdxT,ValT>::ABSENT ;
+
+/************************************************************************/
+/************************************************************************/
+
+extern template class BinaryVectors<uint32_t,uint32_t> ;
+extern template class BinaryVectors<uint32_t,float> ;
+extern template class BinaryVectors<uint32_t,double> ;
+
+} // end namespace Fr
+
+#endif /* !_Fr_BINARYVEC_H_INCLUDED */
+
+// end of file binaryvec.h //
@@ -1,10 +1,10 @@
 /****************************** -*- C++ -*- *****************************/
 /*									*/
 /* FramepaC-ng								*/
-/* Version 0.01, last edit 2017-03-28					*/
+/* Version 0.14, last edit 2019-07-07					*/
 /*	by Ralf Brown <ralf@cs.cmu.edu>					*/
 /*									*/
-/* (c) Copyright 2016,2017 Carnegie Mellon University			*/
+/* (c) Copyright 2016,2017,2019 Carnegie Mellon University		*/
 /*	This program may be redistributed and/or modified under the	*/
 /*	terms of the GNU General Public License, version 3, or an	*/
 /*	alternative license agreement as detailed in the accompanying	*/
@@ -22,8 +22,11 @@
 #ifndef _Fr_BWT_H_INCLUDED
 #define _Fr_BWT_H_INCLUDED
 
+#include "framepac/byteorder.h"
 #include "framepac/config.h"
-
+#include "framepac/file.h"
+#include "framepac/mmapfile.h"
+#include "framepac/sufarray.h"
 
 /*  Compressed BWT
      use 64-entry chunks
@@ -36,16 +39,122 @@
        while the highest set bit has no such simple expression
      extracting pointer and adjustment:
        idx %= 64   // index within chunk
-       unwanted = (1<<(64-idx))-1 ;
+       unwanted = (1<<(63-idx))-1 ;
        wanted = flags & ~unwanted ;   // mask off flag bits past idx'th position
        pointernum = popcnt(wanted) ;  // get index into pointer array
        ptrflag = wanted & -wanted ;   // isolate the lowest set bit
        add = (ptrflag-1) & ~(wanted|unwanted) ;  // bits between lowest set bit and idx
        offset = popcnt(add) ;         // how many such bits
 
-       addr = ptrs[first+ptrnum]+offset ;
+       addr = ptrs[first+ptrnum-1]+offset ;
+
+     The pointers are the successor function Psi of the suffix array (the
+       position in the array of the suffix one token further into the text),
+       which increases within the range of suffixes starting with any given
+       token and so mostly consists of runs of consecutive values.  The
+       first entry of each chunk is always explicit, and the chunk's index
+       into the pointer array is stored with the same type as the pointers
+       so that corpora of more than 2**32 tokens can be indexed.
 */
 
+namespace Fr {
+
+//----------------------------------------------------------------------------
+// A compressed suffix array / FM-index over a token corpus, built from a SuffixArray.  It supports
+//   counting and locating phrases and extracting text without needing the original token array or
+//   the full suffix array.  Line-number records are stored as newlines, since the suffix array sorts
+//   them as such.
+
+template <typename IdT, typename IdxT>
+class BWTIndex
+   {
+   public:
+      static constexpr IdT ErrorID { IdT(~0) } ;
+      static constexpr unsigned default_sample_rate = 32 ;
+   public:
+      BWTIndex() {}
+      BWTIndex(const BWTIndex&) = delete ;
+      BWTIndex(const SuffixArray<IdT,IdxT>& index, unsigned sample_rate = default_sample_rate)
+	 { build(index,sample_rate) ; }
+      ~BWTIndex() { clear() ; }
+      BWTIndex& operator= (const BWTIndex&) = delete ;
+
+      // every sample_rate'th text position is stored explicitly, trading memory for the speed of
+      //   locate() and extract()
+      bool build(const SuffixArray<IdT,IdxT>& index, unsigned sample_rate = default_sample_rate) ;
+      void clear() ;
+
+      bool load(const char* filename, bool allow_mmap = true) ;
+      // load from open file starting at current file position
+      bool load(CFile&, const char* filename, bool allow_mmap = true) ;
+      bool loadMapped(const char* filename, off_t base_offset = 0) ;
+      // load starting from specified position in mmap'ed file
+      bool loadFromMmap(const char* mmap_base, size_t mmap_len) ;
+      bool save(CFile&) const ;
+
+      IdxT indexSize() const { return m_numids ; }
+      IdT vocabSize() const { return m_types ; }
+      unsigned sampleRate() const { return m_sample_rate ; }
+      size_t numPointers() const { return m_numpointers ; }
+      // number of bytes used by the index data
+      size_t memoryUsage() const ;
+
+      // the position in the suffix array of the suffix which starts one token further into the text
+      IdxT psi(IdxT N) const ;
+      // the token beginning the suffix at position N of the suffix array
+      IdT idAt(IdxT N) const ;
+      // the text position of the suffix at position N of the suffix array
+      IdxT locate(IdxT N) const ;
+      // the position in the suffix array of the suffix beginning at the given text position
+      IdxT inverse(IdxT textpos) const ;
+
+      // determine the range of suffix-array positions whose suffixes start with the key
+      bool lookup(const IdT* key, unsigned keylen, IdxT& first_match, IdxT& last_match) const ;
+      IdxT count(const IdT* key, unsigned keylen) const ;
+      // copy up to 'len' tokens starting at text position 'textpos', returning the number copied
+      IdxT extract(IdxT textpos, IdxT len, IdT* buffer) const ;
+
+      operator bool () const { return m_flags != nullptr ; }
+
+   protected:
+      IdT mapID(IdT id) const { return (id >= m_types) ? m_newline : id ; }
+      bool isSampled(IdxT N, size_t& rank) const ;
+      size_t numChunks() const { return ((size_t)m_numids + 63) / 64 ; }
+      size_t numInverse() const { return m_numids ? ((size_t)m_numids - 1) / m_sample_rate + 1 : 0 ; }
+      void releaseArrays() ;
+
+   protected:
+      MemMappedFile m_mmap ;
+      IdxT*	 m_buckets { nullptr } ;	// first suffix-array position of each token, plus end
+      uint64_t*	 m_flags { nullptr } ;		// which entries of each chunk have explicit pointers
+      IdxT*	 m_first { nullptr } ;		// index of each chunk's first pointer
+      IdxT*	 m_pointers { nullptr } ;	// the explicit values of Psi
+      uint64_t*	 m_sampled { nullptr } ;	// which suffix-array positions have stored text positions
+      IdxT*	 m_sampled_rank { nullptr } ;	// number of sampled positions before each chunk
+      IdxT*	 m_samples { nullptr } ;	// text positions of sampled suffixes
+      IdxT*	 m_inverse { nullptr } ;	// suffix-array position of every sample_rate'th text position
+      size_t	 m_numpointers { 0 } ;
+      size_t	 m_numsamples { 0 } ;
+      IdxT	 m_numids { 0 } ;
+      IdxT	 m_last_suffix { 0 } ;		// suffix-array position of the final token
+      IdT	 m_types { 0 } ;
+      IdT	 m_newline { IdT(-1) } ;
+      unsigned	 m_sample_rate { default_sample_rate } ;
+      bool	 m_readonly { false } ;
+
+      // magic values for serializing
+      static constexpr auto signature = "\x7F""BWTIndex" ;
+      static constexpr unsigned file_format = 1 ;
+      static constexpr unsigned min_file_format = 1 ;
+   } ;
+
+//----------------------------------------------------------------------------
+
+extern template class BWTIndex<uint32_t,uint32_t> ;
+extern template class BWTIndex<uint32_t,UInt40> ;
+
+// end of namespace Fr
+} ;
 
 #endif /* !_Fr_BWT_H_INCLUDED */
 
@@ -23,6 +23,7 @@
 #define __FrCLUSTER_H_INCLUDED
 
 #include <csignal>
+#include <vector>
 #include "framepac/array.h"
 #include "framepac/list.h"
 #include "framepac/symbol.h"
@@ -34,6 +35,7 @@ namespace Fr {
 
 class ProgressIndicator ;
 class SignalHandler ;
+template <typename IdxT, typename ValT> class ANNIndex ;
 
 //----------------------------------------------------------------------------
 
@@ -71,6 +73,29 @@ enum class ClusterRep
    rms
    } ;
 
+//----------------------------------------------------------------------------
+// triangle-inequality bounds used by k-means to skip similarity computations (metric measures only)
+
+enum class KMeansBounds
+   {
+   none,
+   hamerly,			// one upper and one lower bound per vector
+   elkan			// one upper bound per vector and one lower bound per vector and center
+   } ;
+
+//----------------------------------------------------------------------------
+// how Brown/Agglomerative clustering computes the similarity of a newly-merged cluster to the others
+
+enum class ClusterLinkage
+   {
+   none,			// compare cluster representatives directly (original behavior)
+   single,
+   complete,
+   average,
+   ward,
+   centroid
+   } ;
+
 //----------------------------------------------------------------------------
 
 class ClusterInfo : public Object
@@ -259,6 +284,52 @@ class ClusterInfo : public Object
       static const char s_typename[] ;
    } ;
 
+//----------------------------------------------------------------------------
+// the complete merge history of an agglomerative clustering.  Nodes are numbered as in SciPy: the
+//   leaves (input vectors) are 0..N-1, and the i-th merge creates node N+i, so that the clusters for
+//   any number of merges or any similarity threshold can be extracted without re-clustering.
+
+class Dendrogram
+   {
+   public:
+      class Merge
+         {
+	 public:
+	    size_t m_left ;
+	    size_t m_right ;
+	    size_t m_size ;		// number of leaves under the new node
+	    double m_similarity ;
+	 } ;
+   public:
+      Dendrogram(size_t num_leaves) : m_leaves(num_leaves) { m_merges.reserve(num_leaves) ; }
+      Dendrogram(const Dendrogram&) = delete ;
+      ~Dendrogram() = default ;
+      Dendrogram& operator= (const Dendrogram&) = delete ;
+
+      size_t numLeaves() const { return m_leaves ; }
+      size_t numMerges() const { return m_merges.size() ; }
+      const Merge& merge(size_t N) const { return m_merges[N] ; }
+
+      // record a merge of the clusters currently containing leaves 'a' and 'b'; once all merges have
+      //   been added, finish() converts them to node numbers, first sorting them by decreasing
+      //   similarity if requested (as for merges found out of order by the nearest-neighbor chain)
+      void addMerge(size_t a, size_t b, double similarity) ;
+      void finish(bool sort) ;
+
+      // number of leading merges with a similarity of at least 'threshold'
+      size_t mergesAbove(double threshold) const ;
+      // assign each leaf the number of its flat cluster after the first 'num_merges' merges, returning
+      //   the number of clusters
+      size_t cut(size_t num_merges, std::vector<size_t>& assignments) const ;
+      // build a cluster hierarchy from the first 'num_merges' merges; each top-level subcluster of the
+      //   result is a binary tree of the merges which formed it
+      ClusterInfo* clusters(const Array* vectors, size_t num_merges) const ;
+
+   protected:
+      std::vector<Merge> m_merges ;
+      size_t             m_leaves ;
+   } ;
+
 //----------------------------------------------------------------------------
 
 class ClusteringAlgoBase
@@ -267,7 +338,7 @@ class ClusteringAlgoBase
       typedef ProgressIndicator* makePIFunc(size_t) ;
    public:
       ClusteringAlgoBase() {}
-      virtual ~ClusteringAlgoBase() { delete[] m_logprefix ; }
+      virtual ~ClusteringAlgoBase() { delete[] m_logprefix ; delete[] m_knn_file ; }
 
       bool parseOptions(const char* opt, bool validate_only = false) ;
       virtual bool validateOption(const char* optname, const char* optvalue, char optflag) const ;
@@ -284,7 +355,16 @@ class ClusteringAlgoBase
 
       void setLoggingPrefix(const char* pre) ;
       void clusterThreshold(double thr) { m_threshold = thr ; }
+      void extractionThreshold(double thr) { m_extract_threshold = thr ; }
       void desiredClusters(size_t N) { m_desired_clusters = N ; }
+      void minPoints(size_t N) { m_min_points = N ; }
+      void numNeighbors(size_t N) { m_num_neighbors = N ; }
+      void knnFile(const char* filename) ;
+      void annCenters(size_t N) { m_ann_centers = N ; }
+      void kmeansBounds(KMeansBounds b) { m_kmeans_bounds = b ; }
+      void linkage(ClusterLinkage l) { m_linkage = l ; }
+      void maxMatrixSize(size_t mb) { m_max_matrix = mb ; }
+      void miniBatchSize(size_t N) { m_minibatch = N ; }
       void maxIterations(size_t N) { m_max_iterations = N ; }
       void verbosity(int v) { m_verbosity = v ; }
       void fastInitialization(bool fast) { m_fast_init = fast ; }
@@ -300,7 +380,16 @@ class ClusteringAlgoBase
 
       const char* loggingPrefix() const { return m_logprefix ; }
       double clusterThreshold() const { return m_threshold ; }
+      double extractionThreshold() const { return m_extract_threshold ; }
       size_t desiredClusters() const { return m_desired_clusters ; }
+      size_t minPoints() const { return m_min_points ; }
+      size_t numNeighbors() const { return m_num_neighbors ; }
+      const char* knnFile() const { return m_knn_file ; }
+      size_t annCenters() const { return m_ann_centers ; }
+      KMeansBounds kmeansBounds() const { return m_kmeans_bounds ; }
+      ClusterLinkage linkage() const { return m_linkage ; }
+      size_t maxMatrixSize() const { return m_max_matrix ; }
+      size_t miniBatchSize() const { return m_minibatch ; }
       size_t maxIterations() const { return m_max_iterations ; }
       int verbosity() const { return m_verbosity ; }
       bool usingSparseVectors() const { return m_use_sparse_vectors ; }
@@ -316,14 +405,20 @@ class ClusteringAlgoBase
 
    protected: // data members
       char*       m_logprefix { nullptr } ;
+      char*       m_knn_file { nullptr } ;	// where to cache the k-nearest-neighbor graph
       makePIFunc* m_makepi { nullptr } ;
       double      m_alpha { 0 } ;
       double      m_beta { 0 } ;
       double      m_gamma { 0 } ;
       double	  m_threshold { 0.2 } ;
+      double      m_extract_threshold { -HUGE_VAL } ; // OPTICS: threshold at which to extract flat clusters
       double      m_backoff { 0.05 } ;
       size_t      m_desired_clusters { 2 } ;
       size_t      m_min_points { 0 } ;
+      size_t      m_num_neighbors { 0 } ;	// 'k' for algorithms using the k nearest neighbors
+      size_t      m_ann_centers { 0 } ;	// use an ANN index to find the nearest of at least this many centers
+      size_t      m_minibatch { 0 } ;		// k-means: number of vectors per mini-batch, 0 to sweep all vectors
+      size_t      m_max_matrix { 4096 } ;	// agglomerative: largest similarity matrix to build, in megabytes
       size_t      m_max_iterations { 5 } ;
       int	  m_verbosity { 0 } ;
       bool	  m_use_sparse_vectors { false } ;
@@ -332,6 +427,8 @@ class ClusteringAlgoBase
       bool        m_ignore_extra { false } ;
       bool        m_allow_singletons { true } ;
       ClusterRep  m_representative { ClusterRep::centroid } ;
+      KMeansBounds m_kmeans_bounds { KMeansBounds::none } ;
+      ClusterLinkage m_linkage { ClusterLinkage::none } ;
       VectorSimilarityMeasure m_similarity { VectorSimilarityMeasure::cosine } ;
 
    protected: // static data members
@@ -364,6 +461,11 @@ class ClusteringAlgo : public ClusteringAlgoBase
 
       static Vector<IdxT,ValT>* nearestNeighbor(const Vector<IdxT,ValT>* vector, const Array* centers,
 	 VectorMeasure<IdxT,ValT>* measure, double threshold = -1.0) ;
+
+      // read the vectors to be clustered from either a binary file written by
+      //   VectorCollection::save() or a text file with one (sparse or dense) vector per line; the
+      //   caller owns the returned Array
+      static Array* loadVectors(const char* filename, bool sparse = false) ;
    protected: //methods
       ClusteringAlgo() {}
 
@@ -372,6 +474,7 @@ class ClusteringAlgo : public ClusteringAlgoBase
 	 { return nearestNeighbor(vector,centers,m_measure,threshold) ; }
       size_t assignToNearest(const Array* vectors, const Array* centers, ProgressIndicator *prog = nullptr,
 	 double threshold = -HUGE_VAL) const ;
+      ANNIndex<IdxT,ValT>* makeCenterIndex(const Array* centers) const ;
       double findNearestCluster(const Array* clusters, const Vector<IdxT,ValT>* vector, size_t& best_cluster,
 	 ProgressIndicator* prog = nullptr) const ;
       bool separateSeeds(const Array* vectors, RefArray*& seed, RefArray*& nonseed) const ;
@@ -389,6 +492,15 @@ ListPtr enumerate_cluster_algo_names(const char* prefix = nullptr) ;
 ClusteringAlgorithm parse_cluster_algo_name(const char* name) ;
 ListPtr enumerate_cluster_rep_names(const char* prefix = nullptr) ;
 ClusterRep parse_cluster_rep_name(const char* name) ;
+const char* cluster_linkage_name(ClusterLinkage linkage) ;
+
+// run agglomerative clustering to completion with the given linkage, returning the full merge
+//   history.  Single linkage needs only O(N) memory; the others keep a similarity matrix which is
+//   updated with the Lance-Williams recurrences, so they fail (returning nullptr) if that matrix
+//   would exceed 'max_matrix_mb' megabytes.
+template <typename IdxT, typename ValT>
+Dendrogram* agglomerative_dendrogram(const Array* vectors, VectorMeasure<IdxT,ValT>* measure,
+   ClusterLinkage linkage, size_t max_matrix_mb = 4096, ProgressIndicator* prog = nullptr) ;
 
 } ; // end of namespace Fr
 
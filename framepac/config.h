@@ -72,9 +72,21 @@ using namespace std ;
 #define FrHASHTABLE_INTERLEAVED_ENTRIES
 
 // uncomment the following line to pass integer keys through FastHash64
-//   instead of using them as-is
+//   instead of using them as-is in hash tables which don't select their
+//   own hash policy (see framepac/hashpolicy.h)
 //#define FrHASHTABLE_USE_FASTHASH64
 
+// number of control bytes a FlatHashTable probe examines at once.  The library and every program
+//   using it must agree on this, so it depends only on the target architecture and not on whether
+//   the including file happens to be compiled with AVX2 enabled; x86-64 always has SSE2.
+#ifndef FrFLATHASH_GROUP_WIDTH
+#  if defined(__x86_64__)
+#    define FrFLATHASH_GROUP_WIDTH 16
+#  else
+#    define FrFLATHASH_GROUP_WIDTH 8
+#  endif
+#endif
+
 /************************************************************************/
 /************************************************************************/
 
@@ -49,6 +49,8 @@ class ContextVectorCollection
       bool setOneHotVector(const KeyT term, IdxT index, ValT value, double weight = 1.0) ;
       context_type* makeTermVector(const KeyT term) ;
       context_type* getTermVector(const KeyT term) const ;
+      // batched getTermVector(), storing nullptr for terms without a vector; returns the number of vectors found
+      size_t getTermVectors(const KeyT* terms, size_t n, context_type** vectors) const ;
       context_type* getContextVector(const KeyT key) const ;
 
       bool addTerm(const KeyT key, const KeyT term, double weight = 1.0) ;
@@ -60,12 +60,19 @@ class LineBatch
       bool append(char* ln) ;
       bool append(CharPtr&& ln) ;
       LineBatch& operator+= (char* ln) { (void)append(ln) ; return *this ; }
+      // discard the current contents and take ownership of a buffer (allocated with new[]) which
+      //   will hold the text of some or all of the lines subsequently appended; lines pointing into
+      //   the buffer are released along with it rather than being deleted individually
+      void adoptBuffer(char* buf, size_t bufsize) ;
+      bool sharedLine(const char* ln) const { return ln >= m_buffer && ln < m_buffer + m_buffersize ; }
       void inputBytes(size_t b) { m_inputbytes = b ; }
       void addInput(size_t b) { m_inputbytes += b ; }
 
       const char* line(size_t N) const { return (N < size()) ?  m_lines[N] : nullptr ; }
       const char* operator[] (size_t N) const { return m_lines[N] ; }
 
+      // the edit function may modify the line in place or return a new string; in the latter case it
+      //   must delete[] the original only if !sharedLine(line)
       bool applyVA(LineEditFunc* fn, std::va_list args) ;
       bool apply(LineEditFunc* fn, ...)
 	 {
@@ -84,6 +91,8 @@ class LineBatch
       size_t m_count ;
       size_t m_inputbytes ;
       char** m_lines ;
+      char*  m_buffer { nullptr } ;	// shared storage for lines, see adoptBuffer()
+      size_t m_buffersize { 0 } ;
    } ;
 
 //----------------------------------------------------------------------------
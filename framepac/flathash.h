@@ -0,0 +1,329 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-10					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#ifndef _Fr_FLATHASH_H_INCLUDED
+#define _Fr_FLATHASH_H_INCLUDED
+
+#include <cstring>
+#include <type_traits>
+#include "framepac/cstring.h"
+#include "framepac/hashtable.h"
+
+#include "framepac/config.h"
+
+#if FrFLATHASH_GROUP_WIDTH == 32
+#  include <immintrin.h>
+#elif FrFLATHASH_GROUP_WIDTH == 16
+#  include <emmintrin.h>
+#endif
+
+/************************************************************************/
+/*	Control-byte groups						*/
+/************************************************************************/
+
+namespace FramepaC
+{
+
+// Each slot of a FlatHashTable has a control byte which is EMPTY, DELETED, or the low seven bits
+//   of the key's hash value.  A probe examines a whole group of control bytes at once, comparing
+//   all of them against the wanted seven bits with a single SIMD compare, and only touches the
+//   slots whose control bytes match.
+
+class FlatHashGroup
+   {
+   public:
+      static constexpr unsigned WIDTH = FrFLATHASH_GROUP_WIDTH ;
+      static constexpr std::int8_t EMPTY = -128 ;	// 0x80
+      static constexpr std::int8_t DELETED = -2 ;	// 0xFE
+#if FrFLATHASH_GROUP_WIDTH == 8
+      typedef std::uint64_t mask_type ;
+#else
+      typedef std::uint32_t mask_type ;
+#endif
+
+   public:
+#if FrFLATHASH_GROUP_WIDTH == 32
+      explicit FlatHashGroup(const std::int8_t* ctrl)
+	 : m_ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(ctrl))) {}
+      mask_type match(std::int8_t h2) const
+	 { return (mask_type)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(h2),m_ctrl)) ; }
+      mask_type matchEmpty() const { return match(EMPTY) ; }
+      // both EMPTY and DELETED have the high bit set, while full slots never do
+      mask_type matchAvailable() const { return (mask_type)_mm256_movemask_epi8(m_ctrl) ; }
+      static unsigned nextIndex(mask_type& mask)
+	 { unsigned idx = __builtin_ctz(mask) ; mask &= (mask - 1) ; return idx ; }
+#elif FrFLATHASH_GROUP_WIDTH == 16
+      explicit FlatHashGroup(const std::int8_t* ctrl)
+	 : m_ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl))) {}
+      mask_type match(std::int8_t h2) const
+	 { return (mask_type)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(h2),m_ctrl)) ; }
+      mask_type matchEmpty() const { return match(EMPTY) ; }
+      mask_type matchAvailable() const { return (mask_type)_mm_movemask_epi8(m_ctrl) ; }
+      static unsigned nextIndex(mask_type& mask)
+	 { unsigned idx = __builtin_ctz(mask) ; mask &= (mask - 1) ; return idx ; }
+#else
+      // portable version processing eight control bytes held in a 64-bit word; match() may report
+      //   an occasional false positive, which the caller's key comparison weeds out
+      explicit FlatHashGroup(const std::int8_t* ctrl) { std::memcpy(&m_ctrl,ctrl,sizeof(m_ctrl)) ; }
+      mask_type match(std::int8_t h2) const
+	 {
+	    mask_type x = m_ctrl ^ (LSBS * (std::uint8_t)h2) ;
+	    return (x - LSBS) & ~x & MSBS ;
+	 }
+      // EMPTY is the only control value with the high bit set and bit 1 clear
+      mask_type matchEmpty() const { return m_ctrl & ~(m_ctrl << 6) & MSBS ; }
+      mask_type matchAvailable() const { return m_ctrl & MSBS ; }
+      static unsigned nextIndex(mask_type& mask)
+	 { unsigned idx = __builtin_ctzll(mask) >> 3 ; mask &= (mask - 1) ; return idx ; }
+#endif
+
+   protected:
+#if FrFLATHASH_GROUP_WIDTH == 32
+      __m256i m_ctrl ;
+#elif FrFLATHASH_GROUP_WIDTH == 16
+      __m128i m_ctrl ;
+#else
+      static constexpr mask_type LSBS = 0x0101010101010101ULL ;
+      static constexpr mask_type MSBS = 0x8080808080808080ULL ;
+      mask_type m_ctrl ;
+#endif
+   } ;
+
+} // end namespace FramepaC
+
+/************************************************************************/
+/************************************************************************/
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Key comparison for FlatHashTable				*/
+/************************************************************************/
+
+template <typename KeyT>
+inline bool flathash_equal(KeyT key1, KeyT key2)
+{
+   return key1 == key2 || Fr::equal(key1,key2) ;
+}
+
+// symbols are unique, so pointer equality suffices
+inline bool flathash_equal(const Symbol* key1, const Symbol* key2)
+{
+   return key1 == key2 ;
+}
+
+inline bool flathash_equal(const CString& key1, const CString& key2)
+{
+   const char* str1 = key1.str() ;
+   const char* str2 = key2.str() ;
+   return str1 == str2 || (str1 && str2 && strcmp(str1,str2) == 0) ;
+}
+
+/************************************************************************/
+/*	Declarations for template class FlatHashTable			*/
+/************************************************************************/
+
+// An open-addressed hash table for data which is written once and then read by many threads.
+//   Unlike HashTable, lookups need no hazard pointers, link words, or atomic status bits: they
+//   compare a whole group of control bytes per step and usually touch exactly one slot.  The
+//   modifying functions are NOT thread-safe; build the table (or freeze() a concurrently-built
+//   HashTable into it) and then share it among readers.  Keys are not copied, so anything they
+//   point at must outlive the table.
+
+template <typename KeyT, typename ValT, typename PolicyT = typename HashTablePolicy<KeyT,ValT>::type>
+class FlatHashTable
+   {
+   public:
+      typedef KeyT key_type ;
+      typedef ValT mapped_type ;
+      typedef FramepaC::FlatHashGroup group_type ;
+      static constexpr size_t NOT_FOUND = ~(size_t)0 ;
+
+      class Slot
+         {
+	 public:
+	    KeyT m_key ;
+	    ValT m_value[std::is_empty<ValT>::value ? 0 : 1] ;
+	 } ;
+
+   public:
+      FlatHashTable(size_t initial_size = 0) { if (initial_size) reserve(initial_size) ; }
+      explicit FlatHashTable(const HashTable<KeyT,ValT,PolicyT>& table) { freeze(table) ; }
+      FlatHashTable(const FlatHashTable&) = delete ;
+      ~FlatHashTable() { releaseArrays() ; }
+      FlatHashTable& operator= (const FlatHashTable&) = delete ;
+
+      // replace the contents of this table with those of the given (concurrent) hash table
+      bool freeze(const HashTable<KeyT,ValT,PolicyT>& table) ;
+
+      // ============== modifiers: single writer, no concurrent readers ================
+      // like HashTable::add(), these return true if the key was already present, in which case its
+      //   value is left unchanged
+      bool add(KeyT key) ;
+      bool add(KeyT key, ValT value) ;
+      bool remove(KeyT key) ;
+      void clear() ;
+      // make room for at least 'count' keys without further resizing
+      bool reserve(size_t count) ;
+
+      // ============== lookups: safe from any number of threads ================
+      bool contains(KeyT key) const { return find(key,hashVal(key)) != NOT_FOUND ; }
+      ValT lookup(KeyT key) const
+	 {
+	    size_t idx = find(key,hashVal(key)) ;
+	    return idx == NOT_FOUND ? nullVal() : getValue(idx) ;
+	 }
+      bool lookup(KeyT key, ValT* value) const
+	 {
+	    size_t idx = find(key,hashVal(key)) ;
+	    if (idx == NOT_FOUND)
+	       return false ;
+	    if (value)
+	       *value = getValue(idx) ;
+	    return true ;
+	 }
+      ValT* lookupValuePtr(KeyT key) const
+	 {
+	    size_t idx = find(key,hashVal(key)) ;
+	    return idx == NOT_FOUND ? nullptr : getValuePtr(idx) ;
+	 }
+      // batched lookups; see HashTable::lookupMany()
+      size_t lookupMany(const KeyT* keys, size_t n, ValT* values, bool* found = nullptr) const ;
+
+      size_t currentSize() const { return m_size ; }
+      size_t countItems() const { return m_size ; }
+      size_t bucket_count() const { return m_capacity ; }
+      float load_factor() const { return m_capacity ? m_size / (float)m_capacity : 0.0f ; }
+      size_t memoryUsage() const { return m_capacity ? m_capacity * sizeof(Slot) + m_capacity + group_type::WIDTH : 0 ; }
+      // histogram of the number of groups probed to find each key, analogous to HashTable::chainLengths()
+      size_t* probeLengths(size_t& max_length) const ;
+
+      template <typename Fn>
+      bool iterate(Fn fn) const
+	 {
+	    for (size_t i = 0 ; i < m_capacity ; ++i)
+	       {
+	       if (m_ctrl[i] >= 0 && !fn(m_slots[i].m_key,getValue(i)))
+		  return false ;
+	       }
+	    return true ;
+	 }
+
+   protected:
+      template <typename RetT = size_t>
+      typename std::enable_if<std::is_integral<KeyT>::value,RetT>::type hashVal(KeyT key) const
+	 { return mixHash(PolicyT::hashInt(key)) ; }
+      template <typename RetT = size_t>
+      typename std::enable_if<!std::is_integral<KeyT>::value,RetT>::type hashVal(KeyT key) const
+	 { return mixHash(PolicyT::hashKey(key)) ; }
+      // the slot position comes from the high bits of the hash value and the control byte from the
+      //   low seven, so a policy which leaves integer keys as-is needs some extra mixing
+      static size_t mixHash(size_t hashval)
+	 {
+	    return std::is_same<PolicyT,HashPolicy_Identity>::value
+	       ? FramepaC::widehash64_int(hashval) : hashval ;
+	 }
+      template <typename RetT = bool>
+      static typename std::enable_if<std::is_integral<KeyT>::value,RetT>::type isEqual(KeyT key1, KeyT key2)
+	 { return key1 == key2 ; }
+      template <typename RetT = bool>
+      static typename std::enable_if<!std::is_integral<KeyT>::value,RetT>::type isEqual(KeyT key1, KeyT key2)
+	 { return flathash_equal(key1,key2) ; }
+
+      static ValT nullVal() { return ValT(0) ; }
+      ValT getValue(size_t idx) const { return std::is_empty<ValT>::value ? nullVal() : m_slots[idx].m_value[0] ; }
+      ValT* getValuePtr(size_t idx) const { return m_slots[idx].m_value ; }
+      void setValue(size_t idx, ValT value) { if (!std::is_empty<ValT>::value) m_slots[idx].m_value[0] = value ; }
+
+      size_t find(KeyT key, size_t hashval) const ;
+      size_t findAvailable(size_t hashval) const ;
+      void setCtrl(size_t idx, std::int8_t ctrl)
+	 {
+	    m_ctrl[idx] = ctrl ;
+	    // the bytes past the end of the table mirror the first group, so that a group load
+	    //   starting near the end of the table wraps around to its start
+	    if (idx < group_type::WIDTH)
+	       m_ctrl[m_capacity + idx] = ctrl ;
+	 }
+      size_t insertNew(KeyT key, size_t hashval) ;
+      bool resize(size_t capacity) ;
+      void releaseArrays() ;
+      static size_t capacityFor(size_t count) ;
+      static size_t maxLoad(size_t capacity) { return capacity - capacity / 8 ; }
+
+   protected:
+      std::int8_t* m_ctrl { nullptr } ;
+      Slot*        m_slots { nullptr } ;
+      size_t       m_capacity { 0 } ;		// always zero or a power of two
+      size_t       m_size { 0 } ;
+      size_t       m_deleted { 0 } ;		// number of DELETED control bytes
+   } ;
+
+// keep linker happy on debug builds:
+template <typename KeyT, typename ValT, typename PolicyT>
+constexpr size_t FlatHashTable<KeyT,ValT,PolicyT>::NOT_FOUND ;
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+inline size_t FlatHashTable<KeyT,ValT,PolicyT>::find(KeyT key, size_t hashval) const
+{
+   if (!m_ctrl)
+      return NOT_FOUND ;
+   size_t mask = m_capacity - 1 ;
+   size_t pos = (hashval >> 7) & mask ;
+   std::int8_t h2 = (std::int8_t)(hashval & 0x7F) ;
+   // triangular probing over groups visits every position in a power-of-two table
+   for (size_t stride = 0 ; stride <= m_capacity ; )
+      {
+      group_type group(m_ctrl + pos) ;
+      for (auto match = group.match(h2) ; match ; )
+	 {
+	 size_t idx = (pos + group_type::nextIndex(match)) & mask ;
+	 if (isEqual(key,m_slots[idx].m_key))
+	    return idx ;
+	 }
+      if (group.matchEmpty())
+	 break ;
+      stride += group_type::WIDTH ;
+      pos = (pos + stride) & mask ;
+      }
+   return NOT_FOUND ;
+}
+
+/************************************************************************/
+/************************************************************************/
+
+extern template class FlatHashTable<uint32_t,uint32_t> ;
+typedef FlatHashTable<uint32_t,uint32_t> FlatHashTable_U32_U32 ;
+
+extern template class FlatHashTable<uint32_t,NullObject> ;
+typedef FlatHashTable<uint32_t,NullObject> FlatHashSet_U32 ;
+
+extern template class FlatHashTable<CString,uint32_t> ;
+typedef FlatHashTable<CString,uint32_t> FlatVocabulary ;
+
+} // end namespace Fr
+
+#endif /* !_Fr_FLATHASH_H_INCLUDED */
+
+// end of file flathash.h //
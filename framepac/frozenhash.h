@@ -0,0 +1,270 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-10					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#ifndef _Fr_FROZENHASH_H_INCLUDED
+#define _Fr_FROZENHASH_H_INCLUDED
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+#include "framepac/cstring.h"
+#include "framepac/fasthash64.h"
+#include "framepac/file.h"
+#include "framepac/hashtable.h"
+#include "framepac/mmapfile.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Key handling for FrozenHashTable				*/
+/************************************************************************/
+
+// A frozen table can't store pointers, so integral keys are stored in the bucket as-is, while string
+//   keys (CString or Symbol) are stored as an offset into a pool of NUL-terminated strings which is
+//   saved along with the buckets.  The hash functions must give the same result in every process, so
+//   we can't use HashTable::hashVal(), which may depend on pointer values.
+
+template <typename KeyT, bool string_keys = !std::is_integral<KeyT>::value>
+class FrozenHashKey
+   {
+   public:
+      typedef KeyT stored_type ;
+      typedef KeyT lookup_type ;
+      static constexpr stored_type EMPTY = (stored_type)~0 ;
+
+   public:
+      FrozenHashKey(lookup_type key) : m_key(key) {}
+
+      static lookup_type lookupKey(KeyT key) { return key ; }
+      static lookup_type keyOf(stored_type stored, const char* /*strings*/) { return stored ; }
+
+      // HashTable reserves the all-ones key as its deletion marker, so it can never be a valid key
+      bool valid() const { return m_key != EMPTY ; }
+      uint64_t hashValue() const { return FramepaC::fasthash64_int(m_key) ; }
+      bool matches(stored_type stored, const char* /*strings*/, size_t /*stringsize*/) const
+	 { return stored == m_key ; }
+      stored_type store(std::vector<char>& /*strings*/) const { return m_key ; }
+
+   protected:
+      lookup_type m_key ;
+   } ;
+
+template <typename KeyT>
+class FrozenHashKey<KeyT,true>
+   {
+   public:
+      typedef uint64_t stored_type ;
+      typedef const char* lookup_type ;
+      static constexpr stored_type EMPTY = ~(uint64_t)0 ;
+      // the low bits of a stored key are the string's offset in the pool, while the high bits
+      //   are a tag taken from the key's hash value, so that most probes which land on a
+      //   different key can be rejected without touching the (cold) string pool
+      static constexpr unsigned OFFSET_BITS = 40 ;
+      static constexpr uint64_t OFFSET_MASK = (1ULL << OFFSET_BITS) - 1 ;
+
+   public:
+      FrozenHashKey(lookup_type key)
+	 : m_key(key), m_len(key ? strlen(key) : 0), m_hash(FramepaC::fasthash64(key,m_len)) {}
+
+      static lookup_type lookupKey(const CString& key) { return key.str() ; }
+      static lookup_type lookupKey(const Symbol* key) { return key ? key->name() : nullptr ; }
+      static lookup_type keyOf(stored_type stored, const char* strings)
+	 { return stored == EMPTY ? nullptr : strings + (stored & OFFSET_MASK) ; }
+
+      bool valid() const { return m_key != nullptr ; }
+      uint64_t hashValue() const { return m_hash ; }
+      bool matches(stored_type stored, const char* strings, size_t stringsize) const
+	 {
+	    if ((stored >> OFFSET_BITS) != (m_hash >> OFFSET_BITS))
+	       return false ;
+	    size_t ofs = stored & OFFSET_MASK ;
+	    return ofs < stringsize && stringsize - ofs > m_len && memcmp(strings+ofs,m_key,m_len) == 0
+	       && strings[ofs+m_len] == '\0' ;
+	 }
+      // append the key to the string pool, returning the value to be stored in the bucket
+      stored_type store(std::vector<char>& strings) const
+	 {
+	    uint64_t ofs = strings.size() ;
+	    if (ofs + m_len >= OFFSET_MASK)
+	       return EMPTY ;
+	    strings.insert(strings.end(),m_key,m_key+m_len+1) ;
+	    return (m_hash & ~OFFSET_MASK) | ofs ;
+	 }
+
+   protected:
+      lookup_type m_key ;
+      size_t      m_len ;
+      uint64_t    m_hash ;
+   } ;
+
+// keep linker happy on debug builds:
+template <typename KeyT, bool string_keys>
+constexpr typename FrozenHashKey<KeyT,string_keys>::stored_type FrozenHashKey<KeyT,string_keys>::EMPTY ;
+template <typename KeyT>
+constexpr typename FrozenHashKey<KeyT,true>::stored_type FrozenHashKey<KeyT,true>::EMPTY ;
+
+/************************************************************************/
+/*	Declarations for template class FrozenHashTable			*/
+/************************************************************************/
+
+// An immutable, open-addressed version of HashTable whose bucket array contains no pointers, so
+//   that a saved table can be memory-mapped and queried in place.  Loading a frozen table takes
+//   constant time regardless of its size, and all processes mapping the same file share a single
+//   copy of it in the page cache.
+
+template <typename KeyT, typename ValT>
+class FrozenHashTable
+   {
+   public:
+      typedef FrozenHashKey<KeyT> key_type ;
+      typedef typename key_type::stored_type stored_type ;
+      typedef typename key_type::lookup_type lookup_type ;
+      static_assert(std::is_trivially_copyable<ValT>::value, "FrozenHashTable values must be plain data") ;
+
+      class Bucket
+         {
+	 public:
+	    stored_type m_key ;
+	    ValT        m_value ;
+	 } ;
+
+   public:
+      FrozenHashTable() {}
+      FrozenHashTable(const char* filename, bool allow_mmap = true) { load(filename,allow_mmap) ; }
+      FrozenHashTable(const FrozenHashTable&) = delete ;
+      ~FrozenHashTable() { clear() ; }
+      FrozenHashTable& operator= (const FrozenHashTable&) = delete ;
+
+      // write a frozen image of the given hash table; if 'reverse_index' is set (and the values are
+      //   integers), also store a map from value back to key, as required by BidirIndex
+      static bool freeze(const HashTable<KeyT,ValT>& table, CFile&, bool reverse_index = false) ;
+      static bool freeze(const HashTable<KeyT,ValT>& table, const char* filename, bool reverse_index = false) ;
+
+      bool load(const char* filename, bool allow_mmap = true) ;
+      // load from open file starting at current file position
+      bool load(CFile&, const char* filename, bool allow_mmap = true) ;
+      bool loadMapped(const char* filename, off_t base_offset = 0) ;
+      // load starting from specified position in mmap'ed file
+      bool loadFromMmap(const char* mmap_base, size_t mmap_len) ;
+      void clear() ;
+
+      size_t size() const { return m_size ; }
+      size_t capacity() const { return m_capacity ; }
+      size_t reverseIndexSize() const { return m_reversesize ; }
+      bool readonly() const { return m_readonly ; }
+      // number of bytes used by the buckets, string pool, and reverse index
+      size_t memoryUsage() const
+	 { return m_capacity * sizeof(Bucket) + m_stringsize + m_reversesize * sizeof(stored_type) ; }
+
+      bool lookup(lookup_type key, ValT* value) const
+	 {
+	    const Bucket* bucket = locate(key_type(key)) ;
+	    if (!bucket)
+	       return false ;
+	    if (value)
+	       *value = bucket->m_value ;
+	    return true ;
+	 }
+      ValT lookup(lookup_type key) const
+	 {
+	    const Bucket* bucket = locate(key_type(key)) ;
+	    return bucket ? bucket->m_value : ValT(0) ;
+	 }
+      bool contains(lookup_type key) const { return locate(key_type(key)) != nullptr ; }
+      // only available if the table was frozen with a reverse index
+      lookup_type getKey(size_t index) const
+	 { return index < m_reversesize ? key_type::keyOf(m_reverse[index],m_strings) : lookup_type(0) ; }
+
+      template <typename Fn>
+      bool iterate(Fn fn) const
+	 {
+	    for (size_t i = 0 ; i < m_capacity ; ++i)
+	       {
+	       if (m_buckets[i].m_key != key_type::EMPTY
+		  && !fn(key_type::keyOf(m_buckets[i].m_key,m_strings),m_buckets[i].m_value))
+		  return false ;
+	       }
+	    return true ;
+	 }
+
+      explicit operator bool () const { return m_buckets != nullptr ; }
+
+   protected:
+      const Bucket* locate(const key_type& key) const ;
+      void releaseArrays() ;
+
+   protected:
+      MemMappedFile  m_mmap ;
+      Bucket*        m_buckets { nullptr } ;
+      char*          m_strings { nullptr } ;
+      stored_type*   m_reverse { nullptr } ;
+      size_t         m_size { 0 } ;
+      size_t         m_capacity { 0 } ;		// always a power of two
+      size_t         m_stringsize { 0 } ;
+      size_t         m_reversesize { 0 } ;
+      bool           m_readonly { false } ;
+
+      // magic values for serializing
+      static constexpr auto signature = "\x7F""FrozHash" ;
+      static constexpr unsigned file_format = 1 ;
+      static constexpr unsigned min_file_format = 1 ;
+   } ;
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT>
+inline const typename FrozenHashTable<KeyT,ValT>::Bucket* FrozenHashTable<KeyT,ValT>::locate(const key_type& key) const
+{
+   if (!m_buckets || !key.valid())
+      return nullptr ;
+   size_t mask = m_capacity - 1 ;
+   size_t pos = key.hashValue() & mask ;
+   // the table is never full, but don't loop forever on a corrupted file
+   for (size_t i = 0 ; i < m_capacity ; ++i)
+      {
+      const Bucket* bucket = &m_buckets[pos] ;
+      if (bucket->m_key == key_type::EMPTY)
+	 break ;
+      if (key.matches(bucket->m_key,m_strings,m_stringsize))
+	 return bucket ;
+      pos = (pos + 1) & mask ;
+      }
+   return nullptr ;
+}
+
+/************************************************************************/
+/************************************************************************/
+
+extern template class FrozenHashTable<uint32_t,uint32_t> ;
+typedef FrozenHashTable<uint32_t,uint32_t> FrozenHashTable_U32_U32 ;
+
+extern template class FrozenHashTable<CString,uint32_t> ;
+typedef FrozenHashTable<CString,uint32_t> FrozenVocabulary ;
+
+extern template class FrozenHashTable<const Symbol*,size_t> ;
+typedef FrozenHashTable<const Symbol*,size_t> FrozenSymCountHashTable ;
+
+} // end namespace Fr
+
+#endif /* !_Fr_FROZENHASH_H_INCLUDED */
+
+// end of file frozenhash.h //
@@ -0,0 +1,242 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-10					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#ifndef _Fr_HASHPOLICY_H_INCLUDED
+#define _Fr_HASHPOLICY_H_INCLUDED
+
+#include <cstdint>
+#include <cstring>
+#include "framepac/config.h"
+#include "framepac/cstring.h"
+#include "framepac/fasthash64.h"
+
+namespace FramepaC
+{
+
+/************************************************************************/
+/*	Wide-word string hash						*/
+/************************************************************************/
+
+// string hash patterned after wyhash by Wang Yi (public domain), available at
+//    https://github.com/wangyi-fudan/wyhash
+// Unlike fasthash64, which folds in one 64-bit word per multiply, this consumes sixteen bytes per
+//   64x64->128-bit multiply and runs three independent lanes over long strings, and it reads short
+//   strings with a pair of overlapping loads instead of a byte-at-a-time tail.
+// limitations: requires unaligned memory access and a compiler with __uint128_t, gives different
+//   results depending on endianness
+
+constexpr std::uint64_t WH64_P0 = 0xa0761d6478bd642fULL ;
+constexpr std::uint64_t WH64_P1 = 0xe7037ed1a0b428dbULL ;
+constexpr std::uint64_t WH64_P2 = 0x8ebc6af09c88c6e3ULL ;
+constexpr std::uint64_t WH64_P3 = 0x589965cc75374cc3ULL ;
+
+// multiply two 64-bit values and fold the 128-bit product back into 64 bits
+inline std::uint64_t widehash64_mum(std::uint64_t a, std::uint64_t b)
+{
+   __uint128_t product = (__uint128_t)a * b ;
+   return (std::uint64_t)product ^ (std::uint64_t)(product >> 64) ;
+}
+
+//----------------------------------------------------------------------------
+
+inline std::uint64_t widehash64_read8(const unsigned char* p)
+{
+   std::uint64_t value ;
+   std::memcpy(&value,p,sizeof(value)) ;
+   return value ;
+}
+
+//----------------------------------------------------------------------------
+
+inline std::uint64_t widehash64_read4(const unsigned char* p)
+{
+   std::uint32_t value ;
+   std::memcpy(&value,p,sizeof(value)) ;
+   return value ;
+}
+
+//----------------------------------------------------------------------------
+
+// hash the contents of a buffer
+inline std::uint64_t widehash64(const void* data, std::size_t len, std::uint64_t seed = 0)
+{
+   const unsigned char* p = reinterpret_cast<const unsigned char*>(data) ;
+   std::uint64_t a, b ;
+   seed ^= WH64_P0 ;
+   if (len <= 16)
+      {
+      if (len >= 4)
+	 {
+	 // two overlapping pairs of 32-bit loads cover all of the bytes for any length from 4 to 16
+	 std::size_t mid = (len >> 3) << 2 ;
+	 a = (widehash64_read4(p) << 32) | widehash64_read4(p + mid) ;
+	 b = (widehash64_read4(p + len - 4) << 32) | widehash64_read4(p + len - 4 - mid) ;
+	 }
+      else if (len > 0)
+	 {
+	 a = ((std::uint64_t)p[0] << 16) | ((std::uint64_t)p[len >> 1] << 8) | p[len - 1] ;
+	 b = 0 ;
+	 }
+      else
+	 a = b = 0 ;
+      }
+   else
+      {
+      std::size_t remaining = len ;
+      if (remaining > 48)
+	 {
+	 std::uint64_t seed1 = seed ;
+	 std::uint64_t seed2 = seed ;
+	 do {
+	    seed = widehash64_mum(widehash64_read8(p) ^ WH64_P1, widehash64_read8(p + 8) ^ seed) ;
+	    seed1 = widehash64_mum(widehash64_read8(p + 16) ^ WH64_P2, widehash64_read8(p + 24) ^ seed1) ;
+	    seed2 = widehash64_mum(widehash64_read8(p + 32) ^ WH64_P3, widehash64_read8(p + 40) ^ seed2) ;
+	    p += 48 ;
+	    remaining -= 48 ;
+	    } while (remaining > 48) ;
+	 seed ^= seed1 ^ seed2 ;
+	 }
+      while (remaining > 16)
+	 {
+	 seed = widehash64_mum(widehash64_read8(p) ^ WH64_P1, widehash64_read8(p + 8) ^ seed) ;
+	 p += 16 ;
+	 remaining -= 16 ;
+	 }
+      // the final sixteen bytes of the string, which may overlap ones we've already hashed
+      a = widehash64_read8(p + remaining - 16) ;
+      b = widehash64_read8(p + remaining - 8) ;
+      }
+   return widehash64_mum(WH64_P1 ^ len, widehash64_mum(a ^ WH64_P1, b ^ seed)) ;
+}
+
+//----------------------------------------------------------------------------
+
+// hash an integral value with a single wide multiply
+inline std::uint64_t widehash64_int(std::uint64_t value, std::uint64_t seed = 0)
+{
+   return widehash64_mum(value ^ seed ^ WH64_P0, WH64_P1) ;
+}
+
+} // end namespace FramepaC
+
+/************************************************************************/
+/************************************************************************/
+
+namespace Fr
+{
+
+// forward declaration
+class Symbol ;
+
+/************************************************************************/
+/*	Hash policies for HashTable					*/
+/************************************************************************/
+
+// A hash policy supplies the hash function used by a HashTable instantiation for integral keys
+//   (hashInt) and for string keys (hashString); other object keys supply their own hashValue().
+//   Each instantiation picks its policy at compile time through its third template argument,
+//   which defaults to HashTablePolicy<KeyT,ValT>::type.
+
+template <class PolicyT>
+class HashPolicyBase
+   {
+   public:
+      template <typename KeyT>
+      static std::size_t hashKey(KeyT key) { return key ? key->hashValue() : 0 ; }
+      static std::size_t hashKey(const CString& key) { return hashString(key.str()) ; }
+      static std::size_t hashString(const char* str)
+	 { return str ? PolicyT::hashString(str,std::strlen(str)) : 0 ; }
+   } ;
+
+//----------------------------------------------------------------------------
+
+// integer keys are used as-is; since HashTable's bucket count avoids multiples of small primes,
+//   this spreads dense or strided IDs perfectly and keeps neighboring IDs in neighboring buckets,
+//   but keys which differ only in their high bits or share a factor with the bucket count collide
+class HashPolicy_Identity : public HashPolicyBase<HashPolicy_Identity>
+   {
+   public:
+      using HashPolicyBase<HashPolicy_Identity>::hashString ;
+      static std::size_t hashInt(std::uint64_t key) { return (std::size_t)key ; }
+      static std::size_t hashString(const char* str, std::size_t len)
+	 { return FramepaC::fasthash64(str,len) ; }
+   } ;
+
+//----------------------------------------------------------------------------
+
+class HashPolicy_FastHash64 : public HashPolicyBase<HashPolicy_FastHash64>
+   {
+   public:
+      using HashPolicyBase<HashPolicy_FastHash64>::hashString ;
+      static std::size_t hashInt(std::uint64_t key) { return FramepaC::fasthash64_int(key) ; }
+      static std::size_t hashString(const char* str, std::size_t len)
+	 { return FramepaC::fasthash64(str,len) ; }
+   } ;
+
+//----------------------------------------------------------------------------
+
+class HashPolicy_WideHash : public HashPolicyBase<HashPolicy_WideHash>
+   {
+   public:
+      using HashPolicyBase<HashPolicy_WideHash>::hashString ;
+      static std::size_t hashInt(std::uint64_t key) { return FramepaC::widehash64_int(key) ; }
+      static std::size_t hashString(const char* str, std::size_t len)
+	 { return FramepaC::widehash64(str,len) ; }
+   } ;
+
+//----------------------------------------------------------------------------
+
+#ifdef FrHASHTABLE_USE_FASTHASH64
+typedef HashPolicy_FastHash64 HashPolicy_Default ;
+#else
+typedef HashPolicy_Identity HashPolicy_Default ;
+#endif /* FrHASHTABLE_USE_FASTHASH64 */
+
+// select the hash policy for HashTable<KeyT,ValT> when none is given explicitly; specialize this
+//   to change the hash function of an existing instantiation without touching its users
+template <typename KeyT, typename ValT>
+class HashTablePolicy
+   {
+   public:
+      typedef HashPolicy_Default type ;
+   } ;
+
+// vocabularies (string -> ID maps) spend most of their time hashing words
+template <typename IdT>
+class HashTablePolicy<CString,IdT>
+   {
+   public:
+      typedef HashPolicy_WideHash type ;
+   } ;
+
+// symbol tables hash the symbol's name whenever a string is interned
+template <>
+class HashTablePolicy<const Symbol*,NullObject>
+   {
+   public:
+      typedef HashPolicy_WideHash type ;
+   } ;
+
+} // end namespace Fr
+
+#endif /* !_Fr_HASHPOLICY_H_INCLUDED */
+
+// end of file hashpolicy.h //
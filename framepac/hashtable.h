@@ -30,16 +30,13 @@
 #include <utility>
 #include "framepac/counter.h"
 #include "framepac/critsect.h"
+#include "framepac/hashpolicy.h"
 #include "framepac/init.h"
 #include "framepac/list.h"
 #include "framepac/number.h"
 #include "framepac/symbol.h"
 #include "framepac/synchevent.h"
 
-#ifdef FrHASHTABLE_USE_FASTHASH64
-#  include "framepac/fasthash64.h"
-#endif /* FrHASHTABLE_USE_FASTHASH64 */
-
 //#undef FrHASHTABLE_VERBOSITY
 //#define FrHASHTABLE_VERBOSITY 2
 
@@ -56,6 +53,10 @@
 //   per segment
 #define FrHASHTABLE_SEGMENT_SIZE 2048
 
+// the batched lookupMany() and addMany() hash a group of this many keys and prefetch all of their
+//   buckets before probing any of them, so that the cache misses for the group overlap
+#define FrHASHTABLE_PREFETCH_GROUP 16
+
 /************************************************************************/
 
 // if we're trying to eke out every last bit of performance by disabling
@@ -102,12 +103,6 @@
 #  define ifnot_INTERLEAVED(x) x
 #endif /* FrHASHTABLE_INTERLEAVED_ENTRIES */
 
-#ifdef FrHASHTABLE_USE_FASTHASH64
-#  define FrHASHTABLE_INT_HASH(k) (size_t)FramepaC::fasthash64_int(k)
-#else
-#  define FrHASHTABLE_INT_HASH(k) ((size_t)k)
-#endif /* FrHASHTABLE_USE_FASTHASH64 */
-
 /************************************************************************/
 
 namespace FramepaC
@@ -269,27 +264,6 @@ class HashBase
 
 //----------------------------------------------------------------------------
 
-class TablePtr
-   {
-   public:
-      TablePtr*	             m_next  { nullptr } ;
-      Fr::Atomic<HashBase*>* m_table { nullptr } ;
-      size_t   	             m_id    { 0 } ;	   // thread ID, for help in debugging
-   public:
-      TablePtr() {}
-      bool initialized() const { return m_table != nullptr ; }
-      void init(HashBase** tab, TablePtr* next)
-	 {
-	    m_table = reinterpret_cast<Fr::Atomic<HashBase*>*>(tab) ;
-	    m_next = next ; m_id = FramepaC::my_job_id ;
-	 }
-      void init(Fr::Atomic<HashBase*>* tab, TablePtr* next)
-	 { m_table = tab ; m_next = next ; m_id = FramepaC::my_job_id ; }
-      const HashBase* table() const { return m_table->load() ; }
-   } ;
-
-//----------------------------------------------------------------------------
-
 } // end namespace FramepaC
 
 /************************************************************************/
@@ -299,8 +273,8 @@ namespace Fr
 {
 
 // forward declarations
-template <typename KeyT, typename ValT, typename RetT> class HashTableIter ;
-template <typename KeyT, typename ValT, typename RetT> class HashTableLocalIter ;
+template <typename KeyT, typename ValT, typename PolicyT, typename RetT> class HashTableIter ;
+template <typename KeyT, typename ValT, typename PolicyT, typename RetT> class HashTableLocalIter ;
 
 /************************************************************************/
 /*	Helper functions						*/
@@ -340,7 +314,8 @@ class HashTableBase : public Object
 /*	Declarations for template class HashTable			*/
 /************************************************************************/
 
-template <typename KeyT, typename ValT>
+// the hash policy (see framepac/hashpolicy.h) selects the hash function applied to integer and string keys
+template <typename KeyT, typename ValT, typename PolicyT = typename HashTablePolicy<KeyT,ValT>::type>
 class HashTable : public HashTableBase
    {
    public:
@@ -351,14 +326,14 @@ class HashTable : public HashTableBase
       typedef std::pair<const KeyT,ValT> value_type ;
       typedef std::size_t size_type ;
       typedef std::ptrdiff_t difference_type ;
-      //typedef X hasher ;	// specialize HashTable::hashVal() instead
+      typedef PolicyT hash_policy ;	// or specialize HashTable::hashVal()
       //typedef Y key_equal ;	// specialize HashTable::isEqual() instead
       typedef ValT& reference ;
       typedef const ValT& const_reference ;
-      typedef HashTableIter<KeyT,ValT,ValT> iterator ;
-      typedef HashTableIter<KeyT,ValT,const ValT> const_iterator ;  //FIXME??
-      typedef HashTableLocalIter<KeyT,ValT,ValT> local_iterator ;
-      typedef HashTableLocalIter<KeyT,ValT,const ValT> const_local_iterator ;
+      typedef HashTableIter<KeyT,ValT,PolicyT,ValT> iterator ;
+      typedef HashTableIter<KeyT,ValT,PolicyT,const ValT> const_iterator ;  //FIXME??
+      typedef HashTableLocalIter<KeyT,ValT,PolicyT,ValT> local_iterator ;
+      typedef HashTableLocalIter<KeyT,ValT,PolicyT,const ValT> const_local_iterator ;
       // unsupported features of C++ unordered_map/unordered_set:
       //  1. nodes are not individually allocated, so there is no way to have a custom allocator
       //   typedef UNAVAILABLE allocator_type ;
@@ -371,7 +346,6 @@ class HashTable : public HashTableBase
       // incorporate the auxiliary classes
       typedef FramepaC::Link Link ;
       typedef FramepaC::HashPtr HashPtr ;
-      typedef FramepaC::TablePtr TablePtr ;
       typedef FramepaC::HashTable_Stats HashTable_Stats ;
 
       // the types of the various callback functions
@@ -485,7 +459,7 @@ class HashTable : public HashTableBase
       // encapsulate all of the fields which must be atomically swapped at the end of a resize()
       class Table : public FramepaC::HashBase
       {
-	 typedef class Fr::HashTable<KeyT,ValT> HT ;
+	 typedef class Fr::HashTable<KeyT,ValT,PolicyT> HT ;
       public:
 	 void* operator new(size_t, Table* ptr) { return ptr ; }
 	 Table() : HashBase(), m_entries(nullptr), m_container(nullptr), remove_fn(nullptr)
@@ -519,6 +493,22 @@ class HashTable : public HashTableBase
 	 HashPtr *bucketPtr(size_t N) const { return &m_entries[N].m_info ; }
 #endif /* FrHASHTABLE_INTERLEAVED_ENTRIES */
 	 bool chainCopied(size_t N) const { return bucketPtr(N)->copyDone() ; }
+	 // start fetching the cache line(s) holding the chain head for the given hash value;
+	 //   the chain's entries are usually within a few slots of the head
+	 void prefetchBucket(size_t hashval, bool for_write = false) const
+	    {
+	       size_t N = hashval % m_size ;
+	       if (for_write)
+		  {
+		  __builtin_prefetch(&m_entries[N],1) ;
+		  ifnot_INTERLEAVED(__builtin_prefetch(&m_ptrs[N],1)) ;
+		  }
+	       else
+		  {
+		  __builtin_prefetch(&m_entries[N]) ;
+		  ifnot_INTERLEAVED(__builtin_prefetch(&m_ptrs[N])) ;
+		  }
+	    }
 	 void copyEntry(size_t N, const Table *othertab)
 	    {
 	       m_entries[N].init(othertab->m_entries[N]) ;
@@ -527,17 +517,6 @@ class HashTable : public HashTableBase
 	    }
 	 static size_t normalizeSize(size_t sz) ;
       protected:
-	 // the following function is defined *after* the declaration of HashTable
-	 //   due to the circular dependency of declarations....
-	 void announceTable()
-	    {
-#ifndef FrSINGLE_THREADED
-	       Atomic<Table*>& tbl = Atomic<Table*>::ref(Fr::HashTable<KeyT,ValT>::s_table) ;
-	       tbl.store(this) ;
-#endif /* !FrSINGLE_THREADED */
-	       return ;
-	    }
-
 	 Link chainHead(size_t N) const { return bucketPtr(N)->first() ; }
 	 Link chainHead(size_t N, Link& status) const { return bucketPtr(N)->firstAndStatus(status) ; }
 	 Link chainNext(size_t N) const { return bucketPtr(N)->next() ; }
@@ -699,31 +678,26 @@ class HashTable : public HashTableBase
 	 static constexpr size_t NULLPOS = ~0UL ;
          } ;
       //------------------------
+      // publishes a hazard pointer to the current Table for the duration of an operation.  Superseded
+      //   tables are released oldest-first, so holding a hazard pointer on a table also keeps alive
+      //   every newer table to which an operation may be forwarded during a resize.
       class HazardLock
          {
-	 private:
 	 public:
 #ifdef FrSINGLE_THREADED
-	    ALWAYS_INLINE HazardLock(Table *) {}
-	    ALWAYS_INLINE HazardLock(Atomic<Table*>) {}
+	    ALWAYS_INLINE HazardLock(const Atomic<Table*>& tab) : m_table(tab.load()) {}
 	    ALWAYS_INLINE ~HazardLock() {}
 #else
-	    HazardLock(Atomic<Table*>tab)
-	       {
-	       Atomic<Table*>& tbl = Atomic<Table*>::ref(HashTable::s_table) ;
-	       tbl.store(tab.load()) ;
-	       }
-	    HazardLock(Table *tab)
-	       {
-	       Atomic<Table*>& tbl = Atomic<Table*>::ref(HashTable::s_table) ;
-	       tbl.store(tab) ;
-	       }
-	    ~HazardLock()
-	       {
-	       Atomic<Table*>& tbl = Atomic<Table*>::ref(HashTable::s_table) ;
-	       tbl.store_relax((Table*)nullptr) ;
-	       }
+	    HazardLock(const Atomic<Table*>& tab) : m_table(HazardPointerList::protect(tab,m_slot)) {}
+	    ~HazardLock() { HazardPointerList::releaseSlot(m_slot) ; }
 #endif /* FrSINGLE_THREADED */
+	    Table* table() const { return m_table ; }
+	    Table* operator-> () const { return m_table ; }
+	 private:
+#ifndef FrSINGLE_THREADED
+	    Atomic<void*>* m_slot ;
+#endif /* !FrSINGLE_THREADED */
+	    Table* m_table ;
          } ;
       //------------------------
    protected: // debug methods
@@ -764,12 +738,12 @@ class HashTable : public HashTableBase
       template <typename RetT = size_t>
       inline typename std::enable_if<!std::is_integral<KeyT>::value,RetT>::type hashVal(KeyT key) const
 	 {
-	    return key ? key->hashValue() : 0 ;
+	    return PolicyT::hashKey(key) ;
 	 }
       template <typename RetT = size_t>
       inline typename std::enable_if<std::is_integral<KeyT>::value,RetT>::type hashVal(KeyT key) const
 	 {
-	    return FrHASHTABLE_INT_HASH(key) ;
+	    return PolicyT::hashInt(key) ;
 	 }
       inline size_t hashValFull(KeyT key) const
 	 {
@@ -780,7 +754,11 @@ class HashTable : public HashTableBase
 	 }
       // special support for Fr::SymHashSet
       size_t hashVal(const char *keyname, size_t *namelen) const
-	 { return Symbol::hashValue(keyname,namelen) ; }
+	 {
+	    size_t len = keyname ? strlen(keyname) : 0 ;
+	    if (namelen) *namelen = len ;
+	    return PolicyT::hashString(keyname,len) ;
+	 }
       template <typename RetT = bool>
       inline typename std::enable_if<std::is_integral<KeyT>::value,RetT>::type isEqual(KeyT key1, KeyT key2) const
 	 {
@@ -814,11 +792,11 @@ class HashTable : public HashTableBase
 #else
 #define DELEGATE(delegate) 						\
             HazardLock hl(m_table) ;					\
-	    return m_table.load()->delegate ;
+	    return hl->delegate ;
 #define DELEGATE_HASH(delegate) 					\
 	    size_t hashval = hashVal(key) ; 				\
 	    HazardLock hl(m_table) ;					\
-	    return m_table.load()->delegate ;
+	    return hl->delegate ;
 #endif /* FrSINGLE_THREADED */
 
    protected:
@@ -834,6 +812,8 @@ class HashTable : public HashTableBase
       // ============== The public API for HashTable ================
    public:
       bool load(CFile&, const char* filename) ;
+      // note: this rebuilds the table from the mapped file; use FrozenHashTable (framepac/frozenhash.h)
+      //   for a read-only table which is queried in place
       bool load(const char* mmap_base, size_t mmap_len) ;
       bool save(CFile&) const ;
 
@@ -866,11 +846,18 @@ class HashTable : public HashTableBase
       //   you will be using both this function and add()/remove()
       //   concurrently on the same hash table.
       ValT *lookupValuePtr(KeyT key) const { DELEGATE_HASH(lookupValuePtr(hashval,key)) }
+      // batched versions of lookup() and add(), which overlap the cache misses for
+      //   FrHASHTABLE_PREFETCH_GROUP keys at a time.  lookupMany() stores each key's value (if
+      //   'values' is non-null) and whether it was found (if 'found' is non-null), and returns the
+      //   number of keys found; addMany() adds each key with the corresponding value (or the null
+      //   value if 'values' is null), and returns the number of keys which were already present.
+      [[gnu::hot]] size_t lookupMany(const KeyT* keys, size_t n, ValT* values, bool* found = nullptr) const ;
+      [[gnu::hot]] size_t addMany(const KeyT* keys, size_t n, const ValT* values = nullptr, bool* existed = nullptr) ;
       [[gnu::hot]] bool add(KeyT key, ValT value, bool replace)
 	 {
 	    size_t hashval = hashVal(key) ;
 	    HazardLock hl(m_table) ;
-	    Table *tab = m_table.load() ;
+	    Table *tab = hl.table() ;
 	    if (replace)
 	       tab->remove(hashval,key) ;
 	    return tab->add(hashval,key,value) ;
@@ -915,6 +902,16 @@ class HashTable : public HashTableBase
          { DELEGATE(chainLengths(max_length)) }
       [[gnu::cold]] size_t* neighborhoodDensities(size_t &num_densities) const
 	 { DELEGATE(neighborhoodDensities(num_densities)) }
+      // number of hash arrays superseded by a resize which have not yet been reclaimed (approximate
+      //   while a resize or reclamation is in progress)
+      size_t pendingTables() const
+	 {
+	    size_t count = 0 ;
+	    const Table* current = m_table.load() ;
+	    for (const Table* tab = m_oldtables.load() ; tab && tab != current ; tab = tab->next())
+	       ++count ;
+	    return count ;
+	 }
 
       void* userData() const { return m_userdata ; }
       void userData(void* ud) { m_userdata = ud ; }
@@ -1100,9 +1097,6 @@ class HashTable : public HashTableBase
       static Atomic<FramepaC::HashBase*> s_freetables ;
 #ifndef FrSINGLE_THREADED
       static Fr::ThreadInitializer<HashTable> initializer ;
-      static Atomic<FramepaC::TablePtr*>      s_thread_entries ;
-      static thread_local TablePtr*           s_thread_record ;
-      static thread_local Table*              s_table ; // thread's announcement which hash table it's using
 #endif /* FrSINGLE_THREADED */
 #ifdef FrHASHTABLE_STATS
       mutable HashTable_Stats	  m_stats ;
@@ -1121,23 +1115,23 @@ class HashTable : public HashTableBase
       static const char s_typename[] ;
    } ;
 
-template <typename KeyT, typename ValT>
-const char HashTable<KeyT,ValT>::s_typename[] = "HashTable" ;
+template <typename KeyT, typename ValT, typename PolicyT>
+const char HashTable<KeyT,ValT,PolicyT>::s_typename[] = "HashTable" ;
 
-template <typename KeyT, typename ValT>
-//Atomic<HashTable<KeyT,ValT>::Table> HashTable<KeyT,ValT>::s_freetables = nullptr ;
-Atomic<FramepaC::HashBase*> HashTable<KeyT,ValT>::s_freetables = nullptr ;
+template <typename KeyT, typename ValT, typename PolicyT>
+//Atomic<HashTable<KeyT,ValT,PolicyT>::Table> HashTable<KeyT,ValT,PolicyT>::s_freetables = nullptr ;
+Atomic<FramepaC::HashBase*> HashTable<KeyT,ValT,PolicyT>::s_freetables = nullptr ;
 
-template <typename KeyT, typename ValT>
-Allocator HashTable<KeyT,ValT>::s_allocator(FramepaC::Object_VMT<HashTable<KeyT,ValT>>::instance(),sizeof(HashTable<KeyT,ValT>)) ;
+template <typename KeyT, typename ValT, typename PolicyT>
+Allocator HashTable<KeyT,ValT,PolicyT>::s_allocator(FramepaC::Object_VMT<HashTable<KeyT,ValT,PolicyT>>::instance(),sizeof(HashTable<KeyT,ValT,PolicyT>)) ;
 
 #ifndef FrSINGLE_THREADED
-template <typename KeyT, typename ValT>
-Fr::ThreadInitializer<HashTable<KeyT,ValT> > HashTable<KeyT,ValT>::initializer ;
+template <typename KeyT, typename ValT, typename PolicyT>
+Fr::ThreadInitializer<HashTable<KeyT,ValT,PolicyT> > HashTable<KeyT,ValT,PolicyT>::initializer ;
 #endif /* FrSINGLE_THREADED */
 
-template <typename KeyT, typename ValT>
-Fr::Initializer<HashTable<KeyT,ValT> > HashTable<KeyT,ValT>::global_initializer ;
+template <typename KeyT, typename ValT, typename PolicyT>
+Fr::Initializer<HashTable<KeyT,ValT,PolicyT> > HashTable<KeyT,ValT,PolicyT>::global_initializer ;
 
 //----------------------------------------------------------------------
 // specializations: Fr::Symbol* keys
@@ -1161,7 +1155,9 @@ typedef HashTable<const Symbol*,V> NAME ;
 template <>
 inline size_t HashTable<const Symbol*,NullObject>::hashValFull(const Symbol* key) const
 { 
-   return Symbol::hashValue(key) ;
+   // must agree with hashVal(keyname,namelen)
+   const char* name = key ? key->name() : nullptr ;
+   return hash_policy::hashString(name,name ? strlen(name) : 0) ;
 }
 
 template <>
@@ -1202,11 +1198,11 @@ inline void HashTable<const Symbol*,NullObject>::deleteSymbol(const Symbol* sym)
 /*	Declarations for class HashTableIter				*/
 /************************************************************************/
 
-template <typename KeyT, typename ValT>
+template <typename KeyT, typename ValT, typename PolicyT>
 class HashTableIterBase
    {
    public:
-      HashTableIterBase(typename HashTable<KeyT,ValT>::Table* table, size_t index = 0)
+      HashTableIterBase(typename HashTable<KeyT,ValT,PolicyT>::Table* table, size_t index = 0)
 	 {
 	    m_table = table  ;
 	    size_t cap = table->capacity() ;
@@ -1237,19 +1233,19 @@ class HashTableIterBase
       bool operator== (const HashTableIterBase& o) const { return m_table == o.m_table && m_index == o.m_index ; }
       bool operator!= (const HashTableIterBase& o) const { return m_table != o.m_table || m_index != o.m_index ; }
    protected:
-      typename HashTable<KeyT,ValT>::Table* m_table ;
+      typename HashTable<KeyT,ValT,PolicyT>::Table* m_table ;
       size_t                       m_index ;
    } ;
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT, typename RetT>
-class HashTableIter : public HashTableIterBase<KeyT,ValT>
+template <typename KeyT, typename ValT, typename PolicyT, typename RetT>
+class HashTableIter : public HashTableIterBase<KeyT,ValT,PolicyT>
    {
    public:
-      typedef HashTableIterBase<KeyT,ValT> super ;
+      typedef HashTableIterBase<KeyT,ValT,PolicyT> super ;
    public:
-      HashTableIter(typename HashTable<KeyT,ValT>::Table* table, size_t index = 0) : super(table,index)
+      HashTableIter(typename HashTable<KeyT,ValT,PolicyT>::Table* table, size_t index = 0) : super(table,index)
 	 {}
       
       std::pair<KeyT,RetT&> operator* () const
@@ -1265,18 +1261,18 @@ class HashTableIter : public HashTableIterBase<KeyT,ValT>
 /*	Declarations for class HashTableLocalIter			*/
 /************************************************************************/
 
-template <typename KeyT, typename ValT>
+template <typename KeyT, typename ValT, typename PolicyT>
 class HashTableLocalIterBase
    {
    public:
-      HashTableLocalIterBase(typename HashTable<KeyT,ValT>::Table* table, size_t bucket, FramepaC::Link index)
+      HashTableLocalIterBase(typename HashTable<KeyT,ValT,PolicyT>::Table* table, size_t bucket, FramepaC::Link index)
 	 {
 	    m_table = table  ;
 	    m_bucket = bucket ;
 	    m_index = index ;
 	    return ;
 	 }
-      HashTableLocalIterBase(typename HashTable<KeyT,ValT>::Table* table, size_t bucket)
+      HashTableLocalIterBase(typename HashTable<KeyT,ValT,PolicyT>::Table* table, size_t bucket)
 	 {
 	    m_table = table  ;
 	    m_bucket = bucket ;
@@ -1302,21 +1298,21 @@ class HashTableLocalIterBase
       bool operator!= (const HashTableLocalIterBase& o) const
 	 { return m_table != o.m_table || m_bucket + m_index != o.m_bucket + o.m_index ; }
    protected:
-      typename HashTable<KeyT,ValT>::Table* m_table ;
+      typename HashTable<KeyT,ValT,PolicyT>::Table* m_table ;
       size_t                       m_bucket ;
       FramepaC::Link		   m_index ;
    } ;
 
-template <typename KeyT, typename ValT, typename RetT>
-class HashTableLocalIter : public HashTableLocalIterBase<KeyT,ValT>
+template <typename KeyT, typename ValT, typename PolicyT, typename RetT>
+class HashTableLocalIter : public HashTableLocalIterBase<KeyT,ValT,PolicyT>
    {
    public:
-      typedef HashTableLocalIterBase<KeyT,ValT> super ;
+      typedef HashTableLocalIterBase<KeyT,ValT,PolicyT> super ;
    public:
-      HashTableLocalIter(typename HashTable<KeyT,ValT>::Table* table, size_t bucket, FramepaC::Link index)
+      HashTableLocalIter(typename HashTable<KeyT,ValT,PolicyT>::Table* table, size_t bucket, FramepaC::Link index)
 	 : super(table,bucket,index)
 	 {}
-      HashTableLocalIter(typename HashTable<KeyT,ValT>::Table* table, size_t bucket)
+      HashTableLocalIter(typename HashTable<KeyT,ValT,PolicyT>::Table* table, size_t bucket)
 	 : super(table,bucket)
 	 {}
 
@@ -1336,29 +1332,29 @@ class HashTableLocalIter : public HashTableLocalIterBase<KeyT,ValT>
 // these need to be defined *after* the members of HashTableIter due to the
 //  circular dependency between the types
 
-template <typename KeyT, typename ValT>
-typename HashTable<KeyT,ValT>::iterator HashTable<KeyT,ValT>::begin() const
+template <typename KeyT, typename ValT, typename PolicyT>
+typename HashTable<KeyT,ValT,PolicyT>::iterator HashTable<KeyT,ValT,PolicyT>::begin() const
 {
    return iterator(m_table.load(),0) ;
 }
 
-template <typename KeyT, typename ValT>
-typename HashTable<KeyT,ValT>::const_iterator HashTable<KeyT,ValT>::cbegin() const
+template <typename KeyT, typename ValT, typename PolicyT>
+typename HashTable<KeyT,ValT,PolicyT>::const_iterator HashTable<KeyT,ValT,PolicyT>::cbegin() const
 {
    return const_iterator(m_table.load(),0) ;
 }
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-typename HashTable<KeyT,ValT>::iterator HashTable<KeyT,ValT>::end() const
+template <typename KeyT, typename ValT, typename PolicyT>
+typename HashTable<KeyT,ValT,PolicyT>::iterator HashTable<KeyT,ValT,PolicyT>::end() const
 {
    Table* table = m_table.load() ;
    return iterator(table,table->capacity()) ; 
 }
 
-template <typename KeyT, typename ValT>
-typename HashTable<KeyT,ValT>::const_iterator HashTable<KeyT,ValT>::cend() const
+template <typename KeyT, typename ValT, typename PolicyT>
+typename HashTable<KeyT,ValT,PolicyT>::const_iterator HashTable<KeyT,ValT,PolicyT>::cend() const
 {
    Table* table = m_table.load() ;
    return const_iterator(table,table->capacity()) ; 
@@ -1367,29 +1363,29 @@ typename HashTable<KeyT,ValT>::const_iterator HashTable<KeyT,ValT>::cend() const
 // these need to be defined *after* the members of HashTableLocalIter due to the
 //  circular dependency between the types
 
-template <typename KeyT, typename ValT>
-typename HashTable<KeyT,ValT>::local_iterator HashTable<KeyT,ValT>::begin(int bcket) const
+template <typename KeyT, typename ValT, typename PolicyT>
+typename HashTable<KeyT,ValT,PolicyT>::local_iterator HashTable<KeyT,ValT,PolicyT>::begin(int bcket) const
 {
    return local_iterator(m_table.load(),bcket,0) ;
 }
 
-template <typename KeyT, typename ValT>
-typename HashTable<KeyT,ValT>::const_local_iterator HashTable<KeyT,ValT>::cbegin(int bcket) const
+template <typename KeyT, typename ValT, typename PolicyT>
+typename HashTable<KeyT,ValT,PolicyT>::const_local_iterator HashTable<KeyT,ValT,PolicyT>::cbegin(int bcket) const
 {
    return const_local_iterator(m_table.load(),bcket,0) ;
 }
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-typename HashTable<KeyT,ValT>::local_iterator HashTable<KeyT,ValT>::end(int bcket) const
+template <typename KeyT, typename ValT, typename PolicyT>
+typename HashTable<KeyT,ValT,PolicyT>::local_iterator HashTable<KeyT,ValT,PolicyT>::end(int bcket) const
 {
    Table* table = m_table.load() ;
    return local_iterator(table,bcket,FramepaC::NULLPTR) ;
 }
 
-template <typename KeyT, typename ValT>
-typename HashTable<KeyT,ValT>::const_local_iterator HashTable<KeyT,ValT>::cend(int bcket) const
+template <typename KeyT, typename ValT, typename PolicyT>
+typename HashTable<KeyT,ValT,PolicyT>::const_local_iterator HashTable<KeyT,ValT,PolicyT>::cend(int bcket) const
 {
    Table* table = m_table.load() ;
    return const_local_iterator(table,bcket,FramepaC::NULLPTR) ;
@@ -1419,6 +1415,18 @@ typedef HashTable<Object*,NullObject> ObjHashSet ;
 extern template class HashTable<uint32_t,NullObject> ;
 typedef HashTable<uint32_t,NullObject> HashSet_U32 ;
 
+// the same set under the other hash policies, for comparing their probe lengths and throughput
+#ifdef FrHASHTABLE_USE_FASTHASH64
+extern template class HashTable<uint32_t,NullObject,HashPolicy_Identity> ;
+#else
+extern template class HashTable<uint32_t,NullObject,HashPolicy_FastHash64> ;
+#endif /* FrHASHTABLE_USE_FASTHASH64 */
+typedef HashTable<uint32_t,NullObject,HashPolicy_Identity> HashSet_U32_Identity ;
+typedef HashTable<uint32_t,NullObject,HashPolicy_FastHash64> HashSet_U32_FastHash ;
+
+extern template class HashTable<uint32_t,NullObject,HashPolicy_WideHash> ;
+typedef HashTable<uint32_t,NullObject,HashPolicy_WideHash> HashSet_U32_WideHash ;
+
 FrMAKE_SYMBOL_HASHTABLE_CLASS(SymHashSet,NullObject) ;
 
 //----------------------------------------------------------------------------
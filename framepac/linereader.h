@@ -0,0 +1,97 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.15, last edit 2019-08-24					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#ifndef _Fr_LINEREADER_H_INCLUDED
+#define _Fr_LINEREADER_H_INCLUDED
+
+#include <vector>
+#include "framepac/file.h"
+#include "framepac/mmapfile.h"
+
+namespace Fr
+{
+
+// forward declaration
+class ThreadPool ;
+
+/************************************************************************/
+/*	Declarations for class LineReader				*/
+/************************************************************************/
+
+// Reads a text file in large blocks which always end at a line boundary and splits each block into
+//   a LineBatch whose lines all live in a single buffer owned by the batch, instead of allocating
+//   every line separately as CFile::getLines() does.  Regular files are memory-mapped, so that
+//   several blocks can be copied and split in parallel; pipes and filtered (decompressed) input
+//   fall back to large-block reads.  Lines may end in LF or CRLF.
+
+class LineReader
+   {
+   public:
+      static constexpr size_t DEFAULT_BLOCKSIZE = 4 * 1024 * 1024 ;
+      enum Options {
+	 default_options = 0,
+	 trim = 1,		// strip leading/trailing whitespace and omit lines which are then empty
+	 } ;
+   public:
+      LineReader(CFile& file, size_t blocksize = DEFAULT_BLOCKSIZE, int options = default_options) ;
+      LineReader(const LineReader&) = delete ;
+      ~LineReader() ;
+      LineReader& operator= (const LineReader&) = delete ;
+
+      bool mapped() const { return (bool)m_map ; }
+      bool eof() const ;
+      size_t blockSize() const { return m_blocksize ; }
+
+      // read the next block of lines, stopping early once 'maxlines' lines (if nonzero) have been
+      //   consumed; returns nullptr at end of file
+      LineBatch* getLines(size_t maxlines = 0) ;
+      // read up to 'count' consecutive blocks, splitting them into lines in parallel; returns the
+      //   number of batches stored, which is less than 'count' only at end of file
+      size_t getBatches(LineBatch** batches, size_t count, ThreadPool* pool = nullptr) ;
+
+   protected:
+      class Block
+         {
+	 public:
+	    const char* m_source { nullptr } ;	// text to be copied into m_buffer (if mapped)
+	    char*       m_buffer { nullptr } ;
+	    size_t      m_length { 0 } ;	// bytes of input, including line terminators
+	    size_t      m_alloc { 0 } ;
+	 } ;
+      bool nextBlock(Block& block, size_t maxlines) ;
+      bool nextMappedBlock(Block& block, size_t maxlines) ;
+      bool nextStreamBlock(Block& block, size_t maxlines) ;
+      LineBatch* splitBlock(Block& block) const ;
+
+   protected:
+      CFile&            m_file ;
+      MemMappedFile     m_map ;
+      std::vector<char> m_carry ;	// partial line left over from the previous read (if not mapped)
+      size_t            m_pos { 0 } ;	// offset of the next unread byte (if mapped)
+      size_t            m_blocksize ;
+      int               m_options ;
+   } ;
+
+} // end namespace Fr
+
+#endif /* !_Fr_LINEREADER_H_INCLUDED */
+
+// end of file linereader.h //
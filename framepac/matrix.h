@@ -39,8 +39,12 @@ class Matrix : public Object
    public:
       // object factories
       static Matrix* create(size_t rows, size_t cols) ;
-      virtual T& operator() (size_t row, size_t col) ;
-      virtual const T& operator() (size_t row, size_t col) const ;
+      virtual T& operator() (size_t row, size_t col) = 0 ;
+      virtual const T& operator() (size_t row, size_t col) const = 0 ;
+
+      // accessors
+      size_t rows() const { return m_rows ; }
+      size_t columns() const { return m_cols ; }
 
    protected:
       // *** creation/destruction ***
@@ -72,13 +76,13 @@ class Matrix : public Object
 	    const Matrix* m = static_cast<const Matrix*>(obj) ;
 	    return m->m_rows * m->m_cols ;
 	 }
-      static size_t empty_(const Object* obj) { return Matrix::size_(obj) == 0 ; }
+      static bool empty_(const Object* obj) { return Matrix::size_(obj) == 0 ; }
 
       // *** standard access functions ***
       static void matrixSet_(Object* o, size_t row, size_t col, double value)
-	 { static_cast<Matrix*>(o)(row,col) = T(value) ; }
+	 { (*static_cast<Matrix*>(o))(row,col) = T(value) ; }
       static double matrixGet_(const Object* o, size_t row, size_t col)
-	 { return static_cast<Matrix*>(o)(row,col) ; }
+	 { return (*static_cast<const Matrix*>(o))(row,col) ; }
 
       // *** comparison functions ***
 
@@ -110,16 +114,23 @@ class FullMatrix : public Matrix<T>
 
    public:
       // object factories
-      static FullMatrix* create(size_t rows, size_t cols) ;
+      static FullMatrix* create(size_t rows, size_t cols) { return new FullMatrix(rows,cols) ; }
       virtual T& operator() (size_t row, size_t col) { return m_matrix[row*this->m_cols + col] ; }
       virtual const T& operator() (size_t row, size_t col) const { return m_matrix[row*this->m_cols + col] ; }
 
+      // direct access to the (contiguous) elements of a row, for bulk fills
+      T* row(size_t r) { return m_matrix + r*this->m_cols ; }
+      const T* row(size_t r) const { return m_matrix + r*this->m_cols ; }
+
    protected: // creation/destruction
       void* operator new(size_t) { return s_allocator.allocate() ; }
       void operator delete(void* blk,size_t) { s_allocator.release(blk) ; }
-      FullMatrix(size_t rows, size_t cols) : super(rows,cols) {} //FIXME
+      FullMatrix(size_t rows, size_t cols) : super(rows,cols), m_matrix(new T[rows*cols]())
+	 {
+	 if (!m_matrix) this->m_rows = this->m_cols = 0 ;
+	 }
       FullMatrix(const FullMatrix&) ;
-      virtual ~FullMatrix() ;
+      virtual ~FullMatrix() { delete[] m_matrix ; }
 
    protected: // implementation functions for virtual methods
       friend class FramepaC::Object_VMT<FullMatrix> ;
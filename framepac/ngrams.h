@@ -1,7 +1,7 @@
 /****************************** -*- C++ -*- *****************************/
 /*									*/
 /* FramepaC-ng								*/
-/* Version 0.14, last edit 2019-02-14					*/
+/* Version 0.14, last edit 2019-07-07					*/
 /*	by Ralf Brown <ralf@cs.cmu.edu>					*/
 /*									*/
 /* (c) Copyright 2016,2017,2018,2019 Carnegie Mellon University		*/
@@ -22,7 +22,10 @@
 #ifndef __Fr_NGRAMS_H_INCLUDED
 #define __Fr_NGRAMS_H_INCLUDED
 
+#include "framepac/bidindex.h"
 #include "framepac/byteorder.h"
+#include "framepac/cstring.h"
+#include "framepac/mmapfile.h"
 
 namespace Fr
 {
@@ -36,21 +39,21 @@ namespace Fr
    	CountID map
 	Array of Unigram Records
    	Array of U32 "next" pointers for Unigrams
+	Array of smoothing factors for Unigrams
 	N-2 times:
            Array of Ngram Records for each ngram rank
 	   Array of U32 "next" pointers
-	   Array of smoothing discount factors for previous rank
+	   Array of smoothing factors
 	Array of Ngram Records for N-grams
-	Array of smoothing discount factors for (N-1)-grams
         Fr::Vocabulary
-	optional FrBWTIndex
 	NOTE: everything but header and record pointers can occur in arbitrary
 		order, since there are pointers in the header and pointer
-	   	records
+	   	records; the arrays are padded to a multiple of eight bytes so
+		that the entire file may be used in place after mmap()ing it
 
    Format of Header:
 	signature "Ngram Statistics File\0"
-	U8	file format version number (2)
+	U8	file format version number (3)
 	U8	n-gram length (maximum rank)
 	U8	bits used for word ID in ngram record (24)
 	U8	bits used for count ID in ngram record (16)
@@ -78,7 +81,9 @@ namespace Fr
 	U8	affix sizes (0 = keep entire word,
 			  else bits 7-4 = prefix chars, bits 3-0 = suffix chars)
         U8[7]	reserved (0)
-	U64[2]	reserved (0)
+	FLOAT64	interpolation weight of the uniform zerogram distribution
+	U32	word ID of the beginning-of-sentence marker
+	U32	word ID of the end-of-sentence marker
 
    Format of record pointers record:
 	U32	number of N-gram records
@@ -88,8 +93,7 @@ namespace Fr
 	U64	file offset of array of "next" pointers for N-grams
 		each "next" pointer is a U32; there is one more pointer than
 		N-gram records to simplify lookup code
-	U64	file offset of array of discount values (FLOATs) for N-grams
-		{optional, as it can be computed (slowly) at runtime}
+	U64	file offset of array of smoothing factors for N-grams
 	NOTE: last two elements are reserved (0) for the highest-rank n-grams,
 		since there are neither continuations nor a higher rank to
 		interpolate with
@@ -110,20 +114,47 @@ namespace Fr
    Format of Ngram Record:
 	16 bits:  count ID 		{bytes 0-1}
         24 bits:  word ID 		{bytes 2-4}
+
+   Format of smoothing factors record (for an N-gram used as history):
+	FLOAT32	 weight of the next-lower rank when interpolating
+	FLOAT32	 backoff weight for unseen continuations
 */
 
 /************************************************************************/
 /************************************************************************/
 
 #define LmSIGNATURE		"Ngram Statistics File"
+#define LmFILE_FORMAT		3
+
+#define LmCOUNTOFCOUNTS_MAX	8
+#define LmDISCOUNT_SCALE_FACTOR	(1UL << 31)
+#define LmWORDID_BITS		24
+#define LmCOUNTID_BITS		16
+#define LmMAX_RANK		16	// longest n-gram supported by the file format
+
+#define NGH_CASED		0x01
+#define NGH_CHARBASED		0x02
+#define NGH_SPACES		0x04
+
+typedef uint32_t LmWordID_t ;
+typedef uint32_t LmWordCount_t ;
+
+// the vocabulary stored in an NGrams file; old FramepaC had a separate Vocabulary class
+typedef BidirIndex<CString,uint32_t> Vocabulary ;
+
+enum class LmSmoothing
+   {
+   Interpolated,	// interpolated absolute discounting (the default)
+   Backoff,		// back off to the next-lower rank only for unseen continuations
+   None			// maximum-likelihood estimate from the longest matching n-gram
+   } ;
 
 /************************************************************************/
 /************************************************************************/
 
-// forward declaration to avoid pulling in all of framepac/file.h
+// forward declarations to avoid pulling in all of framepac/file.h and the corpus classes
 class CFile ;
-
-class Vocabulary ; // old-FramepaC class roughly equiv to BidirIndex<CString,uint32_t>
+template <typename IdT, typename IdxT> class WordCorpusT ;
 
 class NgramFileHeader
    {
@@ -131,8 +162,11 @@ class NgramFileHeader
       NgramFileHeader(size_t rank = 3) ;
       bool read(CFile&) ;
       bool write(CFile&) const ;
+      bool verify(size_t filesize) const ;
 
       // accessors
+      unsigned version() const { return m_version ; }
+      size_t rank() const { return m_rank ; }
       uint64_t trainingSize() const { return m_trainingsize ; }
       size_t countIDmax() const { return m_num_countIDs ; }
       off_t countOfCounts() const { return (off_t)m_countofcounts_offset ; }
@@ -144,6 +178,9 @@ class NgramFileHeader
       uint64_t suffArraySize() const { return m_sarray_size ; }
       off_t suffArrayOffset() const { return (off_t)m_sarray_offset ; }
       uint8_t affixSizes() const { return m_affix_sizes ; }
+      double zerogramWeight() const { return m_zerogram_weight ; }
+      LmWordID_t beginSentenceID() const { return m_begsent_id ; }
+      LmWordID_t endSentenceID() const { return m_endsent_id ; }
       bool isCaseSensitive() const { return m_flags & NGH_CASED ; }
       bool isCharBased() const { return m_flags & NGH_CHARBASED ; }
       bool includesSpaces() const { return m_flags & NGH_SPACES ; }
@@ -160,6 +197,8 @@ class NgramFileHeader
       void setSuffArraySize(uint64_t size) { m_sarray_size = size ; }
       void setSuffArrayOffset(off_t off) { m_sarray_offset = (uint64_t)off ; }
       void setAffixSizes(uint8_t sizes) { m_affix_sizes = sizes ; }
+      void setZerogramWeight(double wt) { m_zerogram_weight = wt ; }
+      void setSentenceMarkers(LmWordID_t beg, LmWordID_t end) { m_begsent_id = beg ; m_endsent_id = end ; }
       void setCaseSensitive(bool cased) { m_flags &= ~NGH_CASED ; if (cased) m_flags |= NGH_CASED ; }
       void setCharBased(bool cased) { m_flags &= ~NGH_CHARBASED ; if (cased) m_flags |= NGH_CHARBASED ; }
       void setIncludeSpaces(bool cased) { m_flags &= ~NGH_SPACES ; if (cased) m_flags |= NGH_SPACES ; }
@@ -184,8 +223,10 @@ class NgramFileHeader
       uint64_t  m_stopword_offset ;
       uint8_t   m_affix_sizes ;
       uint8_t   m_reserved0[7] ;
-      uint64_t	m_reserved[2] ;
-} ;
+      double	m_zerogram_weight ;
+      uint32_t	m_begsent_id ;
+      uint32_t	m_endsent_id ;
+   } ;
 
 /************************************************************************/
 /************************************************************************/
@@ -205,7 +246,7 @@ class RecordPointerRecord
       // modifiers
       void setCount(uint32_t count) { m_count = count ; }
       void setRecords(off_t offset) { m_records = offset ; }
-      void setPointers(off_t offset) { m_pointers = offset) ; }
+      void setPointers(off_t offset) { m_pointers = offset ; }
       void setDiscounts(off_t offset) { m_discounts = offset ; }
    private:
       uint32_t m_count ;
@@ -218,26 +259,29 @@ class RecordPointerRecord
 /************************************************************************/
 /************************************************************************/
 
+// map between the count IDs stored in the packed n-gram records and the actual counts
 class LmCountMap
    {
    public:
-      LmCountMap(size_t numcounts) ;
-      LmCountMap(size_t numcounts, char* counts) ;
-      LmCountMap(size_t numcounts, CFile&) ;
-      ~LmCountMap() ;
-
+      LmCountMap() {}
+      LmCountMap(size_t numcounts, const uint32_t* counts) : m_numcounts(numcounts), m_counts(counts) {}
+      ~LmCountMap() { if (m_allocated) delete[] m_counts ; }
+
+      // build the map from a sorted list of the distinct counts which occur; if there are more
+      //   than can be represented by a count ID, the largest ones are approximated
+      bool build(const uint32_t* counts, size_t numcounts) ;
+      void setCounts(size_t numcounts, const uint32_t* counts) ;
       bool write(CFile&) const ;
 
-      uint32_t countID(size_t count) ;
-      uint32_t count(size_t countID) const ;
+      uint32_t countID(size_t count) const ;
+      uint32_t count(size_t countID) const { return countID < m_numcounts ? m_counts[countID] : 0 ; }
       size_t numCounts() const { return m_numcounts ; }
-      size_t numCountsUsed() const ;
-      bool OK() const { return m_counts != 0 ; }
+      bool OK() const { return m_counts != nullptr ; }
 
    private:
-      size_t	m_numcounts ;
-      uint32_t* m_counts ;
-      bool	m_allocated ;
+      size_t	      m_numcounts { 0 } ;
+      const uint32_t* m_counts { nullptr } ;
+      bool	      m_allocated { false } ;
    } ;
 
 /************************************************************************/
@@ -246,39 +290,30 @@ class LmCountMap
 class LmCountOfCounts
    {
    public:
-      void* operator new(size_t, void* where) { return where ; }
-      LmCountOfCounts() ;
-      LmCountOfCounts(const char* data) ;
+      LmCountOfCounts() { clear() ; }
       ~LmCountOfCounts() {}
 
+      void clear() ;
       bool write(CFile&) const ;
 
-      // accessors
-      uint32_t frequency(size_t N) const
-	 { return (N < LmCOUNTOFCOUNTS_MAX) ? m_freqs[N] : m_freqs[LmCOUNTOFCOUNTS_MAX] ; }
-      uint32_t continuations(size_t N) const
-	 { return (N < LmCOUNTOFCOUNTS_MAX) ? m_conts[N] : m_conts[LmCOUNTOFCOUNTS_MAX] ; }
-      static size_t dataSize()
-	 { return 2*LmCOUNTOFCOUNTS_MAX*sizeof(uint32_t) ; }
+      // accessors; N is the count (or number of continuations), and all values of N at or
+      //   above LmCOUNTOFCOUNTS_MAX are lumped together
+      uint32_t frequency(size_t N) const { return N ? m_freqs[slot(N)] : 0 ; }
+      uint32_t continuations(size_t N) const { return N ? m_conts[slot(N)] : 0 ; }
+      static size_t dataSize() { return 2*LmCOUNTOFCOUNTS_MAX*sizeof(uint32_t) ; }
 
       // modifiers
-      void setFrequency(size_t N, uint32_t freq)
-	 { if (N > LmCOUNTOFCOUNTS_MAX) N = LmCOUNTOFCOUNTS_MAX ;
-	   m_freqs[N] = freq ; }
-      void incrFrequency(size_t N, uint32_t amt = 1)
-	 { if (N > LmCOUNTOFCOUNTS_MAX) N = LmCOUNTOFCOUNTS_MAX ;
-	   m_freqs[N] += amt ; }
-      void setContinuations(size_t N, uint32_t cont)
-	 { if (N > LmCOUNTOFCOUNTS_MAX) N = LmCOUNTOFCOUNTS_MAX ;
-	   m_conts[N] = cont ; }
-      void incrContinuations(size_t N, uint32_t amt = 1)
-	 { if (N > LmCOUNTOFCOUNTS_MAX) N = LmCOUNTOFCOUNTS_MAX ;
-	   m_conts[N] += amt ; }
+      void setFrequency(size_t N, uint32_t freq) { if (N) m_freqs[slot(N)] = freq ; }
+      void incrFrequency(size_t N, uint32_t amt = 1) { if (N) m_freqs[slot(N)] += amt ; }
+      void setContinuations(size_t N, uint32_t cont) { if (N) m_conts[slot(N)] = cont ; }
+      void incrContinuations(size_t N, uint32_t amt = 1) { if (N) m_conts[slot(N)] += amt ; }
       void clearContinuations() ;
 
    private:
-      uint32_t	m_freqs[LmCOUNTOFCOUNTS_MAX+1] ;
-      uint32_t	m_conts[LmCOUNTOFCOUNTS_MAX+1] ;
+      static size_t slot(size_t N) { return (N < LmCOUNTOFCOUNTS_MAX ? N : LmCOUNTOFCOUNTS_MAX) - 1 ; }
+   private:
+      uint32_t	m_freqs[LmCOUNTOFCOUNTS_MAX] ;
+      uint32_t	m_conts[LmCOUNTOFCOUNTS_MAX] ;
    } ;
 
 /************************************************************************/
@@ -289,9 +324,11 @@ class LmNgramDiscounts
    public:
       LmNgramDiscounts() ;
 
-      bool read(CFile&) ;
       bool write(CFile&) const ;
 
+      // compute modified absolute discounts (Chen & Goodman) from the counts-of-counts for a rank
+      void compute(const LmCountOfCounts& counts) ;
+
       // accessors
       double discount(size_t N) const
 	 { if (N == 0) return 0.0 ;
@@ -312,6 +349,24 @@ class LmNgramDiscounts
 /************************************************************************/
 /************************************************************************/
 
+class LmUnigramRecord
+   {
+   public:
+      LmUnigramRecord() {}
+      LmUnigramRecord(uint32_t freq, uint32_t class_size = 1) : m_freq(freq), m_classsize(class_size) {}
+
+      // accessors
+      uint32_t frequency() const { return m_freq ; }
+      uint32_t classSize() const { return m_classsize ; }
+
+   private:
+      uint32_t m_freq ;
+      uint32_t m_classsize ;
+   } ;
+
+/************************************************************************/
+/************************************************************************/
+
 class NgramRecord
    {
    public:
@@ -320,26 +375,49 @@ class NgramRecord
       NgramRecord(const NgramRecord& orig) = default ;
       ~NgramRecord() {}
 
-      bool write(CFile&) const ;
-
       // accessors
       LmWordID_t wordID() const { return m_wordID.load() ; }
-      LmWordCount_t wordCount() const { return m_count.load() ; }
+      LmWordCount_t countID() const { return m_count.load() ; }
       uint32_t wordCount(const LmCountMap* countmap) const
-	 { LmWordCount_t count = wordCount() ; 
+	 { LmWordCount_t count = countID() ;
 	   return countmap ? countmap->count(count) : count ; }
 
       // manipulators
       void setCount(size_t countID) { m_count = countID ; }
 
    private:
-      Int16 m_count ;
-      Int24 m_wordID ;
+      UInt16 m_count ;
+      UInt24 m_wordID ;
    } ;
 
 /************************************************************************/
 /************************************************************************/
 
+class LmSmoothingFactors
+   {
+   public:
+      LmSmoothingFactors() {}
+      LmSmoothingFactors(float interp, float backoff) : m_interp(interp), m_backoff(backoff) {}
+
+      // accessors
+      double interpolationWeight() const { return m_interp ; }
+      double backoffWeight() const { return m_backoff ; }
+
+      // manipulators
+      void setInterpolationWeight(double wt) { m_interp = (float)wt ; }
+      void setBackoffWeight(double wt) { m_backoff = (float)wt ; }
+
+   private:
+      float m_interp ;
+      float m_backoff ;
+   } ;
+
+/************************************************************************/
+/************************************************************************/
+
+// the state of a left-to-right scan over a sentence: the record index of each suffix of the
+//   words seen so far which occurs in the model, so that the next word's probability can be
+//   computed with one search per rank instead of walking every n-gram from the root
 class NGramHistory
    {
    public:
@@ -347,49 +425,53 @@ class NGramHistory
       ~NGramHistory() {}
 
       // accessors
-      uint32_t startLoc() const { return m_hist ; }
-      uint32_t endLoc() const { return m_hist + m_count - 1 ; }
-      uint32_t wordID() const { return m_hist ; }
-      uint32_t count() const { return m_count ; }
+      size_t length() const { return m_length ; }
+      uint32_t record(size_t len) const { return m_records[len-1] ; }
+      bool operator== (const NGramHistory& other) const ;
+      bool operator!= (const NGramHistory& other) const { return !(*this == other) ; }
 
       // manipulators
-      void setID(uint32_t ID) { m_hist = ID ; }
-      void setCount(size_t cnt) { m_count = (uint32_t)cnt ; }
-      void setLoc(uint32_t first, uint32_t last)
-	 { m_hist = first ; m_count = (last - first) + 1 ; }
-//      void setLoc(BWTLocation loc) { m_hist = loc.first() ; m_count = loc.rangeSize() ; }
+      void clear() { m_length = 0 ; }
+      void setLength(size_t len) { m_length = (uint32_t)len ; }
+      void setRecord(size_t len, uint32_t index) { m_records[len-1] = index ; }
 
    private:
-      uint32_t m_hist ;			// location in NGramsFile; raw word ID for unsmoothed/joint-prob model
-      uint32_t m_count ;
+      uint32_t m_length { 0 } ;
+      uint32_t m_records[LmMAX_RANK-1] ;	// index of each suffix's record in its rank's array
    } ;
 
 /************************************************************************/
 /************************************************************************/
 
-// to update from old FramepaC
 class NGramsFile
    {
    public:
-      NGramsFile(const char* filename, size_t max_rank_to_use,
-		   bool allow_mmap = true,
-		   bool preload = true) ;
-      ~NGramsFile() ;
+      NGramsFile() {}
+      NGramsFile(const char* filename, size_t max_rank_to_use = ~0, bool allow_mmap = true,
+	 size_t prefetch_rank = 0) ;
+      NGramsFile(const NGramsFile&) = delete ;
+      ~NGramsFile() { clear() ; }
+      NGramsFile& operator= (const NGramsFile&) = delete ;
+
+      bool load(const char* filename, size_t max_rank_to_use = ~0, bool allow_mmap = true,
+	 size_t prefetch_rank = 0) ;
+      bool loadFromMmap(const char* mmap_base, size_t mmap_len, size_t max_rank_to_use = ~0) ;
+      void clear() ;
       static bool verifyFormat(const char* filename) ;
 
-      static double smoothingFactor(const LmNgramDiscounts* discounts,
-				    const LmCountOfCounts* counts, size_t total_count) ;
+      // ask the OS to start reading in the data for the given rank, so that the first queries
+      //   against a freshly-mapped model don't all stall on page faults
+      bool prefetch(size_t rank) const ;
 
       // accessors
       bool OK() const { return m_OK ; }
-      bool isCaseSensitive() const { return m_case_sensitive ; }
-      bool isCharBased() const { return m_char_based ; }
-      bool includesSpaces() const { return m_include_spaces ; }
-      uint8_t affixSizes() const { return m_affix_sizes ; }
-      FrLMSmoothing smoothing() const { return m_smoothing ; }
-      Vocabulary* vocabulary() const { return m_vocab ; }
-      Vocabulary* surfaceVocabulary() const { return m_surfvocab ; }
-      Vocabulary* stopwordVocabulary() const { return m_stopwords ; }
+      explicit operator bool () const { return m_OK ; }
+      bool isCaseSensitive() const { return m_header->isCaseSensitive() ; }
+      bool isCharBased() const { return m_header->isCharBased() ; }
+      bool includesSpaces() const { return m_header->includesSpaces() ; }
+      uint8_t affixSizes() const { return m_header->affixSizes() ; }
+      LmSmoothing smoothing() const { return m_smoothing ; }
+      const Vocabulary* vocabulary() const { return m_vocab ; }
       size_t maxNgramLength() const { return m_maxlength ; }
       uint64_t trainingSize() const { return m_numtokens ; }
       size_t vocabularySize() const { return m_vocabsize ; }
@@ -399,268 +481,128 @@ class NGramsFile
 	 { return ID < m_vocabsize ? m_unigrams[ID].frequency() : 0 ; }
       size_t ngramCount(size_t N) const
 	 { return (N>=1 && N <= maxNgramLength()) ? m_record_counts[N] : 0 ; }
-      size_t recordOffset(const LmWordID_t* IDs, size_t rank) const ;
-      uint32_t getCount(size_t rank, uint32_t index) const ;
-      uint32_t frequency(const LmWordID_t* IDs, size_t numIDs,
-			 uint32_t* rec_index = 0) const ;
-      uint32_t frequency(size_t prev_rank,LmWordID_t ID,uint32_t index) const ;
-      uint32_t frequency(size_t prev_rank,LmWordID_t ID,
-			 uint32_t* rec_index) const ;
+      const LmCountOfCounts* countOfCounts(size_t N) const
+	 { return (N>=1 && N <= maxNgramLength()) ? &m_countofcounts[N-1] : nullptr ; }
+      double discount(size_t rank, size_t count) const { return m_discounts[rank-1].discount(count) ; }
+
+      LmWordID_t findWordID(const char* word) const ;
+      const char* word(LmWordID_t ID) const ;
+      LmWordID_t unknownID() const { return (LmWordID_t)m_vocabsize ; }
+      LmWordID_t beginSentenceID() const { return m_begsent ; }
+      LmWordID_t endSentenceID() const { return m_endsent ; }
+
+      // look up an n-gram, returning its count and optionally the index of its record
+      uint32_t frequency(const LmWordID_t* IDs, size_t numIDs, uint32_t* rec_index = nullptr) const ;
       size_t longestMatch(const LmWordID_t* IDs, size_t numIDs) const ;
-      double probability(const LmWordID_t* IDs, size_t numIDs,
-			 size_t* max_exist = 0) const ;
-      double probability(NGramHistory* history, size_t numIDs,
-			 LmWordID_t ID, size_t* max_exist = 0) const ;
-      double probability(const char* const* words, size_t numwords,
-			 size_t* max_exist = 0) const ;
-      double probability(const List* words) const ;
 
-      double perplexity(size_t rank, bool use_entropy) const ;
+      // the conditional probability of the last word given the ones preceding it
+      double probability(const LmWordID_t* IDs, size_t numIDs, size_t* max_exist = nullptr) const ;
+
+      // incremental scoring: the probability of ID following the given history, optionally
+      //   updating the history to include ID (newhist may be the same object as history)
+      void initHistory(NGramHistory& history, bool sentence_start = true) const ;
+      double probability(const NGramHistory& history, LmWordID_t ID, NGramHistory* newhist = nullptr,
+	 size_t* max_exist = nullptr) const ;
+
+      // log10 probability of a sentence, optionally including the sentence-boundary markers
+      double scoreSentence(const LmWordID_t* IDs, size_t numIDs, bool add_markers = true) const ;
+      bool scoreSentences(const LmWordID_t* const* sentences, const size_t* lengths, size_t count,
+	 double* scores, bool add_markers = true) const ;
 
       // manipulators
-      //bool unmemmap() ;
-      void smoothing(FrLMSmoothing sm) { m_smoothing = sm ; }
+      void smoothing(LmSmoothing sm) { m_smoothing = sm ; }
 
       // I/O
-      static bool convert(const char* filename, const FrBWTIndex* index,
-			    Vocabulary* vocab, size_t ngram_rank,
-			    size_t precomp_rank = ~0, bool char_based = false,
-			    bool include_spaces = false,
-			    Vocabulary* surfvocab = 0, Vocabulary* stopwords = 0) ;
-      static bool convert(const char* filename, const char* const* files,
-			    size_t ngram_rank, size_t precomp_rank = ~0,
-			    size_t scaling_factor = 1, bool char_based = false,
-			    bool include_spaces = false) ;
-      bool dump(CFile& out, const char* modelname,
-		  bool run_verbosely = false) const ;
+      static bool convert(const char* filename, const WordCorpusT<uint32_t,uint32_t>& corpus,
+	 size_t ngram_rank, bool case_sensitive = true) ;
 
-   private:
-      bool allocPerRankData() ;
-      void loadCountOfCounts(const char* data) ;
-      void loadRecords(const char* recptrs, CFile&, const char* mappedmem, size_t max_touchmem_rank = 0) ;
-      void computeSmoothingFactors(size_t rank) ;
-      uint32_t locateNext(LmWordID_t ID, size_t rank, uint32_t index) const ;
-      double discountFactor(size_t rank, size_t count) const ;
-      double smoothingFactor(size_t rank, uint32_t index) const ;
-      double rawCondProbability(const LmWordID_t* history, size_t histlen, LmWordID_t ID,
-	 			  size_t class_size) const ;
-      double rawCondProbability(NGramHistory* history, size_t histlen, LmWordID_t ID, size_t class_size) const ;
-      double probabilityKN(const LmWordID_t* IDs, size_t numIDs, size_t* max_exist = 0) const ;
-      double probabilityKN(const NGramHistory* history, NGramHistory* newhistory,
-	 		     size_t numIDs, LmWordID_t ID, size_t* max_exist = 0) const ;
-      double probabilityMax(const LmWordID_t* IDs, size_t numIDs, size_t* max_exist = 0) const ;
-      double probabilityMax(NGramHistory* history, size_t numIDs, LmWordID_t ID, size_t* max_exist = 0) const ;
-      double probabilityMean(const LmWordID_t* IDs, size_t numIDs, size_t* max_exist = 0) const ;
-      double probabilityMean(NGramHistory* history, size_t numIDs, LmWordID_t ID, size_t* max_exist = 0) const ;
-      double probabilityBackoff(const LmWordID_t* IDs, size_t numIDs, size_t* max_exist = 0) const ;
-      double probabilityBackoff(NGramHistory* history, size_t numIDs, LmWordID_t ID,
-	 			  size_t* max_exist = 0) const ;
-      void initZerogram(NGramHistory* history) const ;
+   protected:
+      friend class NGramsBuilder ;
+      bool setupArrays(const char* base, size_t len, size_t max_rank_to_use) ;
+      bool locate(const LmWordID_t* IDs, size_t numIDs, uint32_t& index) const ;
+      uint32_t count(size_t rank, uint32_t index) const
+	 { return rank == 1 ? m_unigrams[index].frequency() : m_counts.count(m_ngram_records[rank][index].countID()) ; }
+      bool locateNext(size_t rank, uint32_t index, LmWordID_t ID, uint32_t& next) const ;
+      const LmSmoothingFactors& smoothingFactors(size_t rank, uint32_t index) const
+	 { return m_smoothing_factors[rank][index] ; }
+      double unigramProbability(LmWordID_t ID) const ;
+      double conditionalProbability(size_t rank, uint32_t hist, uint32_t count) const ;
 
-   private:
-      Vocabulary* m_vocab ;			// map from word to ID
-      Vocabulary* m_surfvocab ;			// map adjusting class members
-      Vocabulary* m_stopwords ;			// which words to ignore
-      LmUnigramRecord* m_unigrams ;		// array of unigram records
-      LmNgramRecord** m_ngram_records ;		// arrays for 2..N-grams
-      uint32_t** m_ngram_next ;			// arrays of "next" ptrs
-      uint32_t** m_ngram_disc ;			// arrays of smoothing values
-      size_t* m_record_counts ;			// array of #records per rank
-      LmNgramDiscounts* m_discounts ;		// global discount factors
-      size_t m_maxlength ;			// maximum ngram length in file
-      size_t m_vocabsize ;			// number of distinct words
-      size_t m_numcounts ;			// number of distinct counts
-      uint64_t m_numtokens ;			// training data size
-      LmCountMap* m_counts ;			// countID -> value mapping
-      double m_uniform ;			// uniform 0-gram probability
-      LmCountOfCounts* m_countofcounts ;	//
-      LmCountOfCounts* m_cumcounts ;		// cumulative counts-of-counts
-      FrFileMapping* m_fmap ;			// mmap()ing for file, if any
-      FrLMSmoothing m_smoothing ;		// how to smooth probabilities
-      uint8_t m_affix_sizes ;
-      bool m_case_sensitive ;
-      bool m_char_based ;			// is LM character-based?
-      bool m_include_spaces ;			// char-based LM incl spaces?
-      bool m_OK ;
+   protected:
+      MemMappedFile m_mmap ;			// mmap()ing for file, if any
+      char* m_buffer { nullptr } ;		// file contents if not mmap()ed
+      const NgramFileHeader* m_header { nullptr } ;
+      Vocabulary* m_vocab { nullptr } ;		// map from word to ID
+      const LmUnigramRecord* m_unigrams { nullptr } ;	// array of unigram records
+      const NgramRecord* m_ngram_records[LmMAX_RANK+1] ;	// arrays for 2..N-grams
+      const uint32_t* m_ngram_next[LmMAX_RANK+1] ;		// arrays of "next" ptrs
+      const LmSmoothingFactors* m_smoothing_factors[LmMAX_RANK+1] ;
+      size_t m_record_counts[LmMAX_RANK+1] ;	// array of #records per rank
+      const LmNgramDiscounts* m_discounts { nullptr } ;	// global discount factors
+      const LmCountOfCounts* m_countofcounts { nullptr } ;
+      LmCountMap m_counts ;			// countID -> value mapping
+      size_t m_maxlength { 0 } ;		// maximum ngram length in use
+      size_t m_vocabsize { 0 } ;		// number of distinct words
+      uint64_t m_numtokens { 0 } ;		// training data size
+      double m_uniform { 0.0 } ;		// uniform 0-gram probability
+      double m_zerogram_weight { 1.0 } ;	// interpolation weight of 0-gram
+      LmWordID_t m_begsent { 0 } ;
+      LmWordID_t m_endsent { 0 } ;
+      LmSmoothing m_smoothing { LmSmoothing::Interpolated } ;
+      bool m_OK { false } ;
    } ;
-*/
 
 /************************************************************************/
 /************************************************************************/
 //  this class provides a unified interface to the various different
-//    supported language model file formats
+//    supported language model file formats; currently only the NGrams
+//    file format is implemented
 
-// to update from old FramepaC
 class NGramModel
    {
-   private: // methods
-      LmWordID_t findWordID_SRI(const char* word) const ;
-
-   protected: // methods
-      static bool verifyBWTSignature(const char* filename) ;
-      static bool verifyBBOSignature(const char* filename) ;
-      static bool verifyNGMSignature(const char* filename)
-	 { return LmNGramsFile::verifyFormat(filename) ; }
-      static bool verifySRISignature(const char* filename) ;
-      void init(const char* filename, const char* sourcefile,
-		double weight, double context, double discount,
-		Symbol* smoothing, const char* ident = 0) ;
-      double freq2prob(double freq) const ;
-      double adjustProbability(const char* surf, LmWordID_t ID,
-			       double prob) const ;
-   protected:
-      NGramModel() {}
    public:
-      NGramModel(const class LModelConfig*) ;
-      virtual ~NGramModel() ;
-      static NGramModel* newModel(const char* filename, const char* sourcefile,
-				    size_t max_ngrams, double weight,
-				    double context_weight, double discount,
-				    Symbol* smooth_name, const char* ident,
-				    const List* sequences, const List* fallbacks, bool separate_feature) ;
-      static NGramModel* newModel(const char* filename, size_t max_ngram,
-				    const char* sourcefile, const char* ident, bool separate_feature) ;
-      // note: above method sets smoothing to NONE
-      static NGramModel* newModel(const class LModelConfig*, bool separate_feature) ;
+      virtual ~NGramModel() {}
+      static NGramModel* newModel(const char* filename, size_t max_ngram = ~0, bool allow_mmap = true,
+	 size_t prefetch_rank = 0) ;
 
       // utility functions
-      static bool verifySignature(const char* filename)
-	 { return (verifyBWTSignature(filename) || 
-		   verifyBBOSignature(filename) ||
-		   verifyNGMSignature(filename) ||
-		   verifySRISignature(filename)) ; }
-
-      static const char* remapWord(const char* word, SymHashTable* stem_ht,
-				   bool& is_possessive, bool is_cased = true,
-				   uint8_t affix_sizes = 0, bool* using_affix = 0) ;
-      static double smoothedLog(double x) ;
+      static bool verifySignature(const char* filename) { return verifyNGMSignature(filename) ; }
 
       // accessors
-      bool OK() const
-	 { return (m_index != 0 && m_vocab != 0) ||
-	      (m_ngrams != 0 && m_ngrams->OK() && m_vocab != 0) ||
-	      (m_srilm && m_srivcb) ; }
-      virtual bool isCaseSensitive() const ;
-      virtual bool isCharBased() const ;
-      virtual bool includesSpaces() const ;
-      virtual uint8_t affixSizes() const ;
-      virtual uint64_t trainingSize() const ;
-      size_t modelNumber() const { return m_model_number ; }
-      size_t maxNgramLength() const { return m_max_ngram ; }
-      bool usingLogSpace() const { return m_logspace ; }
-      bool usingJointProb() const { return m_jointprob ; }
-      unsigned featureID() const { return m_featureID ; }
-      LmWordID_t wordID_begsent() const { return m_begsent_id ; }
-      Symbol* word_begsent() const { return m_begsent_sym ; }
-      Symbol* word_endsent() const { return m_endsent_sym ; }
-      FrLMSmoothing smoothing() const { return m_smoothing ; }
-      Symbol* smoothingName() const { return m_smoothing_name ; }
-      double discountMass() const { return m_discount_mass ; }
-      LmWordID_t wordID_unknown() const { return m_unknown_id ; }
-      Symbol* wordForID(LmWordID_t ID) const ;
-      Vocabulary* vocabulary() const { return m_vocab ; }
-      Vocabulary* surfaceVocabulary() const { return m_surfvocab ; }
-      FrBWTIndex* ngramModel() const { return m_index ; }
-      LmNGramsFile* ngramsFile() const { return m_ngrams ; }
-      class Ngram* sriModel() const { return m_srilm ; }
-      class Vocab* sriVocab() const { return m_srivcb ; }
-      NGramModel* sourceModel() const { return m_sourcemodel ; }
-      double weight() const { return  m_weight ; }
-      double baseWeight() const { return m_baseweight ; }
-      double contextWeight() const { return m_contextweight ; }
-      const char* name() const { return m_name ; }
-      const char* sectionName() const { return m_ident ; }
-      const List* sequences() const { return m_sequences ; }
-      const List* fallbacks() const { return m_fallbacks ; }
-      const List* fallbacks(Symbol*) const ;
-      virtual LmWordID_t getUnknownID() const ;
-
-      virtual double rawProbability(size_t numwords, const LmWordID_t* IDs, size_t* max_exist) const ;
-      virtual double rawProbability(size_t numwords, NGramHistory* hist,
-				    LmWordID_t ID, size_t* max_exist) const ;
-
-      static int string2words(const char* string, char**& wordlist) ;
-      LmWordID_t findWordID(const char* word) const ;
-      bool isStopWord(const char* word) const ;
-      size_t longestMatch(const LmWordID_t* IDs, size_t numIDs) const ;
-
-      double rawProbability(const LmWordID_t* IDs, size_t numIDs,
-			    size_t* max_exist = 0,
-			    const char* surf_word = 0) const ;
-      double rawProbability(NGramHistory* history, size_t numIDs,
-			    LmWordID_t ID, size_t* max_exist = 0, const char* surf_word = 0) const ;
-      double probability(const LmWordID_t* IDs, size_t numwords,
-			 size_t* max_exist = 0, const char* surf_word = 0) const ;
-      double probability(NGramHistory* history, size_t numIDs,
-			 LmWordID_t ID, size_t* max_exist, const char* surf_word = 0) const ;
-      double probability(const List* ngram) const ;
-      size_t frequency(const List* words) const ;
-      virtual size_t frequency(const LmWordID_t* IDs, size_t numwords) const ;
-      virtual size_t classSize(LmWordID_t ID) const ;
-      virtual double perplexity(size_t rank) const ;
-      double scaledProbability(double prob) const ;
+      virtual bool OK() const = 0 ;
+      virtual bool isCaseSensitive() const = 0 ;
+      virtual bool isCharBased() const = 0 ;
+      virtual bool includesSpaces() const = 0 ;
+      virtual uint8_t affixSizes() const = 0 ;
+      virtual uint64_t trainingSize() const = 0 ;
+      virtual size_t maxNgramLength() const = 0 ;
+      virtual LmSmoothing smoothing() const = 0 ;
+      virtual LmWordID_t getUnknownID() const = 0 ;
+      virtual LmWordID_t wordID_begsent() const = 0 ;
+      virtual LmWordID_t wordID_endsent() const = 0 ;
+      virtual LmWordID_t findWordID(const char* word) const = 0 ;
+      virtual const char* wordForID(LmWordID_t ID) const = 0 ;
+      virtual size_t classSize(LmWordID_t ID) const = 0 ;
+      virtual size_t frequency(const LmWordID_t* IDs, size_t numwords) const = 0 ;
+      virtual size_t longestMatch(const LmWordID_t* IDs, size_t numwords) const = 0 ;
+
+      virtual double rawProbability(size_t numwords, const LmWordID_t* IDs, size_t* max_exist) const = 0 ;
+      virtual void initHistory(NGramHistory& history, bool sentence_start = true) const = 0 ;
+      virtual double rawProbability(const NGramHistory& history, LmWordID_t ID, NGramHistory* newhist,
+	 size_t* max_exist) const = 0 ;
+
+      // log10 probability of a sentence and of a batch of sentences, the latter scored in parallel
+      virtual double scoreSentence(const LmWordID_t* IDs, size_t numIDs, bool add_markers = true) const ;
+      bool scoreSentences(const LmWordID_t* const* sentences, const size_t* lengths, size_t count,
+	 double* scores, bool add_markers = true) const ;
 
       // manipulators
-      void useLogSpace(bool logsp = true) ;
-      void useJointProb(bool joint = true) { m_jointprob = joint ; }
-      void maxNgramLength(size_t len) ;
-      void setFeatureID(unsigned ID) { m_featureID = ID ; }
-      void setSentMarkers() ;
-      void smoothing(Symbol* smoothing_name) ;
-      void smoothing(FrLMSmoothing sm) ;
-      void modelNumber(size_t N) { m_model_number = N ; }
-      void weight(double wt)
-	 { m_baseweight = (wt >= 0.0 ? wt : 0.0) ;
-	   m_weight = m_baseweight * contextWeight() ; }
-      void contextWeight(double wt)
-	 { m_contextweight = (wt >= 0.0 ? wt : 0.0) ;
-	   m_weight = baseWeight() * m_contextweight ; }
-      void setSequences(const List* sequences, const List* fallbacks) ;
-      bool convertBWTtoNGM(const char* destfile, size_t rank = 4,
-			     size_t precomp_rank = 4) const ;
-
-      // source-cover computation
-      bool accumulateCoverBegin() ;
-      bool accumulateCover(const List* words) ;
-      double accumulatedCoverage() const { return m_sourcecover ; }
-      bool accumulateCoverDone(double total_cover, size_t total_models) ;
-
-      // I/O and debugging
-      bool dump(CFile& out, const char* modelname,
-		  bool run_verbosely = false) const ;
-      void dumpConfig(ostream& out) const ;
+      virtual void smoothing(LmSmoothing sm) = 0 ;
 
    protected:
-      Vocabulary* m_vocab ;		// mapping from word to ID
-      Vocabulary* m_surfvocab ;		// map from surface to adj within class
-      Vocabulary* m_stopwords ;		//
-      LmNGramsFile* m_ngrams ;		// data for .ngm-format model file
-      FrBWTIndex*   m_index ;		// data for .bwt-format model file
-      class Ngram*  m_srilm ;		// SRI-style language model
-      class Vocab*  m_srivcb ;		// vocabulary for SRI-style model
-      NGramModel*   m_sourcemodel ;	// corresponding source-language model
-      Symbol*       m_begsent_sym ;
-      Symbol*       m_endsent_sym ;
-      Symbol*       m_smoothing_name ;
-      char*         m_name ;	 	// friendly name (usu. base filename)
-      char*         m_ident ;		// identifier, used for section name
-      List*         m_sequences ;
-      List*         m_fallbacks ;
-      double        m_baseweight ;     	// default weight of this model
-      double        m_contextweight ;  	// context-dependent weight
-      double        m_weight ;	       	// effective weight
-      double        m_sourcecover ;    	// accumulated source coverage
-      double        m_discount_mass ;
-      size_t        m_max_ngram ;
-      size_t        m_model_number ;
-      LmWordID_t    m_begsent_id ;
-      LmWordID_t    m_unknown_id ;
-      unsigned      m_featureID ;
-      FrLMSmoothing m_smoothing ;
-      bool          m_logspace ;
-      bool          m_jointprob ;
+      NGramModel() {}
+      static bool verifyNGMSignature(const char* filename) { return NGramsFile::verifyFormat(filename) ; }
    } ;
-*/
 
 /************************************************************************/
 /************************************************************************/
@@ -668,26 +610,44 @@ class NGramModel
 class NGramModelNGM : public NGramModel
    {
    public:
-      NGramModelNGM(const char* filename, const char* sourcemodelfile,
-		      size_t max_ngram, double weight, double context_weight,
-		      double discount, Symbol* smooth_name, const char* ident) ;
-      virtual LmWordID_t getUnknownID() const ;
-      virtual double perplexity(size_t rank) const ;
-      virtual size_t classSize(LmWordID_t ID) const ;
-      virtual size_t frequency(const LmWordID_t* IDs, size_t numwords) const ;
-      virtual size_t longestMatch(const LmWordID_t* IDs, size_t numwords) const ;
-      virtual double rawProbability(size_t numwords, const LmWordID_t* IDs, size_t* max_exist) const ;
-      virtual double rawProbability(size_t numwords, NGramHistory* hist,
-				    LmWordID_t ID, size_t* max_exist) const ;
-      virtual bool isCaseSensitive() const ;
-      virtual bool isCharBased() const ;
-      virtual bool includesSpaces() const ;
-      virtual uint8_t affixSizes() const ;
-      virtual uint64_t trainingSize() const ;
-      virtual bool dump(CFile& out, const char* modelname, bool verb) const ;
+      NGramModelNGM(const char* filename, size_t max_ngram = ~0, bool allow_mmap = true,
+	 size_t prefetch_rank = 0) ;
+      virtual ~NGramModelNGM() {}
+
+      const NGramsFile* ngramsFile() const { return &m_ngrams ; }
+
+      virtual bool OK() const { return m_ngrams.OK() ; }
+      virtual bool isCaseSensitive() const { return m_ngrams.isCaseSensitive() ; }
+      virtual bool isCharBased() const { return m_ngrams.isCharBased() ; }
+      virtual bool includesSpaces() const { return m_ngrams.includesSpaces() ; }
+      virtual uint8_t affixSizes() const { return m_ngrams.affixSizes() ; }
+      virtual uint64_t trainingSize() const { return m_ngrams.trainingSize() ; }
+      virtual size_t maxNgramLength() const { return m_ngrams.maxNgramLength() ; }
+      virtual LmSmoothing smoothing() const { return m_ngrams.smoothing() ; }
+      virtual LmWordID_t getUnknownID() const { return m_ngrams.unknownID() ; }
+      virtual LmWordID_t wordID_begsent() const { return m_ngrams.beginSentenceID() ; }
+      virtual LmWordID_t wordID_endsent() const { return m_ngrams.endSentenceID() ; }
+      virtual LmWordID_t findWordID(const char* word) const { return m_ngrams.findWordID(word) ; }
+      virtual const char* wordForID(LmWordID_t ID) const { return m_ngrams.word(ID) ; }
+      virtual size_t classSize(LmWordID_t ID) const { return m_ngrams.classSize(ID) ; }
+      virtual size_t frequency(const LmWordID_t* IDs, size_t numwords) const
+	 { return m_ngrams.frequency(IDs,numwords) ; }
+      virtual size_t longestMatch(const LmWordID_t* IDs, size_t numwords) const
+	 { return m_ngrams.longestMatch(IDs,numwords) ; }
+      virtual double rawProbability(size_t numwords, const LmWordID_t* IDs, size_t* max_exist) const
+	 { return m_ngrams.probability(IDs,numwords,max_exist) ; }
+      virtual void initHistory(NGramHistory& history, bool sentence_start = true) const
+	 { m_ngrams.initHistory(history,sentence_start) ; }
+      virtual double rawProbability(const NGramHistory& history, LmWordID_t ID, NGramHistory* newhist,
+	 size_t* max_exist) const
+	 { return m_ngrams.probability(history,ID,newhist,max_exist) ; }
+      virtual double scoreSentence(const LmWordID_t* IDs, size_t numIDs, bool add_markers = true) const
+	 { return m_ngrams.scoreSentence(IDs,numIDs,add_markers) ; }
+
+      virtual void smoothing(LmSmoothing sm) { m_ngrams.smoothing(sm) ; }
 
    private:
-      void initNGM(const char* filename, size_t max_ngram) ;
+      NGramsFile m_ngrams ;
    } ;
 
 /************************************************************************/
@@ -698,4 +658,3 @@ class NGramModelNGM : public NGramModel
 #endif /* !__Fr_NGRAMS_H_INCLUDED */
 
 // end of file ngrams.h //
-
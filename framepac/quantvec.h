@@ -0,0 +1,180 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.15, last edit 2019-08-26					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+
+#ifndef _Fr_QUANTVEC_H_INCLUDED
+#define _Fr_QUANTVEC_H_INCLUDED
+
+#include <cstdlib>
+#include "framepac/annindex.h"
+#include "framepac/array.h"
+#include "framepac/simd.h"
+#include "framepac/vectorcoll.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/************************************************************************/
+
+enum class QuantizationType
+   {
+   int8,			// signed bytes with a per-vector scale factor
+   float16,			// IEEE half precision
+   bfloat16,			// top 16 bits of an IEEE single
+   binary			// one sign bit per element
+   } ;
+
+enum class QuantizedMeasure
+   {
+   dot,				// inner product
+   cosine,
+   euclidean			// reported as 1 - distance, like the Euclidean VectorMeasure
+   } ;
+
+/************************************************************************/
+/*	Declarations for template class QuantizedVectors		*/
+/************************************************************************/
+
+// A reduced-precision copy of a set of vectors for approximate similarity search, when memory
+//   bandwidth rather than arithmetic limits the speed of brute-force comparisons.  Every vector is
+//   expanded to a dense row of dimensions() elements and stored in one of the QuantizationTypes,
+//   each row padded to a multiple of 64 bytes.  The int8 format uses a per-vector scale factor
+//   chosen to map the element of largest magnitude to +/-127; the float16 and bfloat16 formats
+//   round each element to nearest; the binary format keeps only the sign of each element, along
+//   with the vector's original length, and estimates the angle between two vectors from the
+//   fraction of differing bits, which is a coarse approximation suitable mainly for choosing
+//   candidates to be rescored.
+//
+// Queries are quantized the same way as the stored vectors (see encode()), and all comparisons are
+//   made between quantized values using the SIMD kernels from simd.h.  nearest() can rescore its
+//   best approximate candidates against the full-precision source vectors with an exact measure.
+//   As with VectorCollection, the source Array must outlive the quantized copy.
+
+template <typename IdxT, typename ValT>
+class QuantizedVectors
+   {
+   public:
+      typedef Vector<IdxT,ValT> vec_type ;
+      static constexpr size_t ROW_ALIGN = 64 ;
+
+      // a vector quantized for comparison against the rows of a particular QuantizedVectors
+      class Query
+	 {
+	 public:
+	    Query() {}
+	    Query(const Query&) = delete ;
+	    ~Query() { ::free(m_codes) ; }
+	    Query& operator= (const Query&) = delete ;
+
+	    explicit operator bool () const { return m_codes != nullptr ; }
+
+	 protected:
+	    friend class QuantizedVectors ;
+	    uint8_t* m_codes { nullptr } ;
+	    size_t   m_capacity { 0 } ;
+	    float    m_scale { 1.0f } ;
+	    float    m_norm { 0.0f } ;
+	 } ;
+
+   public:
+      QuantizedVectors(QuantizationType type = QuantizationType::int8) : m_type(type) {}
+      QuantizedVectors(const Array* vectors, QuantizationType type) : m_type(type) { load(vectors) ; }
+      QuantizedVectors(const VectorCollection<IdxT,ValT>& coll, QuantizationType type) : m_type(type)
+	 { load(coll) ; }
+      QuantizedVectors(const QuantizedVectors&) = delete ;
+      ~QuantizedVectors() { clear() ; }
+      QuantizedVectors& operator= (const QuantizedVectors&) = delete ;
+
+      // quantize the given vectors; entries of the array which are not vectors become empty rows
+      //   which are never returned by nearest()
+      bool load(const Array* vectors) ;
+      // quantize the rows of a collection, whose source (if any) becomes our source
+      bool load(const VectorCollection<IdxT,ValT>& coll) ;
+      void clear() ;
+
+      QuantizationType type() const { return m_type ; }
+      size_t size() const { return m_size ; }
+      size_t dimensions() const { return m_dims ; }
+      size_t rowBytes() const { return m_stride ; }
+      const Array* source() const { return m_source ; }
+      const vec_type* vector(size_t N) const
+	 { return m_source ? static_cast<const vec_type*>(m_source->getNth(N)) : nullptr ; }
+      bool present(size_t N) const { return m_norms[N] >= 0.0f ; }
+      // number of bytes of quantized and per-vector storage
+      size_t memoryUsage() const { return m_size * (m_stride + 2 * sizeof(float)) ; }
+
+      // quantize a vector for comparisons; elements past dimensions() are ignored
+      bool encode(const vec_type* vector, Query& query) const ;
+
+      // approximate similarity between the query and row N (0 for rows which were not vectors)
+      double similarity(const Query& query, size_t N, QuantizedMeasure measure) const ;
+      // out[k] = similarity(query,first+k) for first+k < last, on the calling thread
+      bool similarities(const Query& query, QuantizedMeasure measure, size_t first, size_t last, double* out) const ;
+
+      // find the k rows most similar to the query, sorted by decreasing similarity, and return the
+      //   number of results (fewer than k if there are fewer rows).  If 'exact' is given, the best
+      //   'candidates' rows by approximate similarity (default 4*k) are rescored with it against
+      //   the source vectors, and the results report the exact similarities; otherwise (or if there
+      //   is no source) they report the approximate similarities.
+      size_t nearest(const vec_type* query, size_t k, ANNResult* results, QuantizedMeasure measure,
+	 const VectorMeasure<IdxT,ValT>* exact = nullptr, size_t candidates = 0) const ;
+
+      explicit operator bool () const { return m_codes != nullptr ; }
+
+   protected:
+      bool allocate(size_t rows, size_t dims) ;
+      const uint8_t* row(size_t N) const { return m_codes + N * m_stride ; }
+      // quantize m_dims dense values into 'codes', returning the scale factor and the length of the
+      //   quantized vector (or of the original, for the binary format)
+      void quantize(const float* values, uint8_t* codes, float& scale, float& norm) const ;
+      template <typename T>
+      void half_similarities(const T* query, QuantizedMeasure measure, double qnorm, size_t first, size_t last,
+	 double* out) const ;
+
+   protected:
+      const Array*     m_source { nullptr } ;
+      uint8_t*         m_codes { nullptr } ;
+      float*           m_scales { nullptr } ;
+      float*           m_norms { nullptr } ;	// length of each quantized row, or -1 for rows which were not vectors
+      double*          m_cosines { nullptr } ;	// binary only: estimated cosine by number of differing bits
+      size_t           m_size { 0 } ;
+      size_t           m_dims { 0 } ;
+      size_t           m_stride { 0 } ;		// bytes per row including padding
+      QuantizationType m_type ;
+   } ;
+
+// keep linker happy on debug builds:
+template <typename IdxT, typename ValT>
+constexpr size_t QuantizedVectors<IdxT,ValT>::ROW_ALIGN ;
+
+/************************************************************************/
+/************************************************************************/
+
+extern template class QuantizedVectors<uint32_t,uint32_t> ;
+extern template class QuantizedVectors<uint32_t,float> ;
+extern template class QuantizedVectors<uint32_t,double> ;
+
+} // end namespace Fr
+
+#endif /* !_Fr_QUANTVEC_H_INCLUDED */
+
+// end of file quantvec.h //
@@ -0,0 +1,259 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-07					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#ifndef _Fr_SIMD_H_INCLUDED
+#define _Fr_SIMD_H_INCLUDED
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/************************************************************************/
+/*	Vectorized kernels over dense arrays of values			*/
+/************************************************************************/
+
+// The float and double kernels are compiled in scalar, SSE4.2, AVX2, and AVX-512 versions, and
+//   the best version supported by the CPU is selected on first use.  Other element types fall
+//   back to the scalar templates at the end of this file.  All sums are returned as double, but
+//   the float kernels accumulate in single precision, so results may differ from the scalar
+//   versions by rounding error.  There are also kernels for the reduced-precision formats used by
+//   quantized vectors: signed bytes, IEEE half-precision and bfloat16 values (which are widened to
+//   float and accumulated in single precision), and packed bits.
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Reduced-precision floating-point element types			*/
+/************************************************************************/
+
+// IEEE 754 binary16: 1 sign bit, 5 exponent bits, 10 mantissa bits.  Conversion from float rounds to
+//   nearest-even; values too large for the format become infinities.
+
+class Float16
+   {
+   public:
+      Float16() = default ;
+      Float16(float value) : m_bits(fromFloat(value)) {}
+      operator float () const { return toFloat(m_bits) ; }
+
+      uint16_t bits() const { return m_bits ; }
+
+      static uint16_t fromFloat(float value)
+	 {
+	 uint32_t x ;
+	 memcpy(&x,&value,sizeof(x)) ;
+	 uint16_t sign = (uint16_t)((x >> 16) & 0x8000) ;
+	 uint32_t mag = x & 0x7FFFFFFF ;
+	 if (mag >= 0x7F800000)			// infinity or NaN
+	    return sign | 0x7C00 | (mag > 0x7F800000 ? 0x0200 : 0) ;
+	 if (mag >= 0x477FF000)			// rounds to 65520 or more
+	    return sign | 0x7C00 ;
+	 if (mag < 0x38800000)			// subnormal half (or zero)
+	    {
+	    float a ;
+	    memcpy(&a,&mag,sizeof(a)) ;
+	    // scale so that the half's smallest subnormal becomes 1.0 and round to an integer;
+	    //   rounding up to 0x400 correctly yields the smallest normal value
+	    return sign | (uint16_t)std::nearbyint(a * 16777216.0f) ;
+	    }
+	 // rebias the exponent from 127 to 15 and round off the low 13 mantissa bits; a carry out of the
+	 //   mantissa correctly increments the exponent
+	 mag += 0xC8000FFF + ((mag >> 13) & 1) ;
+	 return sign | (uint16_t)(mag >> 13) ;
+	 }
+      static float toFloat(uint16_t h)
+	 {
+	 uint32_t sign = (uint32_t)(h & 0x8000) << 16 ;
+	 uint32_t mag = h & 0x7FFF ;
+	 uint32_t x ;
+	 if (mag >= 0x7C00)
+	    x = sign | 0x7F800000 | ((mag & 0x3FF) << 13) ;
+	 else
+	    {
+	    // shifting puts the exponent and mantissa in place, and multiplying by 2**112 rebiases the
+	    //   exponent (and normalizes subnormals)
+	    uint32_t shifted = mag << 13 ;
+	    float f ;
+	    memcpy(&f,&shifted,sizeof(f)) ;
+	    f *= 5.192296858534828e33f ;
+	    memcpy(&x,&f,sizeof(x)) ;
+	    x |= sign ;
+	    }
+	 float value ;
+	 memcpy(&value,&x,sizeof(value)) ;
+	 return value ;
+	 }
+
+   protected:
+      uint16_t m_bits ;
+   } ;
+
+//----------------------------------------------------------------------------
+// "brain" floating point: the top half of an IEEE single, with the same range but only 8 bits of
+//   mantissa.  Conversion from float rounds to nearest-even.
+
+class BFloat16
+   {
+   public:
+      BFloat16() = default ;
+      BFloat16(float value) : m_bits(fromFloat(value)) {}
+      operator float () const { return toFloat(m_bits) ; }
+
+      uint16_t bits() const { return m_bits ; }
+
+      static uint16_t fromFloat(float value)
+	 {
+	 uint32_t x ;
+	 memcpy(&x,&value,sizeof(x)) ;
+	 if ((x & 0x7FFFFFFF) > 0x7F800000)
+	    return (uint16_t)((x >> 16) | 0x0040) ;	// keep NaNs quiet
+	 x += 0x7FFF + ((x >> 16) & 1) ;
+	 return (uint16_t)(x >> 16) ;
+	 }
+      static float toFloat(uint16_t b)
+	 {
+	 uint32_t x = (uint32_t)b << 16 ;
+	 float value ;
+	 memcpy(&value,&x,sizeof(value)) ;
+	 return value ;
+	 }
+
+   protected:
+      uint16_t m_bits ;
+   } ;
+
+/************************************************************************/
+/*	Vectorized kernels						*/
+/************************************************************************/
+
+enum class SimdLevel
+   {
+   scalar,
+   sse42,
+   avx2,
+   avx512
+   } ;
+
+SimdLevel simd_supported() ;		// best level available on this CPU
+SimdLevel simd_level() ;		// level currently in use
+bool simd_level(SimdLevel level) ;	// force a (lower) level, e.g. for testing; false if unsupported
+const char* simd_level_name(SimdLevel level) ;
+
+// sum(x[i]*y[i])
+double simd_dot_product(const float* x, const float* y, size_t n) ;
+double simd_dot_product(const double* x, const double* y, size_t n) ;
+// sum((x[i]-y[i])^2)
+double simd_squared_distance(const float* x, const float* y, size_t n) ;
+double simd_squared_distance(const double* x, const double* y, size_t n) ;
+// sum(|s1*x[i] - s2*y[i]|)
+double simd_abs_difference(const float* x, const float* y, size_t n, double s1 = 1.0, double s2 = 1.0) ;
+double simd_abs_difference(const double* x, const double* y, size_t n, double s1 = 1.0, double s2 = 1.0) ;
+// sum(min(s1*x[i],s2*y[i]))
+double simd_min_sum(const float* x, const float* y, size_t n, double s1 = 1.0, double s2 = 1.0) ;
+double simd_min_sum(const double* x, const double* y, size_t n, double s1 = 1.0, double s2 = 1.0) ;
+// sum(x[i])
+double simd_sum(const float* x, size_t n) ;
+double simd_sum(const double* x, size_t n) ;
+// sum(x[i]^2)
+double simd_sum_of_squares(const float* x, size_t n) ;
+double simd_sum_of_squares(const double* x, size_t n) ;
+
+// reduced-precision versions; the byte version is computed exactly in integer arithmetic
+int64_t simd_dot_product(const int8_t* x, const int8_t* y, size_t n) ;
+double simd_dot_product(const Float16* x, const Float16* y, size_t n) ;
+double simd_dot_product(const BFloat16* x, const BFloat16* y, size_t n) ;
+double simd_squared_distance(const Float16* x, const Float16* y, size_t n) ;
+double simd_squared_distance(const BFloat16* x, const BFloat16* y, size_t n) ;
+// number of differing bits in two arrays of 'nwords' 64-bit words
+size_t simd_hamming_distance(const uint64_t* x, const uint64_t* y, size_t nwords) ;
+// number of bits set in both of two arrays of 'nwords' 64-bit words
+size_t simd_and_popcount(const uint64_t* x, const uint64_t* y, size_t nwords) ;
+// counts[k] = simd_and_popcount(x,rows+k*stride,nwords) for k < count
+void simd_and_popcounts(const uint64_t* x, const uint64_t* rows, size_t stride, size_t count, size_t nwords,
+   size_t* counts) ;
+
+//----------------------------------------------------------------------------
+// generic versions for other element types
+
+template <typename T>
+double simd_dot_product(const T* x, const T* y, size_t n)
+{
+   double sum(0) ;
+   for (size_t i = 0 ; i < n ; ++i)
+      sum += (double)x[i] * (double)y[i] ;
+   return sum ;
+}
+
+template <typename T>
+double simd_squared_distance(const T* x, const T* y, size_t n)
+{
+   double sum(0) ;
+   for (size_t i = 0 ; i < n ; ++i)
+      {
+      double diff = (double)x[i] - (double)y[i] ;
+      sum += diff * diff ;
+      }
+   return sum ;
+}
+
+template <typename T>
+double simd_abs_difference(const T* x, const T* y, size_t n, double s1 = 1.0, double s2 = 1.0)
+{
+   double sum(0) ;
+   for (size_t i = 0 ; i < n ; ++i)
+      sum += std::fabs(s1 * x[i] - s2 * y[i]) ;
+   return sum ;
+}
+
+template <typename T>
+double simd_min_sum(const T* x, const T* y, size_t n, double s1 = 1.0, double s2 = 1.0)
+{
+   double sum(0) ;
+   for (size_t i = 0 ; i < n ; ++i)
+      sum += std::fmin(s1 * x[i], s2 * y[i]) ;
+   return sum ;
+}
+
+template <typename T>
+double simd_sum(const T* x, size_t n)
+{
+   double sum(0) ;
+   for (size_t i = 0 ; i < n ; ++i)
+      sum += x[i] ;
+   return sum ;
+}
+
+template <typename T>
+double simd_sum_of_squares(const T* x, size_t n)
+{
+   double sum(0) ;
+   for (size_t i = 0 ; i < n ; ++i)
+      sum += (double)x[i] * (double)x[i] ;
+   return sum ;
+}
+
+} // end namespace Fr
+
+#endif /* !_Fr_SIMD_H_INCLUDED */
+
+// end of file simd.h //
@@ -58,6 +58,7 @@ class SuffixArray
 	    if (!m_external_ids)
 	       delete[] m_ids ;
 	    }
+	 freeLCP() ;
 	 m_ids = nullptr ;
 	 m_index = nullptr ;
 	 m_freq = nullptr ;
@@ -79,11 +80,20 @@ class SuffixArray
 
       IdxT indexSize() const { return m_numids ; }
       IdT vocabSize() const { return  m_types ; }
+      IdT newlineID() const { return m_newline ; }
       IdT idAt(IdxT N) const { return (N < m_numids) ? m_ids[N] : ErrorID ; }
       IdxT indexAt(IdxT N) const { return m_index[N] ; }
       IdxT getFreq(IdT N) const { return (m_freq && N < m_types) ? m_freq[N] : (IdxT)0 ; }
       bool lookup(const IdT* key, unsigned keylen, IdxT& first_match, IdxT& last_match) const ;
 
+      // the longest-common-prefix array accelerates lookup() and enumerate(); it must be built while
+      //   the IDs from which the index was generated are still in place
+      bool computeLCP() ;
+      void freeLCP() ;
+      bool haveLCP() const { return m_lcp != nullptr ; }
+      // length of the common prefix of the suffixes at index positions N-1 and N
+      IdxT lcpAt(IdxT N) const ;
+
       bool enumerate(Range<IdxT> positions, Range<unsigned> lengths,
 	 const std::function<EnumFunc>& fn, const std::function<FilterFunc>& filter) const ;
       bool enumerateSegment(Range<IdxT> positions, size_t offset, Range<IdT> IDs, Range<unsigned> lengths,
@@ -97,6 +107,8 @@ class SuffixArray
 
       void setSentinel(IdT sent) { m_sentinel = sent ; }
       void setFreqTable(IdxT* freq, bool external = true) { m_freq = freq ; m_external_freq = external ; }
+      // trade some construction speed for a peak memory use of not much more than the finished index
+      void setLowMemory(bool lowmem = true) { m_lowmem = lowmem ; }
 
    protected:
       struct Job
@@ -123,24 +135,40 @@ class SuffixArray
 	       {}
 	 } ;
 
+      // exact common-prefix length for an LCP array entry too large to store in a byte
+      struct LCPOverflow
+	 {
+	    IdxT pos ;
+	    IdxT len ;
+	 } ;
+
    protected:
       template <typename I>
-      bool Create(const I* ids, IdxT* index, IdxT num_ids, IdT num_types, const IdxT* freqs = nullptr) ;
+      bool Create(const I* ids, IdxT* index, IdxT num_ids, IdxT num_types, const IdxT* freqs = nullptr,
+		  IdxT* workspace = nullptr, size_t workspace_size = 0) ;
+      template <typename I>
+      IdxT convertEOL(I id, IdxT num_types) const ;
+      template <typename I>
+      void bucketBoundaries(IdxT* buckets, const I* ids, IdxT num_ids, IdxT num_types, const IdxT* freqs,
+			    bool bucket_ends) ;
       template <typename I>
-      IdT convertEOL(I id, IdT num_types) const ;
+      void classifyLS(BitVector& ls_types, const I* ids, IdxT num_ids, IdxT num_types) ;
       template <typename I>
-      IdxT* bucketBoundaries(const I* ids, IdxT num_ids, IdT num_types, const IdxT* freqs) ;
-      static IdxT* copyBucketBoundaries(const IdxT* bounds, IdT num_types) ;
+      void induce(const I* ids, IdxT* SA, IdxT num_ids, IdxT num_types, IdxT* buckets, IdxT* bucket_ends,
+		  const IdxT* freqs, const BitVector& ls_types) ;
       template <typename I>
-      void classifyLS(BitVector& ls_types, const I* ids, IdxT num_ids, IdT num_types) ;
+      void induceParallel(const I* ids, IdxT* SA, IdxT num_ids, IdxT num_types, IdxT* buckets,
+			  IdxT* bucket_ends, const IdxT* freqs, const BitVector& ls_types) ;
       template <typename I>
-      void induce(const I* ids, IdxT* SA, IdxT num_ids, IdT num_types, IdxT* buckets,
-	          const BitVector& ls_types) ;
+      IdxT nameSubstrings(const I* ids, IdxT* index, IdxT subsize, IdxT num_types, const BitVector& ls_types) ;
 
       static int compare(IdT, IdT) ;
       int compare(const IdT*, const IdT*, unsigned keylen) const ;
       int compareAt(IdxT, IdxT, unsigned keylen) const ;
       int compareAt(IdxT, const IdT*, unsigned keylen) const ;
+      int compareLCP(size_t mid, const IdT* key, unsigned keylen, unsigned lcp_lo, unsigned lcp_hi,
+		     unsigned& matched) const ;
+      unsigned buildLCPLR(size_t lo, size_t hi) ;
 
       static void enumerate_segment(const void* in, void* out) ;
 
@@ -157,6 +185,12 @@ class SuffixArray
       bool       m_external_ids { true } ;
       bool       m_external_freq { false } ;
       bool	 m_readonly { false } ;
+      bool	 m_lowmem { false } ;
+      bool	 m_lcp_alloc { false } ;	// we allocated the LCP arrays and must free them
+      uint8_t*	 m_lcp { nullptr } ;		// common-prefix length with preceding suffix, saturating
+      uint8_t*	 m_lcp_lr { nullptr } ;		// common-prefix lengths with the binary-search bounds
+      LCPOverflow* m_lcp_overflow { nullptr } ;	// exact values of saturated m_lcp entries, by position
+      IdxT	 m_lcp_overflows { 0 } ;
 
       // magic values for serializing
       static constexpr auto signature = "\x7FSufArray" ;
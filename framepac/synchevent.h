@@ -165,6 +165,7 @@ class SynchEventCountdown
       ~SynchEventCountdown() { consumeAll() ; }
 
       void init(int count) { m_counter = (count << 1) ; }
+      void add(int count = 1) { m_counter += (count << 1) ; }
       bool isDone() const { return m_counter <= 1 ; }
       int countRemaining() const { return m_counter >> 1 ; }
       void clear() { m_counter = 0 ; }
@@ -192,6 +193,7 @@ class SynchEventCountdown
 
 #ifdef __linux__
       void init(int count) { m_futex_val.store(count << 1) ; }
+      void add(int count = 1) { m_futex_val += (count << 1) ; }
       bool isDone() const { return m_futex_val.load() <= 1 ; }
       int countRemaining() const { return m_futex_val.load() >> 1 ; }
       void clear() { m_futex_val.store(0) ; }
@@ -24,8 +24,10 @@
 
 #include <stdarg.h>
 #include <thread>
+#include <type_traits>
 #include "framepac/atomic.h"
 #include "framepac/critsect.h"
+#include "framepac/range.h"
 #include "framepac/semaphore.h"
 #include "framepac/synchevent.h"
 
@@ -44,6 +46,122 @@ typedef bool ThreadPoolMapFunc(size_t index, va_list args) ;
 class WorkOrder ;
 class WorkBatch  ;
 class WorkQueue ;
+class WorkDeque ;
+
+class ThreadPool ;
+
+/************************************************************************/
+/************************************************************************/
+
+// hands out successive chunks of an index range to the threads participating in a parallel_for or
+//   parallel_reduce.  Chunks start at a fraction of the remaining range and shrink as the loop
+//   proceeds (guided self-scheduling), so that there are few claims while much work remains but
+//   stragglers at the end are short; no chunk is smaller than the grain size.
+
+template <typename IdxT>
+class ParallelLoop
+   {
+   public:
+      ParallelLoop(Range<IdxT> range, size_t grain, unsigned participants)
+	 : m_next(range.first()), m_last(range.last()), m_grain(grain ? grain : 1),
+	   m_divisor(participants ? 2*participants : 2)
+	 {}
+      ParallelLoop(const ParallelLoop&) = delete ;
+      ~ParallelLoop() {}
+      ParallelLoop& operator= (const ParallelLoop&) = delete ;
+
+      bool failed() const { return m_failed.load() ; }
+
+      bool nextChunk(Range<IdxT>& chunk)
+	 {
+	    IdxT first = m_next.load_relax() ;
+	    for ( ; ; )
+	       {
+	       if (first >= m_last)
+		  return false ;
+	       size_t remaining = m_last - first ;
+	       size_t size = remaining / m_divisor ;
+	       if (size < m_grain) size = m_grain ;
+	       if (size > remaining) size = remaining ;
+	       IdxT last = first + size ;
+	       if (m_next.compare_exchange_weak(first,last))
+		  {
+		  chunk = Range<IdxT>(first,last) ;
+		  return true ;
+		  }
+	       }
+	 }
+      void stop()
+	 {
+	    m_failed.store(true) ;
+	    m_next.store(m_last) ;
+	 }
+
+   private:
+      // every participant updates m_next, so keep it on its own cache line
+      alignas(std::hardware_destructive_interference_size) Atomic<IdxT> m_next ;
+      alignas(std::hardware_destructive_interference_size) IdxT m_last ;
+      size_t       m_grain ;
+      size_t       m_divisor ;
+      Atomic<bool> m_failed { false } ;
+   } ;
+
+//----------------------------------------------------------------------------
+
+// invoke a loop body which may return either void or bool, returning false only if the body did
+
+template <typename Fn, typename ArgT>
+inline typename std::enable_if<std::is_void<typename std::result_of<Fn&(ArgT)>::type>::value,bool>::type
+invoke_loop_body(Fn& fn, ArgT arg)
+{
+   fn(arg) ;
+   return true ;
+}
+
+template <typename Fn, typename ArgT>
+inline typename std::enable_if<!std::is_void<typename std::result_of<Fn&(ArgT)>::type>::value,bool>::type
+invoke_loop_body(Fn& fn, ArgT arg)
+{
+   return static_cast<bool>(fn(arg)) ;
+}
+
+/************************************************************************/
+/************************************************************************/
+
+// a set of jobs which can be waited on as a unit, independently of any other work in the pool.
+//   Jobs may be added from inside worker functions (including jobs belonging to the same group,
+//   for divide-and-conquer algorithms), and a thread waiting on the group helps execute pending
+//   work rather than simply blocking.
+
+class TaskGroup
+   {
+   public:
+      TaskGroup(ThreadPool* pool = nullptr) ;
+      TaskGroup(const TaskGroup&) = delete ;
+      ~TaskGroup() { wait() ; }
+      TaskGroup& operator= (const TaskGroup&) = delete ;
+
+      // accessors
+      ThreadPool* pool() const { return m_pool ; }
+      size_t pending() const { return m_pending.countRemaining() ; }
+      bool done() const { return m_pending.isDone() ; }
+
+      // manipulators
+      bool spawn(ThreadPoolWorkFunc* fn, const void* input, void* output) ;
+      bool spawn(ThreadPoolWorkFunc* fn, void* in_out) { return spawn(fn,in_out,in_out) ; }
+
+      // synchronization
+      void wait() ;
+
+      // functions called by the thread pool
+      void jobAdded() { m_pending.add() ; }
+      void jobFinished() { m_pending.consume() ; }
+      void waitForJobs() { m_pending.wait() ; }
+
+   private:
+      ThreadPool*	  m_pool ;
+      SynchEventCountdown m_pending ;
+   } ;
 
 /************************************************************************/
 /************************************************************************/
@@ -59,17 +177,17 @@ class ThreadPool
       // accessors
       unsigned numThreads() const { return m_numthreads ; }
       unsigned activeThreads() const { return m_activethreads ; }
-      unsigned idleThreads() const ;  //TODO
+      unsigned idleThreads() const ;
 
       static ThreadPool* defaultPool() ;
 
       // manipulators
-      bool dispatch(ThreadPoolWorkFunc* fn, const void* input, void* output) ;
+      bool dispatch(ThreadPoolWorkFunc* fn, const void* input, void* output, TaskGroup* group = nullptr) ;
       bool dispatch(ThreadPoolWorkFunc* fn, void* in_out)
 	 { return dispatch(fn, in_out, in_out) ; }
 
-      // limitation: no other threads are allowed to dispatch jobs until dispatchBatch() returns; that
-      //   especially includes worker functions dispatching additional work
+      // limitation: no other non-worker threads are allowed to dispatch jobs until dispatchBatch()
+      //   returns; when called from a worker function, the jobs are dispatched individually
       template <typename InT, typename OutT>
       bool dispatchBatch(ThreadPoolWorkFunc* fn, size_t count, const InT* input, OutT* output)
 	 { return dispatchBatch(fn,count,sizeof(InT),input,sizeof(OutT),output) ; }
@@ -79,7 +197,8 @@ class ThreadPool
 
       // simplified interface for map/reduce applications
       //   we use void* and va_list to avoid bloating the object code; the worker function needs to
-      //   cast appropriately
+      //   cast appropriately.  Only the items of this call are waited for, so it may be invoked
+      //   concurrently by multiple threads, including from inside worker functions
       bool parallelize(ThreadPoolMapFunc* fn, size_t num_items, va_list args) ;
       bool parallelize(ThreadPoolMapFunc* fn, size_t num_items, ...)
 	 {
@@ -90,6 +209,20 @@ class ThreadPool
 	    return status ;
 	 }
 
+      // type-safe data-parallel loops.  The calling thread and up to one job per worker claim
+      //   chunks of the index range until it is exhausted; the body may return void or bool, and a
+      //   return of false stops the loop early and makes the call return false.  Neither function
+      //   allocates any memory, and like parallelize() they may be called from inside worker functions.
+      template <typename IdxT, typename Fn>
+      bool parallel_for(Range<IdxT> range, size_t grain, Fn fn) ;
+      template <typename IdxT, typename Fn>
+      bool parallel_for_chunks(Range<IdxT> range, size_t grain, Fn fn) ; // fn is invoked on a Range<IdxT>
+      // map each index in the range to a value and combine them (combine must be associative and
+      //   commutative); each participating thread folds its values into a private partial result,
+      //   and the partials are merged as the threads finish
+      template <typename IdxT, typename T, typename MapFn, typename CombineFn>
+      T parallel_reduce(Range<IdxT> range, T identity, MapFn map, CombineFn combine, size_t grain = 1) ;
+
       static void defaultPool(ThreadPool*) ;
       static void defaultPool(size_t numthreads) { defaultPool(new ThreadPool(numthreads)) ; }
 
@@ -97,14 +230,21 @@ class ThreadPool
       void unlimitThreads() { limitThreads(m_numthreads) ; }
 
       // status
-      bool idle() const ;  //TODO
+      bool idle() const ;
+
+      // work-stealing statistics, summed over all worker threads
+      size_t stealAttempts() const ;
+      size_t successfulSteals() const ;
+      size_t timesParked() const ;
 
       // synchronization
-      void waitUntilIdle() ;
+      void waitUntilIdle() ;		// must not be called from a worker function; use TaskGroup
+      void helpUntilDone(TaskGroup* group) ;
 
       // functions called by worker threads
       WorkOrder* nextOrder(unsigned index) ;
-      WorkOrder* makeWorkOrder(ThreadPoolWorkFunc* fn, const void* in, void* out) ;
+      WorkOrder* makeWorkOrder(ThreadPoolWorkFunc* fn, const void* in, void* out, TaskGroup* group = nullptr) ;
+      void runOrder(WorkOrder*) ;
       void recycle(WorkOrder*) ;
       void threadExiting(unsigned index) ;
       void ack(unsigned index) ;
@@ -112,25 +252,195 @@ class ThreadPool
    protected:
       void allocateWorkOrders() ;
       void discardRecycledOrders() ;
+      bool pushOrder(WorkOrder* order) ;
+      WorkOrder* localOrder(unsigned index) ;
+      WorkOrder* stealOrder(unsigned index, bool exhaustive = false) ;
+      void wakeIdleWorker() ;
+      void spaceAvailable() ;
+      void waitForSpace(unsigned& loop_count, unsigned queue_index) ;
+      static bool backoff(unsigned& loop_count) ;
       bool dispatchBatch(ThreadPoolWorkFunc* fn, size_t count, size_t insize, const void* input,
 			 size_t outsize, void* output) ;
+      unsigned loopHelpers(size_t count, size_t grain) const ;
+      template <typename IdxT, typename Fn>
+      static void run_loop(ParallelLoop<IdxT>& loop, Fn& fn) ;
+      template <typename IdxT, typename Fn>
+      static void loop_worker(const void* loop, void* fn) ;
+      template <typename IdxT, typename T, typename MapFn, typename CombineFn>
+      struct ReduceJob ;
+      template <typename IdxT, typename T, typename MapFn, typename CombineFn>
+      static void reduce_worker(const void* loop, void* job) ;
 
    private:
       static ThreadPool* s_defaultpool ;
       unsigned   m_numthreads ;		// total number of worker threads
       unsigned   m_activethreads ;	// number of worker threads to be given jobs
       unsigned   m_numCPUs { 0 } ;	// hardware threads, used to limit work-stealing scan
-      unsigned	 m_prev_thread { 0 } ;	// next thread to which to try to assign a request
       WorkQueue* m_queues { nullptr } ;	// work queues, one per worker thread
+      WorkDeque* m_deques { nullptr } ;	// per-worker deques for work dispatched by the workers themselves
       WorkBatch* m_batches { nullptr } ;
       WorkOrder* m_freeorders { nullptr } ;
       CriticalSection m_flguard ;	// critical section for guarding the work-order freelist
       SynchEventCountdown m_ack ;
+      SynchEventCounted m_space ;	// signalled when a full work queue has space again
+      atom_uint  m_idle { 0 } ;		// number of worker threads currently parked
+      atom_uint  m_blocked { 0 } ;	// number of dispatchers parked waiting for space in a queue
 #ifndef FrSINGLE_THREADED
       thread**   m_pool { nullptr } ;	// the actual thread objects
 #endif /* !FrSINGLE_THREADED */
    } ;
 
+/************************************************************************/
+/*	Template member functions of class ThreadPool			*/
+/************************************************************************/
+
+inline unsigned ThreadPool::loopHelpers(size_t count, size_t grain) const
+{
+   // the calling thread takes part in the loop, so we need at most one job per worker thread, and
+   //   none at all if the range holds only a single chunk
+   size_t chunks = (count + grain - 1) / grain ;
+   size_t helpers = activeThreads() ;
+   if (helpers >= chunks)
+      helpers = chunks - 1 ;
+   return (unsigned)helpers ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename Fn>
+void ThreadPool::run_loop(ParallelLoop<IdxT>& loop, Fn& fn)
+{
+   Range<IdxT> chunk ;
+   while (loop.nextChunk(chunk))
+      {
+      if (!invoke_loop_body(fn,chunk))
+	 {
+	 loop.stop() ;
+	 break ;
+	 }
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename Fn>
+void ThreadPool::loop_worker(const void* loop, void* fn)
+{
+   auto l = const_cast<ParallelLoop<IdxT>*>(reinterpret_cast<const ParallelLoop<IdxT>*>(loop)) ;
+   run_loop(*l,*reinterpret_cast<Fn*>(fn)) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename Fn>
+bool ThreadPool::parallel_for_chunks(Range<IdxT> range, size_t grain, Fn fn)
+{
+   if (range.last() <= range.first())
+      return true ;
+   if (grain == 0) grain = 1 ;
+   unsigned helpers = loopHelpers(range.last() - range.first(),grain) ;
+   ParallelLoop<IdxT> loop(range,grain,helpers+1) ;
+   if (helpers > 0)
+      {
+      TaskGroup group(this) ;
+      for (unsigned i = 0 ; i < helpers ; ++i)
+	 {
+	 dispatch(&loop_worker<IdxT,Fn>,&loop,&fn,&group) ;
+	 }
+      run_loop(loop,fn) ;
+      // any helper jobs which start after this point will find the range exhausted and exit at once
+      group.wait() ;
+      }
+   else
+      run_loop(loop,fn) ;
+   return !loop.failed() ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename Fn>
+bool ThreadPool::parallel_for(Range<IdxT> range, size_t grain, Fn fn)
+{
+   return parallel_for_chunks(range,grain,[&fn](Range<IdxT> chunk) -> bool
+      {
+      for (auto index : chunk)
+	 {
+	 if (!invoke_loop_body(fn,index))
+	    return false ;
+	 }
+      return true ;
+      }) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename T, typename MapFn, typename CombineFn>
+struct ThreadPool::ReduceJob
+   {
+   public:
+      ReduceJob(const T& ident, MapFn& m, CombineFn& c) : identity(ident), result(ident), map(m), combine(c) {}
+
+      void run(ParallelLoop<IdxT>& loop)
+	 {
+	    // accumulate on our own stack, touching the shared result only once at the end
+	    T partial(identity) ;
+	    Range<IdxT> chunk ;
+	    while (loop.nextChunk(chunk))
+	       {
+	       for (auto index : chunk)
+		  partial = combine(partial,map(index)) ;
+	       }
+	    guard.lock() ;
+	    result = combine(result,partial) ;
+	    guard.unlock() ;
+	 }
+
+   public:
+      const T&        identity ;
+      T               result ;
+      MapFn&          map ;
+      CombineFn&      combine ;
+      CriticalSection guard ;
+   } ;
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename T, typename MapFn, typename CombineFn>
+void ThreadPool::reduce_worker(const void* loop, void* job)
+{
+   auto l = const_cast<ParallelLoop<IdxT>*>(reinterpret_cast<const ParallelLoop<IdxT>*>(loop)) ;
+   reinterpret_cast<ReduceJob<IdxT,T,MapFn,CombineFn>*>(job)->run(*l) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename T, typename MapFn, typename CombineFn>
+T ThreadPool::parallel_reduce(Range<IdxT> range, T identity, MapFn map, CombineFn combine, size_t grain)
+{
+   if (range.last() <= range.first())
+      return identity ;
+   if (grain == 0) grain = 1 ;
+   unsigned helpers = loopHelpers(range.last() - range.first(),grain) ;
+   ParallelLoop<IdxT> loop(range,grain,helpers+1) ;
+   ReduceJob<IdxT,T,MapFn,CombineFn> job(identity,map,combine) ;
+   if (helpers > 0)
+      {
+      TaskGroup group(this) ;
+      for (unsigned i = 0 ; i < helpers ; ++i)
+	 {
+	 dispatch(&reduce_worker<IdxT,T,MapFn,CombineFn>,&loop,&job,&group) ;
+	 }
+      job.run(loop) ;
+      group.wait() ;
+      }
+   else
+      job.run(loop) ;
+   return job.result ;
+}
+
 } // end namespace Fr
 
 #endif /* !_Fr_THREADPOOL_H_INCLUDED */
@@ -26,7 +26,10 @@
 #include <mutex>
 #include <type_traits>
 #include "framepac/byteorder.h"
+#include "framepac/file.h"
 #include "framepac/itempool.h"
+#include "framepac/mmapfile.h"
+#include "framepac/utility.h"
 
 namespace Fr
 {
@@ -34,6 +37,9 @@ namespace Fr
 /************************************************************************/
 /************************************************************************/
 
+template <typename T, typename IdxT, unsigned bits>
+class PackedTrie ;			// forward declaration, as Trie grants it access
+
 template <typename IdxT, unsigned bits>
 class TrieNodeValueless
    {
@@ -104,8 +110,10 @@ class Trie
       typedef TrieNodeValueless<IdxT,bits> ValuelessNode ;
       typedef TrieNode<T,IdxT,bits> Node ;
 
-      // construct an empty trie, optionally pre-allocating nodes
-      Trie(IdxT cap = 4) : m_valueless(cap), m_nodes(cap), m_maxkey(0) { (void) allocNode() ; }
+      // construct an empty trie, optionally pre-allocating nodes.  Valueless node 0 is never used,
+      //   since its index would be indistinguishable from NULL_INDEX.
+      Trie(IdxT cap = 4) : m_valueless(cap), m_nodes(cap), m_maxkey(0)
+	 { (void) allocNode() ; (void) allocValuelessNode() ; }
       ~Trie() = default ;
 
       template <typename RetT = T>
@@ -125,7 +133,7 @@ class Trie
       IdxT size() const { return fullNodes() + valuelessNodes() ; }
       IdxT capacity() const { return m_valueless.capacity() + m_nodes.capacity() ; }
       IdxT fullNodes() const { return m_nodes.size() ; }
-      IdxT valuelessNodes() const { return m_valueless.size() ; }
+      IdxT valuelessNodes() const { return m_valueless.size() - 1 ; }
       IdxT terminalNodes() const  ; // number of leaf (value-containing) nodes without children
       unsigned longestKey() const { return m_maxkey ; }
 
@@ -147,6 +155,7 @@ class Trie
       ItemPool<Node>	      m_nodes ;
       unsigned                m_maxkey ;
    private:
+      template <typename, typename, unsigned> friend class PackedTrie ;
       IdxT allocNode() { return (IdxT)m_nodes.alloc() ; }
       IdxT allocValuelessNode() { return (IdxT)m_valueless.alloc() ; }
       void releaseNode(IdxT index) { m_nodes.release(index) ; }
@@ -218,9 +227,21 @@ class MultiTrie : public Trie<IdxT,IdxT,bits>
 	    T    m_item ;
 	    IdxT m_next ;
 	 } ;
+      static constexpr IdxT END_OF_LIST = (IdxT)0 ;
    public:
-      MultiTrie() : super() {}
-      ~MultiTrie() ;
+      // entry 0 of the value pool is never used, so that its index can terminate the lists
+      MultiTrie() : super() { (void) m_values.alloc() ; }
+      ~MultiTrie() {}
+
+      // add another item to the list for the given key; not safe against concurrent insertions
+      //   of the same key
+      bool insert(const uint8_t* key, unsigned keylength, T item) ;
+
+      // the node values are indices of the most recently added item for the key, with each item
+      //   pointing at the one added before it
+      const TList* valueList(IdxT index) const
+	 { return index == END_OF_LIST ? nullptr : m_values.item(index) ; }
+      size_t numValues() const { return m_values.size() - 1 ; }
 
    protected:
       ItemPool<TList>  m_values ;
@@ -229,10 +250,19 @@ class MultiTrie : public Trie<IdxT,IdxT,bits>
 /************************************************************************/
 /************************************************************************/
 
+// An immutable version of Trie for tries which are built once and then queried many times.  The
+//   nodes are stored breadth-first, so that all of a node's children are adjacent and the node
+//   needs only the index of its first child plus a bitmask of which children are present, and
+//   nodes needing neither a value nor children are not stored at all.  The arrays contain no
+//   pointers, so a saved trie can be memory-mapped and used in place.
+
 template <typename T, typename IdxT, unsigned bits=4>
 class PackedTrie
    {
    public:
+      static constexpr IdxT ROOT_INDEX = (IdxT)0 ;
+      static constexpr IdxT NULL_INDEX = (IdxT)~0 ;
+
       // since we consume only a partial byte of the key with each level in the
       //   trie, intermediate levels can save space by not including a field for the
       //   node's value.  If we allow only leaf nodes to have values, all non-leaf
@@ -240,8 +270,8 @@ class PackedTrie
       class ValuelessNode
          {
 	 public:
-	    ValuelessNode() ;
-	    ~ValuelessNode() ;
+	    ValuelessNode() : m_firstchild(0), m_children(0), m_flags(0) {}
+	    ~ValuelessNode() {}
 
 	    template <typename RetT = T>
 	    typename std::enable_if<std::is_pointer<T>::value, RetT>::type
@@ -250,22 +280,34 @@ class PackedTrie
 	    typename std::enable_if<!std::is_pointer<T>::value, RetT>::type
 	    nodeValue() const { return T(0) ; }
 
+	    bool hasChildren() const { return m_children != 0 ; }
+	    bool hasChild(unsigned N) const { return (m_children & (1U << N)) != 0 ; }
+	    unsigned numChildren() const { return popcount((uint32_t)m_children) ; }
+	    IdxT firstChild() const { return m_firstchild ; }
+	    uint16_t childMask() const { return m_children ; }
+	    IdxT childIndex(unsigned N) const
+	       { return m_firstchild + popcount((uint32_t)(m_children & ((1U << N) - 1))) ; }
+	    void setChildren(IdxT first, uint16_t mask) { m_firstchild = first ; m_children = mask ; }
+
 	 protected:
-	    IdxT   m_firstchild ;	// children are stored breadth-first, so we need only
-	    Int16  m_children ;		//   the index of the first child and an offset from there
+	    IdxT     m_firstchild ;	// children are stored breadth-first, so we need only
+	    uint16_t m_children ;	//   the index of the first child and an offset from there
 					// m_children is a bitmask of the nonzero children, which we use
 					//   to compute the offset from the first child
+	    uint16_t m_flags ;		// alignment constraints leave padding, which full nodes use
          } ;
       // a full node can contain both a value and child pointers
       class Node : public ValuelessNode
          {
 	 public: // types
 	    typedef ValuelessNode super ;
+	    static constexpr uint16_t HAS_VALUE = 1 ;
 	 public:
-	    Node() {}
-	    Node(T val) { m_value = val ; }
+	    Node() : super() {}
+	    Node(T val) : super() { setValue(val) ; }
 	    ~Node() {}
-	    void setValue(T val) { m_value = val ; }
+	    void setValue(T val) { m_value = val ; this->m_flags |= HAS_VALUE ; }
+	    bool hasValue() const { return (this->m_flags & HAS_VALUE) != 0 ; }
 	    T nodeValue() const { return m_value ; }
 
 	 protected:
@@ -275,9 +317,9 @@ class PackedTrie
       class LeafNode
          {
 	 public:
-	    LeafNode() ;
+	    LeafNode() {}
 	    LeafNode(T val) { m_value = val ; }
-	    ~LeafNode() ;
+	    ~LeafNode() {}
 	    void setValue(T val) { m_value = val ; }
 	    T nodeValue() const { return m_value ; }
 
@@ -285,39 +327,94 @@ class PackedTrie
 	    T     m_value ;
          } ;
 
-      PackedTrie() ;
-      PackedTrie(const Trie<T,IdxT,bits>*) ;
-      PackedTrie(const char* filename) ;
+   public:
+      PackedTrie() {}
+      PackedTrie(const Trie<T,IdxT,bits>* trie) { build(trie) ; }
+      PackedTrie(const char* filename, bool allow_mmap = true) { load(filename,allow_mmap) ; }
       PackedTrie(const PackedTrie&) = delete ;
-      ~PackedTrie() ;
+      ~PackedTrie() { clear() ; }
       PackedTrie& operator= (const PackedTrie&) = delete ;
 
+      template <typename RetT = T>
+      constexpr static typename std::enable_if<std::is_pointer<T>::value, RetT>::type
+      nullVal() { return nullptr ; }
+      template <typename RetT = T>
+      constexpr static typename std::enable_if<!std::is_pointer<T>::value, RetT>::type
+      nullVal() { return (RetT)0 ; }
+
+      bool build(const Trie<T,IdxT,bits>* trie) ;
+      void clear() ;
+
+      bool load(const char* filename, bool allow_mmap = true) ;
+      // load from open file starting at current file position
+      bool load(CFile&, const char* filename, bool allow_mmap = true) ;
+      bool loadMapped(const char* filename, off_t base_offset = 0) ;
+      // load starting from specified position in mmap'ed file
+      bool loadFromMmap(const char* mmap_base, size_t mmap_len) ;
+      bool save(CFile&) const ;
+
+      IdxT size() const { return m_size ; }
+      IdxT fullNodes() const { return m_first_valuelessnode ; }
+      IdxT valuelessNodes() const { return m_first_leaf - m_first_valuelessnode ; }
+      IdxT leafNodes() const { return m_size - m_first_leaf ; }
+      size_t numKeys() const { return m_numkeys ; }
       unsigned longestKey() const { return m_maxkey ; }
+      // number of bytes used by the node arrays
+      size_t memoryUsage() const ;
+
       bool extendKey(IdxT& index, uint8_t keybyte) const ;
+      // returns NULL_INDEX if the key is not a path in the trie
+      IdxT findNode(const uint8_t* key, unsigned keylength) const ;
       bool find(const uint8_t* key, unsigned keylength, T& value) const ;
-      bool leafNode(IdxT& index) const ;
-      bool nodeHasValue(IdxT& index) const ;
-      T nodeValue(IdxT& index) const ;
-      bool nodeValue(IdxT& index, T& value) const ;
+      bool contains(const uint8_t* key, unsigned keylength) const ;
+      bool leafNode(IdxT index) const { return index >= m_first_leaf && index < m_size ; }
+      bool nodeHasValue(IdxT index) const ;
+      T nodeValue(IdxT index) const ;
+      bool nodeValue(IdxT index, T& value) const ;
+
+      explicit operator bool () const { return m_size > 0 ; }
 
    protected:
-      void init(IdxT cap) ;
+      template <typename SrcT, typename ValFn>
+      bool build(const Trie<SrcT,IdxT,bits>* trie, ValFn map_value) ;
+      const ValuelessNode* interiorNode(IdxT index) const
+	 {
+	    if (index < m_first_valuelessnode)
+	       return &m_fullnodes[index] ;
+	    return index < m_first_leaf ? &m_nodes[index - m_first_valuelessnode] : nullptr ;
+	 }
+      void releaseArrays() ;
 
    protected:
+      MemMappedFile  m_mmap ;
       // because we have three different types of nodes, we need to
       //   store pointers to the arrays of each type of node
-      Node*          m_fullnodes ;
-      ValuelessNode* m_nodes ;
-      LeafNode*      m_leaves ;
+      Node*          m_fullnodes { nullptr } ;
+      ValuelessNode* m_nodes { nullptr } ;
+      LeafNode*      m_leaves { nullptr } ;
       // we also need to store the starting index of each type except
       //   full nodes, so that we can convert a simple index into the
       //   node type while traversing the trie
-      IdxT           m_first_valuelessnode ;
-      IdxT           m_first_leaf ;
-
-      unsigned       m_maxkey ;
+      IdxT           m_first_valuelessnode { 0 } ;
+      IdxT           m_first_leaf { 0 } ;
+      IdxT           m_size { 0 } ;
+      size_t         m_numkeys { 0 } ;
+      size_t         m_datasize { 0 } ;		// bytes occupied by the trie when saved to a file
+      unsigned       m_maxkey { 0 } ;
+      bool           m_readonly { false } ;
+
+      // magic values for serializing
+      static constexpr auto signature = "\x7F""PackTrie" ;
+      static constexpr unsigned file_format = 1 ;
+      static constexpr unsigned min_file_format = 1 ;
    } ;
 
+// keep linker happy on debug builds:
+template <typename T, typename IdxT, unsigned bits>
+constexpr IdxT PackedTrie<T,IdxT,bits>::ROOT_INDEX ;
+template <typename T, typename IdxT, unsigned bits>
+constexpr IdxT PackedTrie<T,IdxT,bits>::NULL_INDEX ;
+
 /************************************************************************/
 /************************************************************************/
 
@@ -326,17 +423,49 @@ class PackedTrie
 //   having a separate array of items
 
 template <typename T, typename IdxT = std::uint32_t, typename ValIdxT = std::uint32_t, unsigned bits=4>
-class PackedMultiTrie : public PackedTrie<IdxT,ValIdxT>
+class PackedMultiTrie : public PackedTrie<ValIdxT,IdxT,bits>
    {
    public: // types
-      typedef PackedTrie<IdxT,ValIdxT> super ;
+      typedef PackedTrie<ValIdxT,IdxT,bits> super ;
    public:
-      PackedMultiTrie() ;
-      ~PackedMultiTrie() ;
+      PackedMultiTrie() : super() {}
+      PackedMultiTrie(const MultiTrie<T,IdxT,bits>* trie) : super() { build(trie) ; }
+      PackedMultiTrie(const char* filename, bool allow_mmap = true) : super() { load(filename,allow_mmap) ; }
+      ~PackedMultiTrie() { clear() ; }
+
+      // the items for each key are stored in the order in which they were inserted
+      bool build(const MultiTrie<T,IdxT,bits>* trie) ;
+      void clear() ;
+
+      bool load(const char* filename, bool allow_mmap = true) ;
+      // load from open file starting at current file position
+      bool load(CFile&, const char* filename, bool allow_mmap = true) ;
+      bool loadMapped(const char* filename, off_t base_offset = 0) ;
+      // load starting from specified position in mmap'ed file
+      bool loadFromMmap(const char* mmap_base, size_t mmap_len) ;
+      bool save(CFile&) const ;
+
+      // set 'values' to the items stored for the key or node and return their count
+      size_t find(const uint8_t* key, unsigned keylength, const T*& values) const ;
+      size_t nodeValues(IdxT index, const T*& values) const ;
+
+      size_t numValues() const { return m_numvalues ; }
+      size_t memoryUsage() const ;
 
    protected:
-      T*          m_values ;
+      void releaseValues() ;
+      bool setupValues(const char* base, size_t len) ;
 
+   protected:
+      T*          m_values { nullptr } ;
+      ValIdxT*    m_offsets { nullptr } ;	// start of each node's items in m_values, plus end
+      size_t      m_numlists { 0 } ;
+      size_t      m_numvalues { 0 } ;
+
+      // magic values for serializing
+      static constexpr auto signature = "\x7F""MultTrie" ;
+      static constexpr unsigned file_format = 1 ;
+      static constexpr unsigned min_file_format = 1 ;
    } ;
 
 //----------------------------------------------------------------------------
@@ -351,6 +480,11 @@ extern template class Trie<double, std::uint32_t> ;
 typedef PackedTrie<std::uint32_t, std::uint32_t> PackedTrieInteger ;
 extern template class PackedTrie<std::uint32_t, std::uint32_t> ;
 
+typedef MultiTrie<std::uint32_t, std::uint32_t> MultiTrieInteger ;
+extern template class MultiTrie<std::uint32_t, std::uint32_t> ;
+typedef PackedMultiTrie<std::uint32_t, std::uint32_t> PackedMultiTrieInteger ;
+extern template class PackedMultiTrie<std::uint32_t, std::uint32_t> ;
+
 } // end namespace Fr
 
 #endif /* !__Fr_TRIE_H_INCLUDED */
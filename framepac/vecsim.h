@@ -27,6 +27,12 @@
 
 namespace Fr {
 
+// forward declarations
+class Array ;
+template <typename T> class FullMatrix ;
+template <typename IdxT, typename ValT> class BinaryVectors ;
+template <typename IdxT, typename ValT> class VectorCollection ;
+
 /************************************************************************/
 /************************************************************************/
 
@@ -235,6 +241,43 @@ class VectorMeasure
 	    return v1 != v2 ? 1 : 0 ; 
 	 }
 
+      // batched comparisons: out[i] = similarity(query,candidates[i]) and
+      //   result(i,j) = similarity(A[i],B[j]); the result matrix must have at least as many rows
+      //   as A and columns as B.  The work is spread over the default thread pool, and the
+      //   commonly-used measures override these to avoid per-pair virtual calls and to compute
+      //   per-vector quantities such as lengths only once per vector.
+      virtual bool similarities(const vec_type* query, const Array* candidates, double* out) const ;
+      virtual bool similarityMatrix(const Array* A, const Array* B, FullMatrix<float>* result) const ;
+
+      // the same comparisons on the rows of VectorCollections.  similarities() sets out[k] to the
+      //   similarity of row 'query' and row first+k for first+k < last, on the calling thread so
+      //   that callers may spread queries over threads; similarityMatrix() compares rows
+      //   first..last-1 of A against all of B, setting result(i-first,j).  The base versions compare
+      //   the collections' source vectors (and fail for a collection loaded from a file which has
+      //   none); measures which can work directly on the contiguous storage override them.
+      virtual bool similarities(const VectorCollection<IdxT,ValT>& coll, size_t query, size_t first, size_t last,
+	 double* out) const ;
+      virtual bool similarityMatrix(const VectorCollection<IdxT,ValT>& A, size_t first, size_t last,
+	 const VectorCollection<IdxT,ValT>& B, FullMatrix<float>* result) const ;
+
+      // comparisons of rows of BinaryVectors, which compute the binary contingency table with AND and
+      //   popcount instead of merging the vectors' element lists.  Only the measures based on a binary
+      //   contingency table or binary (dis)agreement support them, as reported by
+      //   supportsBinaryVectors(); the others fail.  similarities() sets out[k] to the similarity of row
+      //   'query' of 'queries' and row first+k of 'candidates', on the calling thread; both sets must
+      //   have the same number of dimensions.  Absent rows have similarity -1.
+      virtual bool supportsBinaryVectors() const { return false ; }
+      double similarity(const BinaryVectors<IdxT,ValT>& bits1, size_t row1, const BinaryVectors<IdxT,ValT>& bits2,
+	 size_t row2) const ;
+      bool similarities(const BinaryVectors<IdxT,ValT>& queries, size_t query,
+	 const BinaryVectors<IdxT,ValT>& candidates, size_t first, size_t last, double* out) const ;
+
+      // does a non-empty vector have a similarity of zero or less to every vector with which it
+      //   shares no non-zero elements?  This holds for measures such as cosine and Jaccard but
+      //   not for those derived from distances, and allows callers to skip comparisons between
+      //   disjoint sparse vectors.
+      virtual bool disjointSimilarityNonPositive() const { return false ; }
+
    protected:
       VectorMeasure() : m_opt() {}
       VectorMeasure(const VectorSimilarityOptions& opt) : m_opt(opt) {}
@@ -247,6 +290,10 @@ class VectorMeasure
 		   	    size_t& v2_only, size_t& neither) const ;
       // real-valued contingency table
       void contingencyTable(const vec_type* v1, const vec_type* v2, ValT& a, ValT& b, ValT& c) const ;
+      // real-valued contingency table given the vectors' normalization weights
+      void contingencyTable(const vec_type* v1, ValT wt1, const vec_type* v2, ValT wt2,
+			    ValT& a, ValT& b, ValT& c) const ;
+      ValT normalizationWeight(const vec_type* v) const ;
       void binaryAgreement(const vec_type* v1, const vec_type* v2, size_t& both, size_t& disagree,
 		   	   size_t& neither) const ;
       
@@ -257,6 +304,9 @@ class VectorMeasure
 	 { return both / (both + v1_only + v2_only + neither) ; }
       virtual double scoreBinaryAgreement(size_t both, size_t disagree, size_t neither) const
 	 { return both / (both + disagree + neither) ; }
+      // the similarity for a binary contingency table computed from BinaryVectors
+      virtual double scoreBitCounts(size_t /*both*/, size_t /*v1_only*/, size_t /*v2_only*/, size_t /*neither*/) const
+	 { return -1.0 ; }
 
       inline static ValT p_log_p(ValT p) { return p ? p * std::log(p) : 0 ; }
 
@@ -302,7 +352,7 @@ class SimilarityMeasureReciprocal : public VectorMeasure<IdxT, ValT>
    public:
       virtual double distance(const vec_type* v1, const vec_type* v2) const
 	 {
-	    double sim = similarity(v1,v2) ;
+	    double sim = this->similarity(v1,v2) ;
 	    return sim ? 1.0 / sim : HUGE_VAL ;
 	 }
 
@@ -324,7 +374,7 @@ class DistanceMeasure : public VectorMeasure<IdxT, ValT>
    public:
       virtual double similarity(const vec_type* v1, const vec_type* v2) const
 	 {
-	    return 1.0 - similarity(v1,v2) ;
+	    return 1.0 - this->distance(v1,v2) ;
 	 }
 
    protected:
@@ -345,7 +395,7 @@ class DistanceMeasureReciprocal : public VectorMeasure<IdxT, ValT>
    public:
       virtual double similarity(const vec_type* v1, const vec_type* v2) const
 	 {
-	    double dist = distance(v1,v2) ;
+	    double dist = this->distance(v1,v2) ;
 	    return dist ? 1.0 / dist : HUGE_VAL ;
 	 }
 
@@ -106,6 +106,8 @@ class Vector : public VectorBase
       size_t numElements() const { return m_size ; }
       ValT elementValue(size_t N) const { return m_values.full[N] ; }
       size_t elementIndex(size_t N) const { return N ; }
+      // raw element values for the vectorized kernels; not valid for OneHotVector
+      const ValT* elementValues() const { return m_values.full ; }
       
       // arithmetic operations
       Vector* add(const Vector* other) const ;		// ret = (*this) + (*other)
@@ -0,0 +1,169 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.15, last edit 2019-08-24					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+
+#ifndef _Fr_VECTORCOLL_H_INCLUDED
+#define _Fr_VECTORCOLL_H_INCLUDED
+
+#include "framepac/array.h"
+#include "framepac/file.h"
+#include "framepac/mmapfile.h"
+#include "framepac/vector.h"
+
+namespace Fr
+{
+
+// forward declarations
+class ThreadPool ;
+class VectorCollectionHeader ;
+
+/************************************************************************/
+/*	Declarations for template class VectorCollection		*/
+/************************************************************************/
+
+// A read-only, contiguous copy of a set of vectors for bulk computation.  Instead of one heap object
+//   per vector with its own element buffers, dense vectors become the rows of a single matrix (each
+//   row padded to a multiple of 64 bytes, so that every row starts on a cache line) and sparse
+//   vectors are stored in compressed-sparse-row form.  Lengths, keys, labels, and weights are kept
+//   in parallel arrays.  The collection remembers the Array from which it was built, so that results
+//   indexed by row can be mapped back to the original Vector objects; that Array must outlive it.
+//
+// A collection can also be saved to a binary file whose element arrays are stored exactly as they
+//   are laid out in memory, so that loading it is a matter of mapping the file and checking the
+//   header rather than parsing text.  Keys and labels are stored as indices into a table of
+//   names, so only the distinct names need to be looked up in the symbol table.  A collection
+//   loaded from a file has no source Array until makeVectors() builds one.
+
+template <typename IdxT, typename ValT>
+class VectorCollection
+   {
+   public:
+      typedef Vector<IdxT,ValT> vec_type ;
+      static constexpr size_t ROW_ALIGN = 64 ;
+
+   public:
+      VectorCollection() {}
+      VectorCollection(const Array* vectors) { load(vectors) ; }
+      VectorCollection(const char* filename, bool allow_mmap = true) { load(filename,allow_mmap) ; }
+      VectorCollection(const VectorCollection&) = delete ;
+      ~VectorCollection() { clear() ; }
+      VectorCollection& operator= (const VectorCollection&) = delete ;
+
+      // copy the given vectors into the collection.  If any of them is sparse, all are stored in
+      //   sparse form; entries of the array which are not vectors become empty rows.
+      bool load(const Array* vectors) ;
+      void clear() ;
+
+      // binary files
+      bool save(const char* filename) const ;
+      bool save(CFile&) const ;
+      bool load(const char* filename, bool allow_mmap = true) ;
+      // load from open file starting at current file position
+      bool load(CFile&, const char* filename, bool allow_mmap = true) ;
+      bool loadMapped(const char* filename, off_t base_offset = 0) ;
+      // load starting from specified position in mmap'ed file
+      bool loadFromMmap(const char* mmap_base, size_t mmap_len) ;
+      static bool isCollectionFile(const char* filename) ;
+
+      // parse a text file containing one vector per line, in the format accepted by
+      //   SparseVector::create() or DenseVector::create(); blank lines are skipped.  Blocks of
+      //   lines are split and parsed in parallel, but the vectors are returned in file order.
+      static Array* parseText(CFile& fp, bool sparse, ThreadPool* pool = nullptr) ;
+      // convert such a text file into the binary format written by save()
+      static bool convertText(const char* textfile, const char* binfile, bool sparse, ThreadPool* pool = nullptr) ;
+
+      // create a Vector object for each row (or an empty slot for rows which were not vectors) and
+      //   make the resulting Array the collection's source; the caller owns the Array and must keep
+      //   it alive as long as the collection is in use
+      Array* makeVectors() ;
+
+      size_t size() const { return m_size ; }
+      bool sparse() const { return m_sparse ; }
+      size_t dimensions() const { return m_dims ; }
+      size_t nonZeros() const { return m_nonzeros ; }
+      const Array* source() const { return m_source ; }
+      const vec_type* vector(size_t N) const
+	 { return m_source ? static_cast<const vec_type*>(m_source->getNth(N)) : nullptr ; }
+      bool present(size_t N) const { return m_lengths[N] >= 0.0 ; }
+
+      // element storage: a dense row always has dimensions() elements (zero-filled past the end of a
+      //   shorter vector), while rowIndices() is only valid for a sparse collection
+      size_t rowLength(size_t N) const { return m_sparse ? m_offsets[N+1] - m_offsets[N] : m_dims ; }
+      const ValT* rowValues(size_t N) const { return m_values + (m_sparse ? m_offsets[N] : N * m_stride) ; }
+      const IdxT* rowIndices(size_t N) const { return m_indices + m_offsets[N] ; }
+
+      // per-vector data
+      double length(size_t N) const { return m_lengths[N] ; }
+      Symbol* key(size_t N) const { return m_keys[N] ; }
+      Symbol* label(size_t N) const { return m_labels[N] ; }
+      float weight(size_t N) const { return m_weights[N] ; }
+      void setLabel(size_t N, Symbol* label) { m_labels[N] = label ; }
+
+      // number of bytes of element and per-vector storage
+      size_t memoryUsage() const ;
+
+      bool readonly() const { return m_readonly ; }
+      explicit operator bool () const { return m_values != nullptr ; }
+
+   protected:
+      void releaseArrays() ;
+      bool setContents(const VectorCollectionHeader& header, const uint32_t* keys, const uint32_t* labels,
+	 const uint64_t* names, const char* strings) ;
+
+   protected:
+      MemMappedFile m_mmap ;
+      const Array* m_source { nullptr } ;
+      ValT*    m_values { nullptr } ;
+      IdxT*    m_indices { nullptr } ;	// sparse only
+      size_t*  m_offsets { nullptr } ;	// sparse only: start of each row, plus the end of the last
+      double*  m_lengths { nullptr } ;	// L2 norms, or -1 for rows which were not vectors
+      Symbol** m_keys { nullptr } ;
+      Symbol** m_labels { nullptr } ;
+      float*   m_weights { nullptr } ;
+      size_t   m_size { 0 } ;
+      size_t   m_dims { 0 } ;
+      size_t   m_stride { 0 } ;		// dense only: elements per row including padding
+      size_t   m_nonzeros { 0 } ;
+      bool     m_sparse { false } ;
+      bool     m_readonly { false } ;	// element arrays point into m_mmap
+
+      // magic values for serializing
+      static constexpr auto signature = "\x7F""VecColl" ;
+      static constexpr unsigned file_format = 1 ;
+      static constexpr unsigned min_file_format = 1 ;
+   } ;
+
+// keep linker happy on debug builds:
+template <typename IdxT, typename ValT>
+constexpr size_t VectorCollection<IdxT,ValT>::ROW_ALIGN ;
+
+/************************************************************************/
+/************************************************************************/
+
+extern template class VectorCollection<uint32_t,uint32_t> ;
+extern template class VectorCollection<uint32_t,float> ;
+extern template class VectorCollection<uint32_t,double> ;
+
+} // end namespace Fr
+
+#endif /* !_Fr_VECTORCOLL_H_INCLUDED */
+
+// end of file vectorcoll.h //
@@ -122,6 +122,8 @@ class WordCorpusT
       const SufArr* forwardIndex() const { return &m_fwdindex ; }
 
       IdT findID(const char* word) const ;
+      // look up a batch of words, storing ErrorID for unknown words; returns the number of words found
+      size_t findIDs(const char* const* words, size_t n, IdT* ids) const ;
       IdT findOrAddID(const char* word) ;
       IdT addWord(const char* word) ;
       IdT numberToken() const { return m_number ; }
@@ -141,6 +143,10 @@ class WordCorpusT
       void clearAttribute(unsigned bit) const { clearAttribute(1<<bit) ; }
 
       bool createIndex(bool bidirectional = false) ;
+      // build the suffix arrays using not much more memory than the finished indices, at some cost in speed
+      void lowMemoryIndexing(bool lowmem = true) { m_fwdindex.setLowMemory(lowmem) ; m_revindex.setLowMemory(lowmem) ; }
+      // add longest-common-prefix arrays to the indices to speed up lookup() and enumeration
+      bool createLCP(bool bidirectional = false) ;
       void freeTermFrequencies() ;
       bool freeIndices() ;
       bool lookup(const ID *key, unsigned keylen, Index &first_match, Index &last_match) const ;
@@ -0,0 +1,1040 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-07					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <vector>
+#include "framepac/annindex.h"
+#include "framepac/fasthash64.h"
+#include "framepac/file.h"
+#include "framepac/message.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Manifest constants						*/
+/************************************************************************/
+
+// HNSW: maximum number of links per node on the upper layers; the bottom layer allows twice as many
+#define FrHNSW_DEFAULT_M 16
+// HNSW: size of the dynamic candidate list while inserting
+#define FrHNSW_DEFAULT_EF_CONSTRUCTION 100
+// HNSW: size of the dynamic candidate list while querying
+#define FrHNSW_DEFAULT_EF_SEARCH 48
+// HNSW: the highest layer a node can be assigned to
+#define FrHNSW_MAX_LEVEL 15
+
+// LSH: number of hash tables for random-hyperplane hashing
+#define FrSIMHASH_DEFAULT_TABLES 16
+// LSH: number of hash tables (bands) and min-hashes per band for min-wise hashing
+#define FrMINHASH_DEFAULT_TABLES 16
+#define FrMINHASH_DEFAULT_ROWS 2
+// LSH: log2 of the average number of vectors per bucket when the tables are sized for a known number of vectors
+#define FrLSH_BUCKET_LOAD_BITS 3
+// LSH: limits on the number of bits in a bucket key
+#define FrLSH_MIN_BITS 6
+#define FrLSH_MAX_BITS 20
+#define FrLSH_DEFAULT_BITS 10
+
+#define FrANN_SEED 0x9E3779B97F4A7C15UL
+#define FrANN_NONE UINT32_MAX
+
+/************************************************************************/
+/*	Helper functions						*/
+/************************************************************************/
+
+inline uint64_t ann_hash(uint64_t seed, uint64_t v1, uint64_t v2)
+{
+   uint64_t state = FramepaC::fasthash64_init(2*sizeof(uint64_t),seed) ;
+   state = FramepaC::fasthash64_add(state,v1) ;
+   state = FramepaC::fasthash64_add(state,v2) ;
+   return FramepaC::fasthash64_finalize(state) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+inline size_t ann_element_index(const Vector<IdxT,ValT>* v, size_t N)
+{
+   if (v->isSparseVector())
+      return static_cast<const SparseVector<IdxT,ValT>*>(v)->elementIndex(N) ;
+   return N ;
+}
+
+//----------------------------------------------------------------------------
+
+inline unsigned ann_ceil_log2(size_t N)
+{
+   unsigned bits = 0 ;
+   while (bits < 63 && (size_t(1) << bits) < N)
+      ++bits ;
+   return bits ;
+}
+
+//----------------------------------------------------------------------------
+// scratch bitmap for marking the nodes already examined by a graph search
+
+class ANNVisitedSet
+   {
+   public:
+      ANNVisitedSet(size_t size) : m_bits((size+63)/64)
+	 { std::fill_n(m_bits.begin(),(size+63)/64,0) ; }
+      ~ANNVisitedSet() = default ;
+
+      // mark the node, returning true if it had previously been marked
+      bool visit(size_t id)
+	 {
+	 uint64_t mask = uint64_t(1) << (id % 64) ;
+	 uint64_t& word = m_bits[id / 64] ;
+	 bool seen = (word & mask) != 0 ;
+	 word |= mask ;
+	 return seen ;
+	 }
+      void clear(size_t size) { std::fill_n(m_bits.begin(),(size+63)/64,0) ; }
+
+   protected:
+      NewPtr<uint64_t> m_bits ;
+   } ;
+
+/************************************************************************/
+/*	Hierarchical Navigable Small World graph			*/
+/************************************************************************/
+
+// following Malkov & Yashunin, "Efficient and robust approximate nearest neighbor search using
+//   Hierarchical Navigable Small World graphs" (IEEE TPAMI 2018), but working directly with similarities;
+//   node levels are derived from a hash of the node's position so that an index is reproducible
+
+template <typename IdxT, typename ValT>
+class ANNIndexHNSW : public ANNIndex<IdxT,ValT>
+   {
+   public:
+      typedef ANNIndex<IdxT,ValT> super ;
+      typedef Vector<IdxT,ValT> vec_type ;
+      typedef std::pair<double,uint32_t> Candidate ;
+      typedef std::priority_queue<Candidate> CandidateQueue ;
+      typedef std::priority_queue<Candidate,std::vector<Candidate>,std::greater<Candidate>> ResultQueue ;
+
+   public:
+      ANNIndexHNSW(VectorMeasure<IdxT,ValT>* measure) : super(measure) {}
+      virtual ~ANNIndexHNSW() ;
+
+      virtual ANNIndexType indexType() const { return ANNIndexType::hnsw ; }
+      virtual const char* indexName() const { return "HNSW" ; }
+
+   protected:
+      size_t maxLinks(unsigned level) const { return level ? m_M : m_M0 ; }
+      uint32_t* links(size_t id, unsigned level) const
+	 {
+	 if (level == 0)
+	    return m_links0.at(id * (m_M0+1)) ;
+	 return m_upper[id] + (level-1) * (m_M+1) ;
+	 }
+      unsigned nodeLevel(size_t id) const ;
+      void allocateUpper(size_t id, unsigned level) ;
+
+      void greedyDescend(const vec_type* query, uint32_t& curr, double& curr_sim, unsigned level) const ;
+      void searchLayer(const vec_type* query, std::vector<Candidate>& entries, size_t ef, unsigned level,
+	 ANNVisitedSet& visited) const ;
+      void selectNeighbors(std::vector<Candidate>& candidates, size_t M) const ;
+      void addLink(uint32_t node, uint32_t newnode, double sim, unsigned level) ;
+
+      virtual bool grow(size_t old_capacity, size_t new_capacity) ;
+      virtual void link(size_t id) ;
+      virtual size_t search(const vec_type* vector, size_t k, size_t effort, ANNResult* results) const ;
+      virtual void getParameters(uint64_t* params) const ;
+      virtual bool setParameters(const uint64_t* params) ;
+      virtual bool saveStructure(CFile& fp) const ;
+      virtual bool loadStructure(CFile& fp) ;
+
+   protected:
+      NewPtr<uint8_t>   m_levels ;	// top layer of each node
+      NewPtr<uint32_t>  m_links0 ;	// bottom-layer links, (M0+1) per node with the count first
+      NewPtr<uint32_t*> m_upper ;	// links on layers 1..level, (M+1) per layer, or nullptr
+      size_t            m_M { FrHNSW_DEFAULT_M } ;
+      size_t            m_M0 { 2*FrHNSW_DEFAULT_M } ;
+      size_t            m_ef_construction { FrHNSW_DEFAULT_EF_CONSTRUCTION } ;
+      size_t            m_ef_search { FrHNSW_DEFAULT_EF_SEARCH } ;
+      uint32_t          m_entry { FrANN_NONE } ;
+      unsigned          m_maxlevel { 0 } ;
+   } ;
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+ANNIndexHNSW<IdxT,ValT>::~ANNIndexHNSW()
+{
+   for (size_t i = 0 ; i < this->m_capacity ; ++i)
+      delete[] m_upper[i] ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+unsigned ANNIndexHNSW<IdxT,ValT>::nodeLevel(size_t id) const
+{
+   // draw from the exponentially-decaying level distribution with normalization factor 1/ln(M)
+   double uniform = ((FramepaC::fasthash64_mix(id + FrANN_SEED) >> 11) + 1) * (1.0 / 9007199254740992.0) ;
+   double level = -std::log(uniform) / std::log((double)m_M) ;
+   return level >= FrHNSW_MAX_LEVEL ? FrHNSW_MAX_LEVEL : (unsigned)level ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexHNSW<IdxT,ValT>::allocateUpper(size_t id, unsigned level)
+{
+   m_levels[id] = (uint8_t)level ;
+   links(id,0)[0] = 0 ;
+   delete[] m_upper[id] ;
+   m_upper[id] = nullptr ;
+   if (level > 0)
+      {
+      m_upper[id] = new uint32_t[level * (m_M+1)] ;
+      for (unsigned l = 1 ; l <= level ; ++l)
+	 links(id,l)[0] = 0 ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndexHNSW<IdxT,ValT>::grow(size_t old_capacity, size_t new_capacity)
+{
+   if (!m_levels.reallocate(old_capacity,new_capacity) ||
+      !m_links0.reallocate(old_capacity*(m_M0+1),new_capacity*(m_M0+1)) ||
+      !m_upper.reallocate(old_capacity,new_capacity))
+      return false ;
+   std::fill(m_upper.at(old_capacity),m_upper.at(new_capacity),nullptr) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexHNSW<IdxT,ValT>::greedyDescend(const vec_type* query, uint32_t& curr, double& curr_sim,
+   unsigned level) const
+{
+   bool changed ;
+   do {
+      changed = false ;
+      const uint32_t* nbrs = links(curr,level) ;
+      for (size_t i = 1 ; i <= nbrs[0] ; ++i)
+	 {
+	 double sim = this->similarity(query,nbrs[i]) ;
+	 if (sim > curr_sim)
+	    {
+	    curr_sim = sim ;
+	    curr = nbrs[i] ;
+	    changed = true ;
+	    }
+	 }
+      } while (changed) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexHNSW<IdxT,ValT>::searchLayer(const vec_type* query, std::vector<Candidate>& entries, size_t ef,
+   unsigned level, ANNVisitedSet& visited) const
+{
+   CandidateQueue candidates ;
+   ResultQueue found ;
+   for (auto& entry : entries)
+      {
+      visited.visit(entry.second) ;
+      candidates.push(entry) ;
+      found.push(entry) ;
+      if (found.size() > ef)
+	 found.pop() ;
+      }
+   while (!candidates.empty())
+      {
+      Candidate cand = candidates.top() ;
+      if (found.size() >= ef && cand.first < found.top().first)
+	 break ;			// nothing left to expand can improve the result set
+      candidates.pop() ;
+      const uint32_t* nbrs = links(cand.second,level) ;
+      for (size_t i = 1 ; i <= nbrs[0] ; ++i)
+	 {
+	 uint32_t nbr = nbrs[i] ;
+	 if (visited.visit(nbr))
+	    continue ;
+	 double sim = this->similarity(query,nbr) ;
+	 if (found.size() < ef || sim > found.top().first)
+	    {
+	    candidates.push(Candidate(sim,nbr)) ;
+	    found.push(Candidate(sim,nbr)) ;
+	    if (found.size() > ef)
+	       found.pop() ;
+	    }
+	 }
+      }
+   // return the result set ordered by decreasing similarity
+   entries.resize(found.size()) ;
+   for (size_t i = found.size() ; i > 0 ; --i)
+      {
+      entries[i-1] = found.top() ;
+      found.pop() ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexHNSW<IdxT,ValT>::selectNeighbors(std::vector<Candidate>& candidates, size_t M) const
+{
+   // candidates are sorted by decreasing similarity; keep a candidate only if it is more similar to the
+   //   base node than to any neighbor already kept, so that links point in diverse directions, then
+   //   top up with the best of the discarded candidates
+   if (candidates.size() <= M)
+      return ;
+   std::vector<Candidate> selected ;
+   std::vector<Candidate> discarded ;
+   for (auto& cand : candidates)
+      {
+      if (selected.size() >= M)
+	 break ;
+      bool diverse = true ;
+      for (auto& sel : selected)
+	 {
+	 if (this->similarity(cand.second,sel.second) > cand.first)
+	    {
+	    diverse = false ;
+	    break ;
+	    }
+	 }
+      if (diverse)
+	 selected.push_back(cand) ;
+      else
+	 discarded.push_back(cand) ;
+      }
+   for (size_t i = 0 ; selected.size() < M && i < discarded.size() ; ++i)
+      selected.push_back(discarded[i]) ;
+   candidates.swap(selected) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexHNSW<IdxT,ValT>::addLink(uint32_t node, uint32_t newnode, double sim, unsigned level)
+{
+   uint32_t* nbrs = links(node,level) ;
+   size_t maxM = maxLinks(level) ;
+   if (nbrs[0] < maxM)
+      {
+      nbrs[++nbrs[0]] = newnode ;
+      return ;
+      }
+   // the node's neighbor list is full, so re-select among the existing neighbors plus the new one
+   std::vector<Candidate> cands ;
+   cands.reserve(maxM+1) ;
+   for (size_t i = 1 ; i <= nbrs[0] ; ++i)
+      cands.push_back(Candidate(this->similarity(node,nbrs[i]),nbrs[i])) ;
+   cands.push_back(Candidate(sim,newnode)) ;
+   std::sort(cands.begin(),cands.end(),std::greater<Candidate>()) ;
+   selectNeighbors(cands,maxM) ;
+   nbrs[0] = (uint32_t)cands.size() ;
+   for (size_t i = 0 ; i < cands.size() ; ++i)
+      nbrs[i+1] = cands[i].second ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexHNSW<IdxT,ValT>::link(size_t id)
+{
+   unsigned level = nodeLevel(id) ;
+   allocateUpper(id,level) ;
+   if (m_entry == FrANN_NONE)
+      {
+      m_entry = (uint32_t)id ;
+      m_maxlevel = level ;
+      return ;
+      }
+   auto vector = this->vector(id) ;
+   uint32_t curr = m_entry ;
+   double curr_sim = this->similarity(vector,curr) ;
+   for (unsigned l = m_maxlevel ; l > level ; --l)
+      greedyDescend(vector,curr,curr_sim,l) ;
+   std::vector<Candidate> entries ;
+   entries.push_back(Candidate(curr_sim,curr)) ;
+   ANNVisitedSet visited(id) ;
+   for (unsigned l = std::min(level,m_maxlevel) + 1 ; l > 0 ; --l)
+      {
+      unsigned lev = l - 1 ;
+      visited.clear(id) ;
+      searchLayer(vector,entries,m_ef_construction,lev,visited) ;
+      std::vector<Candidate> selected(entries) ;
+      selectNeighbors(selected,m_M) ;
+      uint32_t* nbrs = links(id,lev) ;
+      nbrs[0] = (uint32_t)selected.size() ;
+      for (size_t i = 0 ; i < selected.size() ; ++i)
+	 {
+	 nbrs[i+1] = selected[i].second ;
+	 addLink(selected[i].second,(uint32_t)id,selected[i].first,lev) ;
+	 }
+      }
+   if (level > m_maxlevel)
+      {
+      m_entry = (uint32_t)id ;
+      m_maxlevel = level ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t ANNIndexHNSW<IdxT,ValT>::search(const vec_type* query, size_t k, size_t effort, ANNResult* results) const
+{
+   if (m_entry == FrANN_NONE)
+      return 0 ;
+   size_t ef = std::max(effort ? effort : m_ef_search, k) ;
+   uint32_t curr = m_entry ;
+   double curr_sim = this->similarity(query,curr) ;
+   for (unsigned l = m_maxlevel ; l > 0 ; --l)
+      greedyDescend(query,curr,curr_sim,l) ;
+   std::vector<Candidate> entries ;
+   entries.push_back(Candidate(curr_sim,curr)) ;
+   ANNVisitedSet visited(this->size()) ;
+   searchLayer(query,entries,ef,0,visited) ;
+   size_t count = std::min(k,entries.size()) ;
+   for (size_t i = 0 ; i < count ; ++i)
+      {
+      results[i].id = entries[i].second ;
+      results[i].sim = entries[i].first ;
+      }
+   return count ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexHNSW<IdxT,ValT>::getParameters(uint64_t* params) const
+{
+   params[0] = m_M ;
+   params[1] = m_ef_construction ;
+   params[2] = m_ef_search ;
+   params[3] = m_entry | ((uint64_t)m_maxlevel << 32) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndexHNSW<IdxT,ValT>::setParameters(const uint64_t* params)
+{
+   if (params[0] < 2 || params[0] > 255)
+      return false ;
+   m_M = params[0] ;
+   m_M0 = 2 * m_M ;
+   m_ef_construction = params[1] ;
+   m_ef_search = params[2] ;
+   m_entry = (uint32_t)params[3] ;
+   m_maxlevel = (unsigned)(params[3] >> 32) ;
+   return m_maxlevel <= FrHNSW_MAX_LEVEL ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndexHNSW<IdxT,ValT>::saveStructure(CFile& fp) const
+{
+   size_t size = this->size() ;
+   if (!fp.writeValues(m_levels.begin(),size) || !fp.writeValues(m_links0.begin(),size*(m_M0+1)))
+      return false ;
+   for (size_t i = 0 ; i < size ; ++i)
+      {
+      if (m_levels[i] && !fp.writeValues(m_upper[i],m_levels[i]*(m_M+1)))
+	 return false ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndexHNSW<IdxT,ValT>::loadStructure(CFile& fp)
+{
+   size_t size = this->size() ;
+   if (fp.read(m_levels.begin(),size,sizeof(uint8_t)) != size ||
+      fp.read(m_links0.begin(),size*(m_M0+1),sizeof(uint32_t)) != size*(m_M0+1))
+      return false ;
+   for (size_t i = 0 ; i < size ; ++i)
+      {
+      unsigned level = m_levels[i] ;
+      if (level > FrHNSW_MAX_LEVEL)
+	 return false ;
+      uint32_t save = links(i,0)[0] ;
+      allocateUpper(i,level) ;
+      links(i,0)[0] = save ;
+      if (level && fp.read(m_upper[i],level*(m_M+1),sizeof(uint32_t)) != level*(m_M+1))
+	 return false ;
+      // the searches use the links as indices without further checks, so reject a neighbor list
+      //   which overflows its slot or names a node that does not exist or is absent from the layer
+      for (unsigned l = 0 ; l <= level ; ++l)
+	 {
+	 const uint32_t* nbrs = links(i,l) ;
+	 if (nbrs[0] > maxLinks(l))
+	    return false ;
+	 for (size_t n = 1 ; n <= nbrs[0] ; ++n)
+	    {
+	    if (nbrs[n] >= size || m_levels[nbrs[n]] < l)
+	       return false ;
+	    }
+	 }
+      }
+   return size == 0 || (m_entry < size && m_levels[m_entry] == m_maxlevel) ;
+}
+
+/************************************************************************/
+/*	Locality-Sensitive Hashing					*/
+/************************************************************************/
+
+// each vector is hashed into one bucket in each of several tables; a query examines the vectors in
+//   its own buckets (plus nearby buckets for hashes where that is meaningful) and ranks them by their
+//   exact similarity.  Buckets are chains threaded through a per-vector array of successors.
+
+template <typename IdxT, typename ValT>
+class ANNIndexLSH : public ANNIndex<IdxT,ValT>
+   {
+   public:
+      typedef ANNIndex<IdxT,ValT> super ;
+      typedef Vector<IdxT,ValT> vec_type ;
+
+   public:
+      virtual ~ANNIndexLSH() = default ;
+
+   protected:
+      ANNIndexLSH(VectorMeasure<IdxT,ValT>* measure, size_t tables) : super(measure), m_tables(tables) {}
+
+      // compute the bucket key in each table for the vector
+      virtual void bucketKeys(const vec_type* vector, uint32_t* keys) const = 0 ;
+      // the number of bits which may be flipped in a key to generate additional buckets to probe
+      virtual size_t probeRadius(size_t effort) const = 0 ;
+
+      void allocateBuckets(unsigned bits) ;
+      void collect(uint32_t bucket, std::vector<uint32_t>& candidates) const ;
+
+      virtual bool grow(size_t old_capacity, size_t new_capacity) ;
+      virtual void prepare(size_t expected_size) ;
+      virtual void link(size_t id) ;
+      virtual size_t search(const vec_type* vector, size_t k, size_t effort, ANNResult* results) const ;
+      virtual void getParameters(uint64_t* params) const ;
+      virtual bool setParameters(const uint64_t* params) ;
+      virtual bool saveStructure(CFile& fp) const ;
+      virtual bool loadStructure(CFile& fp) ;
+
+   protected:
+      NewPtr<uint32_t> m_heads ;		// first vector in each bucket of each table
+      NewPtr<uint32_t> m_next ;			// next vector in the same bucket, m_tables per vector
+      size_t           m_tables ;
+      size_t           m_rows { 1 } ;
+      unsigned         m_bits { 0 } ;
+   } ;
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexLSH<IdxT,ValT>::allocateBuckets(unsigned bits)
+{
+   m_bits = bits ;
+   size_t buckets = m_tables << bits ;
+   m_heads.allocate(buckets) ;
+   std::fill_n(m_heads.begin(),buckets,FrANN_NONE) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndexLSH<IdxT,ValT>::grow(size_t old_capacity, size_t new_capacity)
+{
+   return m_next.reallocate(old_capacity*m_tables,new_capacity*m_tables) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexLSH<IdxT,ValT>::prepare(size_t expected_size)
+{
+   // size the tables for a handful of vectors per bucket, since fewer key bits let moderately similar
+   //   vectors collide more often; the key width can only be chosen while the index is still empty
+   if (this->size() == 0)
+      {
+      unsigned bits = ann_ceil_log2(expected_size) ;
+      bits = bits > FrLSH_BUCKET_LOAD_BITS ? bits - FrLSH_BUCKET_LOAD_BITS : 0 ;
+      allocateBuckets(std::max(std::min(bits,(unsigned)FrLSH_MAX_BITS),(unsigned)FrLSH_MIN_BITS)) ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexLSH<IdxT,ValT>::link(size_t id)
+{
+   if (!m_heads)
+      allocateBuckets(FrLSH_DEFAULT_BITS) ;
+   LocalAlloc<uint32_t,64> keys(m_tables) ;
+   bucketKeys(this->vector(id),keys) ;
+   uint32_t* next = m_next.at(id * m_tables) ;
+   for (size_t t = 0 ; t < m_tables ; ++t)
+      {
+      size_t bucket = (t << m_bits) | keys[t] ;
+      next[t] = m_heads[bucket] ;
+      m_heads[bucket] = (uint32_t)id ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexLSH<IdxT,ValT>::collect(uint32_t bucket, std::vector<uint32_t>& candidates) const
+{
+   size_t table = bucket >> m_bits ;
+   for (uint32_t id = m_heads[bucket] ; id != FrANN_NONE ; id = m_next[id * m_tables + table])
+      candidates.push_back(id) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t ANNIndexLSH<IdxT,ValT>::search(const vec_type* query, size_t k, size_t effort, ANNResult* results) const
+{
+   if (!m_heads)
+      return 0 ;
+   LocalAlloc<uint32_t,64> keys(m_tables) ;
+   bucketKeys(query,keys) ;
+   std::vector<uint32_t> candidates ;
+   size_t radius = probeRadius(effort) ;
+   for (size_t t = 0 ; t < m_tables ; ++t)
+      {
+      uint32_t bucket = (uint32_t)((t << m_bits) | keys[t]) ;
+      collect(bucket,candidates) ;
+      // multi-probe: also examine the buckets whose keys differ in one or two bits
+      for (size_t b1 = 0 ; radius >= 1 && b1 < m_bits ; ++b1)
+	 {
+	 uint32_t probe1 = bucket ^ (1U << b1) ;
+	 collect(probe1,candidates) ;
+	 for (size_t b2 = b1 + 1 ; radius >= 2 && b2 < m_bits ; ++b2)
+	    collect(probe1 ^ (1U << b2),candidates) ;
+	 }
+      }
+   std::sort(candidates.begin(),candidates.end()) ;
+   candidates.erase(std::unique(candidates.begin(),candidates.end()),candidates.end()) ;
+   std::vector<std::pair<double,uint32_t>> scored ;
+   scored.reserve(candidates.size()) ;
+   for (auto id : candidates)
+      scored.push_back(std::make_pair(this->similarity(query,id),id)) ;
+   size_t count = std::min(k,scored.size()) ;
+   std::partial_sort(scored.begin(),scored.begin()+count,scored.end(),
+      [](const std::pair<double,uint32_t>& s1, const std::pair<double,uint32_t>& s2)
+      { return s1.first > s2.first || (s1.first == s2.first && s1.second < s2.second) ; }) ;
+   for (size_t i = 0 ; i < count ; ++i)
+      {
+      results[i].id = scored[i].second ;
+      results[i].sim = scored[i].first ;
+      }
+   return count ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexLSH<IdxT,ValT>::getParameters(uint64_t* params) const
+{
+   params[0] = m_tables ;
+   params[1] = m_bits ;
+   params[2] = m_rows ;
+   params[3] = FrANN_SEED ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndexLSH<IdxT,ValT>::setParameters(const uint64_t* params)
+{
+   if (params[0] == 0 || params[0] > 64 || params[1] > FrLSH_MAX_BITS || params[2] == 0 || params[3] != FrANN_SEED)
+      return false ;
+   m_tables = params[0] ;
+   m_rows = params[2] ;
+   if (params[1])
+      allocateBuckets((unsigned)params[1]) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndexLSH<IdxT,ValT>::saveStructure(CFile& fp) const
+{
+   if (!m_heads)
+      return true ;
+   return fp.writeValues(m_heads.begin(),m_tables << m_bits) && fp.writeValues(m_next.begin(),this->size()*m_tables) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndexLSH<IdxT,ValT>::loadStructure(CFile& fp)
+{
+   if (!m_heads)
+      return this->size() == 0 ;
+   size_t buckets = m_tables << m_bits ;
+   size_t links = this->size() * m_tables ;
+   if (fp.read(m_heads.begin(),buckets,sizeof(uint32_t)) != buckets
+      || fp.read(m_next.begin(),links,sizeof(uint32_t)) != links)
+      return false ;
+   // vectors are pushed onto the front of their buckets in order, so each bucket chain must run from
+   //   an existing vector through strictly decreasing IDs; checking this also rules out cycles
+   for (size_t b = 0 ; b < buckets ; ++b)
+      {
+      if (m_heads[b] != FrANN_NONE && m_heads[b] >= this->size())
+	 return false ;
+      }
+   for (size_t i = 0 ; i < links ; ++i)
+      {
+      if (m_next[i] != FrANN_NONE && m_next[i] >= i / m_tables)
+	 return false ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+// random-hyperplane hashing (Charikar 2002): each key bit is the sign of the projection of the vector
+//   onto a random +1/-1 direction, with the direction's component for each feature taken from a hash
+//   of the feature so that sparse vectors never need a materialized projection matrix
+
+template <typename IdxT, typename ValT>
+class ANNIndexSimHash : public ANNIndexLSH<IdxT,ValT>
+   {
+   public:
+      typedef ANNIndexLSH<IdxT,ValT> super ;
+      typedef Vector<IdxT,ValT> vec_type ;
+
+   public:
+      ANNIndexSimHash(VectorMeasure<IdxT,ValT>* measure) : super(measure,FrSIMHASH_DEFAULT_TABLES) {}
+      virtual ~ANNIndexSimHash() = default ;
+
+      virtual ANNIndexType indexType() const { return ANNIndexType::simhash ; }
+      virtual const char* indexName() const { return "SimHash-LSH" ; }
+
+   protected:
+      virtual void bucketKeys(const vec_type* vector, uint32_t* keys) const ;
+      virtual size_t probeRadius(size_t effort) const { return effort ? effort : 1 ; }
+   } ;
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexSimHash<IdxT,ValT>::bucketKeys(const vec_type* vector, uint32_t* keys) const
+{
+   double projections[FrLSH_MAX_BITS] ;
+   unsigned bits = this->m_bits ;
+   size_t elts = vector->numElements() ;
+   for (size_t t = 0 ; t < this->m_tables ; ++t)
+      {
+      std::fill_n(projections,bits,0.0) ;
+      for (size_t i = 0 ; i < elts ; ++i)
+	 {
+	 double value = vector->elementValue(i) ;
+	 if (!value)
+	    continue ;
+	 uint64_t signs = ann_hash(FrANN_SEED,t,ann_element_index(vector,i)) ;
+	 for (unsigned b = 0 ; b < bits ; ++b)
+	    projections[b] += ((signs >> b) & 1) ? value : -value ;
+	 }
+      uint32_t key = 0 ;
+      for (unsigned b = 0 ; b < bits ; ++b)
+	 {
+	 if (projections[b] > 0.0)
+	    key |= (1U << b) ;
+	 }
+      keys[t] = key ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+// min-wise hashing with banding (Broder 1997): each key combines several min-hashes of the set of
+//   features present in the vector, so vectors collide with a probability which grows with their Jaccard
+//   overlap; this suits the binary similarity measures, which only look at feature presence
+
+template <typename IdxT, typename ValT>
+class ANNIndexMinHash : public ANNIndexLSH<IdxT,ValT>
+   {
+   public:
+      typedef ANNIndexLSH<IdxT,ValT> super ;
+      typedef Vector<IdxT,ValT> vec_type ;
+
+   public:
+      ANNIndexMinHash(VectorMeasure<IdxT,ValT>* measure) : super(measure,FrMINHASH_DEFAULT_TABLES)
+	 { this->m_rows = FrMINHASH_DEFAULT_ROWS ; }
+      virtual ~ANNIndexMinHash() = default ;
+
+      virtual ANNIndexType indexType() const { return ANNIndexType::minhash ; }
+      virtual const char* indexName() const { return "MinHash-LSH" ; }
+
+   protected:
+      virtual void bucketKeys(const vec_type* vector, uint32_t* keys) const ;
+      // neighboring keys are unrelated under min-wise hashing, so there is nothing to gain by probing them
+      virtual size_t probeRadius(size_t /*effort*/) const { return 0 ; }
+   } ;
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ANNIndexMinHash<IdxT,ValT>::bucketKeys(const vec_type* vector, uint32_t* keys) const
+{
+   size_t elts = vector->numElements() ;
+   uint32_t mask = (1U << this->m_bits) - 1 ;
+   for (size_t t = 0 ; t < this->m_tables ; ++t)
+      {
+      uint64_t band = FramepaC::fasthash64_init(this->m_rows * sizeof(uint64_t),t) ;
+      for (size_t r = 0 ; r < this->m_rows ; ++r)
+	 {
+	 uint64_t minhash = UINT64_MAX ;
+	 uint64_t row = t * this->m_rows + r ;
+	 for (size_t i = 0 ; i < elts ; ++i)
+	    {
+	    if (!vector->elementValue(i))
+	       continue ;
+	    uint64_t h = ann_hash(FrANN_SEED,row,ann_element_index(vector,i)) ;
+	    if (h < minhash)
+	       minhash = h ;
+	    }
+	 band = FramepaC::fasthash64_add(band,minhash) ;
+	 }
+      keys[t] = (uint32_t)FramepaC::fasthash64_finalize(band) & mask ;
+      }
+   return ;
+}
+
+/************************************************************************/
+/*	Methods for class ANNIndex					*/
+/************************************************************************/
+
+template <typename IdxT, typename ValT>
+ANNIndex<IdxT,ValT>* ANNIndex<IdxT,ValT>::create(ANNIndexType type, VectorMeasure<IdxT,ValT>* measure)
+{
+   if (!measure)
+      return nullptr ;
+   switch (type)
+      {
+      case ANNIndexType::hnsw:
+	 return new ANNIndexHNSW<IdxT,ValT>(measure) ;
+      case ANNIndexType::simhash:
+	 return new ANNIndexSimHash<IdxT,ValT>(measure) ;
+      case ANNIndexType::minhash:
+	 return new ANNIndexMinHash<IdxT,ValT>(measure) ;
+      default:
+	 return nullptr ;
+      }
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+ANNIndex<IdxT,ValT>* ANNIndex<IdxT,ValT>::create(VectorMeasure<IdxT,ValT>* measure, VectorSimilarityMeasure simtype,
+   bool sparse)
+{
+   ANNIndexType type = ANNIndexType::hnsw ;
+   if (sparse)
+      {
+      bool binary = (simtype >= VectorSimilarityMeasure::binary_anti_dice
+	 && simtype <= VectorSimilarityMeasure::binary_wilsonshmida) ;
+      type = binary ? ANNIndexType::minhash : ANNIndexType::simhash ;
+      }
+   return create(type,measure) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndex<IdxT,ValT>::reserve(size_t capacity)
+{
+   if (capacity <= m_capacity)
+      return true ;
+   size_t newcap = std::max(capacity,std::max(2*m_capacity,size_t(16))) ;
+   if (!m_vectors.reallocate(m_capacity,newcap) || !grow(m_capacity,newcap))
+      return false ;
+   m_capacity = newcap ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndex<IdxT,ValT>::build(const Array* vectors)
+{
+   if (!vectors)
+      return false ;
+   size_t count = 0 ;
+   for (auto obj : *vectors)
+      {
+      if (!obj)
+	 continue ;
+      if (!obj->isVector())
+	 return false ;
+      ++count ;
+      }
+   prepare(m_size + count) ;
+   if (!reserve(m_size + count))
+      return false ;
+   for (auto obj : *vectors)
+      {
+      if (obj)
+	 insert(static_cast<const vec_type*>(obj)) ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t ANNIndex<IdxT,ValT>::insert(const vec_type* vector)
+{
+   if (!vector || m_size >= FrANN_NONE || !reserve(m_size+1))
+      return (size_t)-1 ;
+   size_t id = m_size ;
+   m_vectors[id] = vector ;
+   link(id) ;
+   m_size = id + 1 ;
+   return id ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t ANNIndex<IdxT,ValT>::query(const vec_type* vector, size_t k, ANNResult* results) const
+{
+   if (!vector || !results || k == 0 || m_size == 0)
+      return 0 ;
+   return search(vector,k,m_effort,results) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+const Vector<IdxT,ValT>* ANNIndex<IdxT,ValT>::nearest(const vec_type* vector, double* sim) const
+{
+   ANNResult best ;
+   if (query(vector,1,&best) == 0)
+      return nullptr ;
+   if (sim)
+      *sim = best.sim ;
+   return m_vectors[best.id] ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+ANNIndex<IdxT,ValT>* ANNIndex<IdxT,ValT>::load(CFile& fp, const char* filename, const Array* vectors,
+   VectorMeasure<IdxT,ValT>* measure)
+{
+   int version = file_format ;
+   if (!fp || !vectors || !fp.verifySignature(signature,filename,version,min_file_format))
+      return nullptr ;
+   ANNIndexHeader header ;
+   if (!fp.readValue(&header))
+      return nullptr ;
+   // the index covers the non-null elements of the array, in order
+   size_t available = 0 ;
+   for (auto obj : *vectors)
+      {
+      if (obj && obj->isVector())
+	 ++available ;
+      }
+   if (available != header.m_size)
+      {
+      SystemMessage::error("ANN index in %s covers %lu vectors, but %lu were supplied",filename,
+	 (unsigned long)header.m_size,(unsigned long)available) ;
+      return nullptr ;
+      }
+   ANNIndex* index = create((ANNIndexType)header.m_type,measure) ;
+   if (!index)
+      return nullptr ;
+   if (!index->setParameters(header.m_params) || !index->reserve(header.m_size))
+      {
+      index->free() ;
+      return nullptr ;
+      }
+   for (auto obj : *vectors)
+      {
+      if (obj && obj->isVector())
+	 index->m_vectors[index->m_size++] = static_cast<const vec_type*>(obj) ;
+      }
+   if (!index->loadStructure(fp))
+      {
+      index->free() ;
+      return nullptr ;
+      }
+   return index ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+ANNIndex<IdxT,ValT>* ANNIndex<IdxT,ValT>::load(const char* filename, const Array* vectors,
+   VectorMeasure<IdxT,ValT>* measure)
+{
+   CInputFile fp(filename,CFile::binary) ;
+   return load(fp,filename,vectors,measure) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndex<IdxT,ValT>::save(CFile& fp) const
+{
+   if (!fp || !fp.writeSignature(signature,file_format))
+      return false ;
+   ANNIndexHeader header ;
+   header.m_type = (uint64_t)indexType() ;
+   header.m_size = m_size ;
+   getParameters(header.m_params) ;
+   return fp.writeValue(header) && saveStructure(fp) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool ANNIndex<IdxT,ValT>::save(const char* filename) const
+{
+   COutputFile fp(filename,CFile::binary) ;
+   return save(fp) ;
+}
+
+} // end of namespace Fr
+
+// end of file annindex.cc //
@@ -0,0 +1,188 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.15, last edit 2019-08-28					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "framepac/binaryvec.h"
+#include "framepac/threadpool.h"
+#include "framepac/utility.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Manifest constants						*/
+/************************************************************************/
+
+// number of rows packed by each parallel task
+#define FrBINVEC_BLOCK_SIZE 256
+
+/************************************************************************/
+/*	Helper functions						*/
+/************************************************************************/
+
+static uint64_t* alloc_aligned_words(size_t count, size_t alignment)
+{
+   void* mem = nullptr ;
+   if (count == 0)
+      count = 1 ;
+   if (posix_memalign(&mem,alignment,count * sizeof(uint64_t)) != 0)
+      return nullptr ;
+   return static_cast<uint64_t*>(mem) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+static size_t vector_dimensions(const Vector<IdxT,ValT>* v)
+{
+   if (v->isOneHotVector())
+      return static_cast<const OneHotVector<IdxT,ValT>*>(v)->elementIndex(0) + 1 ;
+   if (v->isSparseVector())
+      {
+      size_t n = v->numElements() ;
+      return n ? static_cast<const SparseVector<IdxT,ValT>*>(v)->elementIndex(n-1) + 1 : 0 ;
+      }
+   return v->numElements() ;
+}
+
+//----------------------------------------------------------------------------
+
+static inline void set_bit(uint64_t* bits, size_t index)
+{
+   bits[index/64] |= (1ULL << (index%64)) ;
+}
+
+/************************************************************************/
+/*	Methods for template class BinaryVectors				*/
+/************************************************************************/
+
+template <typename IdxT, typename ValT>
+void BinaryVectors<IdxT,ValT>::clear()
+{
+   ::free(m_bits) ;
+   m_bits = nullptr ;
+   delete[] m_counts ;
+   m_counts = nullptr ;
+   m_source = nullptr ;
+   m_size = 0 ;
+   m_dims = 0 ;
+   m_stride = 0 ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t BinaryVectors<IdxT,ValT>::encode(const vec_type* v, uint64_t* bits, size_t dims)
+{
+   if (!v || !bits)
+      return 0 ;
+   if (v->isOneHotVector())
+      {
+      auto ohv = static_cast<const OneHotVector<IdxT,ValT>*>(v) ;
+      size_t index = ohv->elementIndex(0) ;
+      if (index < dims && ohv->elementValue(index))
+	 set_bit(bits,index) ;
+      }
+   else if (v->isSparseVector())
+      {
+      auto sv = static_cast<const SparseVector<IdxT,ValT>*>(v) ;
+      for (size_t i = 0 ; i < sv->numElements() ; ++i)
+	 {
+	 size_t index = sv->elementIndex(i) ;
+	 if (index < dims && sv->elementValue(i))
+	    set_bit(bits,index) ;
+	 }
+      }
+   else
+      {
+      size_t count = std::min(dims,v->numElements()) ;
+      const ValT* values = v->elementValues() ;
+      for (size_t i = 0 ; i < count ; ++i)
+	 {
+	 if (values[i])
+	    set_bit(bits,i) ;
+	 }
+      }
+   // count the bits rather than the elements, in case a sparse vector lists an index twice
+   size_t set = 0 ;
+   for (size_t i = 0 ; i < (dims + 63) / 64 ; ++i)
+      set += popcount(bits[i]) ;
+   return set ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool BinaryVectors<IdxT,ValT>::load(const Array* vectors, size_t dims)
+{
+   clear() ;
+   if (!vectors)
+      return false ;
+   size_t N = vectors->size() ;
+   if (dims == 0)
+      {
+      for (size_t i = 0 ; i < N ; ++i)
+	 {
+	 const Object* obj = vectors->getNth(i) ;
+	 if (obj && obj->isVector())
+	    dims = std::max(dims,vector_dimensions(static_cast<const vec_type*>(obj))) ;
+	 }
+      }
+   const size_t align_words = ROW_ALIGN / sizeof(uint64_t) ;
+   size_t stride = ((dims + 63) / 64 + align_words - 1) / align_words * align_words ;
+   if (stride && N > ~(size_t)0 / (stride * sizeof(uint64_t)))
+      return false ;
+   m_bits = alloc_aligned_words(N * stride,ROW_ALIGN) ;
+   if (!m_bits)
+      return false ;
+   m_counts = new size_t[N] ;
+   m_source = vectors ;
+   m_size = N ;
+   m_dims = dims ;
+   m_stride = stride ;
+   size_t blocks = (N + FrBINVEC_BLOCK_SIZE - 1) / FrBINVEC_BLOCK_SIZE ;
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,blocks),1,[&](size_t b)
+      {
+      size_t first = b * FrBINVEC_BLOCK_SIZE ;
+      size_t last = std::min(N,first + FrBINVEC_BLOCK_SIZE) ;
+      // zero the rows including their padding, which then never contributes to any count
+      memset(m_bits + first * m_stride,'\0',(last - first) * m_stride * sizeof(uint64_t)) ;
+      for (size_t i = first ; i < last ; ++i)
+	 {
+	 const Object* obj = vectors->getNth(i) ;
+	 if (obj && obj->isVector())
+	    m_counts[i] = encode(static_cast<const vec_type*>(obj),m_bits + i * m_stride,m_dims) ;
+	 else
+	    m_counts[i] = ABSENT ;
+	 }
+      }) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+} // end namespace Fr
+
+// end of file binaryvec.cc //
@@ -0,0 +1,552 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-07					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#include <algorithm>
+#include <vector>
+#include "framepac/bwt.h"
+#include "framepac/message.h"
+#include "framepac/utility.h"
+
+namespace Fr {
+
+// Compressed suffix array after
+//   Kunihiko Sadakane.  New text indexing functionalities of the compressed suffix arrays.
+//      Journal of Algorithms 48(2):294-313, 2003.
+// using Psi-based backward search, which needs no per-token rank structures and thus remains
+//   compact even with a vocabulary of millions of word types
+
+/************************************************************************/
+/*	Types for this module						*/
+/************************************************************************/
+
+class BWTIndexHeader
+   {
+   public:
+      uint64_t m_numids ;	// number of tokens in the corpus
+      uint64_t m_types ;	// number of types (distinct IDs)
+      uint64_t m_newline ;	// ID for newline
+      uint64_t m_sample_rate ;	// spacing of sampled text positions
+      uint64_t m_numpointers ;	// number of explicit Psi values
+      uint64_t m_numsamples ;	// number of sampled suffix-array positions
+      uint64_t m_buckets ;	// offset of array of bucket starts
+      uint64_t m_flags ;	// offset of array of explicit-pointer flags
+      uint64_t m_first ;	// offset of array of first pointer per chunk
+      uint64_t m_pointers ;	// offset of array of explicit pointers
+      uint64_t m_sampled ;	// offset of array of sampled-position flags
+      uint64_t m_sampled_rank ;	// offset of array of sample counts per chunk
+      uint64_t m_samples ;	// offset of array of sampled text positions
+      uint64_t m_inverse ;	// offset of array of inverse samples
+      uint64_t m_pad[8] { 0 } ; // padding for future extensions
+   } ;
+
+/************************************************************************/
+/*	Methods for template class BWTIndex				*/
+/************************************************************************/
+
+template <typename IdT, typename IdxT>
+bool BWTIndex<IdT,IdxT>::build(const SuffixArray<IdT,IdxT>& index, unsigned sample_rate)
+{
+   clear() ;
+   size_t n = index.indexSize() ;
+   if (!index || n == 0)
+      return false ;
+   m_numids = IdxT(n) ;
+   m_types = index.vocabSize() ;
+   m_newline = index.newlineID() ;
+   m_sample_rate = sample_rate ? sample_rate : 1 ;
+   size_t types = m_types ;
+   if (types == 0 || (size_t)m_newline >= types)
+      {
+      SystemMessage::error("BWTIndex: newline ID must be within the vocabulary") ;
+      clear() ;
+      return false ;
+      }
+   // count the tokens to get the boundaries of the suffix-array buckets
+   std::vector<size_t> next(types+1,0) ;
+   for (size_t pos = 0 ; pos < n ; ++pos)
+      {
+      ++next[mapID(index.idAt(IdxT(pos)))] ;
+      }
+   m_buckets = new IdxT[types+1] ;
+   size_t total = 0 ;
+   for (size_t c = 0 ; c <= types ; ++c)
+      {
+      size_t count = next[c] ;
+      m_buckets[c] = IdxT(total) ;
+      next[c] = total ;
+      total += count ;
+      }
+   // Psi(i) is the suffix-array position j for which SA[j] == SA[i]+1.  Scanning the suffix array in
+   //   order and placing each j with the suffix one token earlier in the text yields Psi without an
+   //   inverse suffix array, because suffixes with the same first token are ordered by their
+   //   remainders.  The exception is the final suffix, whose Psi wraps around to the start of the
+   //   text; being a prefix of every other suffix in its bucket, it sorts first there, so its slot is
+   //   reserved and filled directly.  The same scan collects the sampled text positions.
+   size_t last_id = mapID(index.idAt(IdxT(n-1))) ;
+   m_last_suffix = IdxT(next[last_id]++) ;
+   m_numsamples = (n-1) / m_sample_rate + 1 + (((n-1) % m_sample_rate) ? 1 : 0) ;
+   IdxT* psi_values = new IdxT[n] ;
+   m_sampled = new uint64_t[numChunks()] ;
+   m_sampled_rank = new IdxT[numChunks()] ;
+   m_samples = new IdxT[m_numsamples] ;
+   m_inverse = new IdxT[numInverse()] ;
+   std::fill(m_sampled,m_sampled+numChunks(),0) ;
+   size_t prev_id = 0 ;
+   size_t samples = 0 ;
+   for (size_t j = 0 ; j < n ; ++j)
+      {
+      size_t pos = index.indexAt(IdxT(j)) ;
+      size_t id = mapID(index.idAt(IdxT(pos))) ;
+      if (id < prev_id || pos >= n || (pos == n - 1) != (j == (size_t)m_last_suffix))
+	 {
+	 SystemMessage::error("BWTIndex: suffix array is not properly sorted") ;
+	 delete[] psi_values ;
+	 clear() ;
+	 return false ;
+	 }
+      prev_id = id ;
+      if (pos == 0)
+	 psi_values[m_last_suffix] = IdxT(j) ;
+      else
+	 psi_values[next[mapID(index.idAt(IdxT(pos-1)))]++] = IdxT(j) ;
+      if (j % 64 == 0)
+	 m_sampled_rank[j/64] = IdxT(samples) ;
+      if (pos % m_sample_rate == 0 || pos == n - 1)
+	 {
+	 m_sampled[j/64] |= ((uint64_t)1 << (63 - (j%64))) ;
+	 m_samples[samples++] = IdxT(pos) ;
+	 }
+      if (pos % m_sample_rate == 0)
+	 m_inverse[pos / m_sample_rate] = IdxT(j) ;
+      }
+   // compress Psi into explicit values for the start of each chunk and wherever a value is not one
+   //   more than its predecessor
+   size_t explicit_count = 0 ;
+   for (size_t i = 0 ; i < n ; ++i)
+      {
+      if (i % 64 == 0 || psi_values[i] != psi_values[i-1] + 1)
+	 ++explicit_count ;
+      }
+   m_numpointers = explicit_count ;
+   m_pointers = new IdxT[explicit_count] ;
+   m_flags = new uint64_t[numChunks()] ;
+   m_first = new IdxT[numChunks()] ;
+   std::fill(m_flags,m_flags+numChunks(),0) ;
+   explicit_count = 0 ;
+   for (size_t i = 0 ; i < n ; ++i)
+      {
+      if (i % 64 == 0)
+	 m_first[i/64] = IdxT(explicit_count) ;
+      if (i % 64 == 0 || psi_values[i] != psi_values[i-1] + 1)
+	 {
+	 m_flags[i/64] |= ((uint64_t)1 << (63 - (i%64))) ;
+	 m_pointers[explicit_count++] = psi_values[i] ;
+	 }
+      }
+   delete[] psi_values ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+void BWTIndex<IdT,IdxT>::releaseArrays()
+{
+   if (!m_readonly)
+      {
+      delete[] m_buckets ;
+      delete[] m_flags ;
+      delete[] m_first ;
+      delete[] m_pointers ;
+      delete[] m_sampled ;
+      delete[] m_sampled_rank ;
+      delete[] m_samples ;
+      delete[] m_inverse ;
+      }
+   m_buckets = nullptr ;
+   m_flags = nullptr ;
+   m_first = nullptr ;
+   m_pointers = nullptr ;
+   m_sampled = nullptr ;
+   m_sampled_rank = nullptr ;
+   m_samples = nullptr ;
+   m_inverse = nullptr ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+void BWTIndex<IdT,IdxT>::clear()
+{
+   releaseArrays() ;
+   m_mmap.close() ;
+   m_readonly = false ;
+   m_numpointers = 0 ;
+   m_numsamples = 0 ;
+   m_numids = 0 ;
+   m_last_suffix = 0 ;
+   m_types = 0 ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+size_t BWTIndex<IdT,IdxT>::memoryUsage() const
+{
+   if (!*this)
+      return 0 ;
+   return ((size_t)m_types + 1) * sizeof(IdxT)
+      + numChunks() * 2 * (sizeof(uint64_t) + sizeof(IdxT))
+      + (m_numpointers + m_numsamples + numInverse()) * sizeof(IdxT) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+IdxT BWTIndex<IdT,IdxT>::psi(IdxT N) const
+{
+   size_t chunk = N / 64 ;
+   unsigned idx = N % 64 ;
+   uint64_t unwanted = ((uint64_t)1 << (63 - idx)) - 1 ;
+   uint64_t wanted = m_flags[chunk] & ~unwanted ;
+   uint64_t ptrflag = wanted & (~wanted + 1) ;
+   uint64_t add = (ptrflag - 1) & ~(wanted|unwanted) ;
+   size_t ptrnum = (size_t)m_first[chunk] + popcount(wanted) - 1 ;
+   return IdxT((size_t)m_pointers[ptrnum] + popcount(add)) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+IdT BWTIndex<IdT,IdxT>::idAt(IdxT N) const
+{
+   if (N >= m_numids)
+      return ErrorID ;
+   // find the last bucket starting at or before N; empty buckets share their start with the next one
+   const IdxT* bucket = std::upper_bound((const IdxT*)m_buckets,(const IdxT*)m_buckets+(size_t)m_types+1,N) ;
+   return IdT(bucket - m_buckets - 1) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+bool BWTIndex<IdT,IdxT>::isSampled(IdxT N, size_t& rank) const
+{
+   size_t chunk = N / 64 ;
+   unsigned idx = N % 64 ;
+   uint64_t flags = m_sampled[chunk] ;
+   // count the flags for positions before N, which are in the higher-order bits
+   rank = (size_t)m_sampled_rank[chunk] + popcount(flags & ~(((uint64_t)2 << (63 - idx)) - 1)) ;
+   return (flags & ((uint64_t)1 << (63 - idx))) != 0 ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+IdxT BWTIndex<IdT,IdxT>::locate(IdxT N) const
+{
+   if (N >= m_numids)
+      return m_numids ;
+   // each step of Psi advances one token through the text, so we reach a sampled position (or the
+   //   final position of the text) within sample_rate steps
+   size_t steps = 0 ;
+   size_t rank ;
+   while (!isSampled(N,rank))
+      {
+      N = psi(N) ;
+      ++steps ;
+      }
+   return IdxT((size_t)m_samples[rank] - steps) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+IdxT BWTIndex<IdT,IdxT>::inverse(IdxT textpos) const
+{
+   if (textpos >= m_numids)
+      return m_numids ;
+   IdxT N = m_inverse[textpos / m_sample_rate] ;
+   for (size_t i = textpos % m_sample_rate ; i > 0 ; --i)
+      N = psi(N) ;
+   return N ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+bool BWTIndex<IdT,IdxT>::lookup(const IdT* key, unsigned keylen, IdxT& first_match, IdxT& last_match) const
+{
+   if (!*this || !key || keylen == 0)
+      return false ;
+   // start with the suffixes beginning with the last token of the key, then repeatedly narrow to those
+   //   preceded by the next earlier token; within the bucket for that token, Psi is increasing, so the
+   //   suffixes whose successors lie in the current range form a contiguous range
+   IdT id = mapID(key[keylen-1]) ;
+   size_t lo = m_buckets[id] ;
+   size_t hi = m_buckets[id+1] ;
+   for (size_t k = keylen - 1 ; k > 0 && lo < hi ; --k)
+      {
+      id = mapID(key[k-1]) ;
+      size_t bucket_lo = m_buckets[id] ;
+      size_t bucket_hi = m_buckets[id+1] ;
+      // Psi wraps around from the end of the text to its start, which must not count as a match; the
+      //   final suffix sorts first in its bucket, and skipping it leaves Psi increasing over the rest
+      if (bucket_lo == (size_t)m_last_suffix && bucket_lo < bucket_hi)
+	 ++bucket_lo ;
+      auto lower_bound = [&](size_t target, size_t low, size_t high) -> size_t
+	 {
+	 while (low < high)
+	    {
+	    size_t mid = low + (high - low) / 2 ;
+	    if ((size_t)psi(IdxT(mid)) < target)
+	       low = mid + 1 ;
+	    else
+	       high = mid ;
+	    }
+	 return low ;
+	 } ;
+      size_t new_lo = lower_bound(lo,bucket_lo,bucket_hi) ;
+      hi = lower_bound(hi,new_lo,bucket_hi) ;
+      lo = new_lo ;
+      }
+   if (lo >= hi)
+      return false ;
+   first_match = IdxT(lo) ;
+   last_match = IdxT(hi - 1) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+IdxT BWTIndex<IdT,IdxT>::count(const IdT* key, unsigned keylen) const
+{
+   IdxT first, last ;
+   if (!lookup(key,keylen,first,last))
+      return 0 ;
+   return IdxT((size_t)last - (size_t)first + 1) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+IdxT BWTIndex<IdT,IdxT>::extract(IdxT textpos, IdxT len, IdT* buffer) const
+{
+   if (!*this || !buffer || textpos >= m_numids)
+      return 0 ;
+   if (len > m_numids - textpos)
+      len = m_numids - textpos ;
+   IdxT N = inverse(textpos) ;
+   for (size_t i = 0 ; i < len ; ++i)
+      {
+      buffer[i] = idAt(N) ;
+      N = psi(N) ;
+      }
+   return len ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+bool BWTIndex<IdT,IdxT>::load(const char* filename, bool allow_mmap)
+{
+   CInputFile file(filename,CFile::binary) ;
+   return file ? load(file,filename,allow_mmap) : false ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+bool BWTIndex<IdT,IdxT>::load(CFile& fp, const char* filename, bool allow_mmap)
+{
+   if (!fp)
+      return false ;
+   clear() ;
+   off_t base_offset = fp.tell() ;
+   int version = file_format ;
+   if (!fp.verifySignature(signature,filename,version,min_file_format))
+      return false ;
+   uint8_t idsize, idxsize ;
+   if (!fp.readValue(&idsize) || !fp.readValue(&idxsize))
+      return false ;
+   if (idsize != sizeof(IdT) || idxsize != sizeof(IdxT))
+      {
+      SystemMessage::error("wrong data type - sizeof() does not match") ;
+      return false ;
+      }
+   if (allow_mmap && loadMapped(filename,base_offset))
+      return true ;
+   BWTIndexHeader header ;
+   if (!fp.readValue(&header))
+      return false ;
+   m_numids = IdxT(header.m_numids) ;
+   m_types = IdT(header.m_types) ;
+   m_newline = IdT(header.m_newline) ;
+   m_sample_rate = (unsigned)header.m_sample_rate ;
+   m_numpointers = header.m_numpointers ;
+   m_numsamples = header.m_numsamples ;
+   bool success = m_sample_rate > 0 ;
+   success = success && fp.readVarsAt(header.m_buckets + base_offset,&m_buckets,(size_t)m_types+1) ;
+   success = success && fp.readVarsAt(header.m_flags + base_offset,&m_flags,numChunks()) ;
+   success = success && fp.readVarsAt(header.m_first + base_offset,&m_first,numChunks()) ;
+   success = success && fp.readVarsAt(header.m_pointers + base_offset,&m_pointers,m_numpointers) ;
+   success = success && fp.readVarsAt(header.m_sampled + base_offset,&m_sampled,numChunks()) ;
+   success = success && fp.readVarsAt(header.m_sampled_rank + base_offset,&m_sampled_rank,numChunks()) ;
+   success = success && fp.readVarsAt(header.m_samples + base_offset,&m_samples,m_numsamples) ;
+   success = success && fp.readVarsAt(header.m_inverse + base_offset,&m_inverse,numInverse()) ;
+   if (!success)
+      clear() ;
+   else
+      m_last_suffix = inverse(m_numids-1) ;
+   return success ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+bool BWTIndex<IdT,IdxT>::loadMapped(const char* filename, off_t base_offset)
+{
+   if (!filename || !*filename)
+      return false;
+   MemMappedROFile mm(filename,base_offset) ;
+   if (!mm)
+      return false ;
+   m_mmap = std::move(mm) ;
+   if (loadFromMmap(*m_mmap,m_mmap.size()))
+      return true ;
+   m_mmap.close() ;
+   return false ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+bool BWTIndex<IdT,IdxT>::loadFromMmap(const char* mmap_base, size_t mmap_len)
+{
+   size_t header_size = CFile::signatureSize(signature) + 2*sizeof(uint8_t) ;
+   if (!mmap_base || mmap_len < header_size + sizeof(BWTIndexHeader))
+      return false;
+   releaseArrays() ;
+   m_readonly = true ;
+   const BWTIndexHeader* header = reinterpret_cast<const BWTIndexHeader*>(mmap_base + header_size) ;
+   m_numids = IdxT(header->m_numids) ;
+   m_types = IdT(header->m_types) ;
+   m_newline = IdT(header->m_newline) ;
+   m_sample_rate = (unsigned)header->m_sample_rate ;
+   m_numpointers = header->m_numpointers ;
+   m_numsamples = header->m_numsamples ;
+   // make sure that every array lies within the mapped region before pointing at it
+   bool valid = m_sample_rate > 0 ;
+   auto check = [&](uint64_t offset, size_t count, size_t elt_size)
+      {
+      if (offset < header_size || offset > mmap_len || count > (mmap_len - offset) / elt_size)
+	 valid = false ;
+      return mmap_base + offset ;
+      } ;
+   m_buckets = (IdxT*)check(header->m_buckets,(size_t)m_types+1,sizeof(IdxT)) ;
+   m_flags = (uint64_t*)check(header->m_flags,numChunks(),sizeof(uint64_t)) ;
+   m_first = (IdxT*)check(header->m_first,numChunks(),sizeof(IdxT)) ;
+   m_pointers = (IdxT*)check(header->m_pointers,m_numpointers,sizeof(IdxT)) ;
+   m_sampled = (uint64_t*)check(header->m_sampled,numChunks(),sizeof(uint64_t)) ;
+   m_sampled_rank = (IdxT*)check(header->m_sampled_rank,numChunks(),sizeof(IdxT)) ;
+   m_samples = (IdxT*)check(header->m_samples,m_numsamples,sizeof(IdxT)) ;
+   m_inverse = (IdxT*)check(header->m_inverse,numInverse(),sizeof(IdxT)) ;
+   if (!valid)
+      {
+      SystemMessage::error("BWTIndex: corrupted index file") ;
+      releaseArrays() ;
+      m_readonly = false ;
+      m_numids = 0 ;
+      return false ;
+      }
+   m_last_suffix = inverse(m_numids-1) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+bool BWTIndex<IdT,IdxT>::save(CFile& fp) const
+{
+   if (!fp || !*this)
+      return false ;
+   off_t base_offset = fp.tell() ;
+   if (!fp.writeSignature(signature,file_format))
+      return false ;
+   uint8_t idsize = sizeof(IdT) ;
+   uint8_t idxsize = sizeof(IdxT) ;
+   if (!fp.writeValue(idsize) || !fp.writeValue(idxsize))
+      return false ;
+   off_t header_offset = fp.tell() ;
+   BWTIndexHeader header ;
+   header.m_numids = m_numids ;
+   header.m_types = m_types ;
+   header.m_newline = m_newline ;
+   header.m_sample_rate = m_sample_rate ;
+   header.m_numpointers = m_numpointers ;
+   header.m_numsamples = m_numsamples ;
+   if (!fp.writeValue(header))
+      return false ;
+   // the 64-bit arrays go first, to keep them aligned if the header is
+   header.m_flags = fp.tell() - base_offset ;
+   if (!fp.writeValues(m_flags,numChunks()))
+      return false ;
+   header.m_sampled = fp.tell() - base_offset ;
+   if (!fp.writeValues(m_sampled,numChunks()))
+      return false ;
+   header.m_buckets = fp.tell() - base_offset ;
+   if (!fp.writeValues(m_buckets,(size_t)m_types+1))
+      return false ;
+   header.m_first = fp.tell() - base_offset ;
+   if (!fp.writeValues(m_first,numChunks()))
+      return false ;
+   header.m_pointers = fp.tell() - base_offset ;
+   if (!fp.writeValues(m_pointers,m_numpointers))
+      return false ;
+   header.m_sampled_rank = fp.tell() - base_offset ;
+   if (!fp.writeValues(m_sampled_rank,numChunks()))
+      return false ;
+   header.m_samples = fp.tell() - base_offset ;
+   if (!fp.writeValues(m_samples,m_numsamples))
+      return false ;
+   header.m_inverse = fp.tell() - base_offset ;
+   if (!fp.writeValues(m_inverse,numInverse()))
+      return false ;
+   // now that we've written all the other data, we have a complete header, so return to the start of the file
+   //   and update the header
+   off_t lastpos = fp.tell() ;
+   fp.seek(header_offset) ;
+   bool success = true ;
+   if (!fp.writeValue(header))
+      success = false ;
+   fp.flush() ;
+   fp.seek(lastpos) ;
+   return success ;
+}
+
+//----------------------------------------------------------------------------
+
+} // end of namespace Fr
+
+// end of file bwt.cc //
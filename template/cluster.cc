@@ -20,11 +20,14 @@
 /************************************************************************/
 
 #include <stdarg.h>
+#include "framepac/annindex.h"
 #include "framepac/cluster.h"
 #include "framepac/hashtable.h"
+#include "framepac/message.h"
 #include "framepac/progress.h"
 #include "framepac/random.h"
 #include "framepac/threadpool.h"
+#include "framepac/vectorcoll.h"
 
 namespace Fr
 {
@@ -235,15 +238,13 @@ double ClusterInfo::similarity(ClusterInfo* other, VectorMeasure<IdxT,ValT>* vm)
          {
 	 auto vectors1 = allMembers() ;
 	 auto vectors2 = other->allMembers() ;
+	 LocalAlloc<double> sims(vectors2->size()) ;
 	 double sum { 0.0 } ;
 	 for (auto vec1 : *vectors1)
 	    {
-	    auto vector1 = static_cast<const Vector<IdxT,ValT>*>(vec1) ;
-	    for (auto vec2 : *vectors2)
-	       {
-	       auto vector2 = static_cast<const Vector<IdxT,ValT>*>(vec2) ;
-	       sum += vm->similarity(vector1,vector2) ;
-	       }
+	    vm->similarities(static_cast<const Vector<IdxT,ValT>*>(vec1),vectors2,sims) ;
+	    for (size_t i = 0 ; i < vectors2->size() ; ++i)
+	       sum += sims[i] ;
 	    }
 	 double combinations = vectors1->size() * vectors2->size() ;
 	 return sum / combinations ;
@@ -252,15 +253,13 @@ double ClusterInfo::similarity(ClusterInfo* other, VectorMeasure<IdxT,ValT>* vm)
          {
 	 auto vectors1 = allMembers() ;
 	 auto vectors2 = other->allMembers() ;
+	 LocalAlloc<double> sims(vectors2->size()) ;
 	 double furthest { HUGE_VAL } ;
 	 for (auto vec1 : *vectors1)
 	    {
-	    auto vector1 = static_cast<const Vector<IdxT,ValT>*>(vec1) ;
-	    for (auto vec2 : *vectors2)
-	       {
-	       auto vector2 = static_cast<const Vector<IdxT,ValT>*>(vec2) ;
-	       furthest = std::min(furthest,vm->similarity(vector1,vector2)) ;
-	       }
+	    vm->similarities(static_cast<const Vector<IdxT,ValT>*>(vec1),vectors2,sims) ;
+	    for (size_t i = 0 ; i < vectors2->size() ; ++i)
+	       furthest = std::min(furthest,sims[i]) ;
 	    }
 	 return furthest ;
 	 }
@@ -268,15 +267,13 @@ double ClusterInfo::similarity(ClusterInfo* other, VectorMeasure<IdxT,ValT>* vm)
          {
 	 auto vectors1 = allMembers() ;
 	 auto vectors2 = other->allMembers() ;
-	 double nearest { HUGE_VAL } ;
+	 LocalAlloc<double> sims(vectors2->size()) ;
+	 double nearest { -HUGE_VAL } ;
 	 for (auto vec1 : *vectors1)
 	    {
-	    auto vector1 = static_cast<const Vector<IdxT,ValT>*>(vec1) ;
-	    for (auto vec2 : *vectors2)
-	       {
-	       auto vector2 = static_cast<const Vector<IdxT,ValT>*>(vec2) ;
-	       nearest = std::max(nearest,vm->similarity(vector1,vector2)) ;
-	       }
+	    vm->similarities(static_cast<const Vector<IdxT,ValT>*>(vec1),vectors2,sims) ;
+	    for (size_t i = 0 ; i < vectors2->size() ; ++i)
+	       nearest = std::max(nearest,sims[i]) ;
 	    }
 	 return nearest ;
 	 }
@@ -365,34 +362,37 @@ double ClusterInfo::reverseSimilarity(const Vector<IdxT,ValT>* other, VectorMeas
       case ClusterRep::average:
          {
 	 auto vectors = allMembers() ;
+	 LocalAlloc<double> sims(vectors->size()) ;
+	 vm->similarities(other,vectors,sims) ;
 	 double avg { 0.0 } ;
 	 double combinations { vectors->size() } ;
-	 for (auto vec : *vectors)
+	 for (size_t i = 0 ; i < vectors->size() ; ++i)
 	    {
-	    auto vector = static_cast<const Vector<IdxT,ValT>*>(vec) ;
-	    avg += (vm->similarity(other,vector) / combinations) ;
+	    avg += (sims[i] / combinations) ;
 	    }
 	 return avg ;
 	 }
       case ClusterRep::furthest:
          {
 	 auto vectors = allMembers() ;
+	 LocalAlloc<double> sims(vectors->size()) ;
+	 vm->similarities(other,vectors,sims) ;
 	 double furthest { HUGE_VAL } ;
-	 for (auto vec : *vectors)
+	 for (size_t i = 0 ; i < vectors->size() ; ++i)
 	    {
-	    auto vector = static_cast<const Vector<IdxT,ValT>*>(vec) ;
-	    furthest = std::min(furthest,vm->similarity(other,vector)) ;
+	    furthest = std::min(furthest,sims[i]) ;
 	    }
 	 return furthest ;
 	 }
       case ClusterRep::nearest:
          {
 	 auto vectors = allMembers() ;
+	 LocalAlloc<double> sims(vectors->size()) ;
+	 vm->similarities(other,vectors,sims) ;
 	 double nearest { -HUGE_VAL } ;
-	 for (auto vec : *vectors)
+	 for (size_t i = 0 ; i < vectors->size() ; ++i)
 	    {
-	    auto vector = static_cast<const Vector<IdxT,ValT>*>(vec) ;
-	    nearest = std::max(nearest,vm->similarity(other,vector)) ;
+	    nearest = std::max(nearest,sims[i]) ;
 	    }
 	 return nearest ;
 	 }
@@ -631,6 +631,26 @@ ClusterInfo* ClusteringAlgo<IdxT,ValT>::cluster(ArrayIter first, ArrayIter past_
 
 //----------------------------------------------------------------------------
 
+template <typename IdxT, typename ValT>
+Array* ClusteringAlgo<IdxT,ValT>::loadVectors(const char* filename, bool sparse)
+{
+   if (VectorCollection<IdxT,ValT>::isCollectionFile(filename))
+      {
+      // the binary format is memory-mapped, so the only work is building the Vector objects
+      VectorCollection<IdxT,ValT> coll ;
+      return coll.load(filename) ? coll.makeVectors() : nullptr ;
+      }
+   CInputFile file(filename) ;
+   if (!file)
+      {
+      SystemMessage::error("unable to open %s",filename) ;
+      return nullptr ;
+      }
+   return VectorCollection<IdxT,ValT>::parseText(file,sparse) ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename IdxT, typename ValT>
 bool ClusteringAlgo<IdxT,ValT>::separateSeeds(const Array* vectors, RefArray*& seed, RefArray*& nonseed) const
 {
@@ -655,67 +675,72 @@ bool ClusteringAlgo<IdxT,ValT>::separateSeeds(const Array* vectors, RefArray*& s
 
 //----------------------------------------------------------------------------
 
-template <typename IdxT, typename ValT>
-bool assign_vector_to_nearest_center(size_t index, va_list args)
-{
-   typedef VectorMeasure<IdxT,ValT> VM ;
-   auto vectors = va_arg(args,const void*) ;
-   auto vecarray = reinterpret_cast<const Array*>(vectors) ;
-   auto vector = reinterpret_cast<Vector<IdxT,ValT>*>(vecarray->getNth(index)) ;
-   auto centers = va_arg(args,const Array*) ;
-   auto measure = va_arg(args,VM*) ;
-   auto threshold = va_arg(args,double) ;
-   auto changes = va_arg(args,Atomic<size_t>*) ;
-   auto prog = va_arg(args,ProgressIndicator*) ;
-   if (!vector) return false ;
-   auto best_center = ClusteringAlgo<IdxT,ValT>::nearestNeighbor(vector,centers,measure,threshold) ;
-   if (best_center)
-      {
-      // assign cluster to which best_center belongs to vector
-      auto old_label = vector->label() ;
-      auto new_label = best_center->label() ;
-      if (old_label != new_label)
-	 {
-	 vector->setLabel(new_label) ;
-	 (*changes)++ ;
-	 }
-      }
-   if (prog) prog->incr() ;
-   return true ;
-}
-
-//----------------------------------------------------------------------------
-
 template <typename IdxT, typename ValT>
 size_t ClusteringAlgo<IdxT,ValT>::assignToNearest(const Array* vectors, const Array* centers,
    ProgressIndicator* prog, double threshold) const
 {
    ThreadPool *tp = ThreadPool::defaultPool() ;
    if (!tp) return false ;
-   Atomic<size_t> changes { 0 } ;
-   if (tp->parallelize(assign_vector_to_nearest_center<IdxT,ValT>,vectors->size(),vectors,
-	 centers,m_measure,threshold,&changes,prog))
-      return changes ;
-   else
-      return 0 ;
+   auto measure = m_measure ;
+   ANNIndex<IdxT,ValT>* ann = makeCenterIndex(centers) ;
+   size_t changes = tp->parallel_reduce(Range<size_t>(0,vectors->size()),size_t(0),
+      [&](size_t index) -> size_t
+      {
+      auto vector = static_cast<Vector<IdxT,ValT>*>(vectors->getNth(index)) ;
+      if (!vector)
+	 return 0 ;
+      size_t changed = 0 ;
+      const Vector<IdxT,ValT>* best_center = nullptr ;
+      if (ann)
+	 {
+	 double sim ;
+	 best_center = ann->nearest(vector,&sim) ;
+	 if (best_center && sim < threshold)
+	    best_center = nullptr ;
+	 }
+      // fall back to the exhaustive scan if the index did not come up with a suitable center
+      if (!best_center)
+	 best_center = nearestNeighbor(vector,centers,measure,threshold) ;
+      if (best_center)
+	 {
+	 // assign cluster to which best_center belongs to vector
+	 auto old_label = vector->label() ;
+	 auto new_label = best_center->label() ;
+	 if (old_label != new_label)
+	    {
+	    vector->setLabel(new_label) ;
+	    changed = 1 ;
+	    }
+	 }
+      if (prog) prog->incr() ;
+      return changed ;
+      },
+      [](size_t a, size_t b) { return a + b ; }) ;
+   if (ann)
+      ann->free() ;
+   return changes ;
 }
 
 //----------------------------------------------------------------------------
 
 template <typename IdxT, typename ValT>
-bool compute_similarity(size_t index, va_list args)
+ANNIndex<IdxT,ValT>* ClusteringAlgo<IdxT,ValT>::makeCenterIndex(const Array* centers) const
 {
-   typedef Vector<IdxT,ValT> vectype ;
-   typedef VectorMeasure<IdxT,ValT> VM ;
-   auto clusters = va_arg(args,const Array*) ;
-   auto vector = va_arg(args,const vectype*) ;
-   auto scores = va_arg(args,double*) ;
-   auto measure = va_arg(args,VM*) ;
-   auto prog = va_arg(args,ProgressIndicator*) ;
-   auto cluster = static_cast<ClusterInfo*>(clusters->getNth(index)) ;
-   scores[index] = cluster->similarity(vector,measure) ;
-   if (prog) prog->incr() ;
-   return true ;
+   // an exhaustive scan is cheaper than building an index unless there are many centers
+   if (annCenters() == 0 || !centers || centers->size() < annCenters())
+      return nullptr ;
+   auto first = centers->getNth(0) ;
+   bool sparse = first && first->isSparseVector() ;
+   auto index = ANNIndex<IdxT,ValT>::create(m_measure,similarityMeasure(),sparse) ;
+   if (!index)
+      return nullptr ;
+   if (!index->build(centers))
+      {
+      index->free() ;
+      return nullptr ;
+      }
+   this->log(2,"  using %s index over %lu centers",index->indexName(),index->size()) ;
+   return index ;
 }
 
 //----------------------------------------------------------------------------
@@ -730,22 +755,27 @@ double ClusteringAlgo<IdxT,ValT>::findNearestCluster(const Array* clusters, cons
       {
       return -HUGE_VAL ;
       }
-   size_t num_clusters { clusters->size() } ;
-   LocalAlloc<double> scores(num_clusters) ;
-   double best_score = -HUGE_VAL ;
-   if (tp->parallelize(compute_similarity<IdxT,ValT>,num_clusters,clusters,vector,&scores,m_measure,prog))
+   // find the most similar cluster, preferring the lowest-numbered one in case of ties
+   typedef std::pair<double,size_t> Score ;
+   auto measure = m_measure ;
+   Score best = tp->parallel_reduce(Range<size_t>(0,clusters->size()),Score(-HUGE_VAL,~0),
+      [&](size_t index) -> Score
       {
-      // scan through the list of scores for the best
-      for (size_t i = 0 ; i < num_clusters ; ++i)
-	 {
-	 if (scores[i] > best_score)
-	    {
-	    best_cluster = i ;
-	    best_score = scores[i] ;
-	    }
-	 }
-      }
-   return best_score ;
+      auto cluster = static_cast<ClusterInfo*>(clusters->getNth(index)) ;
+      double sim = cluster->similarity(vector,measure) ;
+      if (prog) prog->incr() ;
+      // as in a sequential scan, a cluster only qualifies with a score above -HUGE_VAL (and not NaN)
+      return (sim > -HUGE_VAL) ? Score(sim,index) : Score(-HUGE_VAL,~0) ;
+      },
+      [](const Score& s1, const Score& s2) -> Score
+      {
+      if (s1.first > s2.first || (s1.first == s2.first && s1.second < s2.second))
+	 return s1 ;
+      return s2 ;
+      }) ;
+   if (best.second != (size_t)~0)
+      best_cluster = best.second ;
+   return best.first ;
 }
 
 //----------------------------------------------------------------------------
@@ -757,11 +787,15 @@ Vector<IdxT,ValT>* ClusteringAlgo<IdxT,ValT>::nearestNeighbor(const Vector<IdxT,
    ScopedObject<RefArray> best_centers ;
    Vector<IdxT,ValT>* best_center = nullptr ;
    double best_sim = -HUGE_VAL ;
-   for (auto cent : *centers)
+   size_t num_centers = centers->size() ;
+   LocalAlloc<double> sims(num_centers) ;
+   measure->similarities(vector,centers,sims) ;
+   for (size_t i = 0 ; i < num_centers ; ++i)
       {
+      auto cent = centers->getNth(i) ;
       if (!cent) continue ;
       auto center = static_cast<Vector<IdxT,ValT>*>(cent) ;
-      double sim = measure->similarity(vector,center) ;
+      double sim = sims[i] ;
       if (sim < threshold)
 	 continue ;
       if (sim == best_sim)
@@ -19,8 +19,13 @@
 /*									*/
 /************************************************************************/
 
+#include <algorithm>
+#include <cmath>
+#include <new>
+#include <vector>
 #include "framepac/cluster.h"
 #include "framepac/symboltable.h"
+#include "framepac/vectorcoll.h"
 
 namespace Fr
 {
@@ -42,6 +47,10 @@ class ClusteringAlgoBrown : public ClusteringAlgo<IdxT,ValT>
 
       virtual ClusterInfo* cluster(const Array* vectors) const ;
 
+   protected:
+      ClusterInfo* mergeByRepresentative(const Array* vectors) const ;
+      ClusterInfo* mergeByLinkage(const Array* vectors) const ;
+
    protected:
       bool   m_flatten { false } ;
    } ;
@@ -66,14 +75,11 @@ class ClusteringAlgoAgglom : public ClusteringAlgoBrown<IdxT,ValT>
 /************************************************************************/
 
 template <typename IdxT, typename ValT>
-bool agglom_clustering_best_similarity(size_t index, va_list args)
+bool agglom_clustering_best_similarity(size_t index, const Array* clusters, double* similarity,
+   size_t* neighbor, VectorMeasure<IdxT,ValT>* measure, ProgressIndicator* prog)
 {
-   typedef VectorMeasure<IdxT,ValT> VM ;
-   auto clusters = va_arg(args,const Array*) ;
-   double* similarity = va_arg(args,double*) + index ;
-   size_t* neighbor = va_arg(args,size_t*) + index ;
-   VM* measure = va_arg(args,VM*) ;
-   ProgressIndicator* prog = va_arg(args,ProgressIndicator*) ;
+   similarity += index ;
+   neighbor += index ;
    if (!measure) return false ;
    auto cluster = static_cast<ClusterInfo*>(clusters->getNth(index))->members() ;
    if (!cluster || cluster->size() != 1)
@@ -104,15 +110,11 @@ bool agglom_clustering_best_similarity(size_t index, va_list args)
 //----------------------------------------------------------------------------
 
 template <typename IdxT, typename ValT>
-bool update_nearest_neighbors(size_t index, va_list args)
+bool update_nearest_neighbors(size_t index, const Array* clusters, double* similarity, size_t* neighbor,
+   VectorMeasure<IdxT,ValT>* measure, size_t clus1, size_t clus2)
 {
-   typedef VectorMeasure<IdxT,ValT> VM ;
-   auto clusters = va_arg(args,const Array*) ;
-   double* similarity = va_arg(args,double*) + index ;
-   size_t* neighbor = va_arg(args,size_t*) + index ;
-   VM* measure = va_arg(args,VM*) ;
-   size_t clus1 = va_arg(args,size_t) ;
-   size_t clus2 = va_arg(args,size_t) ;
+   similarity += index ;
+   neighbor += index ;
    auto this_cluster = static_cast<ClusterInfo*>(clusters->getNth(index)) ;
    auto merged_cluster = static_cast<ClusterInfo*>(clusters->getNth(clus1)) ;
    if (index == clus1)
@@ -180,8 +182,300 @@ bool set_brown_label(Object* vec, const char* label)
    return true ;
 }
 
+/************************************************************************/
+/*	Lance-Williams agglomerative clustering				*/
+/************************************************************************/
+
+// The linkage-based engine works on dissimilarities d = 1 - similarity, stored as a condensed
+//   upper-triangular matrix of floats in which row i holds d(i,j) for j > i.  When two clusters
+//   are merged, the dissimilarities from the new cluster to every other cluster follow directly
+//   from the old ones via the Lance-Williams recurrence, so no vector is ever compared twice.
+
+class AgglomMatrix
+   {
+   public:
+      AgglomMatrix(float* cells, size_t N) : m_cells(cells), m_size(N) {}
+
+      static size_t numCells(size_t N) { return N * (N - 1) / 2 ; }
+      size_t rowOffset(size_t i) const { return i * m_size - i * (i + 1) / 2 ; }
+      float* row(size_t i) const { return m_cells + rowOffset(i) ; } // d(i,j) is at row(i)[j-i-1]
+      float& at(size_t i, size_t j) const
+	 { if (i > j) std::swap(i,j) ; return m_cells[rowOffset(i) + j - i - 1] ; }
+
+   protected:
+      float* m_cells ;
+      size_t m_size ;
+   } ;
+
+//----------------------------------------------------------------------------
+
+static inline double lance_williams_update(ClusterLinkage linkage, double d_ik, double d_jk, double d_ij,
+   size_t n_i, size_t n_j, size_t n_k)
+{
+   switch (linkage)
+      {
+      case ClusterLinkage::single:
+	 return std::min(d_ik,d_jk) ;
+      case ClusterLinkage::complete:
+	 return std::max(d_ik,d_jk) ;
+      case ClusterLinkage::average:
+	 return (n_i * d_ik + n_j * d_jk) / (n_i + n_j) ;
+      case ClusterLinkage::ward:
+	 return ((n_i + n_k) * d_ik + (n_j + n_k) * d_jk - n_k * d_ij) / (n_i + n_j + n_k) ;
+      case ClusterLinkage::centroid:
+	 {
+	 double n_ij = n_i + n_j ;
+	 return (n_i * d_ik + n_j * d_jk) / n_ij - (n_i * n_j * d_ij) / (n_ij * n_ij) ;
+	 }
+      default:
+	 return d_ik ;
+      }
+}
+
+//----------------------------------------------------------------------------
+// keep the clusters which have not yet been merged away in a doubly-linked list, so that the scans
+//   for nearest neighbors skip over the dead rows of the matrix
+
+class AgglomActiveList
+   {
+   public:
+      AgglomActiveList(size_t N) : m_next(N+1), m_prev(N+1), m_end(N)
+	 {
+	    for (size_t i = 0 ; i <= N ; ++i)
+	       {
+	       m_next[i] = (i + 1) % (N + 1) ;
+	       m_prev[i] = (i + N) % (N + 1) ;
+	       }
+	 }
+      size_t first() const { return m_next[m_end] ; }
+      size_t next(size_t i) const { return m_next[i] ; }
+      size_t end() const { return m_end ; }
+      void remove(size_t i)
+	 {
+	    m_next[m_prev[i]] = m_next[i] ;
+	    m_prev[m_next[i]] = m_prev[i] ;
+	 }
+
+   protected:
+      std::vector<size_t> m_next ;
+      std::vector<size_t> m_prev ;
+      size_t              m_end ;
+   } ;
+
+//----------------------------------------------------------------------------
+// merge clusters 'a' and 'b', leaving the result in 'b'
+
+static inline void agglom_merge(AgglomMatrix& dist, AgglomActiveList& active, std::vector<size_t>& sizes,
+   ClusterLinkage linkage, size_t a, size_t b)
+{
+   double d_ab = dist.at(a,b) ;
+   for (size_t k = active.first() ; k != active.end() ; k = active.next(k))
+      {
+      if (k == a || k == b) continue ;
+      float& d_bk = dist.at(b,k) ;
+      d_bk = (float)lance_williams_update(linkage,dist.at(a,k),d_bk,d_ab,sizes[a],sizes[b],sizes[k]) ;
+      }
+   active.remove(a) ;
+   sizes[b] += sizes[a] ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+// nearest-neighbor chain: follow nearest neighbors from an arbitrary cluster until reaching a pair
+//   of reciprocal nearest neighbors, which may be merged immediately for any reducible linkage
+//   (single, complete, average, Ward).  This takes O(N^2) time overall, but finds the merges out of
+//   order, so the dendrogram must be sorted afterwards.
+
+static inline void agglom_nn_chain(AgglomMatrix& dist, size_t N, ClusterLinkage linkage, Dendrogram* dendro)
+{
+   AgglomActiveList active(N) ;
+   std::vector<size_t> sizes(N,1) ;
+   std::vector<size_t> chain ;
+   chain.reserve(N) ;
+   for (size_t merges = 1 ; merges < N ; ++merges)
+      {
+      if (chain.empty())
+	 chain.push_back(active.first()) ;
+      size_t a, b ;
+      double best ;
+      for ( ; ; )
+	 {
+	 a = chain.back() ;
+	 // prefer the previous element of the chain on ties, or the chain might cycle
+	 b = chain.size() >= 2 ? chain[chain.size()-2] : active.end() ;
+	 best = (b != active.end()) ? dist.at(a,b) : HUGE_VAL ;
+	 for (size_t k = active.first() ; k != active.end() ; k = active.next(k))
+	    {
+	    if (k == a) continue ;
+	    double d = dist.at(a,k) ;
+	    if (d < best)
+	       {
+	       best = d ;
+	       b = k ;
+	       }
+	    }
+	 if (chain.size() >= 2 && b == chain[chain.size()-2])
+	    break ;
+	 chain.push_back(b) ;
+	 }
+      chain.pop_back() ;
+      chain.pop_back() ;
+      dendro->addMerge(a,b,1.0 - best) ;
+      agglom_merge(dist,active,sizes,linkage,a,b) ;
+      }
+   dendro->finish(true) ;
+   return ;
+}
 
 //----------------------------------------------------------------------------
+// generic algorithm for non-reducible linkages (centroid): remember each cluster's nearest
+//   neighbor among the higher-numbered clusters, and repair only the entries invalidated by a merge
+
+static inline void agglom_nn_array(AgglomMatrix& dist, size_t N, ClusterLinkage linkage, Dendrogram* dendro)
+{
+   AgglomActiveList active(N) ;
+   std::vector<size_t> sizes(N,1) ;
+   std::vector<size_t> neighbor(N,N) ;
+   std::vector<double> nn_dist(N,HUGE_VAL) ;
+   auto rescan = [&](size_t i)
+      {
+      neighbor[i] = N ;
+      nn_dist[i] = HUGE_VAL ;
+      for (size_t k = active.next(i) ; k != active.end() ; k = active.next(k))
+	 {
+	 double d = dist.at(i,k) ;
+	 if (d < nn_dist[i])
+	    {
+	    nn_dist[i] = d ;
+	    neighbor[i] = k ;
+	    }
+	 }
+      } ;
+   for (size_t i = 0 ; i < N ; ++i)
+      rescan(i) ;
+   for (size_t merges = 1 ; merges < N ; ++merges)
+      {
+      size_t a = active.first() ;
+      for (size_t k = active.next(a) ; k != active.end() ; k = active.next(k))
+	 {
+	 if (nn_dist[k] < nn_dist[a])
+	    a = k ;
+	 }
+      size_t b = neighbor[a] ;		// always greater than 'a'
+      dendro->addMerge(a,b,1.0 - nn_dist[a]) ;
+      agglom_merge(dist,active,sizes,linkage,a,b) ;
+      for (size_t k = active.first() ; k < b ; k = active.next(k))
+	 {
+	 if (neighbor[k] == a || neighbor[k] == b)
+	    rescan(k) ;
+	 else if (dist.at(k,b) < nn_dist[k])
+	    {
+	    nn_dist[k] = dist.at(k,b) ;
+	    neighbor[k] = b ;
+	    }
+	 }
+      rescan(b) ;
+      }
+   // centroid linkage can produce inversions, so keep the merges in the order they were made
+   dendro->finish(false) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+// single linkage is equivalent to a minimum spanning tree, which Prim's algorithm builds in O(N^2)
+//   time while storing only the best similarity from the tree to each remaining vector
+
+template <typename IdxT, typename ValT>
+void agglom_single_linkage(const Array* vectors, VectorMeasure<IdxT,ValT>* measure, Dendrogram* dendro,
+   ProgressIndicator* prog)
+{
+   size_t N = vectors->size() ;
+   std::vector<double> best_sim(N,-HUGE_VAL) ;
+   std::vector<size_t> best_from(N,0) ;
+   std::vector<size_t> pending(N-1) ;
+   for (size_t i = 1 ; i < N ; ++i)
+      pending[i-1] = i ;
+   auto tp = ThreadPool::defaultPool() ;
+   size_t current = 0 ;
+   while (!pending.empty())
+      {
+      auto vec1 = static_cast<Vector<IdxT,ValT>*>(vectors->getNth(current)) ;
+      tp->parallel_for(Range<size_t>(0,pending.size()),256,[&](size_t p)
+	 {
+	 size_t v = pending[p] ;
+	 double sim = measure->similarity(vec1,static_cast<Vector<IdxT,ValT>*>(vectors->getNth(v))) ;
+	 if (sim > best_sim[v])
+	    {
+	    best_sim[v] = sim ;
+	    best_from[v] = current ;
+	    }
+	 }) ;
+      size_t best = 0 ;
+      for (size_t p = 1 ; p < pending.size() ; ++p)
+	 {
+	 if (best_sim[pending[p]] > best_sim[pending[best]])
+	    best = p ;
+	 }
+      current = pending[best] ;
+      pending[best] = pending.back() ;
+      pending.pop_back() ;
+      dendro->addMerge(best_from[current],current,best_sim[current]) ;
+      if (prog) prog->incr() ;
+      }
+   dendro->finish(true) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+Dendrogram* agglomerative_dendrogram(const Array* vectors, VectorMeasure<IdxT,ValT>* measure,
+   ClusterLinkage linkage, size_t max_matrix_mb, ProgressIndicator* prog)
+{
+   if (!vectors || !measure || linkage == ClusterLinkage::none)
+      return nullptr ;
+   size_t N = vectors->size() ;
+   if (N < 2)
+      {
+      Dendrogram* dendro = new Dendrogram(N) ;
+      dendro->finish(false) ;
+      return dendro ;
+      }
+   if (linkage == ClusterLinkage::single)
+      {
+      Dendrogram* dendro = new Dendrogram(N) ;
+      agglom_single_linkage(vectors,measure,dendro,prog) ;
+      return dendro ;
+      }
+   size_t cells = AgglomMatrix::numCells(N) ;
+   if (cells / (1024 * 1024 / sizeof(float)) >= max_matrix_mb)
+      return nullptr ;
+   NewPtr<float> matrix(new (std::nothrow) float[cells]) ;
+   if (!matrix)
+      return nullptr ;
+   AgglomMatrix dist(matrix.get(),N) ;
+   VectorCollection<IdxT,ValT> coll(vectors) ;
+   // the rows get shorter as 'i' increases, so hand them out one at a time
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,N-1),1,[&](size_t i)
+      {
+      LocalAlloc<double> sims(N-i-1) ;
+      measure->similarities(coll,i,i+1,N,sims) ;
+      float* row = dist.row(i) ;
+      for (size_t j = 0 ; j < N-i-1 ; ++j)
+	 row[j] = (float)(1.0 - sims[j]) ;
+      if (prog) prog->incr() ;
+      }) ;
+   Dendrogram* dendro = new Dendrogram(N) ;
+   if (linkage == ClusterLinkage::centroid)
+      agglom_nn_array(dist,N,linkage,dendro) ;
+   else
+      agglom_nn_chain(dist,N,linkage,dendro) ;
+   return dendro ;
+}
+
+/************************************************************************/
+/*	Methods for template class ClusteringAlgoBrown			*/
+/************************************************************************/
 
 template <typename IdxT, typename ValT>
 ClusterInfo* ClusteringAlgoBrown<IdxT,ValT>::cluster(const Array* vectors) const
@@ -189,14 +483,71 @@ ClusterInfo* ClusteringAlgoBrown<IdxT,ValT>::cluster(const Array* vectors) const
    if (!vectors || vectors->size() == 0)
       return ClusterInfo::create() ;
    auto num_vectors = vectors->size() ;
-   auto clusters = ClusterInfo::createSingletonClusters(vectors) ;
-   if (clusters->numSubclusters() <= this->desiredClusters())
+   if (num_vectors <= this->desiredClusters())
       {
       this->log(0,"Nothing to be clustered - want %lu clusters, have only %lu vectors",
-	 this->desiredClusters(),clusters->numSubclusters()) ;
-      return clusters ;
+	 this->desiredClusters(),num_vectors) ;
+      return ClusterInfo::createSingletonClusters(vectors) ;
       }
    this->trapSigInt() ;
+   ClusterInfo* clusters = nullptr ;
+   if (this->linkage() != ClusterLinkage::none)
+      clusters = mergeByLinkage(vectors) ;
+   if (!clusters)
+      clusters = mergeByRepresentative(vectors) ;
+   if (this->m_flatten && clusters->numSubclusters() > 1)
+      {
+      this->log(0,"  flattening clusters") ;
+      clusters->flattenSubclusters() ;
+      }
+   else
+      {
+      this->log(0,"  relabeling vectors with paths") ;
+      clusters->labelSubclusterPaths(set_brown_label<IdxT,ValT>,"B","") ;
+      }
+   this->log(0,"Clustering complete") ;
+   this->untrapSigInt() ;
+   return clusters ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+ClusterInfo* ClusteringAlgoBrown<IdxT,ValT>::mergeByLinkage(const Array* vectors) const
+{
+   auto num_vectors = vectors->size() ;
+   ClusterLinkage linkage = this->linkage() ;
+   this->log(0,"Starting %s clustering using %s measure and %s linkage; %lu vectors to cluster",
+      this->algorithmName(),this->measureName(),cluster_linkage_name(linkage),num_vectors) ;
+   this->log(0,"Computing similarities") ;
+   auto prog = this->makeProgressIndicator(num_vectors) ;
+   Dendrogram* dendro = agglomerative_dendrogram(vectors,this->m_measure,linkage,this->maxMatrixSize(),prog) ;
+   delete prog ;
+   if (!dendro)
+      {
+      this->log(0,"  similarity matrix for %lu vectors would exceed %lu MB, merging by cluster representative",
+	 num_vectors,this->maxMatrixSize()) ;
+      return nullptr ;
+      }
+   // stop at the desired number of clusters or the first merge below the threshold, just as the
+   //   incremental merging does
+   size_t num_merges = std::min(num_vectors - this->desiredClusters(),
+      dendro->mergesAbove(this->clusterThreshold())) ;
+   if (num_merges < dendro->numMerges())
+      this->log(0,"  terminating after %lu merges: next similarity %g, threshold %g",num_merges,
+	 dendro->merge(num_merges).m_similarity,this->clusterThreshold()) ;
+   ClusterInfo* clusters = dendro->clusters(vectors,num_merges) ;
+   delete dendro ;
+   return clusters ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+ClusterInfo* ClusteringAlgoBrown<IdxT,ValT>::mergeByRepresentative(const Array* vectors) const
+{
+   auto num_vectors = vectors->size() ;
+   auto clusters = ClusterInfo::createSingletonClusters(vectors) ;
    this->log(0,"Starting %s clustering using %s measure; %lu vectors to cluster",
       this->algorithmName(),this->measureName(),num_vectors) ;
    // until we've reached the desired number of clusters or the best similarity is below the threshold:
@@ -206,8 +557,12 @@ ClusterInfo* ClusteringAlgoBrown<IdxT,ValT>::cluster(const Array* vectors) const
    auto tp = ThreadPool::defaultPool() ;
    LocalAlloc<double> similarities(num_vectors) ;
    LocalAlloc<size_t> neighbors(num_vectors) ;
-   tp->parallelize(agglom_clustering_best_similarity<IdxT,ValT>,num_vectors,clusters->subclusters(),
-      &similarities,&neighbors,this->m_measure,prog) ;
+   const Array* subclusters = clusters->subclusters() ;
+   auto measure = this->m_measure ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),1,[&](size_t index)
+      {
+      agglom_clustering_best_similarity<IdxT,ValT>(index,subclusters,similarities,neighbors,measure,prog) ;
+      }) ;
    delete prog ;
    this->log(0,"Merging clusters") ;
    prog = this->makeProgressIndicator(num_vectors - this->desiredClusters()) ;
@@ -239,23 +594,15 @@ ClusterInfo* ClusteringAlgoBrown<IdxT,ValT>::cluster(const Array* vectors) const
 	 break ;
       // update nearest neighbors
       this->log(2,"  updating nearest neighbors") ;
-      tp->parallelize(update_nearest_neighbors<IdxT,ValT>,numclus,clusters->subclusters(),&similarities,
-	 &neighbors,this->m_measure,best_clus,best_neighbor) ;
+      subclusters = clusters->subclusters() ;
+      tp->parallel_for(Range<size_t>(0,numclus),1,[&](size_t index)
+	 {
+	 update_nearest_neighbors<IdxT,ValT>(index,subclusters,similarities,neighbors,measure,
+	    best_clus,best_neighbor) ;
+	 }) ;
       prog->incr() ;
       }
    delete prog ;
-   if (this->m_flatten && clusters->numSubclusters() > 1)
-      {
-      this->log(0,"  flattening clusters") ;
-      clusters->flattenSubclusters() ;
-      }
-   else
-      {
-      this->log(0,"  relabeling vectors with paths") ;
-      clusters->labelSubclusterPaths(set_brown_label<IdxT,ValT>,"B","") ;
-      }
-   this->log(0,"Clustering complete") ;
-   this->untrapSigInt() ;
    return clusters ;
 }
 
@@ -20,6 +20,7 @@
 /************************************************************************/
 
 #include "framepac/cluster.h"
+#include "framepac/threadpool.h"
 using namespace Fr ;
 
 namespace Fr
@@ -28,6 +29,15 @@ namespace Fr
 /************************************************************************/
 /************************************************************************/
 
+// DBSCAN works in terms of similarity rather than distance: the epsilon-neighborhood of a vector
+//   consists of the other vectors whose similarity to it is at least clusterThreshold(), and a
+//   vector is a core point if its neighborhood (including itself) contains at least m_min_points
+//   vectors.  Connected core points form clusters, border points join the cluster of their most
+//   similar core neighbor, and everything else is noise.
+
+// the value of MinPts to use if none was specified
+#define FrDBSCAN_DEFAULT_MINPTS 4
+
 template <typename IdxT, typename ValT>
 class ClusteringAlgoDBScan : public ClusteringAlgo<IdxT,ValT>
    {
@@ -38,7 +48,7 @@ class ClusteringAlgoDBScan : public ClusteringAlgo<IdxT,ValT>
       virtual ClusterInfo* cluster(const Array* vectors) const ;
 
    protected:
-
+      size_t minPointsOrDefault() const { return this->m_min_points ? this->m_min_points : FrDBSCAN_DEFAULT_MINPTS ; }
    } ;
 
 /************************************************************************/
@@ -47,8 +57,83 @@ class ClusteringAlgoDBScan : public ClusteringAlgo<IdxT,ValT>
 template <typename IdxT, typename ValT>
 ClusterInfo* ClusteringAlgoDBScan<IdxT,ValT>::cluster(const Array* vectors) const
 {
-   (void)vectors;
-   return nullptr ; //TODO
+   if (!vectors || vectors->size() == 0 || !this->checkSparseOrDense(vectors) || !this->m_measure)
+      {
+      return nullptr ;
+      }
+   ScopedObject<RefArray> nonempty(vectors->size()) ;
+   for (auto v : *vectors)
+      {
+      auto vec = static_cast<Vector<IdxT,ValT>*>(v) ;
+      if (vec && vec->length() > 0.0)
+	 nonempty->append(vec) ;
+      }
+   size_t num_vectors = nonempty->size() ;
+   if (num_vectors == 0)
+      {
+      return nullptr ;			// nothing to be clustered
+      }
+   this->trapSigInt() ;
+   // find the epsilon-neighborhood of every vector
+   this->log(0,"Finding neighborhoods of %lu vectors",num_vectors) ;
+   NeighborIndex<IdxT,ValT> index(nonempty,this->m_measure) ;
+   if (index.usingInvertedIndex())
+      this->log(1,"  using inverted index") ;
+   NeighborGraph neighbors ;
+   auto prog = this->makeProgressIndicator(num_vectors) ;
+   bool success = index.epsilonNeighborhoods(this->clusterThreshold(),neighbors,prog) ;
+   delete prog ;
+   if (!success)
+      {
+      this->untrapSigInt() ;
+      return nullptr ;
+      }
+   this->log(1,"  %lu neighbor links",neighbors.numEdges()) ;
+   // determine which vectors are core points; the neighborhood includes the vector itself
+   size_t minpts = minPointsOrDefault() ;
+   NewPtr<bool> core(num_vectors) ;
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),256,[&](size_t i)
+      {
+      core[i] = (neighbors.numNeighbors(i) + 1 >= minpts) ;
+      }) ;
+   // union together all core points which are in each other's neighborhoods
+   this->log(0,"Connecting core points") ;
+   ConcurrentDisjointSets components(num_vectors) ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),64,[&](size_t i)
+      {
+      if (!core[i])
+	 return ;
+      for (auto nbr = neighbors.begin(i) ; nbr != neighbors.end(i) ; ++nbr)
+	 {
+	 if (nbr->id > i && core[nbr->id])
+	    components.merge(i,nbr->id) ;
+	 }
+      }) ;
+   // assign each core point to its component and each border point to the component of its most
+   //   similar core neighbor
+   NewPtr<uint32_t> root(num_vectors) ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),256,[&](size_t i)
+      {
+      root[i] = FrNOISE_POINT ;
+      if (core[i])
+	 {
+	 root[i] = components.find(i) ;
+	 return ;
+	 }
+      for (auto nbr = neighbors.begin(i) ; nbr != neighbors.end(i) ; ++nbr)
+	 {
+	 if (core[nbr->id])
+	    {
+	    root[i] = components.find(nbr->id) ;
+	    break ;
+	    }
+	 }
+      }) ;
+   size_t num_clusters = number_density_clusters(root.begin(),num_vectors) ;
+   ClusterInfo* result = make_density_clusters(this,nonempty,root.begin(),num_clusters) ;
+   this->untrapSigInt() ;
+   return result ;
 }
 
 } // end of namespace Fr
@@ -20,6 +20,7 @@
 /************************************************************************/
 
 #include "template/cluster.cc"
+#include "template/cluster_neighbors.cc"
 #include "template/cluster_agglom.cc"
 #include "template/cluster_anneal.cc"
 #include "template/cluster_dbscan.cc"
@@ -19,6 +19,7 @@
 /*									*/
 /************************************************************************/
 
+#include <cmath>
 #include "framepac/cluster.h"
 #include "framepac/threadpool.h"
 
@@ -30,6 +31,12 @@ namespace Fr
 /************************************************************************/
 /************************************************************************/
 
+// the most per-vector/per-center lower bounds to store for Elkan's algorithm (8 bytes each)
+#define FrKMEANS_ELKAN_MAX_BOUNDS (64*1024*1024)
+
+/************************************************************************/
+/************************************************************************/
+
 template <typename IdxT, typename ValT>
 class ClusteringAlgoKMeans : public ClusteringAlgo<IdxT,ValT>
    {
@@ -46,6 +53,10 @@ class ClusteringAlgoKMeans : public ClusteringAlgo<IdxT,ValT>
 
    protected:
       void clearCenters(Array&) const ;
+      bool metricMeasure() const ;
+      double distance(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2) const ;
+      void miniBatch(const Array* vectors, Array* centers) const ;
+      void boundedIterations(const Array* vectors, Array* centers, size_t max_iterations, bool sparse) const ;
 
    protected: // data members
       bool   m_use_medioids { false } ;
@@ -69,44 +80,35 @@ class ClusteringAlgoKMedioids : public ClusteringAlgoKMeans<IdxT,ValT>
 /************************************************************************/
 
 template <typename IdxT, typename ValT>
-static bool update_centroid(size_t id, va_list args)
+static void update_centroid(const ClusterInfo* inf, size_t id, Array* centers, bool sparse)
 {
-   auto o = va_arg(args,const ClusterInfo**) ;
-   auto inf = o[id] ;
-   auto centers = va_arg(args,Array*) ;
-   auto sparse = va_arg(args,int) ;
-   auto prog = va_arg(args,ProgressIndicator*) ;
+   Vector<IdxT,ValT>* centroid ;
    if (sparse)
       {
       // create a centroid of the members of the current cluster
-      auto centroid = inf->createSparseCentroid<IdxT,ValT>() ;
-      // make the centroid the new center for the cluster
-      centers->setNthNoCopy(id,centroid) ;
+      centroid = inf->createSparseCentroid<IdxT,ValT>() ;
       }
    else
       {
       // create a centroid of the members of the current cluster
-      auto centroid = inf->createDenseCentroid<IdxT,ValT>() ;
-      // make the centroid the new center for the cluster
-      centers->setNthNoCopy(id,centroid) ;
+      centroid = inf->createDenseCentroid<IdxT,ValT>() ;
       }
-   if (prog)
-      ++(*prog) ;
-   return true ;			// no errors, safe to continue processing
+   // the centroid functions return the sum of the members; only the direction matters for cosine,
+   //   but the distance-based measures need the mean (computed just as mean_vector() does, so that
+   //   the bounded mode arrives at exactly the same centers)
+   if (inf->numMembers() > 0)
+      centroid->scale(1.0 / inf->numMembers()) ;
+   // make the centroid the new center for the cluster
+   centers->setNthNoCopy(id,centroid) ;
+   return ;
 }
 
 //----------------------------------------------------------------------------
 
 template <typename IdxT, typename ValT>
-static bool update_medioid(size_t id, va_list args)
+static void update_medioid(const ClusterInfo* inf, size_t id, Array* centers, bool sparse,
+   VectorMeasure<IdxT,ValT>* measure)
 {
-   typedef VectorMeasure<IdxT,ValT> VM ;
-   auto o = va_arg(args,const ClusterInfo**) ;
-   auto inf = o[id] ;
-   auto centers = va_arg(args,Array*) ;
-   auto sparse = va_arg(args,int) ;
-   auto measure = va_arg(args,VM*) ;
-   auto prog = va_arg(args,ProgressIndicator*) ;
    Ptr<Vector<IdxT,ValT>> centroid ;
    if (sparse)
       {
@@ -118,13 +120,36 @@ static bool update_medioid(size_t id, va_list args)
       // create a centroid of the members of the current cluster
       centroid = inf->createDenseCentroid<IdxT,ValT>() ;
       }
+   if (inf->numMembers() > 0)
+      centroid->scale(1.0 / inf->numMembers()) ;	// the mean, as for update_centroid()
    // find nearest original vector in cluster
    auto medioid = ClusteringAlgo<IdxT,ValT>::nearestNeighbor(centroid,inf->members(),measure) ;
    // make the medioid the new center for the cluster
    centers->setNthNoCopy(id,medioid) ;
-   if (prog)
-      ++(*prog) ;
-   return true ;			// no errors, safe to continue processing
+   return ;
+}
+
+//----------------------------------------------------------------------------
+// compute the mean of the listed vectors, for use as a center by the bounded and mini-batch modes
+
+template <typename IdxT, typename ValT>
+static Vector<IdxT,ValT>* mean_vector(const Array* vectors, const uint32_t* members, size_t count, bool sparse)
+{
+   Vector<IdxT,ValT>* mean ;
+   if (sparse)
+      {
+      mean = SparseVector<IdxT,ValT>::create() ;
+      for (size_t i = 0 ; i < count ; ++i)
+	 mean = mean->incr(static_cast<Vector<IdxT,ValT>*>(vectors->getNth(members[i]))) ;
+      }
+   else
+      {
+      mean = static_cast<Vector<IdxT,ValT>*>(vectors->getNth(members[0])->clone().move()) ;
+      for (size_t i = 1 ; i < count ; ++i)
+	 mean = mean->incr(static_cast<Vector<IdxT,ValT>*>(vectors->getNth(members[i]))) ;
+      }
+   mean->scale(1.0 / count) ;
+   return mean ;
 }
 
 //----------------------------------------------------------------------------
@@ -133,31 +158,47 @@ template <typename IdxT, typename ValT>
 static void find_least_most_similar(const Array* vectors, const Array* refs, VectorMeasure<IdxT,ValT>* vm,
    size_t& least_similar, size_t& most_similar)
 {
-   size_t selected = (size_t)~0 ;
-   size_t discarded = (size_t)~0 ;
-   double best_sim = -HUGE_VAL ;
-   double worst_sim = HUGE_VAL ;
-   //TODO: parallelize this loop
-   for (size_t i = 0 ; i < vectors->size() ; ++i)
+   // for each vector, find its highest similarity to any of the references, and then select the
+   //   vectors for which that value is largest and smallest
+   struct Extremes
+      {
+      double best_sim ;
+      size_t selected ;
+      double worst_sim ;
+      size_t discarded ;
+      } ;
+   Extremes none { -HUGE_VAL, (size_t)~0, HUGE_VAL, (size_t)~0 } ;
+   auto tp = ThreadPool::defaultPool() ;
+   Extremes ext = tp->parallel_reduce(Range<size_t>(0,vectors->size()),none,
+      [&](size_t i) -> Extremes
       {
       auto vector = static_cast<Vector<IdxT,ValT>*>(vectors->getNth(i)) ;
-      if (!vector || vector->length() == 0.0) continue ;
+      if (!vector || vector->length() == 0.0) return none ;
       double sim = -999.99 ;
       for (auto ref : *refs)
 	 {
 	 sim = std::max(sim,vm->similarity(vector,static_cast<Vector<IdxT,ValT>*>(ref))) ;
 	 }
-      if (sim > best_sim)
+      return Extremes { sim, i, sim, i } ;
+      },
+      [](const Extremes& e1, const Extremes& e2) -> Extremes
+      {
+      // on ties, prefer the lower index to match a sequential scan
+      Extremes result(e1) ;
+      if (e2.best_sim > e1.best_sim || (e2.best_sim == e1.best_sim && e2.selected < e1.selected))
 	 {
-	 best_sim = sim ;
-	 selected = i ;
+	 result.best_sim = e2.best_sim ;
+	 result.selected = e2.selected ;
 	 }
-      if (sim < worst_sim)
+      if (e2.worst_sim < e1.worst_sim || (e2.worst_sim == e1.worst_sim && e2.discarded < e1.discarded))
 	 {
-	 worst_sim = sim ;
-	 discarded = i ;
+	 result.worst_sim = e2.worst_sim ;
+	 result.discarded = e2.discarded ;
 	 }
-      }
+      return result ;
+      }) ;
+   size_t selected = ext.selected ;
+   size_t discarded = ext.discarded ;
    least_similar = discarded ;
    most_similar = selected ;
    return ;
@@ -180,6 +221,345 @@ void ClusteringAlgoKMeans<IdxT,ValT>::clearCenters(Array& centers) const
 
 //----------------------------------------------------------------------------
 
+template <typename IdxT, typename ValT>
+bool ClusteringAlgoKMeans<IdxT,ValT>::metricMeasure() const
+{
+   // the bounds rely on the triangle inequality, so they can only be used with a true metric; cosine
+   //   similarity is handled by converting it into the angle between the vectors
+   switch (this->similarityMeasure())
+      {
+      case VectorSimilarityMeasure::cosine:
+      case VectorSimilarityMeasure::euclidean:
+      case VectorSimilarityMeasure::linf:
+      case VectorSimilarityMeasure::manhattan:
+	 return true ;
+      default:
+	 return false ;
+      }
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+double ClusteringAlgoKMeans<IdxT,ValT>::distance(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2) const
+{
+   if (this->similarityMeasure() == VectorSimilarityMeasure::cosine)
+      {
+      double sim = this->m_measure->similarity(v1,v2) ;
+      return std::acos(sim >= 1.0 ? 1.0 : (sim <= -1.0 ? -1.0 : sim)) ;
+      }
+   return this->m_measure->distance(v1,v2) ;
+}
+
+//----------------------------------------------------------------------------
+// mini-batch k-means (Sculley, "Web-Scale K-Means Clustering", WWW 2010): each iteration assigns a
+//   random sample of the vectors to their nearest centers and moves each center toward its newly-assigned
+//   vectors with a per-center learning rate of 1/(vectors assigned so far), which makes every center the
+//   running mean of the initial center and all vectors ever assigned to it
+
+template <typename IdxT, typename ValT>
+void ClusteringAlgoKMeans<IdxT,ValT>::miniBatch(const Array* vectors, Array* centers) const
+{
+   size_t num_centers = centers->size() ;
+   size_t batch_size = this->miniBatchSize() ;
+   NewPtr<Vector<IdxT,ValT>*> sums(num_centers) ;
+   NewPtr<size_t> counts(num_centers) ;
+   for (size_t i = 0 ; i < num_centers ; ++i)
+      {
+      sums[i] = static_cast<Vector<IdxT,ValT>*>(centers->getNth(i)->clone().move()) ;
+      counts[i] = 1 ;
+      }
+   NewPtr<uint32_t> assignments(batch_size) ;
+   NewPtr<bool> touched(num_centers) ;
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   auto measure = this->m_measure ;
+   for (size_t iteration = 1 ; iteration <= this->maxIterations() && !this->abortRequested() ; ++iteration)
+      {
+      Ptr<RefArray> sample { vectors->randomSample(batch_size) } ;
+      size_t sample_size = sample->size() ;
+      tp->parallel_for(Range<size_t>(0,sample_size),1,[&](size_t i)
+	 {
+	 LocalAlloc<double> sims(num_centers) ;
+	 measure->similarities(static_cast<Vector<IdxT,ValT>*>(sample->getNth(i)),centers,sims) ;
+	 size_t best = 0 ;
+	 for (size_t c = 1 ; c < num_centers ; ++c)
+	    {
+	    if (sims[c] > sims[best])
+	       best = c ;
+	    }
+	 assignments[i] = (uint32_t)best ;
+	 }) ;
+      std::fill_n(touched.get(),num_centers,false) ;
+      for (size_t i = 0 ; i < sample_size ; ++i)
+	 {
+	 size_t c = assignments[i] ;
+	 sums[c] = sums[c]->incr(static_cast<Vector<IdxT,ValT>*>(sample->getNth(i))) ;
+	 ++counts[c] ;
+	 touched[c] = true ;
+	 }
+      size_t moved = 0 ;
+      for (size_t c = 0 ; c < num_centers ; ++c)
+	 {
+	 if (!touched[c])
+	    continue ;
+	 auto center = static_cast<Vector<IdxT,ValT>*>(sums[c]->clone().move()) ;
+	 center->scale(1.0 / counts[c]) ;
+	 centers->setNthNoCopy(c,center) ;
+	 ++moved ;
+	 }
+      this->log(1,"  mini-batch %lu: %lu vectors moved %lu centers",iteration,sample_size,moved) ;
+      }
+   for (size_t i = 0 ; i < num_centers ; ++i)
+      sums[i]->free() ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+// k-means using triangle-inequality bounds to avoid most distance computations once the centers stop
+//   moving much (Elkan, "Using the Triangle Inequality to Accelerate k-Means", ICML 2003; Hamerly,
+//   "Making k-means even faster", SDM 2010).  Each vector keeps an upper bound on the distance to its
+//   assigned center and either one lower bound on the distance to any other center (Hamerly) or one
+//   per center (Elkan); the bounds are loosened by how far the centers drift on each update, and
+//   a vector is only compared against a center if the bounds can not rule that center out.  As in the
+//   exhaustive mode, a center which loses all of its vectors is dropped, so that both modes produce
+//   exactly the same clusters from the same initial centers.
+
+template <typename IdxT, typename ValT>
+void ClusteringAlgoKMeans<IdxT,ValT>::boundedIterations(const Array* vectors, Array* centers,
+   size_t max_iterations, bool sparse) const
+{
+   typedef Vector<IdxT,ValT> vec_type ;
+   size_t num_vectors = vectors->size() ;
+   size_t K = centers->size() ;
+   bool elkan = (this->kmeansBounds() == KMeansBounds::elkan) ;
+   if (elkan && num_vectors * K > FrKMEANS_ELKAN_MAX_BOUNDS)
+      {
+      this->log(0,"  too many vectors and centers to store Elkan bounds, using Hamerly bounds instead") ;
+      elkan = false ;
+      }
+   NewPtr<uint32_t> assignment(num_vectors) ;
+   NewPtr<double> upper(num_vectors) ;
+   NewPtr<double> lower(elkan ? num_vectors * K : num_vectors) ;
+   NewPtr<double> center_dist(elkan ? K * K : 1) ;
+   NewPtr<double> half_sep(K) ;	// half the distance from each center to the nearest other center
+   NewPtr<double> drift(K) ;
+   NewPtr<bool> dropped(K) ;
+   std::fill_n(dropped.get(),K,false) ;
+   NewPtr<uint32_t> members(num_vectors) ;
+   NewPtr<size_t> offsets(K+1) ;
+   auto center = [&](size_t c) { return static_cast<const vec_type*>(centers->getNth(c)) ; } ;
+   auto vector = [&](size_t i) { return static_cast<const vec_type*>(vectors->getNth(i)) ; } ;
+   struct Counts
+      {
+      size_t changes ;
+      size_t distances ;
+      } ;
+   auto combine = [](const Counts& c1, const Counts& c2) -> Counts
+      { return Counts { c1.changes + c2.changes, c1.distances + c2.distances } ; } ;
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   // initial assignment: compare each vector against every center
+   auto prog = this->makeProgressIndicator(num_vectors) ;
+   this->log(0,"Iteration 1") ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),16,[&](size_t i)
+      {
+      auto vec = vector(i) ;
+      double best = HUGE_VAL ;
+      double second = HUGE_VAL ;
+      size_t best_center = 0 ;
+      for (size_t c = 0 ; c < K ; ++c)
+	 {
+	 double d = distance(vec,center(c)) ;
+	 if (elkan)
+	    lower[i*K+c] = d ;
+	 if (d < best)
+	    {
+	    second = best ;
+	    best = d ;
+	    best_center = c ;
+	    }
+	 else if (d < second)
+	    second = d ;
+	 }
+      assignment[i] = (uint32_t)best_center ;
+      upper[i] = best ;
+      if (!elkan)
+	 lower[i] = second ;
+      if (prog) prog->incr() ;
+      }) ;
+   delete prog ;
+   this->log(0,"  %lu vectors changed cluster",num_vectors) ;
+   for (size_t iteration = 2 ; iteration <= max_iterations && !this->abortRequested() ; ++iteration)
+      {
+      this->log(0,"Iteration %lu",iteration) ;
+      this->log(1,"  updating centers") ;
+      // group the vectors by assigned center
+      std::fill_n(offsets.get(),K+1,0) ;
+      for (size_t i = 0 ; i < num_vectors ; ++i)
+	 ++offsets[assignment[i]+1] ;
+      for (size_t c = 0 ; c < K ; ++c)
+	 offsets[c+1] += offsets[c] ;
+      {
+      LocalAlloc<size_t> fill(K) ;
+      std::copy(offsets.get(),offsets.at(K),fill.begin()) ;
+      for (size_t i = 0 ; i < num_vectors ; ++i)
+	 members[fill[assignment[i]]++] = (uint32_t)i ;
+      }
+      // move each center to the mean of its vectors, and note how far it moved
+      tp->parallel_for(Range<size_t>(0,K),1,[&](size_t c)
+	 {
+	 size_t count = offsets[c+1] - offsets[c] ;
+	 drift[c] = 0.0 ;
+	 if (count == 0)
+	    {
+	    dropped[c] = true ;		// no vector can be assigned to it again
+	    return ;
+	    }
+	 auto mean = mean_vector<IdxT,ValT>(vectors,members.at(offsets[c]),count,sparse) ;
+	 mean->setLabel(center(c)->label()) ;
+	 drift[c] = distance(center(c),mean) ;
+	 centers->setNthNoCopy(c,mean) ;
+	 }) ;
+      // loosen the bounds by the amount the centers moved
+      size_t max_c = 0 ;
+      for (size_t c = 1 ; c < K ; ++c)
+	 {
+	 if (drift[c] > drift[max_c]) max_c = c ;
+	 }
+      double max_drift = drift[max_c] ;
+      double second_drift = 0.0 ;
+      for (size_t c = 0 ; c < K ; ++c)
+	 {
+	 if (c != max_c && drift[c] > second_drift) second_drift = drift[c] ;
+	 }
+      tp->parallel_for(Range<size_t>(0,num_vectors),256,[&](size_t i)
+	 {
+	 size_t a = assignment[i] ;
+	 upper[i] += drift[a] ;
+	 if (elkan)
+	    {
+	    double* lb = lower.at(i*K) ;
+	    for (size_t c = 0 ; c < K ; ++c)
+	       lb[c] = std::max(0.0,lb[c] - drift[c]) ;
+	    }
+	 else
+	    lower[i] -= (a == max_c) ? second_drift : max_drift ;
+	 }) ;
+      // compute the separation between centers
+      tp->parallel_for(Range<size_t>(0,K),1,[&](size_t c)
+	 {
+	 double nearest = HUGE_VAL ;
+	 for (size_t other = 0 ; other < K ; ++other)
+	    {
+	    if (other == c || dropped[other])
+	       continue ;
+	    double d = distance(center(c),center(other)) ;
+	    if (elkan)
+	       center_dist[c*K+other] = d ;
+	    if (d < nearest)
+	       nearest = d ;
+	    }
+	 half_sep[c] = nearest / 2.0 ;
+	 }) ;
+      // reassign only those vectors whose bounds do not prove that they stay with their current center
+      prog = this->makeProgressIndicator(num_vectors) ;
+      Counts none { 0, 0 } ;
+      Counts counts = tp->parallel_reduce(Range<size_t>(0,num_vectors),none,
+	 [&](size_t i) -> Counts
+	 {
+	 Counts result { 0, 0 } ;
+	 size_t a = assignment[i] ;
+	 double u = upper[i] ;
+	 auto vec = vector(i) ;
+	 if (elkan)
+	    {
+	    if (u > half_sep[a])
+	       {
+	       double* lb = lower.at(i*K) ;
+	       bool tight = false ;
+	       for (size_t c = 0 ; c < K ; ++c)
+		  {
+		  if (c == a || dropped[c] || u <= lb[c] || u <= center_dist[a*K+c] / 2.0)
+		     continue ;
+		  if (!tight)
+		     {
+		     u = distance(vec,center(a)) ;
+		     lb[a] = u ;
+		     tight = true ;
+		     ++result.distances ;
+		     if (u <= lb[c] || u <= center_dist[a*K+c] / 2.0)
+			continue ;
+		     }
+		  double d = distance(vec,center(c)) ;
+		  ++result.distances ;
+		  lb[c] = d ;
+		  if (d < u)
+		     {
+		     a = c ;
+		     u = d ;
+		     }
+		  }
+	       }
+	    }
+	 else
+	    {
+	    double bound = std::max(half_sep[a],lower[i]) ;
+	    if (u > bound)
+	       {
+	       u = distance(vec,center(a)) ;
+	       ++result.distances ;
+	       if (u > bound)
+		  {
+		  // the bounds failed, so compare against every center
+		  double best = HUGE_VAL ;
+		  double second = HUGE_VAL ;
+		  for (size_t c = 0 ; c < K ; ++c)
+		     {
+		     if (dropped[c])
+			continue ;
+		     double d = (c == assignment[i]) ? u : distance(vec,center(c)) ;
+		     if (d < best)
+			{
+			second = best ;
+			best = d ;
+			a = c ;
+			}
+		     else if (d < second)
+			second = d ;
+		     }
+		  result.distances += K - 1 ;
+		  u = best ;
+		  lower[i] = second ;
+		  }
+	       }
+	    }
+	 upper[i] = u ;
+	 if (a != assignment[i])
+	    {
+	    assignment[i] = (uint32_t)a ;
+	    result.changes = 1 ;
+	    }
+	 if (prog) prog->incr() ;
+	 return result ;
+	 },
+	 combine) ;
+      delete prog ;
+      this->log(0,"  %lu vectors changed cluster",counts.changes) ;
+      this->log(1,"  %lu distance computations (%.1f%% of exhaustive)",counts.distances,
+	 100.0 * counts.distances / (num_vectors * (double)K)) ;
+      if (counts.changes == 0)
+	 break ;			// we've converged!
+      }
+   // label each vector with its assigned center
+   for (size_t i = 0 ; i < num_vectors ; ++i)
+      {
+      auto vec = static_cast<vec_type*>(vectors->getNth(i)) ;
+      vec->setLabel(center(assignment[i])->label()) ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename IdxT, typename ValT>
 ClusterInfo* ClusteringAlgoKMeans<IdxT,ValT>::cluster(const Array* vectors) const
 {
@@ -254,6 +634,22 @@ ClusterInfo* ClusteringAlgoKMeans<IdxT,ValT>::cluster(const Array* vectors) cons
       {
       static_cast<Vector<IdxT,ValT>*>(v)->setLabel(ClusterInfo::genLabel()) ;
       }
+   size_t max_iterations = this->maxIterations() ;
+   if (this->miniBatchSize() > 0 && !usingMedioids())
+      {
+      // refine the centers on random samples, then make one full pass to assign every vector
+      this->log(0,"Refining centers on mini-batches of %lu vectors",this->miniBatchSize()) ;
+      miniBatch(nonempty,centers) ;
+      max_iterations = 1 ;
+      }
+   bool bounded = false ;
+   if (this->kmeansBounds() != KMeansBounds::none && max_iterations > 1)
+      {
+      if (!usingMedioids() && metricMeasure())
+	 bounded = true ;
+      else
+	 this->log(0,"Bounds require k-means with a metric similarity measure; using exhaustive assignment") ;
+      }
    // until converged or iteration limit:
    //    assign each vector to the nearest center
    //    collect vectors into clusters by assigned center
@@ -263,7 +659,13 @@ ClusterInfo* ClusteringAlgoKMeans<IdxT,ValT>::cluster(const Array* vectors) cons
    ClusterInfo** clusters(nullptr) ;
    num_clusters = 0 ;
    ThreadPool* tp = ThreadPool::defaultPool() ;
-   for (iteration = 1 ; iteration <= this->maxIterations() && !this->abortRequested() ; iteration++)
+   if (bounded)
+      {
+      boundedIterations(nonempty,centers,max_iterations,using_sparse_vectors) ;
+      this->extractClusters(nonempty,clusters,num_clusters) ;
+      max_iterations = 0 ;
+      }
+   for (iteration = 1 ; iteration <= max_iterations && !this->abortRequested() ; iteration++)
       {
       this->log(0,"Iteration %lu",iteration) ;
       auto prog = this->makeProgressIndicator(nonempty->size()) ;
@@ -274,14 +676,22 @@ ClusterInfo* ClusteringAlgoKMeans<IdxT,ValT>::cluster(const Array* vectors) cons
       this->extractClusters(nonempty,clusters,num_clusters) ;
       if (!changes)
 	 break ;			// we've converged!
-      auto fn = update_centroid<IdxT,ValT> ;
-      if (usingMedioids())
-	 fn = update_medioid<IdxT,ValT> ;
       this->log(1,"  updating centers") ;
       clearCenters(*centers) ;
       centers = Array::create(num_clusters) ;
       prog = (nonempty->size() > 1000) ? this->makeProgressIndicator(num_clusters) : nullptr ;
-      tp->parallelize(fn,num_clusters,clusters,(Array*)centers,using_sparse_vectors,this->m_measure,prog) ;
+      Array* new_centers = centers ;
+      bool medioids = usingMedioids() ;
+      auto measure = this->m_measure ;
+      tp->parallel_for(Range<size_t>(0,num_clusters),1,[&](size_t id)
+	 {
+	 if (medioids)
+	    update_medioid<IdxT,ValT>(clusters[id],id,new_centers,using_sparse_vectors,measure) ;
+	 else
+	    update_centroid<IdxT,ValT>(clusters[id],id,new_centers,using_sparse_vectors) ;
+	 if (prog)
+	    ++(*prog) ;
+	 }) ;
       delete prog ;
       }
    // build the final cluster result from the extracted clusters
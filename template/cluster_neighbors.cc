@@ -0,0 +1,692 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-07					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#include <algorithm>
+#include "framepac/atomic.h"
+#include "framepac/cluster.h"
+#include "framepac/file.h"
+#include "framepac/matrix.h"
+#include "framepac/message.h"
+#include "framepac/progress.h"
+#include "framepac/threadpool.h"
+#include "framepac/vectorcoll.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Neighborhood support for the density-based clustering algorithms	*/
+/************************************************************************/
+
+// cluster number for vectors which do not belong to any cluster
+#define FrNOISE_POINT UINT32_MAX
+
+// approximate amount of memory for the block of similarity rows used to find nearest neighbors
+#define FrKNN_BLOCK_BYTES (64*1024*1024)
+
+struct Neighbor
+   {
+      uint32_t id ;
+      float    sim ;
+   } ;
+
+// order neighbors by decreasing similarity, breaking ties by position
+inline bool better_neighbor(const Neighbor& n1, const Neighbor& n2)
+{
+   return n1.sim > n2.sim || (n1.sim == n2.sim && n1.id < n2.id) ;
+}
+
+//----------------------------------------------------------------------------
+
+class NeighborGraphHeader
+   {
+   public:
+      uint64_t    m_size ;		// number of vectors
+      uint64_t    m_edges ;		// total number of neighbors over all vectors
+      uint64_t    m_k ;			// neighbors per vector for a k-NN graph, 0 otherwise
+      uint64_t    m_pad[5] { 0 } ;	// padding for future extensions
+   } ;
+
+//----------------------------------------------------------------------------
+// the neighbors of each vector, stored in compressed-sparse-row form and sorted by decreasing similarity;
+//   the graph holds either the epsilon-neighborhoods or the k nearest neighbors of each vector
+
+class NeighborGraph
+   {
+   public:
+      NeighborGraph() {}
+      ~NeighborGraph() = default ;
+
+      size_t size() const { return m_size ; }
+      size_t neighborsPerVector() const { return m_k ; }
+      size_t numEdges() const { return m_size ? m_offsets[m_size] : 0 ; }
+      size_t numNeighbors(size_t id) const { return m_offsets[id+1] - m_offsets[id] ; }
+      const Neighbor* neighbors(size_t id) const { return m_neighbors.at(m_offsets[id]) ; }
+      const Neighbor* begin(size_t id) const { return neighbors(id) ; }
+      const Neighbor* end(size_t id) const { return m_neighbors.at(m_offsets[id+1]) ; }
+
+      // take ownership of per-vertex neighbor lists and pack them into a single array
+      void assemble(size_t size, Neighbor** lists, const size_t* counts, size_t k = 0) ;
+
+      // serialization, so that an expensive graph can be reused across clustering runs
+      bool load(CFile& fp, const char* filename) ;
+      bool load(const char* filename) ;
+      bool save(CFile& fp) const ;
+      bool save(const char* filename) const ;
+
+   protected:
+      NewPtr<size_t>   m_offsets ;
+      NewPtr<Neighbor> m_neighbors ;
+      size_t           m_size { 0 } ;
+      size_t           m_k { 0 } ;
+
+      // magic values for serializing
+      static constexpr auto signature = "\x7FNbrGraph" ;
+      static constexpr unsigned file_format = 1 ;
+      static constexpr unsigned min_file_format = 1 ;
+   } ;
+
+//----------------------------------------------------------------------------
+
+inline void NeighborGraph::assemble(size_t size, Neighbor** lists, const size_t* counts, size_t k)
+{
+   m_size = size ;
+   m_k = k ;
+   m_offsets.allocate(size+1) ;
+   size_t total = 0 ;
+   for (size_t i = 0 ; i < size ; ++i)
+      {
+      m_offsets[i] = total ;
+      total += counts[i] ;
+      }
+   m_offsets[size] = total ;
+   m_neighbors.allocate(total ? total : 1) ;
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,size),256,[&](size_t i)
+      {
+      if (lists[i])
+	 std::copy(lists[i],lists[i]+counts[i],m_neighbors.at(m_offsets[i])) ;
+      delete[] lists[i] ;
+      lists[i] = nullptr ;
+      }) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+inline bool NeighborGraph::load(CFile& fp, const char* filename)
+{
+   int version = file_format ;
+   if (!fp || !fp.verifySignature(signature,filename,version,min_file_format))
+      return false ;
+   uint8_t offsize ;
+   if (!fp.readValue(&offsize) || offsize != sizeof(size_t))
+      {
+      SystemMessage::error("wrong data type - sizeof() does not match") ;
+      return false ;
+      }
+   NeighborGraphHeader header ;
+   if (!fp.readValue(&header))
+      return false ;
+   NewPtr<size_t> offsets(header.m_size+1) ;
+   NewPtr<Neighbor> neighbors(header.m_edges ? header.m_edges : 1) ;
+   if (fp.read(offsets.begin(),header.m_size+1,sizeof(size_t)) != header.m_size+1 ||
+      fp.read(neighbors.begin(),header.m_edges,sizeof(Neighbor)) != header.m_edges ||
+      offsets[header.m_size] != header.m_edges)
+      return false ;
+   m_offsets = offsets ;
+   m_neighbors = neighbors ;
+   m_size = header.m_size ;
+   m_k = header.m_k ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+inline bool NeighborGraph::load(const char* filename)
+{
+   CInputFile fp(filename,CFile::binary) ;
+   return load(fp,filename) ;
+}
+
+//----------------------------------------------------------------------------
+
+inline bool NeighborGraph::save(CFile& fp) const
+{
+   if (!fp || !fp.writeSignature(signature,file_format))
+      return false ;
+   uint8_t offsize = sizeof(size_t) ;
+   if (!fp.writeValue(offsize))
+      return false ;
+   NeighborGraphHeader header ;
+   header.m_size = m_size ;
+   header.m_edges = numEdges() ;
+   header.m_k = m_k ;
+   if (!fp.writeValue(header))
+      return false ;
+   size_t zero = 0 ;
+   if (m_size == 0)
+      return fp.writeValue(zero) ;
+   return fp.writeValues(m_offsets.begin(),m_size+1) && fp.writeValues(m_neighbors.begin(),numEdges()) ;
+}
+
+//----------------------------------------------------------------------------
+
+inline bool NeighborGraph::save(const char* filename) const
+{
+   COutputFile fp(filename,CFile::binary) ;
+   return save(fp) ;
+}
+
+//----------------------------------------------------------------------------
+// a lock-free union-find structure which may be updated by multiple threads at once; sets are
+//   always linked from the higher-numbered root to the lower-numbered one, so concurrent merges
+//   can never form a cycle
+
+class ConcurrentDisjointSets
+   {
+   public:
+      ConcurrentDisjointSets(size_t size) : m_parent(new Atomic<uint32_t>[size]), m_size(size)
+	 {
+	 for (size_t i = 0 ; i < size ; ++i)
+	    m_parent[i].store_relax((uint32_t)i) ;
+	 }
+      ~ConcurrentDisjointSets() { delete[] m_parent ; }
+
+      size_t size() const { return m_size ; }
+      uint32_t find(uint32_t elt) const
+	 {
+	 for ( ; ; )
+	    {
+	    uint32_t parent = m_parent[elt].load() ;
+	    if (parent == elt)
+	       return elt ;
+	    uint32_t grandparent = m_parent[parent].load() ;
+	    if (grandparent != parent)
+	       {
+	       // path halving; losing the race just means the path stays a little longer
+	       m_parent[elt].compare_exchange_weak(parent,grandparent) ;
+	       }
+	    elt = grandparent ;
+	    }
+	 }
+      bool merge(uint32_t elt1, uint32_t elt2)
+	 {
+	 for ( ; ; )
+	    {
+	    uint32_t root1 = find(elt1) ;
+	    uint32_t root2 = find(elt2) ;
+	    if (root1 == root2)
+	       return false ;
+	    if (root1 < root2)
+	       std::swap(root1,root2) ;
+	    uint32_t expected = root1 ;
+	    if (m_parent[root1].compare_exchange_weak(expected,root2))
+	       return true ;
+	    }
+	 }
+
+   protected:
+      Atomic<uint32_t>* m_parent ;
+      size_t            m_size ;
+   } ;
+
+//----------------------------------------------------------------------------
+// Region queries for a fixed collection of vectors.  When all of the vectors are sparse and the
+//   measure gives vectors with no features in common a similarity of zero or less (as cosine and
+//   Jaccard do, but measures derived from distances do not), an inverted index from features to
+//   the vectors containing them restricts the similarity computations to vectors which share at
+//   least one feature with the query, so the index is only used for positive thresholds.
+//   Otherwise, vectors are compared exhaustively, but each vector's neighborhood is computed only
+//   once and the work is spread across the thread pool; they are first copied into a
+//   VectorCollection, so that the comparisons stream through contiguous rows rather than
+//   separate Vector objects.
+
+template <typename IdxT, typename ValT>
+class NeighborIndex
+   {
+   public:
+      typedef Vector<IdxT,ValT> vec_type ;
+   public:
+      NeighborIndex(const Array* vectors, VectorMeasure<IdxT,ValT>* measure) ;
+      ~NeighborIndex() = default ;
+
+      size_t size() const { return m_size ; }
+      bool usingInvertedIndex() const { return (bool)m_postings ; }
+      const vec_type* vector(size_t id) const { return static_cast<const vec_type*>(m_vectors->getNth(id)) ; }
+
+      // find every other vector whose similarity to vector 'id' is at least 'threshold'; 'marks' is
+      //   scratch space of size() elements, which must be zeroed before the first call by a thread
+      size_t regionQuery(size_t id, double threshold, Neighbor*& result, uint32_t* marks) const ;
+
+      // compute the neighborhoods of all vectors in parallel
+      bool epsilonNeighborhoods(double threshold, NeighborGraph& graph, ProgressIndicator* prog = nullptr) const ;
+      // compute the k most similar other vectors for every vector in parallel
+      bool nearestNeighbors(size_t k, NeighborGraph& graph, ProgressIndicator* prog = nullptr) const ;
+
+   protected:
+      bool allSparse() const ;
+      void buildInvertedIndex() ;
+      size_t candidateNeighbors(size_t id, size_t k, Neighbor*& result, uint32_t* marks) const ;
+      bool denseNearestNeighbors(size_t k, Neighbor** lists, size_t* counts, ProgressIndicator* prog) const ;
+
+   protected:
+      const Array*              m_vectors ;
+      VectorMeasure<IdxT,ValT>* m_measure ;
+      VectorCollection<IdxT,ValT> m_collection ;	// when not using the inverted index
+      NewPtr<size_t>            m_offsets ;	// start of each feature's postings
+      NewPtr<uint32_t>          m_postings ;	// IDs of the vectors containing each feature
+      size_t                    m_size ;
+      size_t                    m_num_features { 0 } ;
+   } ;
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+NeighborIndex<IdxT,ValT>::NeighborIndex(const Array* vectors, VectorMeasure<IdxT,ValT>* measure)
+   : m_vectors(vectors), m_measure(measure), m_size(vectors ? vectors->size() : 0)
+{
+   if (m_size == 0)
+      return ;
+   if (measure && measure->disjointSimilarityNonPositive() && allSparse())
+      buildInvertedIndex() ;
+   else
+      m_collection.load(vectors) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool NeighborIndex<IdxT,ValT>::allSparse() const
+{
+   for (size_t i = 0 ; i < m_size ; ++i)
+      {
+      auto v = vector(i) ;
+      if (v && !v->isSparseVector())
+	 return false ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void NeighborIndex<IdxT,ValT>::buildInvertedIndex()
+{
+   typedef SparseVector<IdxT,ValT> sparse_type ;
+   // the element indices of a sparse vector are sorted, so the last one is the largest
+   size_t max_feature = ThreadPool::defaultPool()->parallel_reduce(Range<size_t>(0,m_size),size_t(0),
+      [&](size_t i) -> size_t
+      {
+      auto v = static_cast<const sparse_type*>(vector(i)) ;
+      return (v && v->numElements()) ? (size_t)v->elementIndex(v->numElements()-1) + 1 : 0 ;
+      },
+      [](size_t a, size_t b) { return std::max(a,b) ; }) ;
+   m_num_features = max_feature ;
+   m_offsets.allocate(m_num_features+1) ;
+   std::fill(m_offsets.begin(),m_offsets.begin()+m_num_features+1,size_t(0)) ;
+   for (size_t i = 0 ; i < m_size ; ++i)
+      {
+      auto v = static_cast<const sparse_type*>(vector(i)) ;
+      if (!v) continue ;
+      for (size_t j = 0 ; j < v->numElements() ; ++j)
+	 m_offsets[v->elementIndex(j)]++ ;
+      }
+   // convert the counts into starting positions
+   size_t total = 0 ;
+   for (size_t f = 0 ; f <= m_num_features ; ++f)
+      {
+      size_t count = m_offsets[f] ;
+      m_offsets[f] = total ;
+      total += count ;
+      }
+   m_postings.allocate(total ? total : 1) ;
+   NewPtr<size_t> fill(m_num_features ? m_num_features : 1) ;
+   std::copy(m_offsets.begin(),m_offsets.begin()+m_num_features,fill.begin()) ;
+   for (size_t i = 0 ; i < m_size ; ++i)
+      {
+      auto v = static_cast<const sparse_type*>(vector(i)) ;
+      if (!v) continue ;
+      for (size_t j = 0 ; j < v->numElements() ; ++j)
+	 m_postings[fill[v->elementIndex(j)]++] = (uint32_t)i ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t NeighborIndex<IdxT,ValT>::regionQuery(size_t id, double threshold, Neighbor*& result, uint32_t* marks) const
+{
+   result = nullptr ;
+   auto query = vector(id) ;
+   if (!query)
+      return 0 ;
+   size_t capacity = 0 ;
+   size_t count = 0 ;
+   auto add_neighbor = [&](size_t other, double sim)
+      {
+      if (count >= capacity)
+	 {
+	 size_t newcap = capacity ? 2*capacity : 16 ;
+	 Neighbor* newresult = new Neighbor[newcap] ;
+	 if (result)
+	    std::copy(result,result+count,newresult) ;
+	 delete[] result ;
+	 result = newresult ;
+	 capacity = newcap ;
+	 }
+      result[count].id = (uint32_t)other ;
+      result[count].sim = (float)sim ;
+      ++count ;
+      } ;
+   if (usingInvertedIndex() && threshold > 0.0 && query->numElements() > 0)
+      {
+      // only vectors sharing at least one feature with the query can have a positive similarity
+      //   (an empty query is scanned exhaustively, since it may match other empty vectors)
+      auto sq = static_cast<const SparseVector<IdxT,ValT>*>(query) ;
+      uint32_t stamp = (uint32_t)id + 1 ;
+      marks[id] = stamp ;
+      for (size_t j = 0 ; j < sq->numElements() ; ++j)
+	 {
+	 size_t feature = sq->elementIndex(j) ;
+	 for (size_t p = m_offsets[feature] ; p < m_offsets[feature+1] ; ++p)
+	    {
+	    uint32_t other = m_postings[p] ;
+	    if (marks[other] == stamp)
+	       continue ;
+	    marks[other] = stamp ;
+	    double sim = m_measure->similarity(query,vector(other)) ;
+	    if (sim >= threshold)
+	       add_neighbor(other,sim) ;
+	    }
+	 }
+      }
+   else if (m_collection)
+      {
+      LocalAlloc<double> sims(m_size) ;
+      m_measure->similarities(m_collection,id,0,m_size,sims) ;
+      for (size_t other = 0 ; other < m_size ; ++other)
+	 {
+	 if (other != id && m_collection.present(other) && sims[other] >= threshold)
+	    add_neighbor(other,sims[other]) ;
+	 }
+      }
+   else
+      {
+      for (size_t other = 0 ; other < m_size ; ++other)
+	 {
+	 auto v = vector(other) ;
+	 if (other == id || !v)
+	    continue ;
+	 double sim = m_measure->similarity(query,v) ;
+	 if (sim >= threshold)
+	    add_neighbor(other,sim) ;
+	 }
+      }
+   std::sort(result,result+count,better_neighbor) ;
+   return count ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool NeighborIndex<IdxT,ValT>::epsilonNeighborhoods(double threshold, NeighborGraph& graph,
+   ProgressIndicator* prog) const
+{
+   if (m_size >= UINT32_MAX)
+      return false ;
+   NewPtr<Neighbor*> lists(m_size) ;
+   NewPtr<size_t> counts(m_size) ;
+   bool need_marks = usingInvertedIndex() && threshold > 0.0 ;
+   ThreadPool::defaultPool()->parallel_for_chunks(Range<size_t>(0,m_size),16,[&](Range<size_t> chunk)
+      {
+      NewPtr<uint32_t> marks ;
+      if (need_marks)
+	 {
+	 marks.allocate(m_size) ;
+	 std::fill(marks.begin(),marks.begin()+m_size,uint32_t(0)) ;
+	 }
+      for (auto i : chunk)
+	 {
+	 counts[i] = regionQuery(i,threshold,lists[i],marks.begin()) ;
+	 if (prog) prog->incr() ;
+	 }
+      }) ;
+   graph.assemble(m_size,lists.begin(),counts.begin()) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+// find the k most similar vectors among those sharing at least one feature with vector 'id'; since
+//   the remaining vectors have a similarity of zero or less, only neighbors with a positive
+//   similarity are kept, so a vector may have fewer than k neighbors
+
+template <typename IdxT, typename ValT>
+size_t NeighborIndex<IdxT,ValT>::candidateNeighbors(size_t id, size_t k, Neighbor*& result, uint32_t* marks) const
+{
+   result = nullptr ;
+   auto query = static_cast<const SparseVector<IdxT,ValT>*>(vector(id)) ;
+   if (!query)
+      return 0 ;
+   std::vector<Neighbor> candidates ;
+   auto add_candidate = [&](size_t other)
+      {
+      double sim = m_measure->similarity(query,vector(other)) ;
+      if (sim > 0.0)
+	 candidates.push_back(Neighbor { (uint32_t)other, (float)sim }) ;
+      } ;
+   if (query->numElements() == 0)
+      {
+      // an empty query has no postings, but may still be similar to other empty vectors
+      for (size_t other = 0 ; other < m_size ; ++other)
+	 {
+	 if (other != id && vector(other))
+	    add_candidate(other) ;
+	 }
+      }
+   else
+      {
+      uint32_t stamp = (uint32_t)id + 1 ;
+      marks[id] = stamp ;
+      for (size_t j = 0 ; j < query->numElements() ; ++j)
+	 {
+	 size_t feature = query->elementIndex(j) ;
+	 for (size_t p = m_offsets[feature] ; p < m_offsets[feature+1] ; ++p)
+	    {
+	    uint32_t other = m_postings[p] ;
+	    if (marks[other] == stamp)
+	       continue ;
+	    marks[other] = stamp ;
+	    add_candidate(other) ;
+	    }
+	 }
+      }
+   size_t count = std::min(k,candidates.size()) ;
+   if (count == 0)
+      return 0 ;
+   std::partial_sort(candidates.begin(),candidates.begin()+count,candidates.end(),better_neighbor) ;
+   result = new Neighbor[count] ;
+   std::copy(candidates.begin(),candidates.begin()+count,result) ;
+   return count ;
+}
+
+//----------------------------------------------------------------------------
+// compute the similarity matrix a block of rows at a time through the measure's batched interface,
+//   then select the top k entries of each row
+
+template <typename IdxT, typename ValT>
+bool NeighborIndex<IdxT,ValT>::denseNearestNeighbors(size_t k, Neighbor** lists, size_t* counts,
+   ProgressIndicator* prog) const
+{
+   size_t block_rows = FrKNN_BLOCK_BYTES / (m_size * sizeof(float)) ;
+   block_rows = std::max(size_t(1),std::min(size_t(1024),block_rows)) ;
+   Ptr<FullMatrix<float>> sims { FullMatrix<float>::create(block_rows,m_size) } ;
+   if (!sims || sims->rows() < block_rows)
+      return false ;
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   for (size_t start = 0 ; start < m_size ; start += block_rows)
+      {
+      size_t stop = std::min(m_size,start+block_rows) ;
+      if (m_collection)
+	 {
+	 if (!m_measure->similarityMatrix(m_collection,start,stop,m_collection,sims))
+	    return false ;
+	 }
+      else
+	 {
+	 ScopedObject<RefArray> block(stop-start) ;
+	 for (size_t i = start ; i < stop ; ++i)
+	    block->append(m_vectors->getNth(i)) ;
+	 if (!m_measure->similarityMatrix(block,m_vectors,sims))
+	    return false ;
+	 }
+      tp->parallel_for(Range<size_t>(start,stop),1,[&](size_t i)
+	 {
+	 const float* row = sims->row(i - start) ;
+	 std::vector<Neighbor> candidates ;
+	 candidates.reserve(m_size) ;
+	 for (size_t j = 0 ; j < m_size ; ++j)
+	    {
+	    if (j != i && vector(j))
+	       candidates.push_back(Neighbor { (uint32_t)j, row[j] }) ;
+	    }
+	 size_t count = std::min(k,candidates.size()) ;
+	 std::partial_sort(candidates.begin(),candidates.begin()+count,candidates.end(),better_neighbor) ;
+	 lists[i] = count ? new Neighbor[count] : nullptr ;
+	 std::copy(candidates.begin(),candidates.begin()+count,lists[i]) ;
+	 counts[i] = count ;
+	 if (prog) prog->incr() ;
+	 }) ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool NeighborIndex<IdxT,ValT>::nearestNeighbors(size_t k, NeighborGraph& graph, ProgressIndicator* prog) const
+{
+   if (m_size >= UINT32_MAX || k == 0)
+      return false ;
+   NewPtr<Neighbor*> lists(m_size) ;
+   NewPtr<size_t> counts(m_size) ;
+   std::fill(lists.begin(),lists.begin()+m_size,nullptr) ;
+   std::fill(counts.begin(),counts.begin()+m_size,size_t(0)) ;
+   if (usingInvertedIndex())
+      {
+      // vectors which share no features have a similarity of zero or less and are omitted, as
+      //   are any other neighbors which are not positively similar
+      ThreadPool::defaultPool()->parallel_for_chunks(Range<size_t>(0,m_size),16,[&](Range<size_t> chunk)
+	 {
+	 NewPtr<uint32_t> marks(m_size) ;
+	 std::fill(marks.begin(),marks.begin()+m_size,uint32_t(0)) ;
+	 for (auto i : chunk)
+	    {
+	    counts[i] = candidateNeighbors(i,k,lists[i],marks.begin()) ;
+	    if (prog) prog->incr() ;
+	    }
+	 }) ;
+      }
+   else if (!denseNearestNeighbors(k,lists.begin(),counts.begin(),prog))
+      {
+      for (size_t i = 0 ; i < m_size ; ++i)
+	 delete[] lists[i] ;
+      return false ;
+      }
+   graph.assemble(m_size,lists.begin(),counts.begin(),k) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+// number the clusters found by the density-based algorithms in order of their first member; on entry,
+//   'root' holds a representative vector for each vector's cluster (or FrNOISE_POINT), and on exit it
+//   holds the cluster number; returns the number of clusters
+
+inline size_t number_density_clusters(uint32_t* root, size_t num_vectors)
+{
+   NewPtr<uint32_t> cluster_num(num_vectors) ;
+   std::fill(cluster_num.begin(),cluster_num.begin()+num_vectors,FrNOISE_POINT) ;
+   size_t num_clusters = 0 ;
+   for (size_t i = 0 ; i < num_vectors ; ++i)
+      {
+      if (root[i] == FrNOISE_POINT)
+	 continue ;
+      if (cluster_num[root[i]] == FrNOISE_POINT)
+	 cluster_num[root[i]] = num_clusters++ ;
+      root[i] = cluster_num[root[i]] ;
+      }
+   return num_clusters ;
+}
+
+//----------------------------------------------------------------------------
+// build the final clustering from a cluster number for each vector; vectors with a cluster number
+//   of FrNOISE_POINT are noise, and become singleton clusters unless singletons are excluded
+
+template <typename IdxT, typename ValT>
+ClusterInfo* make_density_clusters(const ClusteringAlgo<IdxT,ValT>* algo, const Array* vectors,
+   const uint32_t* assignment, size_t num_clusters)
+{
+   size_t noise = 0 ;
+   for (size_t i = 0 ; i < vectors->size() ; ++i)
+      {
+      if (assignment[i] == FrNOISE_POINT)
+	 noise++ ;
+      }
+   algo->log(0,"  %lu clusters and %lu noise points",num_clusters,noise) ;
+   size_t num_singletons = algo->excludingSingletons() ? 0 : noise ;
+   size_t total = num_clusters + num_singletons ;
+   ClusterInfo** clusters = new ClusterInfo*[total] ;
+   for (size_t i = 0 ; i < num_clusters ; ++i)
+      {
+      clusters[i] = ClusterInfo::create() ;
+      clusters[i]->setLabel(ClusterInfo::genLabel()) ;
+      }
+   size_t singleton = num_clusters ;
+   for (size_t i = 0 ; i < vectors->size() ; ++i)
+      {
+      auto vector = static_cast<Vector<IdxT,ValT>*>(vectors->getNth(i)) ;
+      if (assignment[i] != FrNOISE_POINT)
+	 {
+	 auto cluster = clusters[assignment[i]] ;
+	 cluster->addVector(vector) ;
+	 vector->setLabel(cluster->label()) ;
+	 }
+      else if (num_singletons)
+	 {
+	 auto cluster = ClusterInfo::createSingleton(vector) ;
+	 cluster->setLabel(ClusterInfo::genLabel()) ;
+	 vector->setLabel(cluster->label()) ;
+	 clusters[singleton++] = cluster ;
+	 }
+      else
+	 vector->setLabel(nullptr) ;
+      }
+   ClusterInfo* result = ClusterInfo::create(clusters,total) ;
+   ClusteringAlgoBase::freeClusters(clusters,total) ;
+   // the subclusters are the actual result
+   result->setFlag(ClusterInfo::Flags::group) ;
+   return result ;
+}
+
+} // end of namespace Fr
+
+// end of file cluster_neighbors.cc //
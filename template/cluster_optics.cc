@@ -19,7 +19,9 @@
 /*									*/
 /************************************************************************/
 
+#include <queue>
 #include "framepac/cluster.h"
+#include "framepac/threadpool.h"
 using namespace Fr ;
 
 namespace Fr
@@ -35,6 +37,17 @@ namespace Fr
       SC'13), pp.49:1-49:12 (2013).
    source code to accompany the paper available at
        http://cucis.ece.northwestern.edu/projects/Clustering/download_code_optics.html
+
+   As with DBSCAN, we work in terms of similarity rather than distance, so the "core distance" of
+   a vector becomes the similarity of its MinPts-th nearest neighbor (counting itself), and
+   reachability is the smaller of that and the similarity between the two vectors.  The graph of
+   mutual reachabilities (the smallest of the two core similarities and the vectors' similarity)
+   among the core points is reduced to a maximum spanning forest with a parallel version of
+   Boruvka's algorithm, and each border point is attached to the core point from which it is most
+   reachable.  Since the forest preserves connectivity at every threshold, traversing each tree in
+   order of decreasing reachability yields an OPTICS ordering from which flat clusters can be
+   extracted at the extraction threshold (or the generating threshold clusterThreshold() if none
+   is given).
 */
 
 template <typename IdxT, typename ValT>
@@ -47,17 +60,288 @@ class ClusteringAlgoOPTICS : public ClusteringAlgo<IdxT,ValT>
       virtual ClusterInfo* cluster(const Array* vectors) const ;
 
    protected:
-
+      struct Edge
+         {
+	    float    sim ;
+	    uint32_t from ;
+	    uint32_t to ;
+	 } ;
+   protected:
+      size_t minPointsOrDefault() const { return this->m_min_points ? this->m_min_points : FrDBSCAN_DEFAULT_MINPTS ; }
+      static bool betterEdge(const Edge& e1, const Edge& e2) ;
+      size_t spanningForest(const NeighborGraph& neighbors, const float* core_sim, Edge* forest) const ;
+      void orderVectors(size_t num_vectors, const float* core_sim, const Edge* forest, size_t num_edges,
+	 uint32_t* order, float* reachability) const ;
    } ;
 
 /************************************************************************/
 /************************************************************************/
 
+template <typename IdxT, typename ValT>
+bool ClusteringAlgoOPTICS<IdxT,ValT>::betterEdge(const Edge& e1, const Edge& e2)
+{
+   // a strict total order on the edges guarantees that Boruvka's algorithm never forms a cycle
+   if (e1.sim != e2.sim)
+      return e1.sim > e2.sim ;
+   uint32_t lo1 = std::min(e1.from,e1.to) ;
+   uint32_t lo2 = std::min(e2.from,e2.to) ;
+   if (lo1 != lo2)
+      return lo1 < lo2 ;
+   return std::max(e1.from,e1.to) < std::max(e2.from,e2.to) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t ClusteringAlgoOPTICS<IdxT,ValT>::spanningForest(const NeighborGraph& neighbors, const float* core_sim,
+   Edge* forest) const
+{
+   size_t num_vectors = neighbors.size() ;
+   ConcurrentDisjointSets components(num_vectors) ;
+   NewPtr<Edge> best(num_vectors) ;		// best edge leaving each vertex
+   NewPtr<Edge> comp_best(num_vectors) ;	// best edge leaving each component, indexed by root
+   const float none = -HUGE_VAL ;
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   size_t num_edges = 0 ;
+   for (size_t round = 1 ; ; ++round)
+      {
+      // find the best edge from each vertex to a different component
+      tp->parallel_for(Range<size_t>(0,num_vectors),64,[&](size_t i)
+	 {
+	 Edge edge { none, (uint32_t)i, (uint32_t)i } ;
+	 comp_best[i] = edge ;
+	 best[i] = edge ;
+	 if (core_sim[i] == none)
+	    return ;
+	 uint32_t comp = components.find(i) ;
+	 for (auto nbr = neighbors.begin(i) ; nbr != neighbors.end(i) ; ++nbr)
+	    {
+	    if (core_sim[nbr->id] == none || components.find(nbr->id) == comp)
+	       continue ;
+	    float reach = std::min(std::min(core_sim[i],core_sim[nbr->id]),nbr->sim) ;
+	    Edge candidate { reach, (uint32_t)i, nbr->id } ;
+	    if (edge.from == edge.to || betterEdge(candidate,edge))
+	       edge = candidate ;
+	    }
+	 best[i] = edge ;
+	 }) ;
+      // reduce to the best edge leaving each component
+      for (size_t i = 0 ; i < num_vectors ; ++i)
+	 {
+	 if (best[i].from == best[i].to)
+	    continue ;
+	 uint32_t comp = components.find(i) ;
+	 if (comp_best[comp].from == comp_best[comp].to || betterEdge(best[i],comp_best[comp]))
+	    comp_best[comp] = best[i] ;
+	 }
+      // add those edges to the forest, merging the components they connect
+      size_t merges = 0 ;
+      for (size_t i = 0 ; i < num_vectors ; ++i)
+	 {
+	 const Edge& edge = comp_best[i] ;
+	 if (edge.from != edge.to && components.merge(edge.from,edge.to))
+	    {
+	    forest[num_edges++] = edge ;
+	    ++merges ;
+	    }
+	 }
+      this->log(2,"  round %lu: added %lu edges",round,merges) ;
+      if (merges == 0)
+	 break ;
+      }
+   // attach each border point as a leaf to the core point from which it is most reachable
+   tp->parallel_for(Range<size_t>(0,num_vectors),256,[&](size_t i)
+      {
+      Edge edge { none, (uint32_t)i, (uint32_t)i } ;
+      if (core_sim[i] == none)
+	 {
+	 for (auto nbr = neighbors.begin(i) ; nbr != neighbors.end(i) ; ++nbr)
+	    {
+	    if (core_sim[nbr->id] == none)
+	       continue ;
+	    Edge candidate { std::min(core_sim[nbr->id],nbr->sim), nbr->id, (uint32_t)i } ;
+	    if (edge.from == edge.to || betterEdge(candidate,edge))
+	       edge = candidate ;
+	    }
+	 }
+      best[i] = edge ;
+      }) ;
+   for (size_t i = 0 ; i < num_vectors ; ++i)
+      {
+      if (best[i].from != best[i].to)
+	 forest[num_edges++] = best[i] ;
+      }
+   return num_edges ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void ClusteringAlgoOPTICS<IdxT,ValT>::orderVectors(size_t num_vectors, const float* core_sim, const Edge* forest,
+   size_t num_edges, uint32_t* order, float* reachability) const
+{
+   // build the adjacency lists of the spanning forest
+   NewPtr<size_t> offsets(num_vectors+1) ;
+   std::fill(offsets.begin(),offsets.begin()+num_vectors+1,size_t(0)) ;
+   for (size_t e = 0 ; e < num_edges ; ++e)
+      {
+      offsets[forest[e].from]++ ;
+      offsets[forest[e].to]++ ;
+      }
+   size_t total = 0 ;
+   for (size_t i = 0 ; i <= num_vectors ; ++i)
+      {
+      size_t count = offsets[i] ;
+      offsets[i] = total ;
+      total += count ;
+      }
+   NewPtr<Neighbor> adjacent(total ? total : 1) ;
+   NewPtr<size_t> fill(num_vectors ? num_vectors : 1) ;
+   std::copy(offsets.begin(),offsets.begin()+num_vectors,fill.begin()) ;
+   for (size_t e = 0 ; e < num_edges ; ++e)
+      {
+      const Edge& edge = forest[e] ;
+      adjacent[fill[edge.from]++] = Neighbor { edge.to, edge.sim } ;
+      adjacent[fill[edge.to]++] = Neighbor { edge.from, edge.sim } ;
+      }
+   // expand each tree from its lowest-numbered core point (or from any remaining vertex once the core
+   //   points have all been visited), always continuing with the most reachable unvisited vertex; as
+   //   in sequential OPTICS, only core points are expanded, so border points never join two clusters
+   typedef std::pair<float,uint32_t> Seed ;
+   auto seed_order = [](const Seed& s1, const Seed& s2)
+      { return s1.first < s2.first || (s1.first == s2.first && s1.second > s2.second) ; } ;
+   std::priority_queue<Seed,std::vector<Seed>,decltype(seed_order)> seeds(seed_order) ;
+   NewPtr<bool> visited(num_vectors) ;
+   std::fill(visited.begin(),visited.begin()+num_vectors,false) ;
+   size_t count = 0 ;
+   for (size_t i = 0 ; i < 2*num_vectors ; ++i)
+      {
+      size_t start = i % num_vectors ;
+      if (visited[start] || (i < num_vectors && core_sim[start] == -HUGE_VAL))
+	 continue ;
+      seeds.push(Seed(-HUGE_VAL,(uint32_t)start)) ;
+      while (!seeds.empty())
+	 {
+	 Seed seed = seeds.top() ;
+	 seeds.pop() ;
+	 uint32_t v = seed.second ;
+	 if (visited[v])
+	    continue ;
+	 visited[v] = true ;
+	 order[count] = v ;
+	 reachability[count] = seed.first ;
+	 ++count ;
+	 if (core_sim[v] == -HUGE_VAL)
+	    continue ;
+	 for (size_t a = offsets[v] ; a < offsets[v+1] ; ++a)
+	    {
+	    // a vertex is only as reachable from v as v's own core similarity allows
+	    if (!visited[adjacent[a].id])
+	       seeds.push(Seed(std::min(core_sim[v],adjacent[a].sim),adjacent[a].id)) ;
+	    }
+	 }
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename IdxT, typename ValT>
 ClusterInfo* ClusteringAlgoOPTICS<IdxT,ValT>::cluster(const Array* vectors) const
 {
-   (void)vectors;
-   return nullptr ; //TODO
+   if (!vectors || vectors->size() == 0 || !this->checkSparseOrDense(vectors) || !this->m_measure)
+      {
+      return nullptr ;
+      }
+   ScopedObject<RefArray> nonempty(vectors->size()) ;
+   for (auto v : *vectors)
+      {
+      auto vec = static_cast<Vector<IdxT,ValT>*>(v) ;
+      if (vec && vec->length() > 0.0)
+	 nonempty->append(vec) ;
+      }
+   size_t num_vectors = nonempty->size() ;
+   if (num_vectors == 0)
+      {
+      return nullptr ;			// nothing to be clustered
+      }
+   this->trapSigInt() ;
+   // find the epsilon-neighborhood of every vector
+   this->log(0,"Finding neighborhoods of %lu vectors",num_vectors) ;
+   NeighborIndex<IdxT,ValT> index(nonempty,this->m_measure) ;
+   NeighborGraph neighbors ;
+   auto prog = this->makeProgressIndicator(num_vectors) ;
+   bool success = index.epsilonNeighborhoods(this->clusterThreshold(),neighbors,prog) ;
+   delete prog ;
+   if (!success)
+      {
+      this->untrapSigInt() ;
+      return nullptr ;
+      }
+   this->log(1,"  %lu neighbor links",neighbors.numEdges()) ;
+   // compute the core similarity of each vector; since the neighbors are sorted by decreasing
+   //   similarity and the vector itself counts as the first, it is that of neighbor MinPts-2
+   size_t minpts = minPointsOrDefault() ;
+   NewPtr<float> core_sim(num_vectors) ;
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,num_vectors),256,[&](size_t i)
+      {
+      if (minpts <= 1)
+	 core_sim[i] = HUGE_VAL ;
+      else if (neighbors.numNeighbors(i) + 1 >= minpts)
+	 core_sim[i] = neighbors.neighbors(i)[minpts-2].sim ;
+      else
+	 core_sim[i] = -HUGE_VAL ;
+      }) ;
+   this->log(0,"Building reachability spanning forest") ;
+   NewPtr<Edge> forest(num_vectors) ;
+   size_t num_edges = spanningForest(neighbors,core_sim.begin(),forest.begin()) ;
+   NewPtr<uint32_t> order(num_vectors) ;
+   NewPtr<float> reachability(num_vectors) ;
+   orderVectors(num_vectors,core_sim.begin(),forest.begin(),num_edges,order.begin(),reachability.begin()) ;
+   // extract flat clusters by scanning the ordering: a vector which is not reachable at the
+   //   extraction threshold starts a new cluster if it is a core point at that threshold, and is
+   //   noise otherwise
+   float threshold = (float)std::max(this->clusterThreshold(),this->extractionThreshold()) ;
+   this->log(0,"Extracting clusters at threshold %g",threshold) ;
+   NewPtr<uint32_t> assignment(num_vectors) ;
+   size_t num_clusters = 0 ;
+   uint32_t current = FrNOISE_POINT ;
+   for (size_t i = 0 ; i < num_vectors ; ++i)
+      {
+      uint32_t v = order[i] ;
+      if (reachability[i] < threshold)
+	 {
+	 current = (core_sim[v] >= threshold) ? num_clusters++ : FrNOISE_POINT ;
+	 }
+      assignment[v] = current ;
+      }
+   // a vector which is not a core point at the extraction threshold may still be within that
+   //   threshold of one which is, even if the spanning forest reached it by another path; as in
+   //   DBSCAN, such border points join the cluster of their most similar core neighbor
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,num_vectors),256,[&](size_t v)
+      {
+      if (core_sim[v] >= threshold)
+	 return ;
+      for (auto nbr = neighbors.begin(v) ; nbr != neighbors.end(v) && nbr->sim >= threshold ; ++nbr)
+	 {
+	 if (core_sim[nbr->id] >= threshold)
+	    {
+	    assignment[v] = assignment[nbr->id] ;
+	    break ;
+	    }
+	 }
+      }) ;
+   // collect the vectors in OPTICS order, so that each cluster's members are listed in that order
+   ScopedObject<RefArray> ordered(num_vectors) ;
+   NewPtr<uint32_t> ordered_assignment(num_vectors) ;
+   for (size_t i = 0 ; i < num_vectors ; ++i)
+      {
+      ordered->append(nonempty->getNth(order[i])) ;
+      ordered_assignment[i] = assignment[order[i]] ;
+      }
+   ClusterInfo* result = make_density_clusters(this,ordered,ordered_assignment.begin(),num_clusters) ;
+   this->untrapSigInt() ;
+   return result ;
 }
 
 } // end of namespace Fr
@@ -20,6 +20,8 @@
 /************************************************************************/
 
 #include "framepac/cluster.h"
+#include "framepac/file.h"
+#include "framepac/threadpool.h"
 using namespace Fr ;
 
 namespace Fr
@@ -28,6 +30,24 @@ namespace Fr
 /************************************************************************/
 /************************************************************************/
 
+/* shared-nearest-neighbor clustering as described in
+      Levent Ertoz, Michael Steinbach, and Vipin Kumar, "Finding Clusters of Different Sizes, Shapes, and
+      Densities in Noisy, High Dimensional Data".  In Proceedings of the SIAM International Conference on
+      Data Mining (SDM'03), 2003.
+
+   Two vectors are linked if each is among the other's k nearest neighbors, and the strength of the
+   link is the number of nearest neighbors they share.  clusterThreshold() gives the minimum link
+   strength as a proportion of k; a vector whose number of sufficiently-strong links is at least
+   MinPts is a core point.  As in DBSCAN, linked core points form clusters, other vectors join the
+   cluster of the core point to which they are most strongly linked, and the remainder are noise.
+   Since finding the nearest neighbors is by far the most expensive step, the k-NN graph can be
+   saved to and reloaded from the file named by knnFile(), allowing repeated runs with different
+   thresholds.
+*/
+
+// the number of nearest neighbors to use if none was specified
+#define FrSNN_DEFAULT_NEIGHBORS 20
+
 template <typename IdxT, typename ValT>
 class ClusteringAlgoSharedNN : public ClusteringAlgo<IdxT,ValT>
    {
@@ -38,19 +58,184 @@ class ClusteringAlgoSharedNN : public ClusteringAlgo<IdxT,ValT>
       virtual ClusterInfo* cluster(const Array* vectors) const ;
 
    protected:
-
+      size_t neighborsOrDefault() const
+	 { return this->m_num_neighbors ? this->m_num_neighbors : FrSNN_DEFAULT_NEIGHBORS ; }
+      size_t minPointsOrDefault() const
+	 { return this->m_min_points ? this->m_min_points : (neighborsOrDefault() + 1) / 2 ; }
+      bool nearestNeighbors(const Array* vectors, size_t k, NeighborGraph& knn) const ;
+      void linkStrengths(const NeighborGraph& knn, size_t k, NeighborGraph& snn) const ;
    } ;
 
 /************************************************************************/
 /************************************************************************/
 
+template <typename IdxT, typename ValT>
+bool ClusteringAlgoSharedNN<IdxT,ValT>::nearestNeighbors(const Array* vectors, size_t k, NeighborGraph& knn) const
+{
+   const char* filename = this->knnFile() ;
+   if (filename && file_exists(filename))
+      {
+      // a saved graph is usable if it covers the same vectors with at least as many neighbors
+      if (knn.load(filename) && knn.size() == vectors->size() && knn.neighborsPerVector() >= k)
+	 {
+	 this->log(0,"Loaded %lu-nearest-neighbor graph from %s",knn.neighborsPerVector(),filename) ;
+	 return true ;
+	 }
+      this->log(0,"Unable to use nearest-neighbor graph in %s, recomputing",filename) ;
+      }
+   this->log(0,"Finding %lu nearest neighbors of %lu vectors",k,vectors->size()) ;
+   NeighborIndex<IdxT,ValT> index(vectors,this->m_measure) ;
+   if (index.usingInvertedIndex())
+      this->log(1,"  using inverted index") ;
+   auto prog = this->makeProgressIndicator(vectors->size()) ;
+   bool success = index.nearestNeighbors(k,knn,prog) ;
+   delete prog ;
+   if (success && filename && !knn.save(filename))
+      this->log(0,"Unable to save nearest-neighbor graph to %s",filename) ;
+   return success ;
+}
+
+//----------------------------------------------------------------------------
+// link each vector to those of its nearest neighbors which also have it as a nearest neighbor, with
+//   the number of shared nearest neighbors as the link strength (stored in place of the similarity)
+
+template <typename IdxT, typename ValT>
+void ClusteringAlgoSharedNN<IdxT,ValT>::linkStrengths(const NeighborGraph& knn, size_t k, NeighborGraph& snn) const
+{
+   size_t num_vectors = knn.size() ;
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   // make a sorted copy of each vector's neighbor IDs so that the lists can be intersected by merging
+   NewPtr<uint32_t> sorted(num_vectors * k) ;
+   NewPtr<size_t> counts(num_vectors) ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),256,[&](size_t i)
+      {
+      size_t count = std::min(k,knn.numNeighbors(i)) ;
+      uint32_t* ids = sorted.at(i*k) ;
+      for (size_t n = 0 ; n < count ; ++n)
+	 ids[n] = knn.neighbors(i)[n].id ;
+      std::sort(ids,ids+count) ;
+      counts[i] = count ;
+      }) ;
+   NewPtr<Neighbor*> lists(num_vectors) ;
+   NewPtr<size_t> link_counts(num_vectors) ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),64,[&](size_t i)
+      {
+      const uint32_t* ids = sorted.at(i*k) ;
+      Neighbor* links = counts[i] ? new Neighbor[counts[i]] : nullptr ;
+      size_t num_links = 0 ;
+      for (size_t n = 0 ; n < counts[i] ; ++n)
+	 {
+	 uint32_t other = ids[n] ;
+	 const uint32_t* other_ids = sorted.at(other*(size_t)k) ;
+	 if (!std::binary_search(other_ids,other_ids+counts[other],(uint32_t)i))
+	    continue ;			// not a mutual nearest neighbor
+	 size_t shared = 0 ;
+	 for (size_t p1 = 0, p2 = 0 ; p1 < counts[i] && p2 < counts[other] ; )
+	    {
+	    if (ids[p1] < other_ids[p2])
+	       ++p1 ;
+	    else if (ids[p1] > other_ids[p2])
+	       ++p2 ;
+	    else
+	       {
+	       ++shared ;
+	       ++p1 ;
+	       ++p2 ;
+	       }
+	    }
+	 links[num_links++] = Neighbor { other, (float)shared } ;
+	 }
+      std::sort(links,links+num_links,better_neighbor) ;
+      lists[i] = links ;
+      link_counts[i] = num_links ;
+      }) ;
+   snn.assemble(num_vectors,lists.begin(),link_counts.begin()) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename IdxT, typename ValT>
 ClusterInfo* ClusteringAlgoSharedNN<IdxT,ValT>::cluster(const Array* vectors) const
 {
-   (void)vectors;
-   return nullptr ; //TODO
+   if (!vectors || vectors->size() == 0 || !this->checkSparseOrDense(vectors) || !this->m_measure)
+      {
+      return nullptr ;
+      }
+   ScopedObject<RefArray> nonempty(vectors->size()) ;
+   for (auto v : *vectors)
+      {
+      auto vec = static_cast<Vector<IdxT,ValT>*>(v) ;
+      if (vec && vec->length() > 0.0)
+	 nonempty->append(vec) ;
+      }
+   size_t num_vectors = nonempty->size() ;
+   if (num_vectors == 0)
+      {
+      return nullptr ;			// nothing to be clustered
+      }
+   this->trapSigInt() ;
+   size_t k = std::min(neighborsOrDefault(),num_vectors-1) ;
+   NeighborGraph knn ;
+   if (k == 0 || !nearestNeighbors(nonempty,k,knn))
+      {
+      this->untrapSigInt() ;
+      return nullptr ;
+      }
+   this->log(0,"Computing shared-nearest-neighbor links") ;
+   NeighborGraph links ;
+   linkStrengths(knn,k,links) ;
+   this->log(1,"  %lu mutual-neighbor links",links.numEdges()) ;
+   // a vector's density is the number of its links with at least the threshold strength; since the
+   //   links are sorted by decreasing strength, those are the first ones in the list
+   float min_strength = (float)std::ceil(this->clusterThreshold() * k) ;
+   size_t minpts = minPointsOrDefault() ;
+   NewPtr<bool> core(num_vectors) ;
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),256,[&](size_t i)
+      {
+      size_t density = 0 ;
+      for (auto lnk = links.begin(i) ; lnk != links.end(i) && lnk->sim >= min_strength ; ++lnk)
+	 ++density ;
+      core[i] = (density >= minpts) ;
+      }) ;
+   // union together all core points with strong links
+   ConcurrentDisjointSets components(num_vectors) ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),64,[&](size_t i)
+      {
+      if (!core[i])
+	 return ;
+      for (auto lnk = links.begin(i) ; lnk != links.end(i) && lnk->sim >= min_strength ; ++lnk)
+	 {
+	 if (lnk->id > i && core[lnk->id])
+	    components.merge(i,lnk->id) ;
+	 }
+      }) ;
+   // assign each non-core point to the component of the core point to which it is most strongly linked
+   NewPtr<uint32_t> root(num_vectors) ;
+   tp->parallel_for(Range<size_t>(0,num_vectors),256,[&](size_t i)
+      {
+      root[i] = FrNOISE_POINT ;
+      if (core[i])
+	 {
+	 root[i] = components.find(i) ;
+	 return ;
+	 }
+      for (auto lnk = links.begin(i) ; lnk != links.end(i) && lnk->sim >= min_strength ; ++lnk)
+	 {
+	 if (core[lnk->id])
+	    {
+	    root[i] = components.find(lnk->id) ;
+	    break ;
+	    }
+	 }
+      }) ;
+   size_t num_clusters = number_density_clusters(root.begin(),num_vectors) ;
+   ClusterInfo* result = make_density_clusters(this,nonempty,root.begin(),num_clusters) ;
+   this->untrapSigInt() ;
+   return result ;
 }
 
 } // end of namespace Fr
 
-// end of file cluster_snn.C //
+// end of file cluster_snn.cc //
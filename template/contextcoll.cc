@@ -19,6 +19,7 @@
 /*									*/
 /************************************************************************/
 
+#include <algorithm>
 #include "framepac/contextcoll.h"
 #include "framepac/basisvector.h"
 
@@ -121,6 +122,25 @@ ContextVectorCollection<KeyT,IdxT,ValT,sparse>::getTermVector(const KeyT term) c
 
 //----------------------------------------------------------------------------
 
+template <typename KeyT, typename IdxT, typename ValT, bool sparse>
+size_t ContextVectorCollection<KeyT,IdxT,ValT,sparse>::getTermVectors(const KeyT* terms, size_t n,
+   context_type** vectors) const
+{
+   const size_t batch = 256 ;
+   Object* values[batch] ;
+   size_t numfound = 0 ;
+   for (size_t base = 0 ; base < n ; base += batch)
+      {
+      size_t count = std::min(n - base,batch) ;
+      numfound += m_term_map->lookupMany(terms+base,count,values) ;
+      for (size_t i = 0 ; i < count ; ++i)
+	 vectors[base+i] = static_cast<context_type*>(values[i]) ;
+      }
+   return numfound ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename KeyT, typename IdxT, typename ValT, bool sparse>
 bool ContextVectorCollection<KeyT,IdxT,ValT,sparse>::addTerm(const KeyT key, const KeyT term, double wt)
 {
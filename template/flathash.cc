@@ -0,0 +1,275 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-10					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#include <algorithm>
+#include "framepac/flathash.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Methods for template class FlatHashTable			*/
+/************************************************************************/
+
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t FlatHashTable<KeyT,ValT,PolicyT>::capacityFor(size_t count)
+{
+   size_t capacity = group_type::WIDTH ;
+   while (maxLoad(capacity) <= count)
+      capacity *= 2 ;
+   return capacity ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+void FlatHashTable<KeyT,ValT,PolicyT>::releaseArrays()
+{
+   delete[] m_ctrl ;
+   delete[] m_slots ;
+   m_ctrl = nullptr ;
+   m_slots = nullptr ;
+   m_capacity = 0 ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+void FlatHashTable<KeyT,ValT,PolicyT>::clear()
+{
+   releaseArrays() ;
+   m_size = 0 ;
+   m_deleted = 0 ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+bool FlatHashTable<KeyT,ValT,PolicyT>::reserve(size_t count)
+{
+   size_t capacity = capacityFor(count) ;
+   return capacity <= m_capacity || resize(capacity) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+bool FlatHashTable<KeyT,ValT,PolicyT>::resize(size_t capacity)
+{
+   std::int8_t* ctrl = new std::int8_t[capacity + group_type::WIDTH] ;
+   Slot* slots = new Slot[capacity] ;
+   if (!ctrl || !slots)
+      {
+      delete[] ctrl ;
+      delete[] slots ;
+      return false ;
+      }
+   std::fill_n(ctrl,capacity + group_type::WIDTH,group_type::EMPTY) ;
+   std::int8_t* old_ctrl = m_ctrl ;
+   Slot* old_slots = m_slots ;
+   size_t old_capacity = m_capacity ;
+   m_ctrl = ctrl ;
+   m_slots = slots ;
+   m_capacity = capacity ;
+   m_size = 0 ;				// insertNew() will recount the keys
+   m_deleted = 0 ;
+   // the keys are already known to be unique, so just drop each one into the first available slot
+   for (size_t i = 0 ; i < old_capacity ; ++i)
+      {
+      if (old_ctrl[i] >= 0)
+	 {
+	 size_t idx = insertNew(old_slots[i].m_key,hashVal(old_slots[i].m_key)) ;
+	 if (!std::is_empty<ValT>::value)
+	    m_slots[idx].m_value[0] = old_slots[i].m_value[0] ;
+	 }
+      }
+   delete[] old_ctrl ;
+   delete[] old_slots ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t FlatHashTable<KeyT,ValT,PolicyT>::findAvailable(size_t hashval) const
+{
+   size_t mask = m_capacity - 1 ;
+   size_t pos = (hashval >> 7) & mask ;
+   for (size_t stride = 0 ; ; )
+      {
+      group_type group(m_ctrl + pos) ;
+      auto avail = group.matchAvailable() ;
+      if (avail)
+	 return (pos + group_type::nextIndex(avail)) & mask ;
+      stride += group_type::WIDTH ;
+      pos = (pos + stride) & mask ;
+      }
+}
+
+//----------------------------------------------------------------------------
+
+// claim a slot for a key which is known not to be in the table yet; the caller fills in the slot
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t FlatHashTable<KeyT,ValT,PolicyT>::insertNew(KeyT key, size_t hashval)
+{
+   size_t idx = findAvailable(hashval) ;
+   if (m_ctrl[idx] == group_type::DELETED)
+      --m_deleted ;
+   setCtrl(idx,(std::int8_t)(hashval & 0x7F)) ;
+   m_slots[idx].m_key = key ;
+   ++m_size ;
+   return idx ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+bool FlatHashTable<KeyT,ValT,PolicyT>::add(KeyT key, ValT value)
+{
+   size_t hashval = hashVal(key) ;
+   if (find(key,hashval) != NOT_FOUND)
+      return true ;			// as with HashTable::add(), keep the existing value
+   // we always keep at least one EMPTY slot per group's worth of table, so that unsuccessful
+   //   probes terminate quickly; deleted slots count against the load until the next resize
+   if (m_size + m_deleted + 1 > maxLoad(m_capacity) && !resize(capacityFor(m_size + 1)))
+      return false ;
+   size_t idx = insertNew(key,hashval) ;
+   setValue(idx,value) ;
+   return false ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+bool FlatHashTable<KeyT,ValT,PolicyT>::add(KeyT key)
+{
+   return add(key,nullVal()) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+bool FlatHashTable<KeyT,ValT,PolicyT>::remove(KeyT key)
+{
+   size_t idx = find(key,hashVal(key)) ;
+   if (idx == NOT_FOUND)
+      return false ;
+   setCtrl(idx,group_type::DELETED) ;
+   m_slots[idx].m_key = KeyT() ;
+   --m_size ;
+   ++m_deleted ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+bool FlatHashTable<KeyT,ValT,PolicyT>::freeze(const HashTable<KeyT,ValT,PolicyT>& table)
+{
+   clear() ;
+   if (!reserve(table.currentSize()))
+      return false ;
+   // the source table can't hold duplicates, so we can skip the search for an existing entry
+   for (auto entry : table)
+      {
+      KeyT key = entry.first ;
+      if (m_size + 1 > maxLoad(m_capacity) && !resize(capacityFor(m_size + 1)))
+	 return false ;
+      size_t idx = insertNew(key,hashVal(key)) ;
+      setValue(idx,entry.second) ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t FlatHashTable<KeyT,ValT,PolicyT>::lookupMany(const KeyT* keys, size_t n, ValT* values, bool* found) const
+{
+   size_t hashvals[FrHASHTABLE_PREFETCH_GROUP] ;
+   size_t count = 0 ;
+   size_t mask = m_capacity - 1 ;
+   for (size_t base = 0 ; base < n ; base += FrHASHTABLE_PREFETCH_GROUP)
+      {
+      size_t group = std::min(n - base,(size_t)FrHASHTABLE_PREFETCH_GROUP) ;
+      for (size_t i = 0 ; i < group ; ++i)
+	 {
+	 hashvals[i] = hashVal(keys[base+i]) ;
+	 if (m_ctrl)
+	    {
+	    size_t pos = (hashvals[i] >> 7) & mask ;
+	    __builtin_prefetch(m_ctrl + pos,0,3) ;
+	    __builtin_prefetch(m_slots + pos,0,3) ;
+	    }
+	 }
+      for (size_t i = 0 ; i < group ; ++i)
+	 {
+	 size_t idx = find(keys[base+i],hashvals[i]) ;
+	 bool present = idx != NOT_FOUND ;
+	 if (present)
+	    ++count ;
+	 if (values)
+	    values[base+i] = present ? getValue(idx) : nullVal() ;
+	 if (found)
+	    found[base+i] = present ;
+	 }
+      }
+   return count ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t* FlatHashTable<KeyT,ValT,PolicyT>::probeLengths(size_t& max_length) const
+{
+   max_length = 0 ;
+   if (!m_ctrl)
+      return nullptr ;
+   size_t mask = m_capacity - 1 ;
+   size_t limit = m_capacity / group_type::WIDTH + 2 ;
+   size_t* lengths = new size_t[limit+1] ;
+   std::fill_n(lengths,limit+1,0) ;
+   for (size_t i = 0 ; i < m_capacity ; ++i)
+      {
+      if (m_ctrl[i] < 0)
+	 continue ;
+      // retrace the key's probe sequence until we reach the group containing its slot
+      size_t pos = (hashVal(m_slots[i].m_key) >> 7) & mask ;
+      size_t probes = 1 ;
+      for (size_t stride = 0 ; ((i - pos) & mask) >= group_type::WIDTH && probes < limit ; ++probes)
+	 {
+	 stride += group_type::WIDTH ;
+	 pos = (pos + stride) & mask ;
+	 }
+      ++lengths[probes] ;
+      if (probes > max_length)
+	 max_length = probes ;
+      }
+   return lengths ;
+}
+
+//----------------------------------------------------------------------------
+
+} // end namespace Fr
+
+// end of file flathash.cc //
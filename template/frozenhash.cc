@@ -0,0 +1,325 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-10					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+#include "framepac/frozenhash.h"
+#include "framepac/message.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Types for this module						*/
+/************************************************************************/
+
+class FrozenHashTableHeader
+   {
+   public:
+      uint64_t m_size ;			// number of keys in the table
+      uint64_t m_capacity ;		// number of buckets (a power of two)
+      uint64_t m_bucket_offset ;	// offset of the bucket array
+      uint64_t m_strings_offset ;	// offset of the string pool (if string keys)
+      uint64_t m_strings_size ;		// number of bytes in the string pool
+      uint64_t m_reverse_offset ;	// offset of the value->key map (if any)
+      uint64_t m_reverse_size ;		// number of entries in the value->key map
+      uint64_t m_end ;			// offset of the end of the table's data
+      uint64_t m_pad[8] { 0 } ;		// padding for future extensions
+   } ;
+
+/************************************************************************/
+/*	Helper functions						*/
+/************************************************************************/
+
+// pad the file to a multiple of eight bytes, so that memory-mapped arrays are aligned
+static inline bool align_frozen_file(CFile& fp, off_t base_offset)
+{
+   size_t pad = (8 - ((fp.tell() - base_offset) % 8)) % 8 ;
+   return pad == 0 || fp.putNulls(pad) ;
+}
+
+/************************************************************************/
+/*	Methods for template class FrozenHashTable			*/
+/************************************************************************/
+
+template <typename KeyT, typename ValT>
+bool FrozenHashTable<KeyT,ValT>::freeze(const HashTable<KeyT,ValT>& table, const char* filename, bool reverse_index)
+{
+   COutputFile file(filename,CFile::binary) ;
+   return file ? freeze(table,file,reverse_index) : false ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename KeyT, typename ValT>
+bool FrozenHashTable<KeyT,ValT>::freeze(const HashTable<KeyT,ValT>& table, CFile& fp, bool reverse_index)
+{
+   if (!fp)
+      return false ;
+   if (reverse_index && !std::is_integral<ValT>::value)
+      {
+      SystemMessage::error("FrozenHashTable: a reverse index requires integer values") ;
+      return false ;
+      }
+   // keep the load factor between 3/8 and 3/4 to keep linear-probing sequences short
+   size_t count = table.currentSize() ;
+   size_t capacity = 16 ;
+   while (capacity < count + count / 2)
+      capacity *= 2 ;
+   Bucket empty ;
+   memset(&empty,'\0',sizeof(empty)) ;
+   empty.m_key = key_type::EMPTY ;
+   std::vector<Bucket> buckets(capacity,empty) ;
+   std::vector<char> strings ;
+   std::vector<stored_type> reverse ;
+   size_t mask = capacity - 1 ;
+   size_t numkeys = 0 ;
+   for (auto entry : table)
+      {
+      key_type key(key_type::lookupKey(entry.first)) ;
+      if (!key.valid())
+	 continue ;
+      stored_type stored = key.store(strings) ;
+      if (stored == key_type::EMPTY)
+	 {
+	 SystemMessage::error("FrozenHashTable: string pool too large") ;
+	 return false ;
+	 }
+      size_t pos = key.hashValue() & mask ;
+      while (buckets[pos].m_key != key_type::EMPTY)
+	 pos = (pos + 1) & mask ;
+      buckets[pos].m_key = stored ;
+      buckets[pos].m_value = entry.second ;
+      ++numkeys ;
+      if (reverse_index)
+	 {
+	 // the values must be IDs numbered from zero (allowing for a few gaps), or the reverse index
+	 //   could grow without bound
+	 size_t index = (size_t)entry.second ;
+	 if (index >= capacity)
+	    {
+	    SystemMessage::error("FrozenHashTable: value %lu is too large for a reverse index",(unsigned long)index) ;
+	    return false ;
+	    }
+	 if (index >= reverse.size())
+	    reverse.resize(index+1,key_type::EMPTY) ;
+	 reverse[index] = stored ;
+	 }
+      }
+   off_t base_offset = fp.tell() ;
+   if (!fp.writeSignature(signature,file_format))
+      return false ;
+   uint8_t keysize = sizeof(stored_type) ;
+   uint8_t valsize = sizeof(ValT) ;
+   uint8_t string_keys = !std::is_integral<KeyT>::value ;
+   if (!fp.writeValue(keysize) || !fp.writeValue(valsize) || !fp.writeValue(string_keys))
+      return false ;
+   off_t header_offset = fp.tell() ;
+   FrozenHashTableHeader header ;
+   header.m_size = numkeys ;
+   header.m_capacity = capacity ;
+   header.m_strings_size = strings.size() ;
+   header.m_reverse_size = reverse.size() ;
+   if (!fp.writeValue(header) || !align_frozen_file(fp,base_offset))
+      return false ;
+   header.m_bucket_offset = fp.tell() - base_offset ;
+   if (fp.write(buckets.data(),capacity,sizeof(Bucket)) != capacity || !align_frozen_file(fp,base_offset))
+      return false ;
+   header.m_strings_offset = fp.tell() - base_offset ;
+   if (fp.write(strings.data(),strings.size()) != strings.size() || !align_frozen_file(fp,base_offset))
+      return false ;
+   header.m_reverse_offset = fp.tell() - base_offset ;
+   if (fp.write(reverse.data(),reverse.size(),sizeof(stored_type)) != reverse.size()
+      || !align_frozen_file(fp,base_offset))
+      return false ;
+   header.m_end = fp.tell() - base_offset ;
+   // now that we've written all the other data, we have a complete header, so return to the start of the file
+   //   and update the header
+   off_t lastpos = fp.tell() ;
+   fp.seek(header_offset) ;
+   bool success = true ;
+   if (!fp.writeValue(header))
+      success = false ;
+   fp.flush() ;
+   fp.seek(lastpos) ;
+   return success ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename KeyT, typename ValT>
+void FrozenHashTable<KeyT,ValT>::releaseArrays()
+{
+   if (!m_readonly)
+      {
+      delete[] m_buckets ;
+      delete[] m_strings ;
+      delete[] m_reverse ;
+      }
+   m_buckets = nullptr ;
+   m_strings = nullptr ;
+   m_reverse = nullptr ;
+   return ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename KeyT, typename ValT>
+void FrozenHashTable<KeyT,ValT>::clear()
+{
+   releaseArrays() ;
+   m_mmap.close() ;
+   m_readonly = false ;
+   m_size = 0 ;
+   m_capacity = 0 ;
+   m_stringsize = 0 ;
+   m_reversesize = 0 ;
+   return ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename KeyT, typename ValT>
+bool FrozenHashTable<KeyT,ValT>::load(const char* filename, bool allow_mmap)
+{
+   CInputFile file(filename,CFile::binary) ;
+   return file ? load(file,filename,allow_mmap) : false ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename KeyT, typename ValT>
+bool FrozenHashTable<KeyT,ValT>::load(CFile& fp, const char* filename, bool allow_mmap)
+{
+   if (!fp)
+      return false ;
+   clear() ;
+   off_t base_offset = fp.tell() ;
+   int version = file_format ;
+   if (!fp.verifySignature(signature,filename,version,min_file_format))
+      return false ;
+   uint8_t keysize, valsize, string_keys ;
+   if (!fp.readValue(&keysize) || !fp.readValue(&valsize) || !fp.readValue(&string_keys))
+      return false ;
+   if (keysize != sizeof(stored_type) || valsize != sizeof(ValT)
+      || string_keys != !std::is_integral<KeyT>::value)
+      {
+      SystemMessage::error("wrong data type - sizeof() does not match") ;
+      return false ;
+      }
+   if (allow_mmap && loadMapped(filename,base_offset))
+      return true ;
+   FrozenHashTableHeader header ;
+   if (!fp.readValue(&header))
+      return false ;
+   if (header.m_capacity == 0 || (header.m_capacity & (header.m_capacity - 1)) != 0
+      || header.m_size >= header.m_capacity || header.m_reverse_size > header.m_capacity)
+      return false ;
+   bool success = fp.readVarsAt(header.m_bucket_offset + base_offset,&m_buckets,header.m_capacity) ;
+   if (success && header.m_strings_size)
+      success = fp.readVarsAt(header.m_strings_offset + base_offset,&m_strings,header.m_strings_size) ;
+   if (success && header.m_reverse_size)
+      success = fp.readVarsAt(header.m_reverse_offset + base_offset,&m_reverse,header.m_reverse_size) ;
+   if (!success || (m_strings && m_strings[header.m_strings_size-1] != '\0'))
+      {
+      clear() ;
+      return false ;
+      }
+   m_size = header.m_size ;
+   m_capacity = header.m_capacity ;
+   m_stringsize = header.m_strings_size ;
+   m_reversesize = header.m_reverse_size ;
+   return true ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename KeyT, typename ValT>
+bool FrozenHashTable<KeyT,ValT>::loadMapped(const char* filename, off_t base_offset)
+{
+   if (!filename || !*filename)
+      return false;
+   MemMappedROFile mm(filename,base_offset) ;
+   if (!mm)
+      return false ;
+   m_mmap = std::move(mm) ;
+   if (loadFromMmap(*m_mmap,m_mmap.size()))
+      return true ;
+   m_mmap.close() ;
+   return false ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename KeyT, typename ValT>
+bool FrozenHashTable<KeyT,ValT>::loadFromMmap(const char* mmap_base, size_t mmap_len)
+{
+   size_t sig_size = CFile::signatureSize(signature) ;
+   size_t header_size = sig_size + 3*sizeof(uint8_t) ;
+   if (!mmap_base || mmap_len < header_size + sizeof(FrozenHashTableHeader))
+      return false;
+   // the signature string is followed by the file-format version and a byte-order marker
+   size_t sig_len = strlen(signature) + 1 ;
+   uint16_t version ;
+   uint32_t byteorder ;
+   memcpy(&version,mmap_base + sig_len,sizeof(version)) ;
+   memcpy(&byteorder,mmap_base + sig_len + sizeof(version),sizeof(byteorder)) ;
+   if (memcmp(mmap_base,signature,sig_len) != 0 || version < min_file_format || version > file_format
+      || byteorder != 0x12345678 || (uint8_t)mmap_base[sig_size] != sizeof(stored_type)
+      || (uint8_t)mmap_base[sig_size+1] != sizeof(ValT)
+      || (uint8_t)mmap_base[sig_size+2] != !std::is_integral<KeyT>::value)
+      return false ;
+   releaseArrays() ;
+   m_readonly = true ;
+   const FrozenHashTableHeader* header = reinterpret_cast<const FrozenHashTableHeader*>(mmap_base + header_size) ;
+   // make sure that every array lies within the mapped region before pointing at it; string offsets
+   //   are checked on each comparison, so a terminating NUL is all we need from the string pool
+   bool valid = header->m_capacity > 0 && (header->m_capacity & (header->m_capacity - 1)) == 0
+      && header->m_size < header->m_capacity && header->m_reverse_size <= header->m_capacity
+      && header->m_end <= mmap_len ;
+   auto check = [&](uint64_t offset, size_t count, size_t elt_size)
+      {
+      if (offset < header_size || offset > mmap_len || count > (mmap_len - offset) / elt_size)
+	 valid = false ;
+      return mmap_base + offset ;
+      } ;
+   m_buckets = (Bucket*)check(header->m_bucket_offset,header->m_capacity,sizeof(Bucket)) ;
+   m_strings = (char*)check(header->m_strings_offset,header->m_strings_size,1) ;
+   m_reverse = (stored_type*)check(header->m_reverse_offset,header->m_reverse_size,sizeof(stored_type)) ;
+   if (valid && header->m_strings_size > 0 && m_strings[header->m_strings_size-1] != '\0')
+      valid = false ;
+   if (!valid)
+      {
+      SystemMessage::error("FrozenHashTable: corrupted hash table file") ;
+      releaseArrays() ;
+      m_readonly = false ;
+      return false ;
+      }
+   m_size = header->m_size ;
+   m_capacity = header->m_capacity ;
+   m_stringsize = header->m_strings_size ;
+   m_reversesize = header->m_reverse_size ;
+   return true ;
+}
+
+//----------------------------------------------------------------------
+
+} // end namespace Fr
+
+// end of file frozenhash.cc //
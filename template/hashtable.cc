@@ -19,6 +19,7 @@
 /*									*/
 /************************************************************************/
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <cstdlib>
@@ -83,7 +84,6 @@ namespace Fr {
 	 /* help out with the copying in general */			\
 	 resizeCopySegments(1) ;					\
 	 INCR_COUNT(counter) ;						\
-	 tab->announceTable() ;						\
 	 return tab->delegate ;						\
 	 }							
 #define FORWARD_IF_COPIED(delegate,counter)				\
@@ -96,7 +96,6 @@ namespace Fr {
 	 /*   of the current one				*/	\
          Table* nexttab = next() ;					\
 	 INCR_COUNT(counter) ;						\
-	 nexttab->announceTable() ;					\
 	 return nexttab->delegate ;					\
 	 }
 #define FORWARD_IF_STALE(delegate,counter)				\
@@ -110,7 +109,6 @@ namespace Fr {
 	 INCR_COUNT(counter) ;						\
 	 waitUntilCopied(bucketnum) ;					\
 	 Table* nexttab = next() ;					\
-	 nexttab->announceTable() ;					\
 	 return nexttab->delegate ;					\
 	 }
 #endif /* FrSINGLE_THREADED */
@@ -123,8 +121,8 @@ namespace Fr
 {
 
 
-template <typename KeyT, typename ValT>
-inline void HashTable<KeyT,ValT>::Table::init()
+template <typename KeyT, typename ValT, typename PolicyT>
+inline void HashTable<KeyT,ValT,PolicyT>::Table::init()
 {
    m_entries = nullptr ;
    remove_fn = nullptr ;
@@ -149,8 +147,8 @@ inline void HashTable<KeyT,ValT>::Table::init()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::Table::cleanup()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::Table::cleanup()
 {
    // we have a potential race here in cleaning up old Tables, so atomically swap the pointer with NULL
    auto entries = Atomic<Entry*>::ref(m_entries).exchange(nullptr) ;
@@ -163,8 +161,8 @@ void HashTable<KeyT,ValT>::Table::cleanup()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::Table::clear()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::Table::clear()
 {
    for (size_t pos = 0 ; pos < m_fullsize ; ++pos)
       {
@@ -181,8 +179,8 @@ void HashTable<KeyT,ValT>::Table::clear()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-size_t HashTable<KeyT,ValT>::Table::normalizeSize(size_t sz)
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t HashTable<KeyT,ValT,PolicyT>::Table::normalizeSize(size_t sz)
 {
    if (sz < FrHASHTABLE_MIN_SIZE)
       sz = FrHASHTABLE_MIN_SIZE ;
@@ -204,8 +202,8 @@ size_t HashTable<KeyT,ValT>::Table::normalizeSize(size_t sz)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::Table::autoResize()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::Table::autoResize()
 {
    size_t newsize ;
    size_t sz = capacity() ;
@@ -236,8 +234,8 @@ void HashTable<KeyT,ValT>::Table::autoResize()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::copyChain(size_t bucketnum)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::copyChain(size_t bucketnum)
 {
    Link offset ;
    HashPtr* bcket = bucketPtr(bucketnum) ;
@@ -293,8 +291,8 @@ bool HashTable<KeyT,ValT>::Table::copyChain(size_t bucketnum)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::Table::waitUntilCopied(size_t bucketnum)
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::Table::waitUntilCopied(size_t bucketnum)
 {
    size_t loops = 0 ;
    while (!chainCopied(bucketnum))
@@ -309,8 +307,8 @@ void HashTable<KeyT,ValT>::Table::waitUntilCopied(size_t bucketnum)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::Table::copyChains(size_t bucketnum, size_t endpos)
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::Table::copyChains(size_t bucketnum, size_t endpos)
 {
    bool complete = true ;
    size_t first_incomplete = endpos ;
@@ -345,8 +343,8 @@ void HashTable<KeyT,ValT>::Table::copyChains(size_t bucketnum, size_t endpos)
 //----------------------------------------------------------------------------
 // add a key which is known not to be in the table (yet)
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::reAdd(size_t hashval, KeyT key, ValT value)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::reAdd(size_t hashval, KeyT key, ValT value)
 {
    INCR_COUNT(insert_resize) ;
    DECR_COUNT(insert_attempt) ; // don't count as a retry unless we need more than one attempt
@@ -376,8 +374,8 @@ bool HashTable<KeyT,ValT>::Table::reAdd(size_t hashval, KeyT key, ValT value)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-FramepaC::Link HashTable<KeyT,ValT>::Table::locateEmptySlot(size_t bucketnum, Link hint)
+template <typename KeyT, typename ValT, typename PolicyT>
+FramepaC::Link HashTable<KeyT,ValT,PolicyT>::Table::locateEmptySlot(size_t bucketnum, Link hint)
 {
    if (hint == FramepaC::NULLPTR) hint = 0 ;
    size_t max = searchrange ;
@@ -404,8 +402,8 @@ FramepaC::Link HashTable<KeyT,ValT>::Table::locateEmptySlot(size_t bucketnum, Li
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::insertKey(size_t bucketnum, Link firstptr, KeyT key, ValT value)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::insertKey(size_t bucketnum, Link firstptr, KeyT key, ValT value)
 {
    INCR_COUNT(insert_attempt) ;
    Link offset = locateEmptySlot(bucketnum,firstptr) ;
@@ -465,8 +463,8 @@ bool HashTable<KeyT,ValT>::Table::insertKey(size_t bucketnum, Link firstptr, Key
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::Table::resizeCopySegment(size_t segnum)
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::Table::resizeCopySegment(size_t segnum)
 {
    size_t bucketnum = segnum * FrHASHTABLE_SEGMENT_SIZE ;
    size_t endpos = (segnum + 1) * FrHASHTABLE_SEGMENT_SIZE ;
@@ -480,8 +478,8 @@ void HashTable<KeyT,ValT>::Table::resizeCopySegment(size_t segnum)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::resizeCopySegments(size_t max_segs)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::resizeCopySegments(size_t max_segs)
 {
    // is there any work available to be stolen?
    if (!m_resizelock.load() || m_resizedone.load())
@@ -515,8 +513,8 @@ bool HashTable<KeyT,ValT>::Table::resizeCopySegments(size_t max_segs)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::Table::clearDuplicates(size_t bucketnum)
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::Table::clearDuplicates(size_t bucketnum)
 {
    // scan down the chain for the given hash bucket, marking
    //   any duplicate entries for a key as deleted
@@ -548,8 +546,8 @@ void HashTable<KeyT,ValT>::Table::clearDuplicates(size_t bucketnum)
 //----------------------------------------------------------------------------
 //   must ONLY be called while the hash table is otherwise quiescent
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::reclaimChain(size_t bucketnum)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::reclaimChain(size_t bucketnum)
 {
 #ifdef FrSINGLE_THREADED
    (void)bucketnum ;
@@ -600,8 +598,8 @@ bool HashTable<KeyT,ValT>::Table::reclaimChain(size_t bucketnum)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::Table::resizeCleanup()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::Table::resizeCleanup()
 {
    size_t first_incomplete = m_first_incomplete.load() ;
    size_t last_incomplete = m_last_incomplete.load() ;
@@ -640,8 +638,8 @@ void HashTable<KeyT,ValT>::Table::resizeCleanup()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::resize(size_t newsize)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::resize(size_t newsize)
 {
    if (superseded())
       {
@@ -685,8 +683,8 @@ bool HashTable<KeyT,ValT>::Table::resize(size_t newsize)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::add(size_t hashval, KeyT key, ValT value)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::add(size_t hashval, KeyT key, ValT value)
 {
    size_t bucketnum = hashval % m_size ;
    while (true)
@@ -744,8 +742,8 @@ bool HashTable<KeyT,ValT>::Table::add(size_t hashval, KeyT key, ValT value)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-ValT HashTable<KeyT,ValT>::Table::addCount(size_t hashval, KeyT key, size_t incr)
+template <typename KeyT, typename ValT, typename PolicyT>
+ValT HashTable<KeyT,ValT,PolicyT>::Table::addCount(size_t hashval, KeyT key, size_t incr)
 {
    size_t bucketnum = hashval % m_size ;
    while (true)
@@ -810,8 +808,8 @@ ValT HashTable<KeyT,ValT>::Table::addCount(size_t hashval, KeyT key, size_t incr
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::contains(size_t hashval, const KeyT key) const
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::contains(size_t hashval, const KeyT key) const
 {
    size_t bucketnum = hashval % m_size ;
    FORWARD_IF_COPIED(contains(hashval,key),contains_forwarded) ;
@@ -834,8 +832,8 @@ bool HashTable<KeyT,ValT>::Table::contains(size_t hashval, const KeyT key) const
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-ValT HashTable<KeyT,ValT>::Table::lookup(size_t hashval, KeyT key) const
+template <typename KeyT, typename ValT, typename PolicyT>
+ValT HashTable<KeyT,ValT,PolicyT>::Table::lookup(size_t hashval, KeyT key) const
 {
    size_t bucketnum = hashval % m_size ;
    FORWARD_IF_COPIED(lookup(hashval,key),lookup_forwarded) ;
@@ -864,8 +862,8 @@ ValT HashTable<KeyT,ValT>::Table::lookup(size_t hashval, KeyT key) const
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::lookup(size_t hashval, KeyT key, ValT* value) const
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::lookup(size_t hashval, KeyT key, ValT* value) const
 {
    if (!value)
       return false ;
@@ -895,8 +893,8 @@ bool HashTable<KeyT,ValT>::Table::lookup(size_t hashval, KeyT key, ValT* value)
 //----------------------------------------------------------------------------
 
 // NOTE: this lookup() is not entirely thread-safe if clear==true
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::lookup(size_t hashval, KeyT key, ValT* value, bool clear_entry)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::lookup(size_t hashval, KeyT key, ValT* value, bool clear_entry)
 {
    if (!value)
       return false ;
@@ -929,8 +927,8 @@ bool HashTable<KeyT,ValT>::Table::lookup(size_t hashval, KeyT key, ValT* value,
 //   add() and remove() calls!  Use global synchronization if
 //   you will be using both this function and add()/remove()
 //   concurrently on the same hash table.
-template <typename KeyT, typename ValT>
-ValT* HashTable<KeyT,ValT>::Table::lookupValuePtr(size_t hashval, KeyT key) const
+template <typename KeyT, typename ValT, typename PolicyT>
+ValT* HashTable<KeyT,ValT,PolicyT>::Table::lookupValuePtr(size_t hashval, KeyT key) const
 {
    size_t bucketnum = hashval % m_size ;
    FORWARD_IF_COPIED(lookupValuePtr(hashval,key),lookup_forwarded) ;
@@ -955,8 +953,8 @@ ValT* HashTable<KeyT,ValT>::Table::lookupValuePtr(size_t hashval, KeyT key) cons
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::remove(size_t hashval, KeyT key)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::remove(size_t hashval, KeyT key)
 {
    size_t bucketnum = hashval % m_size ;
 #ifdef FrSINGLE_THREADED
@@ -1065,8 +1063,8 @@ bool HashTable<KeyT,ValT>::Table::remove(size_t hashval, KeyT key)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::reclaimDeletions(size_t totalfrags, size_t fragnum)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::reclaimDeletions(size_t totalfrags, size_t fragnum)
 {
    if (superseded())
       return true ;
@@ -1099,8 +1097,8 @@ bool HashTable<KeyT,ValT>::Table::reclaimDeletions(size_t totalfrags, size_t fra
 //----------------------------------------------------------------------------
 
 // special support for Fr::SymHashSet
-template <typename KeyT, typename ValT>
-KeyT HashTable<KeyT,ValT>::Table::addKey(size_t hashval, const char* name, size_t namelen,
+template <typename KeyT, typename ValT, typename PolicyT>
+KeyT HashTable<KeyT,ValT,PolicyT>::Table::addKey(size_t hashval, const char* name, size_t namelen,
 				    bool* already_existed)
 {
    if (!already_existed)
@@ -1152,8 +1150,8 @@ KeyT HashTable<KeyT,ValT>::Table::addKey(size_t hashval, const char* name, size_
 //----------------------------------------------------------------------------
 
 // special support for Fr::SymHashSet
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::contains(size_t hashval, const char* name, size_t namelen) const
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::contains(size_t hashval, const char* name, size_t namelen) const
 {
    size_t bucketnum = hashval % m_size ;
    FORWARD_IF_COPIED(contains(hashval,name,namelen),contains_forwarded) ;
@@ -1179,8 +1177,8 @@ bool HashTable<KeyT,ValT>::Table::contains(size_t hashval, const char* name, siz
 //----------------------------------------------------------------------------
 
 // special support for Fr::SymHashSet
-template <typename KeyT, typename ValT>
-KeyT HashTable<KeyT,ValT>::Table::lookupKey(size_t hashval, const char* name, size_t namelen) const
+template <typename KeyT, typename ValT, typename PolicyT>
+KeyT HashTable<KeyT,ValT,PolicyT>::Table::lookupKey(size_t hashval, const char* name, size_t namelen) const
 {
    size_t bucketnum = hashval % m_size ;
    FORWARD_IF_COPIED(lookupKey(hashval,name,namelen),contains_forwarded) ;
@@ -1203,8 +1201,8 @@ KeyT HashTable<KeyT,ValT>::Table::lookupKey(size_t hashval, const char* name, si
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::Table::replaceValue(size_t pos, ValT new_value)
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::Table::replaceValue(size_t pos, ValT new_value)
 {
    ValT value = m_entries[pos].swapValue(new_value) ;
    if (remove_fn && value)
@@ -1216,8 +1214,8 @@ void HashTable<KeyT,ValT>::Table::replaceValue(size_t pos, ValT new_value)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-size_t HashTable<KeyT,ValT>::Table::countItems() const
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t HashTable<KeyT,ValT,PolicyT>::Table::countItems() const
 {
    debug_msg("countItems\n") ;
    if (next())
@@ -1234,8 +1232,8 @@ size_t HashTable<KeyT,ValT>::Table::countItems() const
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-size_t HashTable<KeyT,ValT>::Table::countItems(bool remove_dups)
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t HashTable<KeyT,ValT,PolicyT>::Table::countItems(bool remove_dups)
 {
    if (next())
       return next()->countItems(remove_dups) ;
@@ -1251,8 +1249,8 @@ size_t HashTable<KeyT,ValT>::Table::countItems(bool remove_dups)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-size_t HashTable<KeyT,ValT>::Table::countDeletedItems() const
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t HashTable<KeyT,ValT,PolicyT>::Table::countDeletedItems() const
 {
    debug_msg("countDeletedItems\n") ;
    if (next())
@@ -1269,8 +1267,8 @@ size_t HashTable<KeyT,ValT>::Table::countDeletedItems() const
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-size_t HashTable<KeyT,ValT>::Table::bucket_size(size_t bucketnum) const
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t HashTable<KeyT,ValT,PolicyT>::Table::bucket_size(size_t bucketnum) const
 {
    FORWARD_IF_COPIED(bucket_size(bucketnum),none) ;
    size_t len = 0 ;
@@ -1285,8 +1283,8 @@ size_t HashTable<KeyT,ValT>::Table::bucket_size(size_t bucketnum) const
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-size_t* HashTable<KeyT,ValT>::Table::chainLengths(size_t &max_length) const
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t* HashTable<KeyT,ValT,PolicyT>::Table::chainLengths(size_t &max_length) const
 {
    if (next())
       return next()->chainLengths(max_length) ;
@@ -1305,8 +1303,8 @@ size_t* HashTable<KeyT,ValT>::Table::chainLengths(size_t &max_length) const
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-size_t* HashTable<KeyT,ValT>::Table::neighborhoodDensities(size_t &num_densities) const
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t* HashTable<KeyT,ValT,PolicyT>::Table::neighborhoodDensities(size_t &num_densities) const
 {
    if (next())
       return next()->neighborhoodDensities(num_densities) ;
@@ -1337,8 +1335,8 @@ size_t* HashTable<KeyT,ValT>::Table::neighborhoodDensities(size_t &num_densities
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::iterateVA(HashKeyValueFunc* func, std::va_list args) const
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::iterateVA(HashKeyValueFunc* func, std::va_list args) const
 {
    bool success = true ;
    for (size_t i = 0 ; i < capacity() && success ; ++i)
@@ -1361,8 +1359,8 @@ bool HashTable<KeyT,ValT>::Table::iterateVA(HashKeyValueFunc* func, std::va_list
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-List* HashTable<KeyT,ValT>::Table::allKeys() const
+template <typename KeyT, typename ValT, typename PolicyT>
+List* HashTable<KeyT,ValT,PolicyT>::Table::allKeys() const
 {
    List* keys = List::emptyList() ;
    for (size_t i = 0 ; i < capacity() ; ++i)
@@ -1378,8 +1376,8 @@ List* HashTable<KeyT,ValT>::Table::allKeys() const
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::Table::verify() const
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::Table::verify() const
 {
    bool success = true ;
    for (size_t i = 0 ; i < capacity() ; ++i)
@@ -1398,8 +1396,8 @@ bool HashTable<KeyT,ValT>::Table::verify() const
 //----------------------------------------------------------------------------
 
 //TODO: convert to toCString_()
-template <typename KeyT, typename ValT>
-char* HashTable<KeyT,ValT>::Table::displayValue(char* buffer) const
+template <typename KeyT, typename ValT, typename PolicyT>
+char* HashTable<KeyT,ValT,PolicyT>::Table::displayValue(char* buffer) const
 {
    strcpy(buffer,"#H(") ;
    buffer += 3 ;
@@ -1421,8 +1419,8 @@ char* HashTable<KeyT,ValT>::Table::displayValue(char* buffer) const
 // get size of buffer needed to display the string representation of the hash table
 // NOTE: will not be valid if there are any add/remove/resize calls between calling
 //   this function and using displayValue(); user must ensure locking if multithreaded
-template <typename KeyT, typename ValT>
-size_t HashTable<KeyT,ValT>::Table::cStringLength(size_t wrap_at, size_t indent) const
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t HashTable<KeyT,ValT,PolicyT>::Table::cStringLength(size_t wrap_at, size_t indent) const
 {
    if (wrap_at == 0) wrap_at = (size_t)~0 ;
    size_t dlength = indent + 4 ; // "#H(" prefix plus ")" trailer
@@ -1450,8 +1448,8 @@ size_t HashTable<KeyT,ValT>::Table::cStringLength(size_t wrap_at, size_t indent)
 /*	Methods for class HashTable					*/
 /************************************************************************/
 
-template <typename KeyT, typename ValT>
-HashTable<KeyT,ValT>::HashTable(const HashTable &ht)
+template <typename KeyT, typename ValT, typename PolicyT>
+HashTable<KeyT,ValT,PolicyT>::HashTable(const HashTable &ht)
    : HashTableBase(), m_table(nullptr)
 {
 #if __GNUC__ < 6
@@ -1470,8 +1468,8 @@ HashTable<KeyT,ValT>::HashTable(const HashTable &ht)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::init(size_t initial_size)
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::init(size_t initial_size)
 {
    onRemove(nullptr) ;
    onDelete(nullptr) ;
@@ -1496,8 +1494,8 @@ void HashTable<KeyT,ValT>::init(size_t initial_size)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-HashTable<KeyT,ValT>::~HashTable()
+template <typename KeyT, typename ValT, typename PolicyT>
+HashTable<KeyT,ValT,PolicyT>::~HashTable()
 {
    this->waitForResizes() ;		// don't delete while any resizing is still in progress
    Table *table = m_table.load() ;	// get the current active table
@@ -1540,33 +1538,88 @@ HashTable<KeyT,ValT>::~HashTable()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::stillLive(const Table* version)
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t HashTable<KeyT,ValT,PolicyT>::lookupMany(const KeyT* keys, size_t n, ValT* values, bool* found) const
 {
-#ifndef FrSINGLE_THREADED
-   ScopedGlobalThreadLock guard ;
-   // scan the list of per-thread s_table variables
-   for (const TablePtr *tables = s_thread_entries.load() ;
-	tables ;
-	tables = ANNOTATE_UNPROTECTED_READ(tables->m_next))
-      {
-      // check whether the hazard pointer is for the requested version
-      if (tables->table() == version)
+   size_t hashvals[FrHASHTABLE_PREFETCH_GROUP] ;
+   size_t numfound = 0 ;
+   for (size_t base = 0 ; base < n ; base += FrHASHTABLE_PREFETCH_GROUP)
+      {
+      size_t count = std::min(n - base,(size_t)FrHASHTABLE_PREFETCH_GROUP) ;
+      HazardLock hl(m_table) ;
+      const Table* tab = hl.table() ;
+      // hash every key in the group and start fetching its bucket, then probe the buckets, which
+      //   by now should be on their way into the cache
+      for (size_t i = 0 ; i < count ; ++i)
 	 {
-	 // yep, the requested version is still live
-	 return true ;
+	 hashvals[i] = hashVal(keys[base+i]) ;
+	 tab->prefetchBucket(hashvals[i]) ;
+	 }
+      for (size_t i = 0 ; i < count ; ++i)
+	 {
+	 bool success = (values
+	    ? tab->lookup(hashvals[i],keys[base+i],&values[base+i])
+	    : tab->contains(hashvals[i],keys[base+i])) ;
+	 if (found)
+	    found[base+i] = success ;
+	 if (success)
+	    ++numfound ;
 	 }
       }
-#endif /* !FrSINGLE_THREADED */
+   return numfound ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+size_t HashTable<KeyT,ValT,PolicyT>::addMany(const KeyT* keys, size_t n, const ValT* values, bool* existed)
+{
+   size_t hashvals[FrHASHTABLE_PREFETCH_GROUP] ;
+   size_t numexisting = 0 ;
+   for (size_t base = 0 ; base < n ; base += FrHASHTABLE_PREFETCH_GROUP)
+      {
+      size_t count = std::min(n - base,(size_t)FrHASHTABLE_PREFETCH_GROUP) ;
+      // re-fetch the table for each group, since adding keys may trigger a resize; a table which
+      //   gets superseded partway through the group forwards the additions to its successor
+      HazardLock hl(m_table) ;
+      Table* tab = hl.table() ;
+      for (size_t i = 0 ; i < count ; ++i)
+	 {
+	 INCR_COUNT(insert) ;
+	 hashvals[i] = hashVal(keys[base+i]) ;
+	 tab->prefetchBucket(hashvals[i],true) ;
+	 }
+      for (size_t i = 0 ; i < count ; ++i)
+	 {
+	 bool dup = tab->add(hashvals[i],keys[base+i],values ? values[base+i] : nullVal()) ;
+	 if (existed)
+	    existed[base+i] = dup ;
+	 if (dup)
+	    ++numexisting ;
+	 }
+      }
+   return numexisting ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::stillLive(const Table* version)
+{
+#ifndef FrSINGLE_THREADED
+   // check whether any thread holds a hazard pointer to the requested version
+   return HazardPointerList::isHazardous(version) ;
+#else
    (void)version ;
    // nobody else is using that version
    return false ;
+#endif /* !FrSINGLE_THREADED */
 }
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::thread_backoff(size_t &loops)
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::thread_backoff(size_t &loops)
 {
    ++loops ;
    // we expect the pending operation(s) to complete in
@@ -1600,8 +1653,8 @@ void HashTable<KeyT,ValT>::thread_backoff(size_t &loops)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-typename HashTable<KeyT,ValT>::Table* HashTable<KeyT,ValT>::allocTable()
+template <typename KeyT, typename ValT, typename PolicyT>
+typename HashTable<KeyT,ValT,PolicyT>::Table* HashTable<KeyT,ValT,PolicyT>::allocTable()
 {
    // pop a table record off the freelist, if available
    auto tab = s_freetables.load() ;
@@ -1618,8 +1671,8 @@ typename HashTable<KeyT,ValT>::Table* HashTable<KeyT,ValT>::allocTable()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::releaseTable(Table* t)
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::releaseTable(Table* t)
 {
    if (!t)
       return ;
@@ -1635,8 +1688,8 @@ void HashTable<KeyT,ValT>::releaseTable(Table* t)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::preallocateTables(size_t N)
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::preallocateTables(size_t N)
 {
    while (N > 0)
       {
@@ -1648,8 +1701,8 @@ void HashTable<KeyT,ValT>::preallocateTables(size_t N)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::freeTables()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::freeTables()
 {
    FramepaC::HashBase* tab ;
    while ((tab = s_freetables.load()) != nullptr)
@@ -1664,8 +1717,8 @@ void HashTable<KeyT,ValT>::freeTables()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::updateTable()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::updateTable()
 {
    auto table = m_table.load() ;
    bool updated = false ;
@@ -1686,8 +1739,8 @@ void HashTable<KeyT,ValT>::updateTable()
 //   entries and hash arrays, as well as an on-exit callback
 //   to clear that info
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::threadInit()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::threadInit()
 {
    // [[this function runs under a global lock, so only one thread at a time executes it]]
    // check whether we've initialized the thread-local data yet
@@ -1696,46 +1749,19 @@ void HashTable<KeyT,ValT>::threadInit()
    s_stats->clear() ;
 #endif /* FrHASHTABLE_STATS */
 #ifndef FrSINGLE_THREADED
-   if (!s_thread_record)
-      {
-      s_thread_record = new TablePtr ;
-      // push our local-copy variable onto the list of all such variables
-      //   for use by the resizer
-      s_thread_record->init((FramepaC::HashBase**)&s_table,s_thread_entries.load()) ;
-      s_thread_entries.store(s_thread_record) ;
-      }
+   // claim this thread's hazard-pointer list now rather than on the first table access
+   (void)HazardPointerList::threadList() ;
 #endif /* FrSINGLE_THREADED */
    return ;
 }
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::threadCleanup()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::threadCleanup()
 {
    // [[this function runs under a global lock, so only one thread at a time executes it]]
-#ifndef FrSINGLE_THREADED
-   //s_table = nullptr ; //!!! not really needed, since we're killing the thread anyway
-   //storeBarrier() ;
-   // unlink from the list of all thread-local table pointers
-   TablePtr* prev = nullptr ;
-   TablePtr* curr = s_thread_entries.load() ;
-   while (curr && (void**)curr->m_table != (void**)&s_table)
-      {
-      prev = curr ;
-      curr = curr->m_next ;
-      }
-   if (curr)
-      {
-      // found a match, so unlink it
-      if (prev)
-	 prev->m_next = curr->m_next ;
-      else
-	 s_thread_entries.store(curr->m_next) ;
-      }
-   delete s_thread_record ;
-   s_thread_record = nullptr ;
-#endif /* !FrSINGLE_THREADED */
+   // the hazard-pointer list is recycled automatically when the thread exits
 #ifdef FrHASHTABLE_STATS
    delete s_stats ;
    s_stats = nullptr ;
@@ -1745,8 +1771,8 @@ void HashTable<KeyT,ValT>::threadCleanup()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::StaticInitialization()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::StaticInitialization()
 {
    preallocateTables(16) ;
    return ;
@@ -1754,8 +1780,8 @@ void HashTable<KeyT,ValT>::StaticInitialization()
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-void HashTable<KeyT,ValT>::StaticCleanup()
+template <typename KeyT, typename ValT, typename PolicyT>
+void HashTable<KeyT,ValT,PolicyT>::StaticCleanup()
 {
    freeTables() ;
    return ;
@@ -1763,28 +1789,26 @@ void HashTable<KeyT,ValT>::StaticCleanup()
 
 //----------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::doAssistResize(HashTableBase* htb)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::doAssistResize(HashTableBase* htb)
 {
    auto ht = static_cast<HashTable*>(htb) ;
-   auto tab = ht->m_oldtables.load() ;
-   if (tab && tab->resizingDone() && !ht->stillLive(tab))
+   // release superseded tables oldest-first, stopping at the first one which is still in use; a
+   //   table may only be released once it is no longer the current table, since a thread which
+   //   read m_table before the switch could otherwise publish its hazard pointer too late
+   for (auto tab = ht->m_oldtables.load() ; tab && tab != ht->m_table.load() ; tab = ht->m_oldtables.load())
       {
+      if (!tab->resizingDone() || ht->stillLive(tab))
+	 break ;
       Table* nxt = tab->next() ;
       if (ht->m_oldtables.compare_exchange_strong(tab,nxt))
 	 {
 	 ht->releaseTable(tab) ;
 	 }
       }
-   else
-      {
-#if 0
-      tab = ht->m_oldtables.load() ;
-      if (tab && !tab->resizingDone())
-	 tab->resizeCopySegments(~0) ;
-#endif
-      }
-   return ht->m_oldtables.load() != ht->m_table.load() ;
+   // a resize which is still in progress has yet to make its new table current, so keep checking
+   //   back until it has finished and its predecessor can be released
+   return ht->activeResizes() > 0 || ht->m_oldtables.load() != ht->m_table.load() ;
 }
 
 /************************************************************************/
@@ -1794,18 +1818,10 @@ bool HashTable<KeyT,ValT>::doAssistResize(HashTableBase* htb)
 //----------------------------------------------------------------------
 // static members
 
-#ifndef FrSINGLE_THREADED
-template <typename KeyT, typename ValT>
-Atomic<FramepaC::TablePtr*> HashTable<KeyT,ValT>::s_thread_entries = nullptr ;
-template <typename KeyT, typename ValT>
-thread_local typename HashTable<KeyT,ValT>::Table* HashTable<KeyT,ValT>::s_table = nullptr ;
-template <typename KeyT, typename ValT>
-thread_local typename HashTable<KeyT,ValT>::TablePtr* HashTable<KeyT,ValT>::s_thread_record = nullptr ;
-#endif /* !FrSINGLE_THREADED */
 
 #if defined(FrHASHTABLE_STATS)
-template <typename KeyT, typename ValT>
-thread_local FramepaC::HashTable_Stats* HashTable<KeyT,ValT>::s_stats = nullptr ;
+template <typename KeyT, typename ValT, typename PolicyT>
+thread_local FramepaC::HashTable_Stats* HashTable<KeyT,ValT,PolicyT>::s_stats = nullptr ;
 #endif /* FrHASHTABLE_STATS */
 
 } // end namespace Fr
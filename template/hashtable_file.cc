@@ -42,8 +42,8 @@ class HashTableHeader
 /*	Methods for class HashTable					*/
 /************************************************************************/
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::load(CFile& fp, const char* filename)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::load(CFile& fp, const char* filename)
 {
    int version = file_format ;
    if (!fp || !fp.verifySignature(signature,filename,version,min_file_format))
@@ -80,14 +80,14 @@ bool HashTable<KeyT,ValT>::load(CFile& fp, const char* filename)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::load(const char* mmap_base, size_t mmap_len)
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::load(const char* mmap_base, size_t mmap_len)
 {
    size_t signature_size = CFile::signatureSize(signature) + 2*sizeof(uint8_t) ;
    if (!mmap_base || mmap_len < signature_size)
       return false ;
    if (*((uint8_t*)(mmap_base + signature_size-2)) != sizeof(KeyT) ||
-      *((uint8_t*)(mmap_base + signature_size-2)) != sizeof(ValT))
+      *((uint8_t*)(mmap_base + signature_size-1)) != sizeof(ValT))
       {
       SystemMessage::error("wrong data type - sizeof() does not match") ;
       return false ;
@@ -117,8 +117,8 @@ bool HashTable<KeyT,ValT>::load(const char* mmap_base, size_t mmap_len)
 
 //----------------------------------------------------------------------------
 
-template <typename KeyT, typename ValT>
-bool HashTable<KeyT,ValT>::save(CFile& fp) const
+template <typename KeyT, typename ValT, typename PolicyT>
+bool HashTable<KeyT,ValT,PolicyT>::save(CFile& fp) const
 {
    if (!fp || !fp.writeSignature(signature,file_format))
       return false ;
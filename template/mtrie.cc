@@ -1,10 +1,10 @@
 /****************************** -*- C++ -*- *****************************/
 /*									*/
 /* FramepaC-ng								*/
-/* Version 0.01, last edit 2017-05-11					*/
+/* Version 0.14, last edit 2019-07-10					*/
 /*	by Ralf Brown <ralf@cs.cmu.edu>					*/
 /*									*/
-/* (c) Copyright 2017 Carnegie Mellon University			*/
+/* (c) Copyright 2017,2019 Carnegie Mellon University			*/
 /*	This program may be redistributed and/or modified under the	*/
 /*	terms of the GNU General Public License, version 3, or an	*/
 /*	alternative license agreement as detailed in the accompanying	*/
@@ -28,10 +28,30 @@ namespace Fr
 /*	Methods for template class MultiTrie				*/
 /************************************************************************/
 
-
-
-
+template <typename T, typename IdxT, unsigned bits>
+bool MultiTrie<T,IdxT,bits>::insert(const uint8_t* key, unsigned keylength, T item)
+{
+   IdxT entry = (IdxT)m_values.alloc() ;
+   TList* list = m_values.item(entry) ;
+   list->m_item = item ;
+   list->m_next = END_OF_LIST ;
+   IdxT index = this->findNode(key,keylength) ;
+   if (index != super::NULL_INDEX || keylength == 0)
+      {
+      auto n = this->node(index) ;
+      if (n->leaf())
+	 {
+	 // the key already has items, so push the new one onto the front of its list
+	 list->m_next = n->value() ;
+	 n->setValue(entry) ;
+	 return true ;
+	 }
+      }
+   return super::insert(key,keylength,entry) ;
+}
+
+//----------------------------------------------------------------------------
 
 } // end namespace Fr
 
-// end of file ptrie.cc //
+// end of file mtrie.cc //
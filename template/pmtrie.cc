@@ -1,10 +1,10 @@
 /****************************** -*- C++ -*- *****************************/
 /*									*/
 /* FramepaC-ng								*/
-/* Version 0.01, last edit 2017-05-11					*/
+/* Version 0.14, last edit 2019-07-10					*/
 /*	by Ralf Brown <ralf@cs.cmu.edu>					*/
 /*									*/
-/* (c) Copyright 2017 Carnegie Mellon University			*/
+/* (c) Copyright 2017,2019 Carnegie Mellon University			*/
 /*	This program may be redistributed and/or modified under the	*/
 /*	terms of the GNU General Public License, version 3, or an	*/
 /*	alternative license agreement as detailed in the accompanying	*/
@@ -19,18 +19,288 @@
 /*									*/
 /************************************************************************/
 
-#include "framepac/trie.h"
+#include "template/ptrie.cc"
 
 namespace Fr
 {
 
+/************************************************************************/
+/*	Types for this module						*/
+/************************************************************************/
+
+class PackedMultiTrieHeader
+   {
+   public:
+      uint64_t m_numlists ;	// number of nodes with items
+      uint64_t m_numvalues ;	// total number of items
+      uint64_t m_offsets ;	// offset of array of list starts
+      uint64_t m_values ;	// offset of array of items
+      uint64_t m_pad[4] { 0 } ; // padding for future extensions
+   } ;
+
 /************************************************************************/
 /*	Methods for template class PackedMultiTrie			*/
 /************************************************************************/
 
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+bool PackedMultiTrie<T,IdxT,ValIdxT,bits>::build(const MultiTrie<T,IdxT,bits>* trie)
+{
+   clear() ;
+   if (!trie)
+      return false ;
+   // gather each node's items into a contiguous block; the node's value in the packed trie is
+   //   then the number of its block
+   std::vector<ValIdxT> offsets ;
+   std::vector<T> values ;
+   std::vector<T> items ;
+   offsets.reserve(trie->fullNodes()) ;
+   values.reserve(trie->numValues()) ;
+   offsets.push_back(0) ;
+   bool overflow = false ;
+   auto gather = [&](IdxT head) -> ValIdxT
+      {
+      items.clear() ;
+      for (auto entry = trie->valueList(head) ; entry ; entry = trie->valueList(entry->m_next))
+	 items.push_back(entry->m_item) ;
+      // the lists are stored newest-first, so reverse them to restore the order of insertion
+      values.insert(values.end(),items.rbegin(),items.rend()) ;
+      if (values.size() > (size_t)(ValIdxT)~0)
+	 overflow = true ;
+      offsets.push_back((ValIdxT)values.size()) ;
+      return (ValIdxT)(offsets.size() - 2) ;
+      } ;
+   if (!super::build(static_cast<const Trie<IdxT,IdxT,bits>*>(trie),gather) || overflow)
+      {
+      clear() ;
+      return false ;
+      }
+   m_numlists = offsets.size() - 1 ;
+   m_numvalues = values.size() ;
+   m_offsets = new ValIdxT[offsets.size()] ;
+   std::copy(offsets.begin(),offsets.end(),m_offsets) ;
+   if (!values.empty())
+      {
+      m_values = new T[values.size()] ;
+      std::copy(values.begin(),values.end(),m_values) ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+void PackedMultiTrie<T,IdxT,ValIdxT,bits>::releaseValues()
+{
+   if (!this->m_readonly)
+      {
+      delete[] m_values ;
+      delete[] m_offsets ;
+      }
+   m_values = nullptr ;
+   m_offsets = nullptr ;
+   m_numlists = 0 ;
+   m_numvalues = 0 ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+void PackedMultiTrie<T,IdxT,ValIdxT,bits>::clear()
+{
+   // release our arrays before the base class forgets whether they are in a memory-mapped file
+   releaseValues() ;
+   super::clear() ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+size_t PackedMultiTrie<T,IdxT,ValIdxT,bits>::memoryUsage() const
+{
+   size_t lists = m_offsets ? (m_numlists + 1) * sizeof(ValIdxT) : 0 ;
+   return super::memoryUsage() + lists + m_numvalues * sizeof(T) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+size_t PackedMultiTrie<T,IdxT,ValIdxT,bits>::nodeValues(IdxT index, const T*& values) const
+{
+   ValIdxT list ;
+   values = nullptr ;
+   if (!super::nodeValue(index,list) || list >= m_numlists)
+      return 0 ;
+   ValIdxT start = m_offsets[list] ;
+   ValIdxT end = m_offsets[list+1] ;
+   if (end < start || end > m_numvalues)
+      return 0 ;
+   values = m_values + start ;
+   return end - start ;
+}
+
+//----------------------------------------------------------------------------
 
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+size_t PackedMultiTrie<T,IdxT,ValIdxT,bits>::find(const uint8_t* key, unsigned keylength, const T*& values) const
+{
+   IdxT index = this->findNode(key,keylength) ;
+   if (index == super::NULL_INDEX)
+      {
+      values = nullptr ;
+      return 0 ;
+      }
+   return nodeValues(index,values) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+bool PackedMultiTrie<T,IdxT,ValIdxT,bits>::load(const char* filename, bool allow_mmap)
+{
+   CInputFile file(filename,CFile::binary) ;
+   return file ? load(file,filename,allow_mmap) : false ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+bool PackedMultiTrie<T,IdxT,ValIdxT,bits>::load(CFile& fp, const char* filename, bool allow_mmap)
+{
+   if (!fp)
+      return false ;
+   releaseValues() ;
+   off_t base_offset = fp.tell() ;
+   if (!super::load(fp,filename,allow_mmap))
+      return false ;
+   // the item arrays follow the trie itself
+   if (this->m_mmap)
+      {
+      if (setupValues(*this->m_mmap + this->m_datasize,this->m_mmap.size() - this->m_datasize))
+	 return true ;
+      clear() ;
+      return false ;
+      }
+   off_t section_offset = base_offset + this->m_datasize ;
+   int version = file_format ;
+   uint8_t valsize ;
+   PackedMultiTrieHeader header ;
+   bool success = fp.seek(section_offset)
+      && fp.verifySignature(signature,filename,version,min_file_format)
+      && fp.readValue(&valsize) && valsize == sizeof(T)
+      && fp.readValue(&header) ;
+   success = success && fp.readVarsAt(header.m_offsets + section_offset,&m_offsets,header.m_numlists+1) ;
+   success = success && fp.readVarsAt(header.m_values + section_offset,&m_values,header.m_numvalues) ;
+   if (!success)
+      {
+      clear() ;
+      return false ;
+      }
+   m_numlists = header.m_numlists ;
+   m_numvalues = header.m_numvalues ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+bool PackedMultiTrie<T,IdxT,ValIdxT,bits>::loadMapped(const char* filename, off_t base_offset)
+{
+   releaseValues() ;
+   if (!super::loadMapped(filename,base_offset))
+      return false ;
+   if (setupValues(*this->m_mmap + this->m_datasize,this->m_mmap.size() - this->m_datasize))
+      return true ;
+   clear() ;
+   return false ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+bool PackedMultiTrie<T,IdxT,ValIdxT,bits>::loadFromMmap(const char* mmap_base, size_t mmap_len)
+{
+   releaseValues() ;
+   if (!super::loadFromMmap(mmap_base,mmap_len))
+      return false ;
+   if (setupValues(mmap_base + this->m_datasize,mmap_len - this->m_datasize))
+      return true ;
+   releaseValues() ;
+   this->releaseArrays() ;
+   this->m_readonly = false ;
+   return false ;
+}
+
+//----------------------------------------------------------------------------
 
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+bool PackedMultiTrie<T,IdxT,ValIdxT,bits>::setupValues(const char* base, size_t len)
+{
+   size_t sig_size = CFile::signatureSize(signature) ;
+   size_t header_size = sig_size + sizeof(uint8_t) ;
+   if (len < header_size + sizeof(PackedMultiTrieHeader) || memcmp(base,signature,strlen(signature)) != 0
+      || (uint8_t)base[sig_size] != sizeof(T))
+      return false ;
+   const PackedMultiTrieHeader* header = reinterpret_cast<const PackedMultiTrieHeader*>(base + header_size) ;
+   bool valid = true ;
+   auto check = [&](uint64_t offset, size_t count, size_t elt_size)
+      {
+      if (offset < header_size || offset > len || count > (len - offset) / elt_size)
+	 valid = false ;
+      return base + offset ;
+      } ;
+   m_offsets = (ValIdxT*)check(header->m_offsets,header->m_numlists+1,sizeof(ValIdxT)) ;
+   m_values = (T*)check(header->m_values,header->m_numvalues,sizeof(T)) ;
+   if (!valid)
+      {
+      SystemMessage::error("PackedMultiTrie: corrupted trie file") ;
+      m_offsets = nullptr ;
+      m_values = nullptr ;
+      return false ;
+      }
+   m_numlists = header->m_numlists ;
+   m_numvalues = header->m_numvalues ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename T, typename IdxT, typename ValIdxT, unsigned bits>
+bool PackedMultiTrie<T,IdxT,ValIdxT,bits>::save(CFile& fp) const
+{
+   if (!fp || !m_offsets || !super::save(fp))
+      return false ;
+   off_t section_offset = fp.tell() ;
+   if (!fp.writeSignature(signature,file_format))
+      return false ;
+   uint8_t valsize = sizeof(T) ;
+   if (!fp.writeValue(valsize))
+      return false ;
+   off_t header_offset = fp.tell() ;
+   PackedMultiTrieHeader header ;
+   header.m_numlists = m_numlists ;
+   header.m_numvalues = m_numvalues ;
+   if (!fp.writeValue(header) || !align_trie_file(fp,section_offset))
+      return false ;
+   header.m_offsets = fp.tell() - section_offset ;
+   if (!fp.writeValues(m_offsets,m_numlists+1) || !align_trie_file(fp,section_offset))
+      return false ;
+   header.m_values = fp.tell() - section_offset ;
+   if (!fp.writeValues(m_values,m_numvalues))
+      return false ;
+   // now that we've written the arrays, we have a complete header, so go back and update it
+   off_t lastpos = fp.tell() ;
+   fp.seek(header_offset) ;
+   bool success = true ;
+   if (!fp.writeValue(header))
+      success = false ;
+   fp.flush() ;
+   fp.seek(lastpos) ;
+   return success ;
+}
 
+//----------------------------------------------------------------------------
 
 } // end namespace Fr
 
@@ -1,7 +1,7 @@
 /****************************** -*- C++ -*- *****************************/
 /*									*/
 /* FramepaC-ng								*/
-/* Version 0.14, last edit 2019-02-14					*/
+/* Version 0.14, last edit 2019-07-10					*/
 /*	by Ralf Brown <ralf@cs.cmu.edu>					*/
 /*									*/
 /* (c) Copyright 2019 Carnegie Mellon University			*/
@@ -19,51 +19,522 @@
 /*									*/
 /************************************************************************/
 
+#include <cstring>
+#include <deque>
+#include <vector>
+#include "framepac/message.h"
 #include "framepac/trie.h"
 
 namespace Fr
 {
 
 /************************************************************************/
+/*	Types for this module						*/
 /************************************************************************/
 
+class PackedTrieHeader
+   {
+   public:
+      uint64_t m_fullnodes ;	// number of full nodes
+      uint64_t m_valueless ;	// number of valueless nodes
+      uint64_t m_leaves ;	// number of leaf nodes
+      uint64_t m_numkeys ;	// number of nodes with values
+      uint64_t m_maxkey ;	// length of the longest key
+      uint64_t m_fullnode_offset ;  // offset of array of full nodes
+      uint64_t m_valueless_offset ; // offset of array of valueless nodes
+      uint64_t m_leaf_offset ;	// offset of array of leaf nodes
+      uint64_t m_end ;		// offset of the end of the trie's data
+      uint64_t m_pad[7] { 0 } ; // padding for future extensions
+   } ;
+
+/************************************************************************/
+/*	Helper functions						*/
+/************************************************************************/
+
+// pad the file to a multiple of eight bytes, so that memory-mapped node arrays are aligned
+static inline bool align_trie_file(CFile& fp, off_t base_offset)
+{
+   size_t pad = (8 - ((fp.tell() - base_offset) % 8)) % 8 ;
+   return pad == 0 || fp.putNulls(pad) ;
+}
 
 /************************************************************************/
 /*	Methods for template class PackedTrie				*/
 /************************************************************************/
 
 template <typename T, typename IdxT, unsigned bits>
-PackedTrie<T,IdxT,bits>::PackedTrie()
+bool PackedTrie<T,IdxT,bits>::build(const Trie<T,IdxT,bits>* trie)
 {
+   return build(trie,[](T value) { return value ; }) ;
+}
 
-   return ;
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+template <typename SrcT, typename ValFn>
+bool PackedTrie<T,IdxT,bits>::build(const Trie<SrcT,IdxT,bits>* trie, ValFn map_value)
+{
+   static_assert( bits >= 2 && bits <= 4, "PackedTrie only supports 2/3/4 bits per level") ;
+   constexpr unsigned fanout = 1U << bits ;
+   constexpr unsigned iter = (7 + bits) / bits ;
+   enum { FULL, VALUELESS, LEAF } ;
+   typedef typename Trie<SrcT,IdxT,bits>::ValuelessNode SrcNode ;
+   clear() ;
+   if (!trie)
+      return false ;
+   std::vector<Node> full ;
+   std::vector<ValuelessNode> valueless ;
+   std::vector<LeafNode> leaves ;
+   // which of the three arrays holds the children of each full or valueless node
+   std::vector<uint8_t> full_children ;
+   std::vector<uint8_t> valueless_children ;
+   // the nodes whose children have yet to be added; 'level' is the number of partial-byte steps
+   //   since the last full byte of the key, which tells us which kind of node the source trie uses
+   class Pending
+      {
+      public:
+	 IdxT    m_source ;
+	 IdxT    m_packed ;
+	 uint8_t m_kind ;
+	 uint8_t m_level ;
+      } ;
+   std::deque<Pending> queue ;
+   // the root is always a full node, so that the empty key can have a value
+   auto root = trie->node(trie->ROOT_INDEX) ;
+   full.emplace_back() ;
+   full_children.push_back(LEAF) ;
+   if (root->leaf())
+      {
+      full[0].setValue(map_value(root->value())) ;
+      ++m_numkeys ;
+      }
+   if (root->hasChildren())
+      queue.push_back({ trie->ROOT_INDEX, ROOT_INDEX, FULL, 0 }) ;
+   while (!queue.empty())
+      {
+      Pending parent = queue.front() ;
+      queue.pop_front() ;
+      const SrcNode* src = parent.m_level ? trie->valuelessNode(parent.m_source) : trie->node(parent.m_source) ;
+      unsigned level = (parent.m_level + 1) % iter ;
+      // gather the children, and determine which kind of node can represent all of them, since
+      //   siblings must be adjacent in the same array
+      IdxT children[fanout] ;
+      unsigned count = 0 ;
+      uint16_t mask = 0 ;
+      bool need_value = false ;
+      bool need_children = (level != 0) ;  // partial-byte nodes always lead to a full node
+      for (unsigned i = 0 ; i < fanout ; ++i)
+	 {
+	 if (!src->hasChild(i))
+	    continue ;
+	 children[count++] = src->childIndex(i) ;
+	 mask |= (1U << i) ;
+	 if (level == 0)
+	    {
+	    auto child = trie->node(children[count-1]) ;
+	    if (child->leaf()) need_value = true ;
+	    if (child->hasChildren()) need_children = true ;
+	    }
+	 }
+      uint8_t kind = need_children ? (need_value ? FULL : VALUELESS) : (need_value ? LEAF : VALUELESS) ;
+      size_t first ;
+      if (kind == FULL)
+	 {
+	 first = full.size() ;
+	 full.resize(first + count) ;
+	 full_children.resize(first + count,LEAF) ;
+	 }
+      else if (kind == VALUELESS)
+	 {
+	 first = valueless.size() ;
+	 valueless.resize(first + count) ;
+	 valueless_children.resize(first + count,LEAF) ;
+	 }
+      else
+	 {
+	 first = leaves.size() ;
+	 leaves.resize(first + count) ;
+	 }
+      if (first + count >= (size_t)NULL_INDEX)
+	 {
+	 SystemMessage::error("PackedTrie: too many nodes for index type") ;
+	 return false ;
+	 }
+      // the child index is relative to the start of its array until we know the array sizes
+      if (parent.m_kind == FULL)
+	 {
+	 full[parent.m_packed].setChildren((IdxT)first,mask) ;
+	 full_children[parent.m_packed] = kind ;
+	 }
+      else
+	 {
+	 valueless[parent.m_packed].setChildren((IdxT)first,mask) ;
+	 valueless_children[parent.m_packed] = kind ;
+	 }
+      for (unsigned i = 0 ; i < count ; ++i)
+	 {
+	 IdxT packed = (IdxT)(first + i) ;
+	 if (level != 0)
+	    {
+	    queue.push_back({ children[i], packed, kind, (uint8_t)level }) ;
+	    continue ;
+	    }
+	 auto child = trie->node(children[i]) ;
+	 if (child->leaf())
+	    {
+	    if (kind == FULL)
+	       full[packed].setValue(map_value(child->value())) ;
+	    else
+	       leaves[packed].setValue(map_value(child->value())) ;
+	    ++m_numkeys ;
+	    }
+	 if (child->hasChildren())
+	    queue.push_back({ children[i], packed, kind, 0 }) ;
+	 }
+      }
+   // now that we know how many nodes of each kind there are, convert child indices into the
+   //   combined index space
+   size_t total = full.size() + valueless.size() + leaves.size() ;
+   if (total >= (size_t)NULL_INDEX)
+      {
+      SystemMessage::error("PackedTrie: too many nodes for index type") ;
+      return false ;
+      }
+   IdxT base[3] = { 0, (IdxT)full.size(), (IdxT)(full.size() + valueless.size()) } ;
+   for (size_t i = 0 ; i < full.size() ; ++i)
+      {
+      if (full[i].hasChildren())
+	 full[i].setChildren(full[i].firstChild() + base[full_children[i]],full[i].childMask()) ;
+      }
+   for (size_t i = 0 ; i < valueless.size() ; ++i)
+      {
+      if (valueless[i].hasChildren())
+	 valueless[i].setChildren(valueless[i].firstChild() + base[valueless_children[i]],
+	    valueless[i].childMask()) ;
+      }
+   m_fullnodes = new Node[full.size()] ;
+   std::copy(full.begin(),full.end(),m_fullnodes) ;
+   if (!valueless.empty())
+      {
+      m_nodes = new ValuelessNode[valueless.size()] ;
+      std::copy(valueless.begin(),valueless.end(),m_nodes) ;
+      }
+   if (!leaves.empty())
+      {
+      m_leaves = new LeafNode[leaves.size()] ;
+      std::copy(leaves.begin(),leaves.end(),m_leaves) ;
+      }
+   m_first_valuelessnode = base[VALUELESS] ;
+   m_first_leaf = base[LEAF] ;
+   m_size = (IdxT)total ;
+   m_maxkey = trie->longestKey() ;
+   return true ;
 }
 
 //----------------------------------------------------------------------
 
 template <typename T, typename IdxT, unsigned bits>
-PackedTrie<T,IdxT,bits>::PackedTrie(const Trie<T,IdxT,bits>* /*in_trie*/)
+void PackedTrie<T,IdxT,bits>::releaseArrays()
 {
+   if (!m_readonly)
+      {
+      delete[] m_fullnodes ;
+      delete[] m_nodes ;
+      delete[] m_leaves ;
+      }
+   m_fullnodes = nullptr ;
+   m_nodes = nullptr ;
+   m_leaves = nullptr ;
+   return ;
+}
+
+//----------------------------------------------------------------------
 
+template <typename T, typename IdxT, unsigned bits>
+void PackedTrie<T,IdxT,bits>::clear()
+{
+   releaseArrays() ;
+   m_mmap.close() ;
+   m_readonly = false ;
+   m_first_valuelessnode = 0 ;
+   m_first_leaf = 0 ;
+   m_size = 0 ;
+   m_numkeys = 0 ;
+   m_datasize = 0 ;
+   m_maxkey = 0 ;
    return ;
 }
 
 //----------------------------------------------------------------------
 
 template <typename T, typename IdxT, unsigned bits>
-PackedTrie<T,IdxT,bits>::PackedTrie(const char* /*filename*/)
+size_t PackedTrie<T,IdxT,bits>::memoryUsage() const
 {
+   return fullNodes() * sizeof(Node) + valuelessNodes() * sizeof(ValuelessNode) + leafNodes() * sizeof(LeafNode) ;
+}
 
-   return ;
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::extendKey(IdxT& index, uint8_t keybyte) const
+{
+   constexpr unsigned mask = (1U << bits) - 1 ;
+   constexpr unsigned iter = (7 + bits) / bits ;
+   // only the node at a byte boundary can be of any kind; the nodes for the partial bytes in
+   //   between are always valueless, so we need only check that the index is in range
+   const ValuelessNode* n = interiorNode(index) ;
+   if (!n)
+      return false ;
+   for (unsigned shift = (iter-1)*bits ; shift > 0 ; shift -= bits)
+      {
+      unsigned childnum = (keybyte >> shift) & mask ;
+      if (!n->hasChild(childnum))
+	 return false ;
+      IdxT child = n->childIndex(childnum) - m_first_valuelessnode ;
+      if (child >= valuelessNodes())
+	 return false ;
+      n = &m_nodes[child] ;
+      }
+   // retrieve the final node
+   unsigned childnum = keybyte & mask ;
+   if (!n->hasChild(childnum))
+      return false ;
+   index = n->childIndex(childnum) ;
+   return true ;
 }
 
 //----------------------------------------------------------------------
 
 template <typename T, typename IdxT, unsigned bits>
-void PackedTrie<T,IdxT,bits>::init(IdxT /*cap*/)
+IdxT PackedTrie<T,IdxT,bits>::findNode(const uint8_t* key, unsigned keylength) const
 {
+   if (m_size == 0)
+      return NULL_INDEX ;
+   IdxT index = ROOT_INDEX ;
+   for (size_t i = 0 ; i < keylength ; ++i)
+      {
+      if (!extendKey(index,key[i]))
+	 return NULL_INDEX ;
+      }
+   return index ;
+}
 
-   return ;
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::find(const uint8_t* key, unsigned keylength, T& value) const
+{
+   IdxT index = findNode(key,keylength) ;
+   return index != NULL_INDEX && nodeValue(index,value) ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::contains(const uint8_t* key, unsigned keylength) const
+{
+   IdxT index = findNode(key,keylength) ;
+   return index != NULL_INDEX && nodeHasValue(index) ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::nodeHasValue(IdxT index) const
+{
+   if (index < m_first_valuelessnode)
+      return m_fullnodes[index].hasValue() ;
+   return leafNode(index) ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+T PackedTrie<T,IdxT,bits>::nodeValue(IdxT index) const
+{
+   T value ;
+   return nodeValue(index,value) ? value : nullVal() ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::nodeValue(IdxT index, T& value) const
+{
+   if (index < m_first_valuelessnode)
+      {
+      const Node& n = m_fullnodes[index] ;
+      if (!n.hasValue())
+	 return false ;
+      value = n.nodeValue() ;
+      return true ;
+      }
+   if (!leafNode(index))
+      return false ;
+   value = m_leaves[index - m_first_leaf].nodeValue() ;
+   return true ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::load(const char* filename, bool allow_mmap)
+{
+   CInputFile file(filename,CFile::binary) ;
+   return file ? load(file,filename,allow_mmap) : false ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::load(CFile& fp, const char* filename, bool allow_mmap)
+{
+   if (!fp)
+      return false ;
+   clear() ;
+   off_t base_offset = fp.tell() ;
+   int version = file_format ;
+   if (!fp.verifySignature(signature,filename,version,min_file_format))
+      return false ;
+   uint8_t valsize, idxsize, nodebits ;
+   if (!fp.readValue(&valsize) || !fp.readValue(&idxsize) || !fp.readValue(&nodebits))
+      return false ;
+   if (valsize != sizeof(T) || idxsize != sizeof(IdxT) || nodebits != bits)
+      {
+      SystemMessage::error("wrong data type - sizeof() does not match") ;
+      return false ;
+      }
+   if (allow_mmap && loadMapped(filename,base_offset))
+      return true ;
+   PackedTrieHeader header ;
+   if (!fp.readValue(&header))
+      return false ;
+   if (header.m_fullnodes == 0 || header.m_fullnodes + header.m_valueless + header.m_leaves >= (uint64_t)NULL_INDEX)
+      return false ;
+   bool success = fp.readVarsAt(header.m_fullnode_offset + base_offset,&m_fullnodes,header.m_fullnodes) ;
+   success = success && fp.readVarsAt(header.m_valueless_offset + base_offset,&m_nodes,header.m_valueless) ;
+   success = success && fp.readVarsAt(header.m_leaf_offset + base_offset,&m_leaves,header.m_leaves) ;
+   if (!success)
+      {
+      clear() ;
+      return false ;
+      }
+   m_first_valuelessnode = (IdxT)header.m_fullnodes ;
+   m_first_leaf = (IdxT)(header.m_fullnodes + header.m_valueless) ;
+   m_size = (IdxT)(m_first_leaf + header.m_leaves) ;
+   m_numkeys = header.m_numkeys ;
+   m_maxkey = (unsigned)header.m_maxkey ;
+   m_datasize = header.m_end ;
+   return true ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::loadMapped(const char* filename, off_t base_offset)
+{
+   if (!filename || !*filename)
+      return false;
+   MemMappedROFile mm(filename,base_offset) ;
+   if (!mm)
+      return false ;
+   m_mmap = std::move(mm) ;
+   if (loadFromMmap(*m_mmap,m_mmap.size()))
+      return true ;
+   m_mmap.close() ;
+   return false ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::loadFromMmap(const char* mmap_base, size_t mmap_len)
+{
+   size_t sig_size = CFile::signatureSize(signature) ;
+   size_t header_size = sig_size + 3*sizeof(uint8_t) ;
+   if (!mmap_base || mmap_len < header_size + sizeof(PackedTrieHeader))
+      return false;
+   if (memcmp(mmap_base,signature,strlen(signature)) != 0 || (uint8_t)mmap_base[sig_size] != sizeof(T)
+      || (uint8_t)mmap_base[sig_size+1] != sizeof(IdxT) || (uint8_t)mmap_base[sig_size+2] != bits)
+      return false ;
+   releaseArrays() ;
+   m_readonly = true ;
+   const PackedTrieHeader* header = reinterpret_cast<const PackedTrieHeader*>(mmap_base + header_size) ;
+   // make sure that every array lies within the mapped region before pointing at it; child indices
+   //   need no checking, since any index past the end of the arrays is treated as a missing node
+   bool valid = header->m_fullnodes > 0
+      && header->m_fullnodes + header->m_valueless + header->m_leaves < (uint64_t)NULL_INDEX
+      && header->m_end <= mmap_len ;
+   auto check = [&](uint64_t offset, size_t count, size_t elt_size)
+      {
+      if (offset < header_size || offset > mmap_len || count > (mmap_len - offset) / elt_size)
+	 valid = false ;
+      return mmap_base + offset ;
+      } ;
+   m_fullnodes = (Node*)check(header->m_fullnode_offset,header->m_fullnodes,sizeof(Node)) ;
+   m_nodes = (ValuelessNode*)check(header->m_valueless_offset,header->m_valueless,sizeof(ValuelessNode)) ;
+   m_leaves = (LeafNode*)check(header->m_leaf_offset,header->m_leaves,sizeof(LeafNode)) ;
+   if (!valid)
+      {
+      SystemMessage::error("PackedTrie: corrupted trie file") ;
+      releaseArrays() ;
+      m_readonly = false ;
+      return false ;
+      }
+   m_first_valuelessnode = (IdxT)header->m_fullnodes ;
+   m_first_leaf = (IdxT)(header->m_fullnodes + header->m_valueless) ;
+   m_size = (IdxT)(m_first_leaf + header->m_leaves) ;
+   m_numkeys = header->m_numkeys ;
+   m_maxkey = (unsigned)header->m_maxkey ;
+   m_datasize = header->m_end ;
+   return true ;
+}
+
+//----------------------------------------------------------------------
+
+template <typename T, typename IdxT, unsigned bits>
+bool PackedTrie<T,IdxT,bits>::save(CFile& fp) const
+{
+   if (!fp || !*this)
+      return false ;
+   off_t base_offset = fp.tell() ;
+   if (!fp.writeSignature(signature,file_format))
+      return false ;
+   uint8_t valsize = sizeof(T) ;
+   uint8_t idxsize = sizeof(IdxT) ;
+   uint8_t nodebits = bits ;
+   if (!fp.writeValue(valsize) || !fp.writeValue(idxsize) || !fp.writeValue(nodebits))
+      return false ;
+   off_t header_offset = fp.tell() ;
+   PackedTrieHeader header ;
+   header.m_fullnodes = fullNodes() ;
+   header.m_valueless = valuelessNodes() ;
+   header.m_leaves = leafNodes() ;
+   header.m_numkeys = m_numkeys ;
+   header.m_maxkey = m_maxkey ;
+   if (!fp.writeValue(header) || !align_trie_file(fp,base_offset))
+      return false ;
+   header.m_fullnode_offset = fp.tell() - base_offset ;
+   if (fp.write(m_fullnodes,fullNodes(),sizeof(Node)) != fullNodes() || !align_trie_file(fp,base_offset))
+      return false ;
+   header.m_valueless_offset = fp.tell() - base_offset ;
+   if (fp.write(m_nodes,valuelessNodes(),sizeof(ValuelessNode)) != valuelessNodes()
+      || !align_trie_file(fp,base_offset))
+      return false ;
+   header.m_leaf_offset = fp.tell() - base_offset ;
+   if (fp.write(m_leaves,leafNodes(),sizeof(LeafNode)) != leafNodes() || !align_trie_file(fp,base_offset))
+      return false ;
+   header.m_end = fp.tell() - base_offset ;
+   // now that we've written all the other data, we have a complete header, so return to the start of the file
+   //   and update the header
+   off_t lastpos = fp.tell() ;
+   fp.seek(header_offset) ;
+   bool success = true ;
+   if (!fp.writeValue(header))
+      success = false ;
+   fp.flush() ;
+   fp.seek(lastpos) ;
+   return success ;
 }
 
 //----------------------------------------------------------------------
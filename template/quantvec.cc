@@ -0,0 +1,528 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.15, last edit 2019-08-26					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "framepac/quantvec.h"
+#include "framepac/threadpool.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Manifest constants						*/
+/************************************************************************/
+
+// number of rows quantized or scored by each parallel task
+#define FrQUANT_BLOCK_SIZE 256
+
+// by default, nearest() rescores this many candidates per requested result
+#define FrQUANT_RESCORE_FACTOR 4
+
+/************************************************************************/
+/*	Helper functions						*/
+/************************************************************************/
+
+static uint8_t* alloc_aligned_bytes(size_t count, size_t alignment)
+{
+   void* mem = nullptr ;
+   if (count == 0)
+      count = 1 ;
+   if (posix_memalign(&mem,alignment,count) != 0)
+      return nullptr ;
+   return static_cast<uint8_t*>(mem) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+static size_t vector_dimensions(const Vector<IdxT,ValT>* v)
+{
+   if (v->isOneHotVector())
+      return static_cast<const OneHotVector<IdxT,ValT>*>(v)->elementIndex(0) + 1 ;
+   if (v->isSparseVector())
+      {
+      size_t n = v->numElements() ;
+      return n ? static_cast<const SparseVector<IdxT,ValT>*>(v)->elementIndex(n-1) + 1 : 0 ;
+      }
+   return v->numElements() ;
+}
+
+//----------------------------------------------------------------------------
+
+// expand any kind of vector into 'dims' dense single-precision values
+template <typename IdxT, typename ValT>
+static void expand_vector(const Vector<IdxT,ValT>* v, float* dense, size_t dims)
+{
+   std::fill(dense,dense+dims,0.0f) ;
+   if (v->isOneHotVector())
+      {
+      auto ohv = static_cast<const OneHotVector<IdxT,ValT>*>(v) ;
+      size_t index = ohv->elementIndex(0) ;
+      if (index < dims)
+	 dense[index] = (float)ohv->elementValue(index) ;
+      }
+   else if (v->isSparseVector())
+      {
+      auto sv = static_cast<const SparseVector<IdxT,ValT>*>(v) ;
+      for (size_t i = 0 ; i < sv->numElements() ; ++i)
+	 {
+	 size_t index = sv->elementIndex(i) ;
+	 if (index < dims)
+	    dense[index] = (float)sv->elementValue(i) ;
+	 }
+      }
+   else
+      {
+      size_t count = std::min(dims,v->numElements()) ;
+      const ValT* values = v->elementValues() ;
+      for (size_t i = 0 ; i < count ; ++i)
+	 dense[i] = (float)values[i] ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+// convert the dot product of two quantized vectors into the requested measure
+static inline double finish_similarity(QuantizedMeasure measure, double dot, double norm1, double norm2)
+{
+   switch (measure)
+      {
+      case QuantizedMeasure::dot:
+	 return dot ;
+      case QuantizedMeasure::cosine:
+	 return (norm1 > 0.0 && norm2 > 0.0) ? dot / (norm1 * norm2) : 0.0 ;
+      case QuantizedMeasure::euclidean:
+	 // |x-y|^2 = |x|^2 + |y|^2 - 2x.y, which is exact for the dequantized vectors since the norms
+	 //   were computed from the quantized values
+	 return 1.0 - std::sqrt(std::max(0.0,norm1 * norm1 + norm2 * norm2 - 2.0 * dot)) ;
+      }
+   return 0.0 ;
+}
+
+//----------------------------------------------------------------------------
+
+// run fn(first,last) over blocks of rows in parallel
+template <typename Fn>
+static void for_row_blocks(size_t rows, Fn fn)
+{
+   size_t blocks = (rows + FrQUANT_BLOCK_SIZE - 1) / FrQUANT_BLOCK_SIZE ;
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,blocks),1,[&](size_t b)
+      {
+      size_t first = b * FrQUANT_BLOCK_SIZE ;
+      fn(first,std::min(rows,first + FrQUANT_BLOCK_SIZE)) ;
+      }) ;
+   return ;
+}
+
+/************************************************************************/
+/*	Methods for template class QuantizedVectors			*/
+/************************************************************************/
+
+template <typename IdxT, typename ValT>
+void QuantizedVectors<IdxT,ValT>::clear()
+{
+   ::free(m_codes) ;
+   m_codes = nullptr ;
+   delete[] m_scales ;
+   m_scales = nullptr ;
+   delete[] m_norms ;
+   m_norms = nullptr ;
+   delete[] m_cosines ;
+   m_cosines = nullptr ;
+   m_source = nullptr ;
+   m_size = 0 ;
+   m_dims = 0 ;
+   m_stride = 0 ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool QuantizedVectors<IdxT,ValT>::allocate(size_t rows, size_t dims)
+{
+   size_t bytes ;
+   switch (m_type)
+      {
+      case QuantizationType::int8:
+	 bytes = dims ;
+	 break ;
+      case QuantizationType::float16:
+      case QuantizationType::bfloat16:
+	 bytes = 2 * dims ;
+	 break ;
+      case QuantizationType::binary:
+	 bytes = (dims + 63) / 64 * sizeof(uint64_t) ;
+	 break ;
+      default:
+	 return false ;
+      }
+   m_stride = (bytes + ROW_ALIGN - 1) / ROW_ALIGN * ROW_ALIGN ;
+   if (m_stride && rows > ~(size_t)0 / m_stride)
+      return false ;
+   m_codes = alloc_aligned_bytes(rows * m_stride,ROW_ALIGN) ;
+   if (!m_codes)
+      return false ;
+   m_scales = new float[rows] ;
+   m_norms = new float[rows] ;
+   m_size = rows ;
+   m_dims = dims ;
+   if (m_type == QuantizationType::binary)
+      {
+      // the angle between two vectors is estimated as pi times the fraction of differing sign bits,
+      //   so tabulate the cosine for every possible number of differing bits
+      m_cosines = new double[dims+1] ;
+      for (size_t i = 0 ; i <= dims ; ++i)
+	 m_cosines[i] = dims ? std::cos(M_PI * i / dims) : 0.0 ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void QuantizedVectors<IdxT,ValT>::quantize(const float* values, uint8_t* codes, float& scale, float& norm) const
+{
+   // zero the padding, which then contributes nothing to any of the comparisons
+   memset(codes,'\0',m_stride) ;
+   double sumsq(0) ;
+   scale = 1.0f ;
+   switch (m_type)
+      {
+      case QuantizationType::int8:
+	 {
+	 float maxabs = 0.0f ;
+	 for (size_t i = 0 ; i < m_dims ; ++i)
+	    maxabs = std::max(maxabs,std::fabs(values[i])) ;
+	 scale = maxabs / 127.0f ;
+	 if (scale > 0.0f)
+	    {
+	    int8_t* q = reinterpret_cast<int8_t*>(codes) ;
+	    int64_t qsumsq(0) ;
+	    for (size_t i = 0 ; i < m_dims ; ++i)
+	       {
+	       long v = std::lrint(values[i] / scale) ;
+	       q[i] = (int8_t)std::max(-127L,std::min(127L,v)) ;
+	       qsumsq += (int)q[i] * (int)q[i] ;
+	       }
+	    sumsq = (double)scale * scale * qsumsq ;
+	    }
+	 }
+	 break ;
+      case QuantizationType::float16:
+	 {
+	 Float16* q = reinterpret_cast<Float16*>(codes) ;
+	 for (size_t i = 0 ; i < m_dims ; ++i)
+	    {
+	    q[i] = Float16(values[i]) ;
+	    double v = q[i] ;
+	    sumsq += v * v ;
+	    }
+	 }
+	 break ;
+      case QuantizationType::bfloat16:
+	 {
+	 BFloat16* q = reinterpret_cast<BFloat16*>(codes) ;
+	 for (size_t i = 0 ; i < m_dims ; ++i)
+	    {
+	    q[i] = BFloat16(values[i]) ;
+	    double v = q[i] ;
+	    sumsq += v * v ;
+	    }
+	 }
+	 break ;
+      case QuantizationType::binary:
+	 {
+	 uint64_t* bits = reinterpret_cast<uint64_t*>(codes) ;
+	 for (size_t i = 0 ; i < m_dims ; ++i)
+	    {
+	    if (values[i] > 0.0f)
+	       bits[i/64] |= (1ULL << (i%64)) ;
+	    sumsq += (double)values[i] * values[i] ;
+	    }
+	 }
+	 break ;
+      }
+   norm = (float)std::sqrt(sumsq) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool QuantizedVectors<IdxT,ValT>::load(const Array* vectors)
+{
+   clear() ;
+   if (!vectors)
+      return false ;
+   size_t N = vectors->size() ;
+   size_t dims = 0 ;
+   for (size_t i = 0 ; i < N ; ++i)
+      {
+      const Object* obj = vectors->getNth(i) ;
+      if (obj && obj->isVector())
+	 dims = std::max(dims,vector_dimensions(static_cast<const vec_type*>(obj))) ;
+      }
+   if (!allocate(N,dims))
+      {
+      clear() ;
+      return false ;
+      }
+   m_source = vectors ;
+   for_row_blocks(N,[&](size_t first, size_t last)
+      {
+      std::vector<float> dense(m_dims) ;
+      for (size_t i = first ; i < last ; ++i)
+	 {
+	 const Object* obj = vectors->getNth(i) ;
+	 if (obj && obj->isVector())
+	    {
+	    expand_vector(static_cast<const vec_type*>(obj),dense.data(),m_dims) ;
+	    quantize(dense.data(),m_codes + i * m_stride,m_scales[i],m_norms[i]) ;
+	    }
+	 else
+	    {
+	    memset(m_codes + i * m_stride,'\0',m_stride) ;
+	    m_scales[i] = 0.0f ;
+	    m_norms[i] = -1.0f ;
+	    }
+	 }
+      }) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool QuantizedVectors<IdxT,ValT>::load(const VectorCollection<IdxT,ValT>& coll)
+{
+   clear() ;
+   if (!coll || !allocate(coll.size(),coll.dimensions()))
+      {
+      clear() ;
+      return false ;
+      }
+   m_source = coll.source() ;
+   for_row_blocks(m_size,[&](size_t first, size_t last)
+      {
+      std::vector<float> dense(m_dims) ;
+      for (size_t i = first ; i < last ; ++i)
+	 {
+	 if (!coll.present(i))
+	    {
+	    memset(m_codes + i * m_stride,'\0',m_stride) ;
+	    m_scales[i] = 0.0f ;
+	    m_norms[i] = -1.0f ;
+	    continue ;
+	    }
+	 const ValT* values = coll.rowValues(i) ;
+	 if (coll.sparse())
+	    {
+	    std::fill(dense.begin(),dense.end(),0.0f) ;
+	    const IdxT* indices = coll.rowIndices(i) ;
+	    for (size_t j = 0 ; j < coll.rowLength(i) ; ++j)
+	       dense[indices[j]] = (float)values[j] ;
+	    }
+	 else
+	    {
+	    for (size_t j = 0 ; j < m_dims ; ++j)
+	       dense[j] = (float)values[j] ;
+	    }
+	 quantize(dense.data(),m_codes + i * m_stride,m_scales[i],m_norms[i]) ;
+	 }
+      }) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool QuantizedVectors<IdxT,ValT>::encode(const vec_type* vector, Query& query) const
+{
+   if (!vector || !m_codes)
+      return false ;
+   if (query.m_capacity < m_stride || !query.m_codes)
+      {
+      ::free(query.m_codes) ;
+      query.m_codes = alloc_aligned_bytes(m_stride,ROW_ALIGN) ;
+      query.m_capacity = query.m_codes ? m_stride : 0 ;
+      if (!query.m_codes)
+	 return false ;
+      }
+   std::vector<float> dense(m_dims) ;
+   expand_vector(vector,dense.data(),m_dims) ;
+   quantize(dense.data(),query.m_codes,query.m_scale,query.m_norm) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+double QuantizedVectors<IdxT,ValT>::similarity(const Query& query, size_t N, QuantizedMeasure measure) const
+{
+   double sim ;
+   return similarities(query,measure,N,N+1,&sim) ? sim : 0.0 ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool QuantizedVectors<IdxT,ValT>::similarities(const Query& query, QuantizedMeasure measure, size_t first,
+   size_t last, double* out) const
+{
+   if (!query || !m_codes || !out || first > last || last > m_size)
+      return false ;
+   // dispatch on the storage format once rather than once per row
+   double qnorm = query.m_norm ;
+   switch (m_type)
+      {
+      case QuantizationType::int8:
+	 {
+	 auto q = reinterpret_cast<const int8_t*>(query.m_codes) ;
+	 for (size_t i = first ; i < last ; ++i)
+	    {
+	    if (m_norms[i] < 0.0f)
+	       {
+	       *out++ = 0.0 ;
+	       continue ;
+	       }
+	    double dot = query.m_scale * (double)m_scales[i]
+	       * simd_dot_product(q,reinterpret_cast<const int8_t*>(row(i)),m_dims) ;
+	    *out++ = finish_similarity(measure,dot,qnorm,m_norms[i]) ;
+	    }
+	 }
+	 break ;
+      case QuantizationType::float16:
+	 half_similarities(reinterpret_cast<const Float16*>(query.m_codes),measure,qnorm,first,last,out) ;
+	 break ;
+      case QuantizationType::bfloat16:
+	 half_similarities(reinterpret_cast<const BFloat16*>(query.m_codes),measure,qnorm,first,last,out) ;
+	 break ;
+      case QuantizationType::binary:
+	 {
+	 auto q = reinterpret_cast<const uint64_t*>(query.m_codes) ;
+	 size_t nwords = m_stride / sizeof(uint64_t) ;
+	 for (size_t i = first ; i < last ; ++i)
+	    {
+	    if (m_norms[i] < 0.0f)
+	       {
+	       *out++ = 0.0 ;
+	       continue ;
+	       }
+	    double cosine = m_cosines[simd_hamming_distance(q,reinterpret_cast<const uint64_t*>(row(i)),nwords)] ;
+	    *out++ = (measure == QuantizedMeasure::cosine)
+	       ? cosine : finish_similarity(measure,cosine*qnorm*m_norms[i],qnorm,m_norms[i]) ;
+	    }
+	 }
+	 break ;
+      default:
+	 return false ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+template <typename T>
+void QuantizedVectors<IdxT,ValT>::half_similarities(const T* query, QuantizedMeasure measure, double qnorm,
+   size_t first, size_t last, double* out) const
+{
+   for (size_t i = first ; i < last ; ++i)
+      {
+      if (m_norms[i] < 0.0f)
+	 *out++ = 0.0 ;
+      else if (measure == QuantizedMeasure::euclidean)
+	 {
+	 // compute the distance directly, which avoids the cancellation in |x|^2 + |y|^2 - 2x.y
+	 *out++ = 1.0 - std::sqrt(simd_squared_distance(query,reinterpret_cast<const T*>(row(i)),m_dims)) ;
+	 }
+      else
+	 {
+	 double dot = simd_dot_product(query,reinterpret_cast<const T*>(row(i)),m_dims) ;
+	 *out++ = finish_similarity(measure,dot,qnorm,m_norms[i]) ;
+	 }
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t QuantizedVectors<IdxT,ValT>::nearest(const vec_type* query, size_t k, ANNResult* results,
+   QuantizedMeasure measure, const VectorMeasure<IdxT,ValT>* exact, size_t candidates) const
+{
+   Query q ;
+   if (k == 0 || !results || !encode(query,q))
+      return 0 ;
+   bool rescore = exact && m_source ;
+   size_t wanted = rescore ? std::max(k,candidates ? candidates : FrQUANT_RESCORE_FACTOR * k) : k ;
+   std::vector<double> scores(m_size) ;
+   for_row_blocks(m_size,[&](size_t first, size_t last)
+      {
+      similarities(q,measure,first,last,scores.data() + first) ;
+      }) ;
+   // keep the best 'wanted' rows in a heap whose top is the worst of them
+   auto better = [](const ANNResult& a, const ANNResult& b)
+      { return a.sim > b.sim || (a.sim == b.sim && a.id < b.id) ; } ;
+   std::vector<ANNResult> best ;
+   best.reserve(wanted) ;
+   for (size_t i = 0 ; i < m_size ; ++i)
+      {
+      if (!present(i))
+	 continue ;
+      if (best.size() < wanted)
+	 {
+	 best.push_back(ANNResult{i,scores[i]}) ;
+	 std::push_heap(best.begin(),best.end(),better) ;
+	 }
+      else if (scores[i] > best.front().sim)
+	 {
+	 std::pop_heap(best.begin(),best.end(),better) ;
+	 best.back() = ANNResult{i,scores[i]} ;
+	 std::push_heap(best.begin(),best.end(),better) ;
+	 }
+      }
+   if (rescore)
+      {
+      ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,best.size()),16,[&](size_t i)
+	 {
+	 const vec_type* v = vector(best[i].id) ;
+	 best[i].sim = v ? exact->similarity(query,v) : -HUGE_VAL ;
+	 }) ;
+      }
+   std::sort(best.begin(),best.end(),better) ;
+   k = std::min(k,best.size()) ;
+   std::copy(best.begin(),best.begin()+k,results) ;
+   return k ;
+}
+
+//----------------------------------------------------------------------------
+
+} // end namespace Fr
+
+// end of file quantvec.cc //
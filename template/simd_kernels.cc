@@ -0,0 +1,316 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.14, last edit 2019-07-07					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+// This file is included by src/simd.C once per instruction set, inside a namespace which
+//   defines the structures FloatOps and DoubleOps wrapping the intrinsics for that instruction
+//   set.  Each kernel processes two registers' worth of elements per iteration to hide the
+//   latency of the adds, then finishes any leftover elements with scalar code.  HalfOps and
+//   BFloat16Ops are FloatOps whose load() widens reduced-precision values, so they reuse the
+//   float kernels, while Int8Ops and BitOps provide the integer operations for the byte and
+//   bit-vector kernels.
+
+/************************************************************************/
+/************************************************************************/
+
+template <typename Ops>
+double dot_product(const typename Ops::value_type* x, const typename Ops::value_type* y, size_t n)
+{
+   const size_t W = Ops::width ;
+   auto sum0 = Ops::zero() ;
+   auto sum1 = Ops::zero() ;
+   size_t i = 0 ;
+   for ( ; i + 2*W <= n ; i += 2*W)
+      {
+      sum0 = Ops::fmadd(Ops::load(x+i),Ops::load(y+i),sum0) ;
+      sum1 = Ops::fmadd(Ops::load(x+i+W),Ops::load(y+i+W),sum1) ;
+      }
+   if (i + W <= n)
+      {
+      sum0 = Ops::fmadd(Ops::load(x+i),Ops::load(y+i),sum0) ;
+      i += W ;
+      }
+   double sum = Ops::hsum(Ops::add(sum0,sum1)) ;
+   for ( ; i < n ; ++i)
+      sum += (double)x[i] * (double)y[i] ;
+   return sum ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename Ops>
+double squared_distance(const typename Ops::value_type* x, const typename Ops::value_type* y, size_t n)
+{
+   const size_t W = Ops::width ;
+   auto sum0 = Ops::zero() ;
+   auto sum1 = Ops::zero() ;
+   size_t i = 0 ;
+   for ( ; i + 2*W <= n ; i += 2*W)
+      {
+      auto diff0 = Ops::sub(Ops::load(x+i),Ops::load(y+i)) ;
+      auto diff1 = Ops::sub(Ops::load(x+i+W),Ops::load(y+i+W)) ;
+      sum0 = Ops::fmadd(diff0,diff0,sum0) ;
+      sum1 = Ops::fmadd(diff1,diff1,sum1) ;
+      }
+   if (i + W <= n)
+      {
+      auto diff = Ops::sub(Ops::load(x+i),Ops::load(y+i)) ;
+      sum0 = Ops::fmadd(diff,diff,sum0) ;
+      i += W ;
+      }
+   double sum = Ops::hsum(Ops::add(sum0,sum1)) ;
+   for ( ; i < n ; ++i)
+      {
+      double diff = (double)x[i] - (double)y[i] ;
+      sum += diff * diff ;
+      }
+   return sum ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename Ops>
+double abs_difference(const typename Ops::value_type* x, const typename Ops::value_type* y, size_t n,
+   double s1, double s2)
+{
+   const size_t W = Ops::width ;
+   auto scale1 = Ops::set1(s1) ;
+   auto scale2 = Ops::set1(s2) ;
+   auto sum0 = Ops::zero() ;
+   auto sum1 = Ops::zero() ;
+   size_t i = 0 ;
+   for ( ; i + 2*W <= n ; i += 2*W)
+      {
+      auto diff0 = Ops::sub(Ops::mul(scale1,Ops::load(x+i)),Ops::mul(scale2,Ops::load(y+i))) ;
+      auto diff1 = Ops::sub(Ops::mul(scale1,Ops::load(x+i+W)),Ops::mul(scale2,Ops::load(y+i+W))) ;
+      sum0 = Ops::add(sum0,Ops::abs(diff0)) ;
+      sum1 = Ops::add(sum1,Ops::abs(diff1)) ;
+      }
+   if (i + W <= n)
+      {
+      auto diff = Ops::sub(Ops::mul(scale1,Ops::load(x+i)),Ops::mul(scale2,Ops::load(y+i))) ;
+      sum0 = Ops::add(sum0,Ops::abs(diff)) ;
+      i += W ;
+      }
+   double sum = Ops::hsum(Ops::add(sum0,sum1)) ;
+   for ( ; i < n ; ++i)
+      sum += std::fabs(s1 * x[i] - s2 * y[i]) ;
+   return sum ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename Ops>
+double min_sum(const typename Ops::value_type* x, const typename Ops::value_type* y, size_t n,
+   double s1, double s2)
+{
+   const size_t W = Ops::width ;
+   auto scale1 = Ops::set1(s1) ;
+   auto scale2 = Ops::set1(s2) ;
+   auto sum0 = Ops::zero() ;
+   auto sum1 = Ops::zero() ;
+   size_t i = 0 ;
+   for ( ; i + 2*W <= n ; i += 2*W)
+      {
+      sum0 = Ops::add(sum0,Ops::min(Ops::mul(scale1,Ops::load(x+i)),Ops::mul(scale2,Ops::load(y+i)))) ;
+      sum1 = Ops::add(sum1,Ops::min(Ops::mul(scale1,Ops::load(x+i+W)),Ops::mul(scale2,Ops::load(y+i+W)))) ;
+      }
+   if (i + W <= n)
+      {
+      sum0 = Ops::add(sum0,Ops::min(Ops::mul(scale1,Ops::load(x+i)),Ops::mul(scale2,Ops::load(y+i)))) ;
+      i += W ;
+      }
+   double sum = Ops::hsum(Ops::add(sum0,sum1)) ;
+   for ( ; i < n ; ++i)
+      sum += std::fmin(s1 * x[i], s2 * y[i]) ;
+   return sum ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename Ops>
+double sum(const typename Ops::value_type* x, size_t n)
+{
+   const size_t W = Ops::width ;
+   auto sum0 = Ops::zero() ;
+   auto sum1 = Ops::zero() ;
+   size_t i = 0 ;
+   for ( ; i + 2*W <= n ; i += 2*W)
+      {
+      sum0 = Ops::add(sum0,Ops::load(x+i)) ;
+      sum1 = Ops::add(sum1,Ops::load(x+i+W)) ;
+      }
+   if (i + W <= n)
+      {
+      sum0 = Ops::add(sum0,Ops::load(x+i)) ;
+      i += W ;
+      }
+   double total = Ops::hsum(Ops::add(sum0,sum1)) ;
+   for ( ; i < n ; ++i)
+      total += x[i] ;
+   return total ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename Ops>
+double sum_of_squares(const typename Ops::value_type* x, size_t n)
+{
+   const size_t W = Ops::width ;
+   auto sum0 = Ops::zero() ;
+   auto sum1 = Ops::zero() ;
+   size_t i = 0 ;
+   for ( ; i + 2*W <= n ; i += 2*W)
+      {
+      auto val0 = Ops::load(x+i) ;
+      auto val1 = Ops::load(x+i+W) ;
+      sum0 = Ops::fmadd(val0,val0,sum0) ;
+      sum1 = Ops::fmadd(val1,val1,sum1) ;
+      }
+   if (i + W <= n)
+      {
+      auto val = Ops::load(x+i) ;
+      sum0 = Ops::fmadd(val,val,sum0) ;
+      i += W ;
+      }
+   double total = Ops::hsum(Ops::add(sum0,sum1)) ;
+   for ( ; i < n ; ++i)
+      total += (double)x[i] * (double)x[i] ;
+   return total ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename Ops>
+int64_t int8_dot_product(const int8_t* x, const int8_t* y, size_t n)
+{
+   // each 32-bit lane gains at most 2**15 per step, so fold the lanes into the total every BLOCK
+   //   elements, long before they could overflow
+   const size_t W = Ops::width ;
+   const size_t BLOCK = 65536 ;
+   int64_t total(0) ;
+   size_t i = 0 ;
+   while (i + W <= n)
+      {
+      size_t limit = std::min(n,i+BLOCK) ;
+      auto sum0 = Ops::zero() ;
+      auto sum1 = Ops::zero() ;
+      for ( ; i + 2*W <= limit ; i += 2*W)
+	 {
+	 sum0 = Ops::add(sum0,Ops::madd(Ops::load(x+i),Ops::load(y+i))) ;
+	 sum1 = Ops::add(sum1,Ops::madd(Ops::load(x+i+W),Ops::load(y+i+W))) ;
+	 }
+      if (i + W <= limit)
+	 {
+	 sum0 = Ops::add(sum0,Ops::madd(Ops::load(x+i),Ops::load(y+i))) ;
+	 i += W ;
+	 }
+      total += Ops::hsum(Ops::add(sum0,sum1)) ;
+      }
+   for ( ; i < n ; ++i)
+      total += (int)x[i] * (int)y[i] ;
+   return total ;
+}
+
+//----------------------------------------------------------------------------
+
+// (a function rather than a lambda, since lambdas don't pick up the instruction set's target pragma;
+//   always inlined, so that vector registers are never passed between functions)
+template <typename Ops, bool use_and>
+[[gnu::always_inline]] inline typename Ops::reg combine_bits(typename Ops::reg a, typename Ops::reg b)
+{
+   return use_and ? Ops::band(a,b) : Ops::bxor(a,b) ;
+}
+
+//----------------------------------------------------------------------------
+
+// count the bits set in the XOR (for Hamming distances) or AND (for binary contingency tables)
+//   of two bit arrays
+template <typename Ops, bool use_and>
+size_t count_bits(const uint64_t* x, const uint64_t* y, size_t n)
+{
+   const size_t W = Ops::width ;
+   auto sum0 = Ops::zero() ;
+   auto sum1 = Ops::zero() ;
+   size_t i = 0 ;
+   for ( ; i + 2*W <= n ; i += 2*W)
+      {
+      sum0 = Ops::add(sum0,Ops::popcount(combine_bits<Ops,use_and>(Ops::load(x+i),Ops::load(y+i)))) ;
+      sum1 = Ops::add(sum1,Ops::popcount(combine_bits<Ops,use_and>(Ops::load(x+i+W),Ops::load(y+i+W)))) ;
+      }
+   if (i + W <= n)
+      {
+      sum0 = Ops::add(sum0,Ops::popcount(combine_bits<Ops,use_and>(Ops::load(x+i),Ops::load(y+i)))) ;
+      i += W ;
+      }
+   size_t total = Ops::hsum(Ops::add(sum0,sum1)) ;
+   for ( ; i < n ; ++i)
+      total += __builtin_popcountll(use_and ? (x[i] & y[i]) : (x[i] ^ y[i])) ;
+   return total ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename Ops>
+size_t hamming_distance(const uint64_t* x, const uint64_t* y, size_t n)
+{
+   return count_bits<Ops,false>(x,y,n) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename Ops>
+size_t and_popcount(const uint64_t* x, const uint64_t* y, size_t n)
+{
+   return count_bits<Ops,true>(x,y,n) ;
+}
+
+//----------------------------------------------------------------------------
+
+// compare one bit array against 'count' rows spaced 'stride' words apart, so that a batch of
+//   comparisons needs only a single call through the kernel table
+template <typename Ops>
+void and_popcounts(const uint64_t* x, const uint64_t* rows, size_t stride, size_t count, size_t n, size_t* counts)
+{
+   for (size_t k = 0 ; k < count ; ++k)
+      counts[k] = count_bits<Ops,true>(x,rows + k * stride,n) ;
+   return ;
+}
+
+/************************************************************************/
+/************************************************************************/
+
+const SimdKernels kernels =
+   {
+   dot_product<FloatOps>, dot_product<DoubleOps>,
+   squared_distance<FloatOps>, squared_distance<DoubleOps>,
+   abs_difference<FloatOps>, abs_difference<DoubleOps>,
+   min_sum<FloatOps>, min_sum<DoubleOps>,
+   sum<FloatOps>, sum<DoubleOps>,
+   sum_of_squares<FloatOps>, sum_of_squares<DoubleOps>,
+   int8_dot_product<Int8Ops>,
+   dot_product<HalfOps>, dot_product<BFloat16Ops>,
+   squared_distance<HalfOps>, squared_distance<BFloat16Ops>,
+   hamming_distance<BitOps>,
+   and_popcount<BitOps>,
+   and_popcounts<BitOps>
+   } ;
+
+// end of file simd_kernels.cc //
@@ -19,6 +19,7 @@
 /*									*/
 /************************************************************************/
 
+#include <algorithm>
 #include <cstring>
 #include <vector>
 #include "framepac/bitvector.h"
@@ -28,6 +29,18 @@
 /************************************************************************/
 /************************************************************************/
 
+// don't bother splitting scans of fewer elements than this among multiple threads
+#define FrSA_PARALLEL_MIN (1U<<20)
+
+// the number of suffix-array slots processed per block by the parallel induced sorting
+#define FrSA_INDUCE_BLOCK (1U<<18)
+
+// LCP array entries of at least this value are stored in a separate overflow table
+#define FrSA_LCP_ESCAPE 255U
+
+/************************************************************************/
+/************************************************************************/
+
 namespace Fr {
 
 // Suffix array construction code adapted/optimized from
@@ -44,70 +57,147 @@ namespace Fr {
 // special case for EOL markers, since they can encode line numbers
 template <typename IdT, typename IdxT>
 template <typename I>
-IdT SuffixArray<IdT,IdxT>::convertEOL(I id, IdT num_types) const
+IdxT SuffixArray<IdT,IdxT>::convertEOL(I id, IdxT num_types) const
 {
-   return (id >= num_types) ? I(m_newline) : id ;
+   return ((size_t)id >= (size_t)num_types) ? IdxT(m_newline) : IdxT(id) ;
 }
 
 //----------------------------------------------------------------------------
 
+// pick the chunk size for splitting a scan of N elements among the threads of the default pool, or
+//   return N if the scan is too small to be worth parallelizing; chunks are a multiple of 64 elements so
+//   that concurrent setBit() calls on a BitVector never modify the same word
+static size_t sa_chunk_size(size_t N)
+{
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   size_t nt = tp ? tp->numThreads() : 0 ;
+   if (nt < 2 || N < FrSA_PARALLEL_MIN)
+      return N ? N : 1 ;
+   return ((N / (4*nt)) + 63) & ~(size_t)63 ;
+}
+
+//----------------------------------------------------------------------------
+
+// invoke fn(chunk_number,start,stop) on each chunk of the range [0,N)
+template <typename Fn>
+static void sa_for_chunks(size_t N, size_t chunk_size, Fn fn)
+{
+   size_t num_chunks = (N + chunk_size - 1) / chunk_size ;
+   if (num_chunks > 1)
+      {
+      ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,num_chunks),1,[&](size_t c)
+	 {
+	 fn(c,c*chunk_size,std::min(N,(c+1)*chunk_size)) ;
+	 }) ;
+      }
+   else if (N > 0)
+      fn(0,0,N) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+// storage for the bucket boundaries used during construction; to limit peak memory use, the
+//   boundaries are placed in spare space within the suffix array whenever it is large enough
+template <typename IdxT>
+class SABucketStore
+   {
+   public:
+      SABucketStore(size_t size, bool with_ends, IdxT* workspace, size_t workspace_size)
+	 {
+	 size_t needed = with_ends ? 2*size : size ;
+	 if (needed <= workspace_size)
+	    m_starts = workspace ;
+	 else
+	    m_starts = m_alloc = new IdxT[needed] ;
+	 m_ends = with_ends ? m_starts + size : nullptr ;
+	 }
+      SABucketStore(const SABucketStore&) = delete ;
+      ~SABucketStore() { delete[] m_alloc ; }
+      SABucketStore& operator= (const SABucketStore&) = delete ;
+
+      IdxT* starts() const { return m_starts ; }
+      IdxT* ends() const { return m_ends ; }
+
+   private:
+      IdxT* m_alloc { nullptr } ;
+      IdxT* m_starts ;
+      IdxT* m_ends ;
+   } ;
+
+//----------------------------------------------------------------------------
+
 template <typename IdT, typename IdxT>
 template <typename I>
-IdxT* SuffixArray<IdT,IdxT>::bucketBoundaries(const I* ids, IdxT num_ids, IdT num_types, const IdxT* freqs)
+void SuffixArray<IdT,IdxT>::bucketBoundaries(IdxT* buckets, const I* ids, IdxT num_ids, IdxT num_types,
+   const IdxT* freqs, bool bucket_ends)
 {
-   // allocate and clear buckets
-   IdxT* buckets = new IdxT[num_types+1] ;
-   if (buckets)
+   if (!freqs)
       {
-      std::fill(buckets,buckets+num_types+1,0) ;
-      if (!freqs)
+      // accumulate bucket sizes
+      std::fill(buckets,buckets+num_types+1,IdxT(0)) ;
+      ThreadPool* tp = ThreadPool::defaultPool() ;
+      size_t nt = tp ? tp->numThreads() : 0 ;
+      if (nt > 1 && num_ids >= FrSA_PARALLEL_MIN && num_types <= num_ids / (8*nt))
+	 {
+	 // count each chunk into a private histogram and then merge that into the shared one, to
+	 //   avoid contention on the buckets of frequent IDs; the grain size ensures that each chunk
+	 //   is large compared to the histogram, so the merges are cheap enough to serialize
+	 CriticalSection merge_guard ;
+	 tp->parallel_for_chunks(Range<size_t>(0,num_ids),4*(size_t)num_types,[&](Range<size_t> chunk)
+	    {
+	    LocalAlloc<IdxT> counts(num_types+1,true) ;
+	    for (auto i : chunk)
+	       {
+	       IdxT id = convertEOL(ids[i],num_types) ;
+	       ++counts[id] ;
+	       }
+	    merge_guard.lock() ;
+	    for (size_t id = 0 ; id <= num_types ; ++id)
+	       {
+	       buckets[id] += counts[id] ;
+	       }
+	    merge_guard.unlock() ;
+	    }) ;
+	 }
+      else
 	 {
-	 // accumulate bucket sizes
-	 // TODO: parallelize this loop
 	 for (IdxT i = 0 ; i < num_ids ; ++i)
 	    {
-	    IdT id = convertEOL(ids[i],num_types) ;
+	    IdxT id = convertEOL(ids[i],num_types) ;
 	    ++buckets[id] ;
 	    }
-	 freqs = buckets ;
-	 }
-      // convert per-bucket counts into running totals such that
-      //   buckets[i] is the start of the ith bucket, and buckets[i+1]
-      //   points just past the bucket's end
-      IdxT total = 0 ;
-      for (IdxT i = 0 ; i < num_types ; ++i)
-	 {
-	 IdxT bcount = freqs[i] ;
-	 buckets[i] = total ;
-	 total += bcount ;
 	 }
-      buckets[num_types] = total ;
+      freqs = buckets ;
       }
-   return buckets ;
-}
-
-//----------------------------------------------------------------------------
-
-template <typename IdT, typename IdxT>
-IdxT* SuffixArray<IdT,IdxT>::copyBucketBoundaries(const IdxT* bounds, IdT num_types)
-{
-   // make a copy of the bucket positions
-   IdxT* copy = new IdxT[num_types+1] ;
-   if (copy)
+   // convert per-bucket counts into running totals such that buckets[i] is the start of the ith
+   //   bucket (or if 'bucket_ends' is set, points just past the bucket's end), and buckets[num_types]
+   //   is the total size of all buckets
+   size_t total = 0 ;
+   for (size_t i = 0 ; i < num_types ; ++i)
       {
-      std::copy(bounds,bounds+num_types,copy) ;
+      size_t bcount = freqs[i] ;
+      buckets[i] = bucket_ends ? total + bcount : total ;
+      total += bcount ;
       }
-   return copy ;
+   buckets[num_types] = total ;
+   return ;
 }
 
 //----------------------------------------------------------------------------
 
 template <typename IdT, typename IdxT>
 template <typename I>
-void SuffixArray<IdT,IdxT>::induce(const I* ids, IdxT* SA, IdxT num_ids, IdT num_types, IdxT* buckets,
-	    const Fr::BitVector& ls_types)
+void SuffixArray<IdT,IdxT>::induce(const I* ids, IdxT* SA, IdxT num_ids, IdxT num_types, IdxT* buckets,
+   IdxT* bucket_ends, const IdxT* freqs, const Fr::BitVector& ls_types)
 {
-   LocalAlloc<IdxT,1> bucket_ends { copyBucketBoundaries(buckets+1,num_types) } ;
+   // on entry, 'buckets' holds the bucket starts; 'bucket_ends' holds the bucket ends, or is null if the
+   //   ends should be recomputed into 'buckets' once the starts are no longer needed
+   if (sa_chunk_size(num_ids) < num_ids)
+      {
+      induceParallel(ids,SA,num_ids,num_types,buckets,bucket_ends,freqs,ls_types) ;
+      return ;
+      }
    // induce on bucket starts (SAl in original paper)
    for (IdxT i = 0 ; i < num_ids ; ++i)
       {
@@ -122,7 +212,11 @@ void SuffixArray<IdT,IdxT>::induce(const I* ids, IdxT* SA, IdxT num_ids, IdT num
 	 ++buckets[bck] ;
 	 }
       }
-   delete[] buckets ;
+   if (!bucket_ends)
+      {
+      bucketBoundaries(buckets,ids,num_ids,num_types,freqs,true) ;
+      bucket_ends = buckets ;
+      }
    // induce on bucket ends (SAs in original paper)
    for (IdxT i = num_ids ; i > 0 ; --i)
       {
@@ -143,23 +237,137 @@ void SuffixArray<IdT,IdxT>::induce(const I* ids, IdxT* SA, IdxT num_ids, IdT num
 
 template <typename IdT, typename IdxT>
 template <typename I>
-void SuffixArray<IdT,IdxT>::classifyLS(Fr::BitVector& ls_types, const I* ids, IdxT num_ids, IdT num_types)
+void SuffixArray<IdT,IdxT>::induceParallel(const I* ids, IdxT* SA, IdxT num_ids, IdxT num_types,
+   IdxT* buckets, IdxT* bucket_ends, const IdxT* freqs, const Fr::BitVector& ls_types)
+{
+   // Each pass scans the suffix array in blocks.  The threads first look up the ID and type of the
+   //   predecessor of every suffix already present in the block, which is where the sequential scan
+   //   spends most of its time waiting on cache misses, and then a single thread performs the actual
+   //   insertions.  A slot which has been filled or overwritten since its lookup is simply looked up
+   //   again, so the result is identical to that of the sequential scan.  See
+   //   Julian Labeit, Julian Shun, and Guy E. Blelloch.  Parallel Lightweight Wavelet Tree, Suffix
+   //      Array and FM-Index Construction.  Data Compression Conference (DCC 2015).
+   struct Pending
+      {
+      IdxT suffix ;
+      IdxT bucket ;
+      } ;
+   const size_t unfilled = (size_t)IdxT(-1) ;
+   size_t N = num_ids ;
+   size_t block_size = std::min(N,(size_t)FrSA_INDUCE_BLOCK) ;
+   NewPtr<Pending> pending(block_size) ;
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   size_t grain = std::max(block_size / (4*tp->numThreads()),(size_t)1024) ;
+   // get the bucket into which the predecessor of suffix 'j' gets inserted if it has the requested type
+   auto predecessor = [&](size_t j, bool s_type) -> size_t
+      {
+      if (j == unfilled || j == 0 || ls_types.getBit(j-1) != s_type)
+	 return unfilled ;
+      return convertEOL(ids[j-1],num_types) ;
+      } ;
+   auto lookup = [&](size_t start, size_t stop, bool s_type)
+      {
+      tp->parallel_for_chunks(Range<size_t>(start,stop),grain,[&](Range<size_t> chunk)
+	 {
+	 for (auto i : chunk)
+	    {
+	    size_t j = SA[i] ;
+	    pending[i-start].suffix = j ;
+	    pending[i-start].bucket = predecessor(j,s_type) ;
+	    }
+	 }) ;
+      } ;
+   // induce on bucket starts (SAl in original paper)
+   for (size_t start = 0 ; start < N ; start += block_size)
+      {
+      size_t stop = std::min(N,start+block_size) ;
+      lookup(start,stop,false) ;
+      for (size_t i = start ; i < stop ; ++i)
+	 {
+	 size_t j = SA[i] ;
+	 const Pending& p = pending[i-start] ;
+	 size_t bck = (j == (size_t)p.suffix) ? (size_t)p.bucket : predecessor(j,false) ;
+	 if (bck != unfilled)
+	    {
+	    SA[buckets[bck]] = j - 1 ;
+	    ++buckets[bck] ;
+	    }
+	 }
+      }
+   if (!bucket_ends)
+      {
+      bucketBoundaries(buckets,ids,num_ids,num_types,freqs,true) ;
+      bucket_ends = buckets ;
+      }
+   // induce on bucket ends (SAs in original paper)
+   for (size_t stop = N ; stop > 0 ; )
+      {
+      size_t start = (stop > block_size) ? stop - block_size : 0 ;
+      lookup(start,stop,true) ;
+      for (size_t i = stop ; i > start ; --i)
+	 {
+	 size_t j = SA[i-1] ;
+	 const Pending& p = pending[i-1-start] ;
+	 size_t bck = (j == (size_t)p.suffix) ? (size_t)p.bucket : predecessor(j,true) ;
+	 if (bck != unfilled)
+	    SA[--bucket_ends[bck]] = j - 1 ;
+	 }
+      stop = start ;
+      }
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+template <typename I>
+void SuffixArray<IdT,IdxT>::classifyLS(Fr::BitVector& ls_types, const I* ids, IdxT num_ids, IdxT num_types)
 {
    // classify elements of 'ids' array
    ls_types.setBit(num_ids+1,true) ;
    ls_types.setBit(num_ids,false) ;
    ls_types.setBit(num_ids-1,true) ;
-   bool bit = true ;
-   if (num_ids >= 2)
+   if (num_ids < 2)
+      return ;
+   // the type of a position depends on that of its successor only if both have the same ID, so each
+   //   chunk can be classified independently except for a run of identical IDs at its end, which takes
+   //   on the type of the first position in the following chunk
+   size_t last = num_ids - 1 ;
+   size_t chunk_size = sa_chunk_size(last) ;
+   size_t num_chunks = (last + chunk_size - 1) / chunk_size ;
+   LocalAlloc<size_t> run_start(num_chunks) ;
+   sa_for_chunks(last,chunk_size,[&](size_t c, size_t start, size_t stop)
       {
-      IdxT id2 = convertEOL(ids[num_ids-1],num_types) ;
-      for (IdxT i = num_ids-1 ; i > 0 ; --i)
+      bool known = (stop == last) ;
+      bool bit = true ;
+      IdxT id2 = convertEOL(ids[stop],num_types) ;
+      size_t run = stop ;
+      for (size_t i = stop ; i > start ; --i)
 	 {
 	 IdxT id1 = convertEOL(ids[i-1],num_types) ;
-	 bit = (id1 < id2 || (id1 == id2 && bit)) ;
-	 ls_types.setBit(i-1,bit) ;
+	 if (id1 != id2)
+	    {
+	    bit = (id1 < id2) ;
+	    known = true ;
+	    }
+	 if (known)
+	    ls_types.setBit(i-1,bit) ;
+	 else
+	    run = i-1 ;
 	 id2 = id1 ;
 	 }
+      run_start[c] = run ;
+      }) ;
+   // fill in the trailing runs, working backwards since a run may span an entire chunk
+   for (size_t c = num_chunks ; c > 0 ; --c)
+      {
+      size_t stop = std::min(last,c*chunk_size) ;
+      if (run_start[c-1] < stop)
+	 {
+	 bool bit = ls_types.getBit(stop) ;
+	 for (size_t i = run_start[c-1] ; i < stop ; ++i)
+	    ls_types.setBit(i,bit) ;
+	 }
       }
    return ;
 }
@@ -168,17 +376,87 @@ void SuffixArray<IdT,IdxT>::classifyLS(Fr::BitVector& ls_types, const I* ids, Id
 
 template <typename IdT, typename IdxT>
 template <typename I>
-bool SuffixArray<IdT,IdxT>::Create(const I* ids, IdxT* index, IdxT num_ids, IdT num_types, const IdxT* freqs)
+IdxT SuffixArray<IdT,IdxT>::nameSubstrings(const I* ids, IdxT* index, IdxT subsize, IdxT num_types,
+   const Fr::BitVector& ls_types)
+{
+   // the sorted LMS substrings are in index[0..subsize); determine which ones differ from their
+   //   predecessor in sorted order (this is independent for each substring, so it can proceed in
+   //   parallel), then assign lexicographic names, storing them in the now-spare part of the suffix
+   //   array
+   ScopedObject<BitVector> new_name(subsize) ;
+   sa_for_chunks(subsize,sa_chunk_size(subsize),[&](size_t, size_t start, size_t stop)
+      {
+      for (size_t i = start ; i < stop ; ++i)
+	 {
+	 if (i == 0)
+	    {
+	    new_name->setBit(i,true) ;
+	    continue ;
+	    }
+	 size_t pos = index[i] ;
+	 size_t prev = index[i-1] ;
+	 bool diff = false ;
+	 bool last_pos_bit = true ;
+	 bool last_prev_bit = true ;
+	 for (size_t d = 0 ; ; ++d)
+	    {
+	    if (convertEOL(ids[pos+d],num_types) != convertEOL(ids[prev+d],num_types))
+	       {
+	       diff = true ;
+	       break ;
+	       }
+	    bool pos_bit = ls_types.getBit(pos+d) ;
+	    bool prev_bit = ls_types.getBit(prev+d) ;
+	    if (pos_bit != prev_bit)
+	       {
+	       diff = true ;
+	       break ;
+	       }
+	    else if ((pos_bit && !last_pos_bit) || (prev_bit && !last_prev_bit))
+	       {
+	       break ;
+	       }
+	    last_pos_bit = pos_bit ;
+	    last_prev_bit = prev_bit ;
+	    }
+	 new_name->setBit(i,diff) ;
+	 }
+      }) ;
+   IdxT *s1 = index + subsize ;
+   IdxT name { 0 } ;
+   for (IdxT i = 0 ; i < subsize ; ++i)
+      {
+      if (new_name->getBit(i))
+	 ++name ;
+      s1[index[i]/2] = name - 1 ;
+      }
+   return name ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+template <typename I>
+bool SuffixArray<IdT,IdxT>::Create(const I* ids, IdxT* index, IdxT num_ids, IdxT num_types, const IdxT* freqs,
+   IdxT* workspace, size_t workspace_size)
 {
    if (num_ids == IdxT(0))
       return false ;
+   if (num_ids == IdxT(1))
+      {
+      index[0] = 0 ;
+      return true ;
+      }
    ScopedObject<BitVector> ls_types(num_ids+2) ;
    if (!ls_types)
       return false ;
    classifyLS(*ls_types,ids,num_ids,num_types) ;
    std::fill(index,index+num_ids,IdxT(-1)) ;
-   IdxT* buckets = bucketBoundaries(ids, num_ids, num_types, freqs) ;
-   IdxT* bucket_ends = copyBucketBoundaries(buckets+1,num_types) ;
+   // in low-memory mode, we keep only one set of bucket boundaries, which gets recomputed as needed
+   {
+   SABucketStore<IdxT> buckets(num_types+1,!m_lowmem,workspace,workspace_size) ;
+   IdxT* bucket_ends = buckets.ends() ? buckets.ends() : buckets.starts() ;
+   bucketBoundaries(bucket_ends,ids,num_ids,num_types,freqs,true) ;
    bool prev_type = ls_types->getBit(0) ;
    for (IdxT i = 1 ; i < num_ids ; ++i)
       {
@@ -186,13 +464,16 @@ bool SuffixArray<IdT,IdxT>::Create(const I* ids, IdxT* index, IdxT num_ids, IdT
       bool curr_type = ls_types->getBit(i) ;
       if (!prev_type && curr_type)
 	 {
-	 IdT bck = convertEOL(ids[i],num_types) ;
+	 IdxT bck = convertEOL(ids[i],num_types) ;
 	 index[--bucket_ends[bck]] = i ;
 	 }
       prev_type = curr_type ;
       }
-   delete[] bucket_ends ;
-   induce(ids, index, num_ids, num_types, buckets, *ls_types) ;
+   bucketBoundaries(buckets.starts(),ids,num_ids,num_types,freqs,false) ;
+   if (buckets.ends())
+      std::copy(buckets.starts()+1,buckets.starts()+num_types+1,buckets.ends()) ;
+   induce(ids, index, num_ids, num_types, buckets.starts(), buckets.ends(), freqs, *ls_types) ;
+   }
    // compact all of the sorted substrings into the start of 'suffix_index'
    IdxT subsize { 0 } ;
    for (IdxT i = 0 ; i < num_ids ; ++i)
@@ -206,53 +487,10 @@ bool SuffixArray<IdT,IdxT>::Create(const I* ids, IdxT* index, IdxT num_ids, IdT
       }
    //!assert(subsize > 0) ;
    // init as-yet-unused part of buffer
-   std::fill(index+subsize,index+num_ids,-1) ;
+   std::fill(index+subsize,index+num_ids,IdxT(-1)) ;
    IdxT *s1 = index + subsize ;
-   // find the lexicographic names of the substrings, storing them in
-   //   the now-spare part of the suffix array
-   IdxT name { 0 } ;
-   IdxT prev { IdxT(-1) } ;
-   for (IdxT i = 0 ; i < subsize ; ++i)
-      {
-      IdxT pos = index[i] ;
-      bool diff = false ;
-      if (prev == (IdxT)-1)
-	 {
-	 diff = true ;
-	 }
-      else
-	 {
-	 bool last_pos_bit = true ;
-	 bool last_prev_bit = true ;
-	 for (IdxT d = 0; d < num_ids ; ++d)
-	    {
-	    if (ids[pos+d] != ids[prev+d])
-	       {
-	       diff = true ;
-	       break ;
-	       }
-	    bool pos_bit = ls_types->getBit(pos+d) ;
-	    bool prev_bit = ls_types->getBit(prev+d) ;
-	    if (pos_bit != prev_bit)
-	       {
-	       diff = true ;
-	       break ;
-	       }
-	    else if ((pos_bit && !last_pos_bit) || (prev_bit && !last_prev_bit))
-	       {
-	       break ;
-	       }
-	    last_pos_bit = pos_bit ;
-	    last_prev_bit = prev_bit ;
-	    }
-	 }
-      if (diff)
-	 {
-	 ++name ;
-	 prev = pos ;
-	 }
-      s1[pos/2]=name-1;
-      }
+   // find the lexicographic names of the substrings
+   IdxT name = nameSubstrings(ids,index,subsize,num_types,*ls_types) ;
    // compact used elements to the beginning of the spare part of the suffix array
    for (IdxT i = subsize, j = subsize ; i < num_ids ; ++i)
       {
@@ -266,8 +504,16 @@ bool SuffixArray<IdT,IdxT>::Create(const I* ids, IdxT* index, IdxT num_ids, IdT
    // stage 2: solve the reduced problem
    if (name < subsize)
       {
-      // names are not yet unique, so recurse
-      Create(s1, index, subsize, name) ;
+      // names are not yet unique, so recurse; the reduced string occupies index[subsize..2*subsize),
+      //   which leaves the remainder of the suffix array free for use as scratch space
+      IdxT* scratch = index + 2*subsize ;
+      size_t scratch_size = num_ids - 2*subsize ;
+      if (scratch_size < workspace_size)
+	 {
+	 scratch = workspace ;
+	 scratch_size = workspace_size ;
+	 }
+      Create(s1, index, subsize, name, nullptr, scratch, scratch_size) ;
       }
    else
       {
@@ -296,18 +542,23 @@ bool SuffixArray<IdT,IdxT>::Create(const I* ids, IdxT* index, IdxT num_ids, IdT
       {
       index[i] = s1[index[i]] ;
       }
-   std::fill(index+subsize,index+num_ids,-1) ;   // init remainder of suffix_index
-   buckets = bucketBoundaries(ids, num_ids, num_types, freqs) ;
-   bucket_ends = copyBucketBoundaries(buckets+1, num_types) ;
+   std::fill(index+subsize,index+num_ids,IdxT(-1)) ;   // init remainder of suffix_index
+   {
+   SABucketStore<IdxT> buckets(num_types+1,!m_lowmem,workspace,workspace_size) ;
+   IdxT* bucket_ends = buckets.ends() ? buckets.ends() : buckets.starts() ;
+   bucketBoundaries(bucket_ends,ids,num_ids,num_types,freqs,true) ;
    for (IdxT i = subsize ; i > 0 ; --i)
       {
       IdxT j = index[i-1] ;
       index[i-1] = -1 ;
-      IdT bck = convertEOL(ids[j],num_types) ;
+      IdxT bck = convertEOL(ids[j],num_types) ;
       index[--bucket_ends[bck]] = j ;
       }
-   delete[] bucket_ends ;
-   induce(ids, index, num_ids, num_types, buckets, *ls_types) ;
+   bucketBoundaries(buckets.starts(),ids,num_ids,num_types,freqs,false) ;
+   if (buckets.ends())
+      std::copy(buckets.starts()+1,buckets.starts()+num_types+1,buckets.ends()) ;
+   induce(ids, index, num_ids, num_types, buckets.starts(), buckets.ends(), freqs, *ls_types) ;
+   }
    return true ;
 }
 
@@ -393,55 +644,273 @@ int SuffixArray<IdT,IdxT>::compareAt(IdxT idx1, const IdT* key2, unsigned keylen
 
 //----------------------------------------------------------------------------
 
+// compare the suffix at index position 'mid' against the key, given the lengths of the prefixes which
+//   the key shares with the suffixes bounding the current binary-search interval; the LCP-LR table
+//   (Manber and Myers) lets us decide most probes without touching the corpus, and otherwise the
+//   comparison can skip the prefix already known to match
+template <typename IdT, typename IdxT>
+int SuffixArray<IdT,IdxT>::compareLCP(size_t mid, const IdT* key, unsigned keylen, unsigned lcp_lo,
+				      unsigned lcp_hi, unsigned& matched) const
+{
+   unsigned start = std::min(lcp_lo,lcp_hi) ;
+   if (m_lcp_lr)
+      {
+      bool from_lo = lcp_lo >= lcp_hi ;
+      unsigned known = from_lo ? lcp_lo : lcp_hi ;
+      unsigned bound = m_lcp_lr[2*mid + (from_lo ? 0 : 1)] ;
+      bool exact = bound < FrSA_LCP_ESCAPE || keylen <= FrSA_LCP_ESCAPE ;
+      if (bound > keylen)
+	 bound = keylen ;
+      if (!exact && known >= FrSA_LCP_ESCAPE)
+	 start = FrSA_LCP_ESCAPE ;
+      else if (bound > known)
+	 {
+	 // the suffix agrees with the bound at the point where the key differs from it
+	 matched = known ;
+	 return from_lo ? -1 : +1 ;
+	 }
+      else if (bound < known)
+	 {
+	 // the suffix differs from the bound at a point where the key agrees with it
+	 matched = bound ;
+	 return from_lo ? +1 : -1 ;
+	 }
+      else
+	 start = known ;
+      }
+   IdxT num_types = m_types ;
+   size_t pos = (size_t)m_index[mid] + start ;
+   for (unsigned i = start ; i < keylen ; ++i, ++pos)
+      {
+      if (pos >= m_numids)
+	 {
+	 matched = i ;
+	 return -1 ;
+	 }
+      size_t id = convertEOL(m_ids[pos],num_types) ;
+      size_t keyid = convertEOL(key[i],num_types) ;
+      if (id != keyid)
+	 {
+	 matched = i ;
+	 return id < keyid ? -1 : +1 ;
+	 }
+      }
+   matched = keylen ;
+   return 0 ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename IdT, typename IdxT>
 bool SuffixArray<IdT,IdxT>::lookup(const IdT* key, unsigned keylen, IdxT& first_match, IdxT& last_match) const
 {
    if (!m_index)			// do we actually have an index?
       return false ;
-   // binary search for the first match of the key
-   IdxT lo(0), hi(m_numids) ;
+   // the searches for the first and last matches take the same path until they encounter a match, so
+   //   share that part of the search; the interval [lo,hi) excludes its bounding suffixes, which share
+   //   lcp_lo and lcp_hi leading IDs with the key
+   size_t lo(0), hi(m_numids) ;
+   unsigned lcp_lo(0), lcp_hi(0) ;
+   size_t match(m_numids) ;
    while (lo < hi)
       {
-      IdxT mid = lo + (hi-lo)/2 ;
-      int cmp = compareAt(m_index[mid],key,keylen) ;
+      size_t mid = lo + (hi-lo-1)/2 ;
+      unsigned matched ;
+      int cmp = compareLCP(mid,key,keylen,lcp_lo,lcp_hi,matched) ;
       if (cmp < 0)
-         {
-         lo = mid + 1 ;
-         }
-      else // if (cmp >= 0)
-         {
-         hi = mid ;
-         }
+	 {
+	 lo = mid + 1 ;
+	 lcp_lo = matched ;
+	 }
+      else if (cmp > 0)
+	 {
+	 hi = mid ;
+	 lcp_hi = matched ;
+	 }
+      else
+	 {
+	 match = mid ;
+	 break ;
+	 }
       }
    // if there was no match, we can bail out now
-   if (lo >= m_numids || compareAt(m_index[lo],key,keylen) != 0)
-      {
+   if (match >= m_numids)
       return false ;
+   // binary search for the first match of the key
+   size_t lo2(match+1), hi2(hi) ;
+   unsigned lcp_lo2(keylen), lcp_hi2(lcp_hi) ;
+   hi = match ;
+   lcp_hi = keylen ;
+   while (lo < hi)
+      {
+      size_t mid = lo + (hi-lo-1)/2 ;
+      unsigned matched ;
+      if (compareLCP(mid,key,keylen,lcp_lo,lcp_hi,matched) < 0)
+	 {
+	 lo = mid + 1 ;
+	 lcp_lo = matched ;
+	 }
+      else
+	 {
+	 hi = mid ;
+	 lcp_hi = matched ;
+	 }
       }
-   first_match = lo ;
+   first_match = IdxT(lo) ;
    // binary search for the last match of the key
-   lo = 0 ;
-   hi = m_numids ;
-   while (lo < hi)
+   while (lo2 < hi2)
       {
-      IdxT mid = lo + (hi-lo)/2 ;
-      int cmp = compareAt(m_index[mid],key,keylen) ;
-      if (cmp <= 0)
-         {
-         lo = mid + 1 ;
-         }
-      else // if (cmp > 0)
-         {
-         hi = mid ;
-         }
+      size_t mid = lo2 + (hi2-lo2-1)/2 ;
+      unsigned matched ;
+      if (compareLCP(mid,key,keylen,lcp_lo2,lcp_hi2,matched) > 0)
+	 {
+	 hi2 = mid ;
+	 lcp_hi2 = matched ;
+	 }
+      else
+	 {
+	 lo2 = mid + 1 ;
+	 lcp_lo2 = matched ;
+	 }
+      }
+   last_match = IdxT(lo2 - 1) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+bool SuffixArray<IdT,IdxT>::computeLCP()
+{
+   freeLCP() ;
+   size_t n = m_numids ;
+   if (!m_index || !m_ids || n == 0)
+      return false ;
+   // Kasai et al's algorithm in the permuted form of Karkkainen, Manzini, and Puglisi: store the
+   //   predecessor in suffix order of each text position, then compute the common-prefix lengths in
+   //   text order, where each is at least one less than the one before; splitting the text among
+   //   threads only costs re-scanning the first prefix of each chunk.  The lengths overwrite the
+   //   predecessors in place.
+   IdxT* plcp = new IdxT[n] ;
+   if (!plcp)
+      return false ;
+   size_t chunk_size = sa_chunk_size(n) ;
+   sa_for_chunks(n,chunk_size,[&](size_t, size_t start, size_t stop)
+      {
+      for (size_t i = start ; i < stop ; ++i)
+	 plcp[m_index[i]] = i ? m_index[i-1] : IdxT(n) ;
+      }) ;
+   IdxT num_types = m_types ;
+   sa_for_chunks(n,chunk_size,[&](size_t, size_t start, size_t stop)
+      {
+      size_t h = 0 ;
+      for (size_t p = start ; p < stop ; ++p)
+	 {
+	 size_t prev = plcp[p] ;
+	 if (prev >= n)
+	    {
+	    plcp[p] = IdxT(0) ;
+	    h = 0 ;
+	    continue ;
+	    }
+	 while (p + h < n && prev + h < n
+	    && convertEOL(m_ids[p+h],num_types) == convertEOL(m_ids[prev+h],num_types))
+	    ++h ;
+	 plcp[p] = IdxT(h) ;
+	 if (h > 0)
+	    --h ;
+	 }
+      }) ;
+   // permute into suffix order, storing one byte per entry plus the rare long prefixes separately
+   m_lcp = new uint8_t[n] ;
+   m_lcp_lr = new uint8_t[2*n] ;
+   m_lcp_alloc = true ;
+   std::vector<std::vector<LCPOverflow>> overflows((n + chunk_size - 1) / chunk_size) ;
+   sa_for_chunks(n,chunk_size,[&](size_t c, size_t start, size_t stop)
+      {
+      for (size_t i = start ; i < stop ; ++i)
+	 {
+	 size_t len = plcp[m_index[i]] ;
+	 if (len >= FrSA_LCP_ESCAPE)
+	    {
+	    m_lcp[i] = FrSA_LCP_ESCAPE ;
+	    overflows[c].push_back(LCPOverflow { IdxT(i), IdxT(len) }) ;
+	    }
+	 else
+	    m_lcp[i] = (uint8_t)len ;
+	 }
+      }) ;
+   delete[] plcp ;
+   size_t num_overflows = 0 ;
+   for (const auto& ovf : overflows)
+      num_overflows += ovf.size() ;
+   if (num_overflows)
+      {
+      m_lcp_overflow = new LCPOverflow[num_overflows] ;
+      LCPOverflow* dest = m_lcp_overflow ;
+      for (const auto& ovf : overflows)
+	 dest = std::copy(ovf.begin(),ovf.end(),dest) ;
       }
-   last_match = lo ;
-   if (lo > 0) --last_match ;
+   m_lcp_overflows = IdxT(num_overflows) ;
+   // the LCP-LR table only needs the saturated values, since min(sat(a),sat(b)) == sat(min(a,b))
+   buildLCPLR(0,n) ;
    return true ;
 }
 
 //----------------------------------------------------------------------------
 
+// fill in the LCP-LR entries for the midpoints of the binary-search interval [lo,hi), returning the
+//   length of the common prefix of the suffixes bounding the interval
+template <typename IdT, typename IdxT>
+unsigned SuffixArray<IdT,IdxT>::buildLCPLR(size_t lo, size_t hi)
+{
+   if (lo >= hi)
+      return (lo > 0 && hi < m_numids) ? m_lcp[hi] : 0 ;
+   size_t mid = lo + (hi-lo-1)/2 ;
+   unsigned lcp_lo = buildLCPLR(lo,mid) ;
+   unsigned lcp_hi = buildLCPLR(mid+1,hi) ;
+   m_lcp_lr[2*mid] = (uint8_t)lcp_lo ;
+   m_lcp_lr[2*mid+1] = (uint8_t)lcp_hi ;
+   return std::min(lcp_lo,lcp_hi) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+void SuffixArray<IdT,IdxT>::freeLCP()
+{
+   if (m_lcp_alloc)
+      {
+      delete[] m_lcp ;
+      delete[] m_lcp_lr ;
+      delete[] m_lcp_overflow ;
+      m_lcp_alloc = false ;
+      }
+   m_lcp = nullptr ;
+   m_lcp_lr = nullptr ;
+   m_lcp_overflow = nullptr ;
+   m_lcp_overflows = 0 ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdT, typename IdxT>
+IdxT SuffixArray<IdT,IdxT>::lcpAt(IdxT N) const
+{
+   if (!m_lcp || N >= m_numids)
+      return 0 ;
+   unsigned len = m_lcp[N] ;
+   if (len < FrSA_LCP_ESCAPE)
+      return len ;
+   const LCPOverflow* end = m_lcp_overflow + (size_t)m_lcp_overflows ;
+   const LCPOverflow* ovf = std::lower_bound((const LCPOverflow*)m_lcp_overflow,end,N,
+      [](const LCPOverflow& o, IdxT pos) { return o.pos < pos ; }) ;
+   return (ovf != end && ovf->pos == N) ? ovf->len : IdxT(len) ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename IdT, typename IdxT>
 bool SuffixArray<IdT,IdxT>::enumerateSegment(Range<IdxT> positions, size_t offset, Range<IdT> IDs,
    Range<unsigned> lengths, const std::function<EnumFunc>& fn,
@@ -499,6 +968,7 @@ bool SuffixArray<IdT,IdxT>::enumerate(Range<IdxT> positions, Range<unsigned> len
 {
    unsigned minlen = lengths.first() ;
    unsigned maxlen = lengths.last() ;
+   IdxT num_types = m_types ;
    IdxT keystart[maxlen+1] ;
    IdT keyval[maxlen+1] ;
    std::fill(keystart,keystart+maxlen+1,positions.first()) ;
@@ -513,12 +983,21 @@ bool SuffixArray<IdT,IdxT>::enumerate(Range<IdxT> positions, Range<unsigned> len
       //   of the previous position, and figure out the length of the
       //   common prefix
       unsigned common = 0 ;
-      for ( ; common < maxlen ; ++common)
-         {
-         IdxT pos = m_index[idx] + common ;
-         if (keyval[common] != idAt(pos))
-            break ;
-         }
+      if (m_lcp)
+	 {
+	 size_t len = lcpAt(idx) ;
+	 common = len < maxlen ? (unsigned)len : maxlen ;
+	 }
+      else
+	 {
+	 // line-number records compare as newlines, as they do when sorting
+	 for ( ; common < maxlen ; ++common)
+	    {
+	    size_t pos = (size_t)m_index[idx] + common ;
+	    if (pos >= m_numids || convertEOL(keyval[common],num_types) != convertEOL(m_ids[pos],num_types))
+	       break ;
+	    }
+	 }
       // if the common prefix is less than 'maxlen', invoke the
       //   caller's function for each length from prefix-len to
       //   'maxlen', provided that the phrase passes the filter
@@ -542,7 +1021,7 @@ bool SuffixArray<IdT,IdxT>::enumerate(Range<IdxT> positions, Range<unsigned> len
    for (size_t len = maxlen ; len >= minlen ; --len)
       {
       size_t freq = positions.last() - keystart[len] ;
-      if (!filter | filter(this,keyval,len,freq,false))
+      if (!filter || filter(this,keyval,len,freq,false))
          {
          fn(this, keyval, len, freq, keystart[len]) ;
          }
@@ -41,7 +41,11 @@ class SuffixArrayHeader
       uint64_t m_index ;	// offset of array of indices
       uint64_t m_ids { 0 } ;	// offset of array of IDs
       uint64_t m_freq { 0 } ;	// offset of array of ID frequencies
-      uint64_t m_pad[8] { 0 } ; // padding for future extensions
+      uint64_t m_lcp { 0 } ;	// offset of array of common-prefix lengths
+      uint64_t m_lcp_lr { 0 } ;	// offset of array of common-prefix lengths with binary-search bounds
+      uint64_t m_lcp_overflow { 0 } ; // offset of table of common-prefix lengths too large for m_lcp
+      uint64_t m_lcp_overflows { 0 } ; // number of entries in overflow table
+      uint64_t m_pad[4] { 0 } ; // padding for future extensions
    } ;
 
 /************************************************************************/
@@ -102,8 +106,18 @@ bool SuffixArray<IdT,IdxT>::load(CFile& fp, const char* filename, bool allow_mma
       {
       success &= fp.readVarsAt(header.m_ids + base_offset,&m_ids,m_numids) ;
       }
+   if (success && header.m_lcp && header.m_lcp_lr)
+      {
+      m_lcp_alloc = true ;
+      m_lcp_overflows = IdxT(header.m_lcp_overflows) ;
+      success &= fp.readVarsAt(header.m_lcp + base_offset,&m_lcp,m_numids) ;
+      success &= fp.readVarsAt(header.m_lcp_lr + base_offset,&m_lcp_lr,2*(size_t)m_numids) ;
+      if (header.m_lcp_overflow)
+	 success &= fp.readVarsAt(header.m_lcp_overflow + base_offset,&m_lcp_overflow,m_lcp_overflows) ;
+      }
    if (!success)
       {
+      freeLCP() ;
       delete[] m_index ;
       m_index = nullptr  ;
       delete[] m_freq ;
@@ -164,6 +178,17 @@ bool SuffixArray<IdT,IdxT>::loadFromMmap(const char* mmap_base, size_t mmap_len,
       {
       m_ids = const_cast<IdT*>(reinterpret_cast<const IdT*>(mmap_base + header->m_ids)) ;
       }
+   if (header->m_lcp && header->m_lcp_lr)
+      {
+      m_lcp = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(mmap_base + header->m_lcp)) ;
+      m_lcp_lr = const_cast<uint8_t*>(reinterpret_cast<const uint8_t*>(mmap_base + header->m_lcp_lr)) ;
+      if (header->m_lcp_overflow)
+	 {
+	 m_lcp_overflow = const_cast<LCPOverflow*>(reinterpret_cast<const LCPOverflow*>(mmap_base
+	    + header->m_lcp_overflow)) ;
+	 m_lcp_overflows = IdxT(header->m_lcp_overflows) ;
+	 }
+      }
    return true ;
 }
 
@@ -209,6 +234,23 @@ bool SuffixArray<IdT,IdxT>::save(CFile& fp, bool include_ids) const
       if (!fp.writeValues(m_ids,m_numids))
 	 return false ;
       }
+   if (m_lcp && m_lcp_lr)
+      {
+      // the overflow table goes first, so that it has the same alignment as the arrays above
+      if (m_lcp_overflows)
+	 {
+	 header.m_lcp_overflow = fp.tell() - base_offset ;
+	 header.m_lcp_overflows = m_lcp_overflows ;
+	 if (!fp.writeValues(m_lcp_overflow,m_lcp_overflows))
+	    return false ;
+	 }
+      header.m_lcp = fp.tell() - base_offset ;
+      if (!fp.writeValues(m_lcp,m_numids))
+	 return false ;
+      header.m_lcp_lr = fp.tell() - base_offset ;
+      if (!fp.writeValues(m_lcp_lr,2*(size_t)m_numids))
+	 return false ;
+      }
    // now that we've written all the other data, we have a complete header, so return to the start of the file
    //   and update the header
    off_t lastpos = fp.tell() ;
@@ -160,9 +160,10 @@ template <typename T, typename IdxT, unsigned bits>
 T Trie<T,IdxT,bits>::find(const uint8_t* key, unsigned keylength) const
 {
    IdxT n = findNode(key,keylength) ;
-   if (n != ROOT_INDEX || node(n)->leaf())
-      return node(n)->value() ;
-   return nullVal() ;
+   if (n == NULL_INDEX && keylength > 0)
+      return nullVal() ;		// key is not a path in the trie
+   Node* nd = node(n) ;
+   return nd->leaf() ? nd->value() : nullVal() ;
 }
 
 //----------------------------------------------------------------------------
@@ -171,9 +172,9 @@ template <typename T, typename IdxT, unsigned bits>
 bool Trie<T,IdxT,bits>::contains(const uint8_t* key, unsigned keylength) const
 {
    IdxT n = findNode(key,keylength) ;
-   if (n != ROOT_INDEX || node(n)->leaf())
-      return true ;
-   return false ;
+   if (n == NULL_INDEX && keylength > 0)
+      return false ;
+   return node(n)->leaf() ;
 }
 
 //----------------------------------------------------------------------------
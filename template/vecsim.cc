@@ -21,7 +21,14 @@
 
 #include <cmath>
 #include <float.h>
+#include <type_traits>
+#include "framepac/array.h"
+#include "framepac/binaryvec.h"
+#include "framepac/matrix.h"
+#include "framepac/simd.h"
+#include "framepac/threadpool.h"
 #include "framepac/vecsim.h"
+#include "framepac/vectorcoll.h"
 
 /************************************************************************/
 /************************************************************************/
@@ -77,33 +84,267 @@ ValT max_weight(const Vector<IdxT,ValT>* v)
 //----------------------------------------------------------------------------
 
 template <typename IdxT, typename ValT>
-void normalization_weights(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2, int normalization,
-			   ValT &wt1, ValT &wt2)
+ValT normalization_weight(const Vector<IdxT,ValT>* v, int normalization)
 {
-   wt1 = wt2 = 1.0 ;
    if (normalization == 1)
       {
       // L1-normalization: divide by sum of element values
-      wt1 = sum_of_weights(v1) ;
-      wt2 = sum_of_weights(v2) ;
+      return sum_of_weights(v) ;
       }
    else if (normalization == 2)
       {
       // L2-normalization: divide by vector's Euclidean length
-      wt1 = v1->length() ;
-      wt2 = v2->length() ;
-      if (!wt1) wt1 = 1.0 ;
-      if (!wt2) wt2 = 1.0 ;
+      ValT wt = v->length() ;
+      return wt ? wt : 1.0 ;
       }
    else if (normalization == 3)
       {
       // Linf-normalization: divide by maximum element value
-      wt1 = max_weight(v1) ;
-      wt2 = max_weight(v2) ;
+      return max_weight(v) ;
       }
+   return 1.0 ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void normalization_weights(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2, int normalization,
+			   ValT &wt1, ValT &wt2)
+{
+   wt1 = normalization_weight(v1,normalization) ;
+   wt2 = normalization_weight(v2,normalization) ;
    return ;
 }
 
+//============================================================================
+//   Drivers for batched comparisons					    //
+//============================================================================
+
+// minimum number of comparisons to hand to a thread at once
+#define FrVECSIM_GRAIN 32
+
+// number of rows of the result to compute together in a tile of similarityMatrix()
+#define FrVECSIM_TILE_ROWS 16
+
+// approximate amount of data for the column vectors of a tile; about half of a typical L2 cache
+#define FrVECSIM_TILE_BYTES (128*1024)
+
+// The measures supply two functions to the drivers: norm(v) returns a per-vector quantity
+//   (such as the length) which is computed just once per vector, and score(v1,norm1,v2,norm2)
+//   computes the similarity of a pair of vectors given their norms.  Since both are passed as
+//   templated functors, the pairwise calls are inlined rather than going through the vtable.
+
+template <typename IdxT, typename ValT, typename NormFn, typename ScoreFn>
+bool batch_similarities(const Vector<IdxT,ValT>* query, const Array* candidates, double* out,
+   NormFn norm, ScoreFn score)
+{
+   if (!candidates || !out)
+      return false ;
+   size_t count = candidates->size() ;
+   if (!query)
+      {
+      std::fill(out,out+count,-1.0) ;
+      return true ;
+      }
+   double qnorm = norm(query) ;
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,count),FrVECSIM_GRAIN,[&](size_t i)
+      {
+      auto v = static_cast<const Vector<IdxT,ValT>*>(candidates->getNth(i)) ;
+      out[i] = v ? score(query,qnorm,v,norm(v)) : -1.0 ;
+      }) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t similarity_tile_columns(const Array* vectors)
+{
+   // size the tile so that the column vectors it touches fit comfortably in the L2 cache
+   auto v = static_cast<const Vector<IdxT,ValT>*>(vectors->getNth(0)) ;
+   size_t bytes = v ? v->numElements() * sizeof(ValT) : 0 ;
+   if (v && v->isSparseVector())
+      bytes += v->numElements() * sizeof(IdxT) ;
+   size_t cols = bytes ? FrVECSIM_TILE_BYTES / bytes : 1024 ;
+   return std::max(size_t(8),std::min(size_t(1024),cols)) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT, typename NormFn, typename ScoreFn>
+bool batch_similarity_matrix(const Array* A, const Array* B, FullMatrix<float>* result, NormFn norm, ScoreFn score)
+{
+   if (!A || !B || !result || result->rows() < A->size() || result->columns() < B->size())
+      return false ;
+   size_t rows = A->size() ;
+   size_t cols = B->size() ;
+   if (rows == 0 || cols == 0)
+      return true ;
+   ThreadPool* tp = ThreadPool::defaultPool() ;
+   // compute the per-vector norms just once
+   LocalAlloc<double> norms_a(rows) ;
+   LocalAlloc<double> norms_b(cols) ;
+   tp->parallel_for(Range<size_t>(0,rows),4*FrVECSIM_GRAIN,[&](size_t i)
+      {
+      auto v = static_cast<const Vector<IdxT,ValT>*>(A->getNth(i)) ;
+      norms_a[i] = v ? norm(v) : 0.0 ;
+      }) ;
+   tp->parallel_for(Range<size_t>(0,cols),4*FrVECSIM_GRAIN,[&](size_t i)
+      {
+      auto v = static_cast<const Vector<IdxT,ValT>*>(B->getNth(i)) ;
+      norms_b[i] = v ? norm(v) : 0.0 ;
+      }) ;
+   // process the matrix in tiles, so that a block of B's vectors stays in cache while it is
+   //   compared against a block of A's vectors
+   size_t tile_rows = FrVECSIM_TILE_ROWS ;
+   size_t tile_cols = similarity_tile_columns<IdxT,ValT>(B) ;
+   size_t row_tiles = (rows + tile_rows - 1) / tile_rows ;
+   size_t col_tiles = (cols + tile_cols - 1) / tile_cols ;
+   tp->parallel_for(Range<size_t>(0,row_tiles*col_tiles),1,[&](size_t tile)
+      {
+      size_t first_row = (tile / col_tiles) * tile_rows ;
+      size_t last_row = std::min(rows,first_row + tile_rows) ;
+      size_t first_col = (tile % col_tiles) * tile_cols ;
+      size_t last_col = std::min(cols,first_col + tile_cols) ;
+      for (size_t i = first_row ; i < last_row ; ++i)
+	 {
+	 auto v1 = static_cast<const Vector<IdxT,ValT>*>(A->getNth(i)) ;
+	 float* out = result->row(i) ;
+	 for (size_t j = first_col ; j < last_col ; ++j)
+	    {
+	    auto v2 = static_cast<const Vector<IdxT,ValT>*>(B->getNth(j)) ;
+	    out[j] = (v1 && v2) ? (float)score(v1,norms_a[i],v2,norms_b[j]) : -1.0f ;
+	    }
+	 }
+      }) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+// the same drivers for VectorCollections, where score(c1,row1,c2,row2) compares two rows in place
+
+template <typename IdxT, typename ValT, typename ScoreFn>
+bool collection_similarities(const VectorCollection<IdxT,ValT>& coll, size_t query, size_t first, size_t last,
+   double* out, ScoreFn score)
+{
+   if (!out || query >= coll.size() || first > last || last > coll.size())
+      return false ;
+   for (size_t i = first ; i < last ; ++i)
+      {
+      *out++ = (coll.present(query) && coll.present(i)) ? score(coll,query,coll,i) : -1.0 ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT, typename ScoreFn>
+bool collection_similarity_matrix(const VectorCollection<IdxT,ValT>& A, size_t first, size_t last,
+   const VectorCollection<IdxT,ValT>& B, FullMatrix<float>* result, ScoreFn score)
+{
+   if (!result || first > last || last > A.size() || result->rows() < last - first
+      || result->columns() < B.size())
+      return false ;
+   size_t rows = last - first ;
+   size_t cols = B.size() ;
+   if (rows == 0 || cols == 0)
+      return true ;
+   // the rows are contiguous, so the tile only needs to be sized by the average row
+   size_t bytes = B.sparse() ? B.nonZeros() / cols * (sizeof(ValT) + sizeof(IdxT)) : B.dimensions() * sizeof(ValT) ;
+   size_t tile_cols = bytes ? FrVECSIM_TILE_BYTES / bytes : 1024 ;
+   tile_cols = std::max(size_t(8),std::min(size_t(1024),tile_cols)) ;
+   size_t tile_rows = FrVECSIM_TILE_ROWS ;
+   size_t row_tiles = (rows + tile_rows - 1) / tile_rows ;
+   size_t col_tiles = (cols + tile_cols - 1) / tile_cols ;
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,row_tiles*col_tiles),1,[&](size_t tile)
+      {
+      size_t first_row = first + (tile / col_tiles) * tile_rows ;
+      size_t last_row = std::min(last,first_row + tile_rows) ;
+      size_t first_col = (tile % col_tiles) * tile_cols ;
+      size_t last_col = std::min(cols,first_col + tile_cols) ;
+      for (size_t i = first_row ; i < last_row ; ++i)
+	 {
+	 float* out = result->row(i - first) ;
+	 bool present = A.present(i) ;
+	 for (size_t j = first_col ; j < last_col ; ++j)
+	    out[j] = (present && B.present(j)) ? (float)score(A,i,B,j) : -1.0f ;
+	 }
+      }) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+// kernels on rows of VectorCollections; both collections must be dense or both sparse
+
+template <typename IdxT, typename ValT>
+double collection_dot_product(const VectorCollection<IdxT,ValT>& c1, size_t row1,
+   const VectorCollection<IdxT,ValT>& c2, size_t row2)
+{
+   const ValT* values1 = c1.rowValues(row1) ;
+   const ValT* values2 = c2.rowValues(row2) ;
+   if (!c1.sparse())
+      return simd_dot_product(values1,values2,std::min(c1.dimensions(),c2.dimensions())) ;
+   const IdxT* indices1 = c1.rowIndices(row1) ;
+   const IdxT* indices2 = c2.rowIndices(row2) ;
+   size_t elts1 = c1.rowLength(row1) ;
+   size_t elts2 = c2.rowLength(row2) ;
+   size_t pos1(0), pos2(0) ;
+   double dotprod(0) ;
+   while (pos1 < elts1 && pos2 < elts2)
+      {
+      if (indices1[pos1] < indices2[pos2])
+	 ++pos1 ;
+      else if (indices1[pos1] > indices2[pos2])
+	 ++pos2 ;
+      else
+	 dotprod += (double)values1[pos1++] * values2[pos2++] ;
+      }
+   return dotprod ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+double collection_squared_distance(const VectorCollection<IdxT,ValT>& c1, size_t row1,
+   const VectorCollection<IdxT,ValT>& c2, size_t row2)
+{
+   const ValT* values1 = c1.rowValues(row1) ;
+   const ValT* values2 = c2.rowValues(row2) ;
+   size_t elts1 = c1.rowLength(row1) ;
+   size_t elts2 = c2.rowLength(row2) ;
+   size_t pos1(0), pos2(0) ;
+   double sum(0) ;
+   if (!c1.sparse())
+      {
+      pos1 = pos2 = std::min(elts1,elts2) ;
+      sum = simd_squared_distance(values1,values2,pos1) ;
+      }
+   else
+      {
+      const IdxT* indices1 = c1.rowIndices(row1) ;
+      const IdxT* indices2 = c2.rowIndices(row2) ;
+      while (pos1 < elts1 && pos2 < elts2)
+	 {
+	 double diff ;
+	 if (indices1[pos1] < indices2[pos2])
+	    diff = values1[pos1++] ;
+	 else if (indices1[pos1] > indices2[pos2])
+	    diff = values2[pos2++] ;
+	 else
+	    {
+	    diff = (double)values1[pos1++] - (double)values2[pos2++] ;
+	    }
+	 sum += diff * diff ;
+	 }
+      }
+   // handle any leftovers from either vector
+   for ( ; pos1 < elts1 ; ++pos1)
+      sum += (double)values1[pos1] * values1[pos1] ;
+   for ( ; pos2 < elts2 ; ++pos2)
+      sum += (double)values2[pos2] * values2[pos2] ;
+   return sum ;
+}
+
 //============================================================================
 //============================================================================
 
@@ -111,9 +352,51 @@ template <typename IdxT, typename ValT>
 class VectorMeasureCosine : public SimilarityMeasure<IdxT, ValT>
    {
    public:
-      virtual double similarity(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2) const
+      typedef SimilarityMeasure<IdxT,ValT> super ;
+      typedef Vector<IdxT,ValT> vec_type ;
+      typedef VectorCollection<IdxT,ValT> coll_type ;
+   public:
+      virtual double similarity(const vec_type* v1, const vec_type* v2) const
+	 {
+	    return score(v1,v1->length(),v2,v2->length()) ;
+	 }
+      virtual bool similarities(const vec_type* query, const Array* candidates, double* out) const
+	 {
+	    return batch_similarities(query,candidates,out,[](const vec_type* v) { return length(v) ; },
+	       [](const vec_type* v1, double n1, const vec_type* v2, double n2) { return score(v1,n1,v2,n2) ; }) ;
+	 }
+      virtual bool similarityMatrix(const Array* A, const Array* B, FullMatrix<float>* result) const
+	 {
+	    return batch_similarity_matrix<IdxT,ValT>(A,B,result,[](const vec_type* v) { return length(v) ; },
+	       [](const vec_type* v1, double n1, const vec_type* v2, double n2) { return score(v1,n1,v2,n2) ; }) ;
+	 }
+      virtual bool similarities(const coll_type& coll, size_t query, size_t first, size_t last, double* out) const
+	 {
+	    return collection_similarities(coll,query,first,last,out,&scoreRows) ;
+	 }
+      virtual bool similarityMatrix(const coll_type& A, size_t first, size_t last, const coll_type& B,
+	 FullMatrix<float>* result) const
+	 {
+	    if (A.sparse() != B.sparse())
+	       return super::similarityMatrix(A,first,last,B,result) ;
+	    return collection_similarity_matrix(A,first,last,B,result,&scoreRows) ;
+	 }
+
+   protected:
+      virtual const char* myCanonicalName() const { return "Cosine" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
+
+      // the collection stores each vector's length, so cosine needs only the dot product
+      static double scoreRows(const coll_type& c1, size_t row1, const coll_type& c2, size_t row2)
 	 {
-	    double prod_lengths((v1->length() * v2->length())) ;
+	    double prod_lengths(c1.length(row1) * c2.length(row2)) ;
+	    return prod_lengths ? collection_dot_product(c1,row1,c2,row2) / prod_lengths : 0.0 ;
+	 }
+
+      static double length(const vec_type* v) { return v->length() ; }
+      static double score(const vec_type* v1, double len1, const vec_type* v2, double len2)
+	 {
+	    double prod_lengths(len1 * len2) ;
 	    if (!prod_lengths)
 	       return 0.0 ;
 	    ValT dotprod(0) ;
@@ -147,16 +430,10 @@ class VectorMeasureCosine : public SimilarityMeasure<IdxT, ValT>
 	       {
 	       // with two dense vectors we can be more efficient
 	       size_t len(std::min(elts1,elts2)) ;
-	       for (size_t i = 0 ; i < len ; ++i)
-		  {
-		  dotprod += (v1->elementValue(i) * v2->elementValue(i)) ;
-		  }
+	       dotprod = simd_dot_product(v1->elementValues(),v2->elementValues(),len) ;
 	       }
 	    return dotprod / prod_lengths ;
 	 }
-
-   protected:
-      virtual const char* myCanonicalName() const { return "Cosine" ; }
    } ;
       
 //============================================================================
@@ -395,6 +672,7 @@ class VectorMeasureFidelity : public SimilarityMeasure<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Fidelity" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double similarity(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2) const
 	 {
 	    size_t pos1(0) ;
@@ -1581,10 +1859,7 @@ class VectorMeasureManhattan : public DistanceMeasureReciprocal<IdxT, ValT>
 		  {
 		  ValT wt1, wt2 ;
 		  normalization_weights(v1,v2,this->m_opt.normalize,wt1,wt2) ;
-		  for (size_t i = 0 ; i < minlen ; ++i)
-		     {
-		     sum += abs_value(v1->elementValue(i)/wt1 - v2->elementValue(i)/wt2) ;
-		     }
+		  sum = simd_abs_difference(v1->elementValues(),v2->elementValues(),minlen,1.0/wt1,1.0/wt2) ;
 		  // handle any leftovers from the first vector
 		  for (size_t i = minlen ; i < v1->numElements() ; ++i)
 		     {
@@ -1599,10 +1874,7 @@ class VectorMeasureManhattan : public DistanceMeasureReciprocal<IdxT, ValT>
 	       else
 		  {
 		  // no normalization
-		  for (size_t i = 0 ; i < minlen ; ++i)
-		     {
-		     sum += abs_value(v1->elementValue(i) - v2->elementValue(i)) ;
-		     }
+		  sum = simd_abs_difference(v1->elementValues(),v2->elementValues(),minlen) ;
 		  // handle any leftovers from the first vector
 		  for (size_t i = minlen ; i < v1->numElements() ; ++i)
 		     {
@@ -1815,6 +2087,11 @@ class VectorMeasureSquaredEuclidean : public DistanceMeasure<IdxT, ValT>
    {
    public:
       virtual double distance(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2) const
+	 {
+	    return squaredDistance(v1,v2) ;
+	 }
+
+      static double squaredDistance(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2)
 	 {
 	    size_t pos1(0) ;
 	    size_t pos2(0) ;
@@ -1849,12 +2126,8 @@ class VectorMeasureSquaredEuclidean : public DistanceMeasure<IdxT, ValT>
 	    else
 	       {
 	       size_t minlen(std::min(elts1,elts2)) ;
-	       for ( ; pos1 < minlen ; ++pos1)
-		  {
-		  ValT diff = v1->elementValue(pos1) - v2->elementValue(pos1) ;
-		  sum += (diff * diff) ;
-		  }
-	       pos2 = pos1 ;
+	       sum = simd_squared_distance(v1->elementValues(),v2->elementValues(),minlen) ;
+	       pos1 = pos2 = minlen ;
 	       }
 	    // handle any leftovers from the first vector
 	    while (pos1 < elts1)
@@ -1881,10 +2154,34 @@ template <typename IdxT, typename ValT>
 class VectorMeasureEuclidean : public DistanceMeasure<IdxT, ValT>
    {
    public:
-      virtual double distance(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2) const
+      typedef DistanceMeasure<IdxT,ValT> super ;
+      typedef Vector<IdxT,ValT> vec_type ;
+      typedef VectorCollection<IdxT,ValT> coll_type ;
+   public:
+      virtual double distance(const vec_type* v1, const vec_type* v2) const
+	 {
+	    return std::sqrt(VectorMeasureSquaredEuclidean<IdxT,ValT>::squaredDistance(v1,v2)) ;
+	 }
+      virtual bool similarities(const vec_type* query, const Array* candidates, double* out) const
+	 {
+	    return batch_similarities(query,candidates,out,[](const vec_type*) { return 0.0 ; },
+	       [](const vec_type* v1, double n1, const vec_type* v2, double n2) { return score(v1,n1,v2,n2) ; }) ;
+	 }
+      virtual bool similarityMatrix(const Array* A, const Array* B, FullMatrix<float>* result) const
+	 {
+	    return batch_similarity_matrix<IdxT,ValT>(A,B,result,[](const vec_type*) { return 0.0 ; },
+	       [](const vec_type* v1, double n1, const vec_type* v2, double n2) { return score(v1,n1,v2,n2) ; }) ;
+	 }
+      virtual bool similarities(const coll_type& coll, size_t query, size_t first, size_t last, double* out) const
+	 {
+	    return collection_similarities(coll,query,first,last,out,&scoreRows) ;
+	 }
+      virtual bool similarityMatrix(const coll_type& A, size_t first, size_t last, const coll_type& B,
+	 FullMatrix<float>* result) const
 	 {
-	    VectorMeasureSquaredEuclidean<IdxT,ValT> vm ;
-	    return std::sqrt(vm.distance(v1,v2)) ;
+	    if (A.sparse() != B.sparse())
+	       return super::similarityMatrix(A,first,last,B,result) ;
+	    return collection_similarity_matrix(A,first,last,B,result,&scoreRows) ;
 	 }
 
    protected:
@@ -1893,6 +2190,17 @@ class VectorMeasureEuclidean : public DistanceMeasure<IdxT, ValT>
       VectorMeasureEuclidean() : DistanceMeasure<IdxT,ValT>() {}
       VectorMeasureEuclidean(const VectorSimilarityOptions& opt) : DistanceMeasure<IdxT,ValT>(opt) {}
       virtual const char* myCanonicalName() const { return "Euclidean" ; }
+
+      // the difference of two vectors can't be derived from their separate lengths without
+      //   losing precision, so there is no per-vector quantity to cache
+      static double score(const vec_type* v1, double, const vec_type* v2, double)
+	 {
+	    return 1.0 - std::sqrt(VectorMeasureSquaredEuclidean<IdxT,ValT>::squaredDistance(v1,v2)) ;
+	 }
+      static double scoreRows(const coll_type& c1, size_t row1, const coll_type& c2, size_t row2)
+	 {
+	    return 1.0 - std::sqrt(collection_squared_distance(c1,row1,c2,row2)) ;
+	 }
 } ;
 
 //============================================================================
@@ -1985,6 +2293,113 @@ class VectorMeasureLNorm : public DistanceMeasure<IdxT, ValT>
 /*	methods for base class VectorMeasure				*/
 /************************************************************************/
 
+template <typename IdxT, typename ValT>
+bool VectorMeasure<IdxT,ValT>::similarities(const Vector<IdxT,ValT>* query, const Array* candidates,
+   double* out) const
+{
+   return batch_similarities(query,candidates,out,
+      [](const vec_type*) { return 0.0 ; },
+      [this](const vec_type* v1, double, const vec_type* v2, double) { return this->similarity(v1,v2) ; }) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorMeasure<IdxT,ValT>::similarityMatrix(const Array* A, const Array* B, FullMatrix<float>* result) const
+{
+   return batch_similarity_matrix<IdxT,ValT>(A,B,result,
+      [](const vec_type*) { return 0.0 ; },
+      [this](const vec_type* v1, double, const vec_type* v2, double) { return this->similarity(v1,v2) ; }) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorMeasure<IdxT,ValT>::similarities(const VectorCollection<IdxT,ValT>& coll, size_t query, size_t first,
+   size_t last, double* out) const
+{
+   if (!coll.source())
+      return false ;
+   return collection_similarities(coll,query,first,last,out,
+      [this](const VectorCollection<IdxT,ValT>& c1, size_t row1, const VectorCollection<IdxT,ValT>& c2, size_t row2)
+      { return this->similarity(c1.vector(row1),c2.vector(row2)) ; }) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorMeasure<IdxT,ValT>::similarityMatrix(const VectorCollection<IdxT,ValT>& A, size_t first, size_t last,
+   const VectorCollection<IdxT,ValT>& B, FullMatrix<float>* result) const
+{
+   if (!A.source() || !B.source())
+      return false ;
+   return collection_similarity_matrix(A,first,last,B,result,
+      [this](const VectorCollection<IdxT,ValT>& c1, size_t row1, const VectorCollection<IdxT,ValT>& c2, size_t row2)
+      { return this->similarity(c1.vector(row1),c2.vector(row2)) ; }) ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+double VectorMeasure<IdxT,ValT>::similarity(const BinaryVectors<IdxT,ValT>& bits1, size_t row1,
+   const BinaryVectors<IdxT,ValT>& bits2, size_t row2) const
+{
+   double sim ;
+   return similarities(bits1,row1,bits2,row2,row2+1,&sim) ? sim : -1.0 ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorMeasure<IdxT,ValT>::similarities(const BinaryVectors<IdxT,ValT>& queries, size_t query,
+   const BinaryVectors<IdxT,ValT>& candidates, size_t first, size_t last, double* out) const
+{
+   if (!supportsBinaryVectors() || !out || query >= queries.size() || first > last || last > candidates.size()
+      || queries.dimensions() != candidates.dimensions())
+      return false ;
+   if (!queries.present(query))
+      {
+      std::fill(out,out+(last-first),-1.0) ;
+      return true ;
+      }
+   const uint64_t* q = queries.row(query) ;
+   size_t q_count = queries.bitsSet(query) ;
+   size_t dims = candidates.dimensions() ;
+   size_t nwords = (dims + 63) / 64 ;
+   // count the shared bits for a batch of rows with a single kernel call, then fill in the rest of
+   //   each contingency table from the rows' bit counts
+   const size_t batch = 256 ;
+   size_t shared[batch] ;
+   for (size_t start = first ; start < last ; start += batch)
+      {
+      size_t count = std::min(last - start,batch) ;
+      simd_and_popcounts(q,candidates.row(start),candidates.rowWords(),count,nwords,shared) ;
+      for (size_t k = 0 ; k < count ; ++k)
+	 {
+	 size_t row = start + k ;
+	 if (!candidates.present(row))
+	    {
+	    *out++ = -1.0 ;
+	    continue ;
+	    }
+	 size_t both = shared[k] ;
+	 size_t c_count = candidates.bitsSet(row) ;
+	 *out++ = scoreBitCounts(both,q_count - both,c_count - both,dims - q_count - c_count + both) ;
+	 }
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+ValT VectorMeasure<IdxT,ValT>::normalizationWeight(const Vector<IdxT,ValT>* v) const
+{
+   return normalization_weight(v,this->m_opt.normalize) ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename IdxT, typename ValT>
 void VectorMeasure<IdxT,ValT>::contingencyTable(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2,
    ValT& a, ValT& b, ValT& c) const
@@ -1996,6 +2411,17 @@ void VectorMeasure<IdxT,ValT>::contingencyTable(const Vector<IdxT,ValT>* v1, con
       }
    ValT wt1, wt2 ;
    normalization_weights(v1,v2,this->m_opt.normalize,wt1,wt2) ;
+   contingencyTable(v1,wt1,v2,wt2,a,b,c) ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void VectorMeasure<IdxT,ValT>::contingencyTable(const Vector<IdxT,ValT>* v1, ValT wt1,
+   const Vector<IdxT,ValT>* v2, ValT wt2, ValT& a, ValT& b, ValT& c) const
+{
+   a = b = c = 0 ;
    size_t pos1(0) ;
    size_t pos2(0) ;
    size_t elts1(v1->numElements()) ;
@@ -2034,6 +2460,19 @@ void VectorMeasure<IdxT,ValT>::contingencyTable(const Vector<IdxT,ValT>* v1, con
       // if either vector is all zeros, we don't need to treat it in
       //   common with the other one
       if (wt1 == 0.0 || wt2 == 0.0) minlen = 0 ;
+      if (std::is_floating_point<ValT>::value && minlen > 0)
+	 {
+	 // sum(val1 - wt1*min(val1/wt1,val2/wt2)) == sum(val1) - wt1*a, and likewise for c; each term
+	 //   is nonnegative, so clamp away any rounding error left by the subtraction.  (Integer values
+	 //   would be truncated differently than in the loop below, so they always take the loop.)
+	 auto values1 = v1->elementValues() ;
+	 auto values2 = v2->elementValues() ;
+	 double common = simd_min_sum(values1,values2,minlen,1.0/wt1,1.0/wt2) ;
+	 a = ValT(common) ;
+	 b = ValT(std::max(0.0,simd_sum(values1,minlen) - wt1*common)) ;
+	 c = ValT(std::max(0.0,simd_sum(values2,minlen) - wt2*common)) ;
+	 pos1 = minlen ;
+	 }
       for ( ; pos1 < minlen ; ++pos1)
 	 {
 	 ValT val1(v1->elementValue(pos1)) ;
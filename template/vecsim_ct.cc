@@ -47,6 +47,30 @@ class SimilarityMeasureCT : public VectorMeasure<IdxT, ValT>
 	 {
 	    return 1.0 - similarity(v1,v2) ;
 	 }
+      // the normalization weights only depend on the individual vectors, so compute them just
+      //   once per vector in batched comparisons
+      virtual bool similarities(const Vector<IdxT,ValT>* query, const Array* candidates, double* out) const
+	 {
+	    return batch_similarities(query,candidates,out,
+	       [this](const Vector<IdxT,ValT>* v) { return (double)this->normalizationWeight(v) ; },
+	       [this](const Vector<IdxT,ValT>* v1, double wt1, const Vector<IdxT,ValT>* v2, double wt2)
+		  { return this->scoreWeighted(v1,wt1,v2,wt2) ; }) ;
+	 }
+      virtual bool similarityMatrix(const Array* A, const Array* B, FullMatrix<float>* result) const
+	 {
+	    return batch_similarity_matrix<IdxT,ValT>(A,B,result,
+	       [this](const Vector<IdxT,ValT>* v) { return (double)this->normalizationWeight(v) ; },
+	       [this](const Vector<IdxT,ValT>* v1, double wt1, const Vector<IdxT,ValT>* v2, double wt2)
+		  { return this->scoreWeighted(v1,wt1,v2,wt2) ; }) ;
+	 }
+
+   protected:
+      double scoreWeighted(const Vector<IdxT,ValT>* v1, double wt1, const Vector<IdxT,ValT>* v2, double wt2) const
+	 {
+	    ValT both, v1_only, v2_only ;
+	    this->contingencyTable(v1,ValT(wt1),v2,ValT(wt2),both,v1_only,v2_only) ;
+	    return this->scoreContingencyTable(both,v1_only,v2_only) ;
+	 }
 
    protected:
       SimilarityMeasureCT() : VectorMeasure<IdxT,ValT>() {}
@@ -72,6 +96,14 @@ class SimilarityMeasureBCT : public VectorMeasure<IdxT, ValT>
 	    return 1.0 - similarity(v1,v2) ;
 	 }
 
+      virtual bool supportsBinaryVectors() const { return true ; }
+
+   protected:
+      virtual double scoreBitCounts(size_t both, size_t v1_only, size_t v2_only, size_t neither) const
+	 {
+	    return this->scoreContingencyTable(both,v1_only,v2_only,neither) ;
+	 }
+
    protected:
       SimilarityMeasureBCT() : VectorMeasure<IdxT,ValT>() {}
       SimilarityMeasureBCT(const VectorSimilarityOptions& opt) : VectorMeasure<IdxT,ValT>(opt) {}
@@ -96,6 +128,14 @@ class SimilarityMeasureBA : public VectorMeasure<IdxT, ValT>
 	    return 1.0 - similarity(v1,v2) ;
 	 }
 
+      virtual bool supportsBinaryVectors() const { return true ; }
+
+   protected:
+      virtual double scoreBitCounts(size_t both, size_t v1_only, size_t v2_only, size_t neither) const
+	 {
+	    return this->scoreBinaryAgreement(both,v1_only+v2_only,neither) ;
+	 }
+
    protected:
       SimilarityMeasureBA() : VectorMeasure<IdxT,ValT>() {}
       SimilarityMeasureBA(const VectorSimilarityOptions& opt) : VectorMeasure<IdxT,ValT>(opt) {}
@@ -117,7 +157,7 @@ class DistanceMeasureCT : public VectorMeasure<IdxT, ValT>
 	 }
       virtual double similarity(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2) const
 	 {
-	    return 1.0 - similarity(v1,v2) ;
+	    return 1.0 - distance(v1,v2) ;
 	 }
 
    protected:
@@ -141,7 +181,15 @@ class DistanceMeasureBCT : public VectorMeasure<IdxT, ValT>
 	 }
       virtual double similarity(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2) const
 	 {
-	    return 1.0 - similarity(v1,v2) ;
+	    return 1.0 - distance(v1,v2) ;
+	 }
+
+      virtual bool supportsBinaryVectors() const { return true ; }
+
+   protected:
+      virtual double scoreBitCounts(size_t both, size_t v1_only, size_t v2_only, size_t neither) const
+	 {
+	    return 1.0 - this->scoreContingencyTable(both,v1_only,v2_only,neither) ;
 	 }
 
    protected:
@@ -165,7 +213,15 @@ class DistanceMeasureBA : public VectorMeasure<IdxT, ValT>
 	 }
       virtual double similarity(const Vector<IdxT,ValT>* v1, const Vector<IdxT,ValT>* v2) const
 	 {
-	    return 1.0 - similarity(v1,v2) ;
+	    return 1.0 - distance(v1,v2) ;
+	 }
+
+      virtual bool supportsBinaryVectors() const { return true ; }
+
+   protected:
+      virtual double scoreBitCounts(size_t both, size_t v1_only, size_t v2_only, size_t neither) const
+	 {
+	    return 1.0 - this->scoreBinaryAgreement(both,v1_only+v2_only,neither) ;
 	 }
 
    protected:
@@ -184,6 +240,7 @@ class VectorMeasureAntiDice : public SimilarityMeasureCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Anti-Dice" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(ValT both, ValT v1_only, ValT v2_only) const
 	 {
 	    ValT denom(both + 2.0*(v1_only + v2_only)) ;
@@ -206,6 +263,7 @@ class VectorMeasureBinaryAntiDice : public SimilarityMeasureBA<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Binary Anti-Dice" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreBinaryAgreement(size_t both, size_t only_1, size_t /*neither*/) const
 	 {
 	    double denom(both + 2.0 * only_1) ;
@@ -266,6 +324,7 @@ class VectorMeasureBraunBlanquet : public SimilarityMeasureCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Braun-Blanquet" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(ValT both, ValT v1_only, ValT v2_only) const
 	 {
 	    ValT larger(std::max(both+v1_only,both+v2_only)) ;
@@ -280,6 +339,7 @@ class VectorMeasureBinaryBraunBlanquet : public SimilarityMeasureBCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Binary Braun-Blanquet" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(size_t both, size_t v1_only, size_t v2_only, size_t /*neither*/) const
 	 {
 	    double larger(std::max(both+v1_only,both+v2_only)) ;
@@ -414,6 +474,7 @@ class VectorMeasureDice : public SimilarityMeasureCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Dice" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(ValT both, ValT v1_only, ValT v2_only) const
 	 {
 	    if (both + v1_only + v2_only <= 0.0)
@@ -437,6 +498,7 @@ class VectorMeasureBinaryDice : public SimilarityMeasureBA<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Binary Dice" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreBinaryAgreement(size_t both, size_t only_1, size_t /*neither*/) const
 	 {
 	    both *= 2 ;
@@ -510,7 +572,17 @@ class VectorMeasureBinaryGamma : public SimilarityMeasure<IdxT, ValT>
 	       return -1.0 ;			// maximal difference if only one vector zero-length
 	    size_t both, v1_only, v2_only, neither ;
 	    this->contingencyTable(v1,v2,both,v1_only,v2_only,neither) ;
+	    return scoreBitCounts(both,v1_only,v2_only,neither) ;
+	 }
+   public:
+      virtual bool supportsBinaryVectors() const { return true ; }
+   protected:
+      // rows of BinaryVectors always have the full number of dimensions, so only the table matters
+      virtual double scoreBitCounts(size_t both, size_t v1_only, size_t v2_only, size_t neither) const
+	 {
 	    double N(both + v1_only + v2_only + neither) ;
+	    if (N == 0)
+	       return 1.0 ;
 	    double concordance(both / N * neither / N) ;
 	    double discordance(v1_only / N * v2_only / N) ;
 	    return (concordance + discordance > 0) ? (concordance - discordance) / (concordance + discordance) : 1.0 ;
@@ -640,6 +712,7 @@ class VectorMeasureJaccard : public SimilarityMeasureCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Jaccard" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(ValT both, ValT v1_only, ValT v2_only) const
 	 {
 	    double either(both + v1_only + v2_only) ;
@@ -659,6 +732,7 @@ class VectorMeasureBinaryJaccard : public SimilarityMeasureBA<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Binary Jaccard" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreBinaryAgreement(size_t both, size_t only_1, size_t /*neither*/) const
 	 {
 	    double either(both + only_1) ;
@@ -723,6 +797,7 @@ class VectorMeasureKulczynski2 : public SimilarityMeasureCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Kulczynski2" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(ValT both, ValT v1_only, ValT v2_only) const
 	 {
 	    if (both + v1_only + v2_only == 0)
@@ -749,6 +824,7 @@ class VectorMeasureBinaryKulczynski2 : public SimilarityMeasureBCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Binary Kulczynski2" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(size_t both, size_t v1_only, size_t v2_only, size_t /*neither*/) const
 	 {
 	    if (both + v1_only + v2_only == 0)
@@ -1146,6 +1222,7 @@ class VectorMeasureOchiai : public SimilarityMeasureCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Ochiai" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(ValT both, ValT v1_only, ValT v2_only) const
 	 {
 	    if (both + v1_only + v2_only == 0)
@@ -1168,6 +1245,7 @@ class VectorMeasureBinaryOchiai : public SimilarityMeasureBCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Binary Ochiai" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(size_t both, size_t v1_only, size_t v2_only, size_t /*neither*/) const
 	 {
 	    if (both + v1_only + v2_only == 0)
@@ -1298,6 +1376,7 @@ class VectorMeasureSokalSneath : public SimilarityMeasureCT<IdxT, ValT>
    {
    protected:
       virtual const char* myCanonicalName() const { return "Sokal-Sneath" ; }
+      virtual bool disjointSimilarityNonPositive() const { return true ; }
       virtual double scoreContingencyTable(ValT both, ValT v1_only, ValT v2_only) const
 	 {
 	    double denom(2*both + v1_only + v2_only) ;
@@ -0,0 +1,716 @@
+/****************************** -*- C++ -*- *****************************/
+/*									*/
+/* FramepaC-ng								*/
+/* Version 0.15, last edit 2019-08-24					*/
+/*	by Ralf Brown <ralf@cs.cmu.edu>					*/
+/*									*/
+/* (c) Copyright 2019 Carnegie Mellon University			*/
+/*	This program may be redistributed and/or modified under the	*/
+/*	terms of the GNU General Public License, version 3, or an	*/
+/*	alternative license agreement as detailed in the accompanying	*/
+/*	file LICENSE.  You should also have received a copy of the	*/
+/*	GPL (file COPYING) along with this program.  If not, see	*/
+/*	http://www.gnu.org/licenses/					*/
+/*									*/
+/*	This program is distributed in the hope that it will be		*/
+/*	useful, but WITHOUT ANY WARRANTY; without even the implied	*/
+/*	warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR		*/
+/*	PURPOSE.  See the GNU General Public License for more details.	*/
+/*									*/
+/************************************************************************/
+
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "framepac/hashtable.h"
+#include "framepac/linereader.h"
+#include "framepac/message.h"
+#include "framepac/symboltable.h"
+#include "framepac/threadpool.h"
+#include "framepac/vectorcoll.h"
+
+namespace Fr
+{
+
+/************************************************************************/
+/*	Types for this module						*/
+/************************************************************************/
+
+class VectorCollectionHeader
+   {
+   public:
+      uint64_t m_size ;			// number of rows
+      uint64_t m_dims ;			// number of dimensions
+      uint64_t m_stride ;		// dense only: elements per row including padding
+      uint64_t m_nonzeros ;		// number of elements in the original vectors
+      uint64_t m_sparse ;		// nonzero if rows are in compressed-sparse-row form
+      uint64_t m_values_offset ;	// offset of the element values
+      uint64_t m_indices_offset ;	// offset of the element indices (if sparse)
+      uint64_t m_offsets_offset ;	// offset of the row start offsets (if sparse)
+      uint64_t m_lengths_offset ;	// offset of the per-vector lengths
+      uint64_t m_weights_offset ;	// offset of the per-vector weights
+      uint64_t m_keys_offset ;		// offset of the per-vector key name numbers
+      uint64_t m_labels_offset ;	// offset of the per-vector label name numbers
+      uint64_t m_names_offset ;		// offset of the name table (offsets into the string pool)
+      uint64_t m_names_count ;		// number of distinct names
+      uint64_t m_strings_offset ;	// offset of the string pool
+      uint64_t m_strings_size ;		// number of bytes in the string pool
+      uint64_t m_end ;			// offset of the end of the collection's data
+      uint64_t m_pad[7] { 0 } ;		// padding for future extensions
+   } ;
+
+// name number stored for vectors without a key or label
+static constexpr uint32_t NO_NAME = ~(uint32_t)0 ;
+
+/************************************************************************/
+/*	Helper functions						*/
+/************************************************************************/
+
+template <typename T>
+static T* alloc_aligned_array(size_t count, size_t alignment)
+{
+   void* mem = nullptr ;
+   if (count == 0)
+      count = 1 ;
+   if (posix_memalign(&mem,alignment,count * sizeof(T)) != 0)
+      return nullptr ;
+   return static_cast<T*>(mem) ;
+}
+
+//----------------------------------------------------------------------------
+
+// pad the file to a multiple of 'alignment' bytes, so that memory-mapped arrays are aligned
+static inline bool align_collection_file(CFile& fp, off_t base_offset, size_t alignment = 8)
+{
+   size_t pad = (alignment - ((fp.tell() - base_offset) % alignment)) % alignment ;
+   return pad == 0 || fp.putNulls(pad) ;
+}
+
+//----------------------------------------------------------------------------
+
+static inline bool write_collection_array(CFile& fp, const void* data, size_t count, size_t elt_size)
+{
+   return count == 0 || fp.write(data,count,elt_size) == count ;
+}
+
+//----------------------------------------------------------------------------
+
+// check the header for consistency and return the number of stored element values, or ~0 if the
+//   header can't be valid
+static size_t collection_value_count(const VectorCollectionHeader& header, size_t valsize)
+{
+   if (header.m_sparse)
+      return header.m_nonzeros ;
+   if (header.m_stride < header.m_dims || (header.m_stride && header.m_size > ~(size_t)0 / valsize / header.m_stride))
+      return ~(size_t)0 ;
+   return header.m_size * header.m_stride ;
+}
+
+/************************************************************************/
+/*	Methods for template class VectorCollection			*/
+/************************************************************************/
+
+template <typename IdxT, typename ValT>
+void VectorCollection<IdxT,ValT>::releaseArrays()
+{
+   if (!m_readonly)
+      {
+      ::free(m_values) ;
+      delete[] m_indices ;
+      delete[] m_offsets ;
+      delete[] m_lengths ;
+      delete[] m_weights ;
+      }
+   m_values = nullptr ;
+   m_indices = nullptr ;
+   m_offsets = nullptr ;
+   m_lengths = nullptr ;
+   m_weights = nullptr ;
+   delete[] m_keys ;
+   m_keys = nullptr ;
+   delete[] m_labels ;
+   m_labels = nullptr ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+void VectorCollection<IdxT,ValT>::clear()
+{
+   releaseArrays() ;
+   m_mmap.close() ;
+   m_readonly = false ;
+   m_source = nullptr ;
+   m_size = 0 ;
+   m_dims = 0 ;
+   m_stride = 0 ;
+   m_nonzeros = 0 ;
+   m_sparse = false ;
+   return ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::load(const Array* vectors)
+{
+   clear() ;
+   if (!vectors)
+      return false ;
+   size_t N = vectors->size() ;
+   // the first pass determines the layout and size of the element storage; the virtual type checks
+   //   are done only once per vector, and the row sizes recorded so that the second pass can run in
+   //   parallel
+   NewPtr<size_t> offsets(N+1) ;
+   NewPtr<uint8_t> kinds(N) ;		// 0 = not a vector, 1 = dense, 2 = sparse, 3 = one-hot
+   size_t dims = 0 ;
+   size_t nonzeros = 0 ;
+   bool sparse = false ;
+   for (size_t i = 0 ; i < N ; ++i)
+      {
+      offsets[i] = nonzeros ;
+      const Object* obj = vectors->getNth(i) ;
+      kinds[i] = 0 ;
+      if (!obj || !obj->isVector())
+	 continue ;
+      auto v = static_cast<const vec_type*>(obj) ;
+      if (v->isOneHotVector())
+	 {
+	 kinds[i] = 3 ;
+	 sparse = true ;
+	 dims = std::max(dims,static_cast<const OneHotVector<IdxT,ValT>*>(v)->elementIndex(0) + 1) ;
+	 nonzeros++ ;
+	 }
+      else if (v->isSparseVector())
+	 {
+	 kinds[i] = 2 ;
+	 sparse = true ;
+	 size_t n = v->numElements() ;
+	 if (n > 0)
+	    dims = std::max(dims,static_cast<const SparseVector<IdxT,ValT>*>(v)->elementIndex(n-1) + 1) ;
+	 nonzeros += n ;
+	 }
+      else
+	 {
+	 kinds[i] = 1 ;
+	 dims = std::max(dims,v->numElements()) ;
+	 nonzeros += v->numElements() ;
+	 }
+      }
+   offsets[N] = nonzeros ;
+   m_lengths = new double[N] ;
+   m_keys = new Symbol*[N] ;
+   m_labels = new Symbol*[N] ;
+   m_weights = new float[N] ;
+   if (sparse)
+      {
+      m_values = alloc_aligned_array<ValT>(nonzeros,ROW_ALIGN) ;
+      m_indices = new IdxT[nonzeros ? nonzeros : 1] ;
+      m_offsets = offsets.release() ;
+      }
+   else
+      {
+      size_t per_line = ROW_ALIGN / sizeof(ValT) ;
+      m_stride = (dims + per_line - 1) / per_line * per_line ;
+      m_values = alloc_aligned_array<ValT>(N * m_stride,ROW_ALIGN) ;
+      }
+   if (!m_values)
+      {
+      clear() ;
+      return false ;
+      }
+   m_source = vectors ;
+   m_size = N ;
+   m_dims = dims ;
+   m_nonzeros = nonzeros ;
+   m_sparse = sparse ;
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,N),64,[&](size_t i)
+      {
+      auto v = static_cast<const vec_type*>(vectors->getNth(i)) ;
+      ValT* values = m_sparse ? m_values + m_offsets[i] : m_values + i * m_stride ;
+      IdxT* indices = m_sparse ? m_indices + m_offsets[i] : nullptr ;
+      size_t count = 0 ;
+      double sumsq = 0.0 ;
+      switch (kinds[i])
+	 {
+	 case 1:
+	    count = v->numElements() ;
+	    std::copy(v->elementValues(),v->elementValues()+count,values) ;
+	    if (indices)
+	       {
+	       for (size_t j = 0 ; j < count ; ++j)
+		  indices[j] = (IdxT)j ;
+	       }
+	    break ;
+	 case 2:
+	    {
+	    auto sv = static_cast<const SparseVector<IdxT,ValT>*>(v) ;
+	    count = sv->numElements() ;
+	    for (size_t j = 0 ; j < count ; ++j)
+	       {
+	       indices[j] = sv->keyAt(j) ;
+	       values[j] = sv->elementValue(j) ;
+	       }
+	    }
+	    break ;
+	 case 3:
+	    {
+	    auto ohv = static_cast<const OneHotVector<IdxT,ValT>*>(v) ;
+	    size_t index = ohv->elementIndex(0) ;
+	    count = 1 ;
+	    indices[0] = (IdxT)index ;
+	    values[0] = ohv->elementValue(index) ;
+	    }
+	    break ;
+	 default:
+	    break ;
+	 }
+      if (!m_sparse)
+	 std::fill(values+count,values+m_stride,ValT(0)) ;
+      for (size_t j = 0 ; j < count ; ++j)
+	 sumsq += (double)values[j] * (double)values[j] ;
+      if (kinds[i])
+	 {
+	 m_lengths[i] = std::sqrt(sumsq) ;
+	 m_keys[i] = v->key() ;
+	 m_labels[i] = v->label() ;
+	 m_weights[i] = v->weight() ;
+	 }
+      else
+	 {
+	 m_lengths[i] = -1.0 ;
+	 m_keys[i] = nullptr ;
+	 m_labels[i] = nullptr ;
+	 m_weights[i] = 0.0f ;
+	 }
+      }) ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+size_t VectorCollection<IdxT,ValT>::memoryUsage() const
+{
+   size_t bytes = m_size * (sizeof(double) + 2 * sizeof(Symbol*) + sizeof(float)) ;
+   if (m_sparse)
+      bytes += m_nonzeros * (sizeof(ValT) + sizeof(IdxT)) + (m_size + 1) * sizeof(size_t) ;
+   else
+      bytes += m_size * m_stride * sizeof(ValT) ;
+   return bytes ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::save(const char* filename) const
+{
+   COutputFile file(filename,CFile::binary) ;
+   return file ? save(file) : false ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::save(CFile& fp) const
+{
+   if (!fp || !m_values)
+      return false ;
+   // number the distinct keys and labels, collecting their names into a string pool
+   ScopedObject<SymCountHashTable> name_ids ;
+   std::vector<uint64_t> names ;
+   std::vector<char> strings ;
+   auto name_id = [&](const Symbol* sym) -> uint32_t
+      {
+      if (!sym)
+	 return NO_NAME ;
+      size_t id ;
+      if (name_ids->lookup(sym,&id))
+	 return (uint32_t)id ;
+      id = names.size() ;
+      name_ids->add(sym,id) ;
+      names.push_back(strings.size()) ;
+      const char* name = sym->name() ;
+      strings.insert(strings.end(),name,name+strlen(name)+1) ;
+      return (uint32_t)id ;
+      } ;
+   std::vector<uint32_t> keys(m_size) ;
+   std::vector<uint32_t> labels(m_size) ;
+   for (size_t i = 0 ; i < m_size ; ++i)
+      {
+      keys[i] = name_id(m_keys[i]) ;
+      labels[i] = name_id(m_labels[i]) ;
+      }
+   off_t base_offset = fp.tell() ;
+   if (!fp.writeSignature(signature,file_format))
+      return false ;
+   uint8_t idxsize = sizeof(IdxT) ;
+   uint8_t valsize = sizeof(ValT) ;
+   uint8_t offsize = sizeof(size_t) ;
+   if (!fp.writeValue(idxsize) || !fp.writeValue(valsize) || !fp.writeValue(offsize))
+      return false ;
+   off_t header_offset = fp.tell() ;
+   VectorCollectionHeader header ;
+   header.m_size = m_size ;
+   header.m_dims = m_dims ;
+   header.m_stride = m_stride ;
+   header.m_nonzeros = m_nonzeros ;
+   header.m_sparse = m_sparse ;
+   header.m_names_count = names.size() ;
+   header.m_strings_size = strings.size() ;
+   // the element values go first, on a cache-line boundary, so that mapped rows keep the same
+   //   alignment as rows built in memory
+   if (!fp.writeValue(header) || !align_collection_file(fp,base_offset,ROW_ALIGN))
+      return false ;
+   header.m_values_offset = fp.tell() - base_offset ;
+   size_t num_values = m_sparse ? m_nonzeros : m_size * m_stride ;
+   if (!write_collection_array(fp,m_values,num_values,sizeof(ValT)) || !align_collection_file(fp,base_offset))
+      return false ;
+   header.m_indices_offset = fp.tell() - base_offset ;
+   if (m_sparse && (!write_collection_array(fp,m_indices,m_nonzeros,sizeof(IdxT))
+	 || !align_collection_file(fp,base_offset)))
+      return false ;
+   header.m_offsets_offset = fp.tell() - base_offset ;
+   if (m_sparse && !write_collection_array(fp,m_offsets,m_size+1,sizeof(size_t)))
+      return false ;
+   header.m_lengths_offset = fp.tell() - base_offset ;
+   if (!write_collection_array(fp,m_lengths,m_size,sizeof(double)))
+      return false ;
+   header.m_weights_offset = fp.tell() - base_offset ;
+   if (!write_collection_array(fp,m_weights,m_size,sizeof(float)) || !align_collection_file(fp,base_offset))
+      return false ;
+   header.m_keys_offset = fp.tell() - base_offset ;
+   if (!write_collection_array(fp,keys.data(),m_size,sizeof(uint32_t)))
+      return false ;
+   header.m_labels_offset = fp.tell() - base_offset ;
+   if (!write_collection_array(fp,labels.data(),m_size,sizeof(uint32_t)) || !align_collection_file(fp,base_offset))
+      return false ;
+   header.m_names_offset = fp.tell() - base_offset ;
+   if (!write_collection_array(fp,names.data(),names.size(),sizeof(uint64_t)))
+      return false ;
+   header.m_strings_offset = fp.tell() - base_offset ;
+   if (!write_collection_array(fp,strings.data(),strings.size(),1) || !align_collection_file(fp,base_offset))
+      return false ;
+   header.m_end = fp.tell() - base_offset ;
+   // now that we've written all the other data, we have a complete header, so return to the start of the file
+   //   and update the header
+   off_t lastpos = fp.tell() ;
+   fp.seek(header_offset) ;
+   bool success = true ;
+   if (!fp.writeValue(header))
+      success = false ;
+   fp.flush() ;
+   fp.seek(lastpos) ;
+   return success ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::isCollectionFile(const char* filename)
+{
+   CInputFile file(filename,CFile::binary) ;
+   return file && file.verifySignature(signature) >= (int)min_file_format ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::load(const char* filename, bool allow_mmap)
+{
+   CInputFile file(filename,CFile::binary) ;
+   return file ? load(file,filename,allow_mmap) : false ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::load(CFile& fp, const char* filename, bool allow_mmap)
+{
+   if (!fp)
+      return false ;
+   clear() ;
+   off_t base_offset = fp.tell() ;
+   int version = file_format ;
+   if (!fp.verifySignature(signature,filename,version,min_file_format))
+      return false ;
+   uint8_t idxsize, valsize, offsize ;
+   if (!fp.readValue(&idxsize) || !fp.readValue(&valsize) || !fp.readValue(&offsize))
+      return false ;
+   if (idxsize != sizeof(IdxT) || valsize != sizeof(ValT) || offsize != sizeof(size_t))
+      {
+      SystemMessage::error("wrong data type - sizeof() does not match") ;
+      return false ;
+      }
+   if (allow_mmap && loadMapped(filename,base_offset))
+      return true ;
+   VectorCollectionHeader header ;
+   if (!fp.readValue(&header))
+      return false ;
+   size_t num_values = collection_value_count(header,sizeof(ValT)) ;
+   if (num_values == ~(size_t)0)
+      return false ;
+   size_t N = header.m_size ;
+   auto read_array = [&](uint64_t offset, void* buf, size_t count, size_t elt_size)
+      {
+      return count == 0 || (fp.seek(offset + base_offset) && fp.read(buf,count,elt_size) == count) ;
+      } ;
+   std::vector<uint32_t> keys(N) ;
+   std::vector<uint32_t> labels(N) ;
+   std::vector<uint64_t> names(header.m_names_count) ;
+   std::vector<char> strings(header.m_strings_size) ;
+   m_values = alloc_aligned_array<ValT>(num_values,ROW_ALIGN) ;
+   m_lengths = new double[N] ;
+   m_weights = new float[N] ;
+   bool success = m_values && read_array(header.m_values_offset,m_values,num_values,sizeof(ValT))
+      && read_array(header.m_lengths_offset,m_lengths,N,sizeof(double))
+      && read_array(header.m_weights_offset,m_weights,N,sizeof(float))
+      && read_array(header.m_keys_offset,keys.data(),N,sizeof(uint32_t))
+      && read_array(header.m_labels_offset,labels.data(),N,sizeof(uint32_t))
+      && read_array(header.m_names_offset,names.data(),names.size(),sizeof(uint64_t))
+      && read_array(header.m_strings_offset,strings.data(),strings.size(),1) ;
+   if (success && header.m_sparse)
+      {
+      m_indices = new IdxT[num_values ? num_values : 1] ;
+      m_offsets = new size_t[N+1] ;
+      success = read_array(header.m_indices_offset,m_indices,num_values,sizeof(IdxT))
+	 && read_array(header.m_offsets_offset,m_offsets,N+1,sizeof(size_t)) ;
+      }
+   if (!success || !setContents(header,keys.data(),labels.data(),names.data(),strings.data()))
+      {
+      clear() ;
+      return false ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::loadMapped(const char* filename, off_t base_offset)
+{
+   if (!filename || !*filename)
+      return false;
+   MemMappedROFile mm(filename,base_offset) ;
+   if (!mm)
+      return false ;
+   m_mmap = std::move(mm) ;
+   if (loadFromMmap(*m_mmap,m_mmap.size()))
+      return true ;
+   m_mmap.close() ;
+   return false ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::loadFromMmap(const char* mmap_base, size_t mmap_len)
+{
+   size_t sig_size = CFile::signatureSize(signature) ;
+   size_t header_size = sig_size + 3*sizeof(uint8_t) ;
+   if (!mmap_base || mmap_len < header_size + sizeof(VectorCollectionHeader))
+      return false;
+   if (memcmp(mmap_base,signature,strlen(signature)) != 0 || (uint8_t)mmap_base[sig_size] != sizeof(IdxT)
+      || (uint8_t)mmap_base[sig_size+1] != sizeof(ValT) || (uint8_t)mmap_base[sig_size+2] != sizeof(size_t))
+      return false ;
+   releaseArrays() ;
+   m_readonly = true ;
+   // copy the header, since it follows the variable-length signature and may be misaligned
+   VectorCollectionHeader header ;
+   memcpy(&header,mmap_base + header_size,sizeof(header)) ;
+   size_t num_values = collection_value_count(header,sizeof(ValT)) ;
+   size_t N = header.m_size ;
+   // make sure that every array lies within the mapped region before pointing at it
+   bool valid = num_values != ~(size_t)0 && header.m_end <= mmap_len && N < ~(size_t)0 ;
+   auto check = [&](uint64_t offset, size_t count, size_t elt_size)
+      {
+      if (offset < header_size || offset > mmap_len || count > (mmap_len - offset) / elt_size)
+	 valid = false ;
+      return mmap_base + offset ;
+      } ;
+   m_values = (ValT*)check(header.m_values_offset,num_values,sizeof(ValT)) ;
+   if (header.m_sparse)
+      {
+      m_indices = (IdxT*)check(header.m_indices_offset,num_values,sizeof(IdxT)) ;
+      m_offsets = (size_t*)check(header.m_offsets_offset,N+1,sizeof(size_t)) ;
+      }
+   m_lengths = (double*)check(header.m_lengths_offset,N,sizeof(double)) ;
+   m_weights = (float*)check(header.m_weights_offset,N,sizeof(float)) ;
+   auto keys = (const uint32_t*)check(header.m_keys_offset,N,sizeof(uint32_t)) ;
+   auto labels = (const uint32_t*)check(header.m_labels_offset,N,sizeof(uint32_t)) ;
+   auto names = (const uint64_t*)check(header.m_names_offset,header.m_names_count,sizeof(uint64_t)) ;
+   auto strings = check(header.m_strings_offset,header.m_strings_size,1) ;
+   if (!valid || !setContents(header,keys,labels,names,strings))
+      {
+      SystemMessage::error("VectorCollection: corrupted vector file") ;
+      releaseArrays() ;
+      m_readonly = false ;
+      return false ;
+      }
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::setContents(const VectorCollectionHeader& header, const uint32_t* keys,
+   const uint32_t* labels, const uint64_t* names, const char* strings)
+{
+   size_t N = header.m_size ;
+   size_t numnames = header.m_names_count ;
+   size_t stringsize = header.m_strings_size ;
+   if (stringsize > 0 && strings[stringsize-1] != '\0')
+      return false ;
+   if (header.m_sparse)
+      {
+      if (m_offsets[0] != 0 || m_offsets[N] != header.m_nonzeros)
+	 return false ;
+      for (size_t i = 0 ; i < N ; ++i)
+	 {
+	 if (m_offsets[i+1] < m_offsets[i])
+	    return false ;
+	 }
+      }
+   for (size_t i = 0 ; i < numnames ; ++i)
+      {
+      if (names[i] >= stringsize)
+	 return false ;
+      }
+   for (size_t i = 0 ; i < N ; ++i)
+      {
+      if ((keys[i] >= numnames && keys[i] != NO_NAME) || (labels[i] >= numnames && labels[i] != NO_NAME))
+	 return false ;
+      }
+   // look up each distinct name just once, then fill in the per-vector symbols
+   std::vector<Symbol*> symbols(numnames) ;
+   SymbolTable* symtab = SymbolTable::current() ;
+   for (size_t i = 0 ; i < numnames ; ++i)
+      symbols[i] = symtab->add(strings + names[i]) ;
+   m_keys = new Symbol*[N] ;
+   m_labels = new Symbol*[N] ;
+   for (size_t i = 0 ; i < N ; ++i)
+      {
+      m_keys[i] = keys[i] == NO_NAME ? nullptr : symbols[keys[i]] ;
+      m_labels[i] = labels[i] == NO_NAME ? nullptr : symbols[labels[i]] ;
+      }
+   m_size = N ;
+   m_dims = header.m_dims ;
+   m_stride = header.m_stride ;
+   m_nonzeros = header.m_nonzeros ;
+   m_sparse = header.m_sparse != 0 ;
+   return true ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+Array* VectorCollection<IdxT,ValT>::makeVectors()
+{
+   if (!m_values)
+      return nullptr ;
+   std::vector<vec_type*> made(m_size,nullptr) ;
+   ThreadPool::defaultPool()->parallel_for(Range<size_t>(0,m_size),64,[&](size_t i)
+      {
+      if (!present(i))
+	 return ;
+      const ValT* values = rowValues(i) ;
+      size_t count = rowLength(i) ;
+      vec_type* v ;
+      if (m_sparse)
+	 {
+	 auto sv = SparseVector<IdxT,ValT>::create(count) ;
+	 const IdxT* indices = rowIndices(i) ;
+	 for (size_t j = 0 ; j < count ; ++j)
+	    sv->newElement(indices[j],values[j]) ;
+	 v = sv ;
+	 }
+      else
+	 {
+	 auto dv = DenseVector<IdxT,ValT>::create(count) ;
+	 for (size_t j = 0 ; j < count ; ++j)
+	    dv->setElement(j,values[j]) ;
+	 v = dv ;
+	 }
+      v->setKey(m_keys[i]) ;
+      v->setLabel(m_labels[i]) ;
+      v->setWeight(m_weights[i]) ;
+      made[i] = v ;
+      }) ;
+   Array* vectors = Array::create(m_size) ;
+   for (auto v : made)
+      vectors->appendNoCopy(v) ;
+   m_source = vectors ;
+   return vectors ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+Array* VectorCollection<IdxT,ValT>::parseText(CFile& fp, bool sparse, ThreadPool* pool)
+{
+   if (!fp)
+      return nullptr ;
+   if (!pool)
+      pool = ThreadPool::defaultPool() ;
+   LineReader reader(fp,LineReader::DEFAULT_BLOCKSIZE,LineReader::trim) ;
+   std::vector<LineBatch*> batches(2 * (pool->numThreads() + 1)) ;
+   std::vector<const char*> lines ;
+   std::vector<vec_type*> parsed ;
+   Array* vectors = Array::create() ;
+   size_t n ;
+   while ((n = reader.getBatches(batches.data(),batches.size(),pool)) > 0)
+      {
+      // parse all of the lines in this group of batches in parallel, then append the vectors in
+      //   their original order
+      lines.clear() ;
+      for (size_t b = 0 ; b < n ; ++b)
+	 lines.insert(lines.end(),batches[b]->cbegin(),batches[b]->cend()) ;
+      parsed.resize(lines.size()) ;
+      pool->parallel_for(Range<size_t>(0,lines.size()),256,[&](size_t i)
+	 {
+	 if (sparse)
+	    parsed[i] = SparseVector<IdxT,ValT>::create(lines[i]) ;
+	 else
+	    parsed[i] = DenseVector<IdxT,ValT>::create(lines[i]) ;
+	 }) ;
+      vectors->reserve(vectors->size() + parsed.size()) ;
+      for (auto v : parsed)
+	 vectors->appendNoCopy(v) ;
+      for (size_t b = 0 ; b < n ; ++b)
+	 delete batches[b] ;
+      }
+   return vectors ;
+}
+
+//----------------------------------------------------------------------------
+
+template <typename IdxT, typename ValT>
+bool VectorCollection<IdxT,ValT>::convertText(const char* textfile, const char* binfile, bool sparse,
+   ThreadPool* pool)
+{
+   CInputFile infile(textfile) ;
+   if (!infile)
+      {
+      SystemMessage::error("unable to open %s",textfile) ;
+      return false ;
+      }
+   Array* vectors = parseText(infile,sparse,pool) ;
+   if (!vectors)
+      return false ;
+   bool success ;
+   {
+   VectorCollection coll ;
+   success = coll.load(vectors) && coll.save(binfile) ;
+   }
+   vectors->free() ;
+   return success ;
+}
+
+//----------------------------------------------------------------------------
+
+} // end namespace Fr
+
+// end of file vectorcoll.cc //
@@ -19,6 +19,7 @@
 /*									*/
 /************************************************************************/
 
+#include <algorithm>
 #include "framepac/mmapfile.h"
 #include "framepac/wordcorpus.h"
 #include "framepac/words.h"
@@ -476,6 +477,32 @@ IdT WordCorpusT<IdT,IdxT>::findID(const char* word) const
 
 //----------------------------------------------------------------------------
 
+template <typename IdT, typename IdxT>
+size_t WordCorpusT<IdT,IdxT>::findIDs(const char* const* words, size_t n, IdT* ids) const
+{
+   const size_t batch = 256 ;
+   CString keys[batch] ;
+   bool found[batch] ;
+   size_t numfound = 0 ;
+   for (size_t base = 0 ; base < n ; base += batch)
+      {
+      size_t count = std::min(n - base,batch) ;
+      for (size_t i = 0 ; i < count ; ++i)
+	 keys[i] = words[base+i] ;
+      m_wordmap->lookupMany(keys,count,ids+base,found) ;
+      for (size_t i = 0 ; i < count ; ++i)
+	 {
+	 if (found[i] && words[base+i] && *words[base+i])
+	    ++numfound ;
+	 else
+	    ids[base+i] = ErrorID ;
+	 }
+      }
+   return numfound ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename IdT, typename IdxT>
 IdT WordCorpusT<IdT,IdxT>::findOrAddID(const char* word)
 {
@@ -606,7 +633,7 @@ void WordCorpusT<IdT,IdxT>::computeTermFrequencies()
       IdT id = buf[i] ;
       if (id < num_types)
 	 ++m_freq[id] ;
-      else if (id >= m_last_linenum)
+      else				// line numbers are counted as newlines, as in the suffix arrays
 	 ++m_freq[m_newline] ;
       }
    return ;
@@ -758,6 +785,27 @@ bool WordCorpusT<IdT,IdxT>::createIndex(bool bidirectional)
 
 //----------------------------------------------------------------------------
 
+template <typename IdT, typename IdxT>
+bool WordCorpusT<IdT,IdxT>::createLCP(bool bidirectional)
+{
+   if (!createForwardIndex())
+      return false ;
+   bool success = m_fwdindex.haveLCP() || m_fwdindex.computeLCP() ;
+   if (success && bidirectional && !m_revindex.haveLCP())
+      {
+      if (!createReverseIndex())
+	 return false ;
+      // the reverse index was built on the reversed text, so reverse it again while computing the
+      //   common prefixes
+      std::reverse(m_wordbuf.begin(),m_wordbuf.end()-1) ;
+      success &= m_revindex.computeLCP() ;
+      std::reverse(m_wordbuf.begin(),m_wordbuf.end()-1) ;
+      }
+   return success ;
+}
+
+//----------------------------------------------------------------------------
+
 template <typename IdT, typename IdxT>
 bool WordCorpusT<IdT,IdxT>::lookup(const IdT *key, unsigned keylen, IdxT& first_match, IdxT& last_match) const
 {
@@ -892,10 +940,12 @@ bool WordCorpusT<IdT,IdxT>::createReverseIndex()
       }
    m_wordmap->finalize() ;
    computeTermFrequencies(); 
-   m_wordbuf.reverse() ;
+   // reverse the text, but keep the end-of-data sentinel at the end, where suffix-array construction
+   //   requires it to be
+   std::reverse(m_wordbuf.begin(),m_wordbuf.end()-1) ;
    m_revindex.generate(m_wordbuf.currentBuffer(),m_wordbuf.size(), m_wordmap->size(), m_newline, m_freq) ;
    //TODO: adjust offsets in index to match un-reversed positions in buffer
-   m_wordbuf.reverse() ;
+   std::reverse(m_wordbuf.begin(),m_wordbuf.end()-1) ;
    m_revindex.setFreqTable(m_freq) ;
    m_revindex.setSentinel(m_sentinel) ;
    return m_revindex == true ;